@@ -393,6 +393,10 @@ internal_to_base_MiscFlags i@Internal.MiscFlags{..} =
       -- accurately because want to freeze the API of the the compat RTS flags
       -- here. Using "auto" is the least bad translation.
       -- https://github.com/haskell/core-libraries-committee/issues/362
+    internal_to_base_ioManager Internal.IoManagerFlagEpoll       = IoManagerFlagAuto
+      -- Likewise for epoll.
+    internal_to_base_ioManager Internal.IoManagerFlagIOUring     = IoManagerFlagAuto
+      -- Likewise for io_uring.
     internal_to_base_ioManager Internal.IoManagerFlagMIO         = IoManagerFlagMIO
     internal_to_base_ioManager Internal.IoManagerFlagWinIO       = IoManagerFlagWinIO
     internal_to_base_ioManager Internal.IoManagerFlagWin32Legacy = IoManagerFlagWin32Legacy
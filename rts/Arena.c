@@ -32,8 +32,9 @@ struct _Arena {
 };
 
 // We like to keep track of how many blocks we've allocated for
-// Storage.c:memInventory().
-static long arena_blocks = 0;
+// Storage.c:memInventory().  Arenas may be used by several threads at
+// once (e.g. by a parallel heap census), so we update it atomically.
+static StgWord arena_blocks = 0;
 
 // Begin a new arena
 Arena *
@@ -46,7 +47,7 @@ newArena( void )
     arena->current->link = NULL;
     arena->free = arena->current->start;
     arena->lim  = arena->current->start + BLOCK_SIZE_W;
-    arena_blocks++;
+    atomic_inc(&arena_blocks, 1);
 
     return arena;
 }
@@ -82,7 +83,7 @@ arenaAlloc( Arena *arena, size_t size )
         // allocate a fresh block...
         req_blocks =  (W_)BLOCK_ROUND_UP(size) / BLOCK_SIZE;
         bd = allocGroup_lock(req_blocks);
-        arena_blocks += bd->blocks;
+        atomic_inc(&arena_blocks, bd->blocks);
 
         bd->gen_no  = 0;
         bd->gen     = NULL;
@@ -105,8 +106,8 @@ arenaFree( Arena *arena )
 
     for (bd = arena->current; bd != NULL; bd = next) {
         next = bd->link;
-        arena_blocks -= bd->blocks;
-        ASSERT(arena_blocks >= 0);
+        ASSERT(RELAXED_LOAD(&arena_blocks) >= bd->blocks);
+        atomic_dec(&arena_blocks, bd->blocks);
         freeGroup_lock(bd);
     }
     stgFree(arena);
@@ -115,7 +116,7 @@ arenaFree( Arena *arena )
 unsigned long
 arenaBlocks( void )
 {
-    return arena_blocks;
+    return RELAXED_LOAD(&arena_blocks);
 }
 
 #if defined(DEBUG)
@@ -98,8 +98,10 @@ findSpark (Capability *cap)
 {
   Capability *robbed;
   StgClosurePtr spark;
+  StgClosurePtr stolen[SPARK_STEAL_BATCH];
   bool retry;
   uint32_t i = 0;
+  uint32_t j, n, pushed;
 
   // This is an approximate check so relaxed load is acceptable here.
   if (!emptyRunQueue(cap) || RELAXED_LOAD(&cap->n_returning_tasks) != 0) {
@@ -117,7 +119,9 @@ findSpark (Capability *cap)
       // needing any atomic instructions:
       //   spark = reclaimSpark(cap->sparks);
       // However, measurements show that this makes at least one benchmark
-      // slower (prsa) and doesn't affect the others.
+      // slower (prsa) and doesn't affect the others.  It is also not safe
+      // now that other capabilities steal half of our sparks at a time,
+      // see Note [Stealing half a WSDeque] in WSDeque.c.
       spark = tryStealSpark(cap->sparks);
       while (spark != NULL && fizzledSpark(spark)) {
           cap->spark_stats.fizzled++;
@@ -142,25 +146,42 @@ findSpark (Capability *cap)
                  "cap %d: Trying to steal work from other capabilities",
                  cap->no);
 
-      /* visit cap.s 0..n-1 in sequence until a theft succeeds. We could
-      start at a random place instead of 0 as well.  */
-      for ( i=0 ; i < getNumCapabilities() ; i++ ) {
-          robbed = getCapability(i);
-          if (cap == robbed)  // ourselves...
-              continue;
+      /* visit the other caps, nearest first, until a theft succeeds.
+         See Note [Capability victim order]. */
+      for ( i=0 ; i < getNumCapabilities() - 1 ; i++ ) {
+          robbed = getCapability(cap->victims[i]);
 
           if (emptySparkPoolCap(robbed)) // nothing to steal here
               continue;
 
-          spark = tryStealSpark(robbed->sparks);
-          while (spark != NULL && fizzledSpark(spark)) {
-              cap->spark_stats.fizzled++;
-              traceEventSparkFizzle(cap);
-              spark = tryStealSpark(robbed->sparks);
+          // Steal half of robbed's sparks at once: we run the first one
+          // that hasn't fizzled, and keep the rest in our own pool where
+          // other capabilities can steal them in turn.
+          n = tryStealSparks(robbed->sparks, stolen, SPARK_STEAL_BATCH);
+          cap->migration_stats.sparks_stolen += n;
+          if (robbed->locality != cap->locality) {
+              cap->migration_stats.sparks_stolen_remote += n;
+          }
+
+          spark = NULL;
+          for (j = 0; j < n && spark == NULL; j++) {
+              if (fizzledSpark(stolen[j])) {
+                  cap->spark_stats.fizzled++;
+                  traceEventSparkFizzle(cap);
+              } else {
+                  spark = stolen[j];
+              }
           }
+          if (j < n) {
+              pushed = pushSparks(cap->sparks, &stolen[j], n - j);
+              // Our own pool was empty, so this only drops sparks if it
+              // is tiny (+RTS -e).
+              cap->spark_stats.overflowed += n - j - pushed;
+          }
+
           if (spark == NULL && !emptySparkPoolCap(robbed)) {
-              // we conflicted with another thread while trying to steal;
-              // try again later.
+              // we conflicted with another thread while trying to steal,
+              // or all the sparks we stole had fizzled; try again later.
               retry = true;
           }
 
@@ -283,6 +304,14 @@ initCapability (Capability *cap, uint32_t i)
     cap->spark_stats.converted  = 0;
     cap->spark_stats.gcd        = 0;
     cap->spark_stats.fizzled    = 0;
+    cap->victims                = NULL;
+    cap->locality               = 0;
+    cap->migration_stats.threads_pushed        = 0;
+    cap->migration_stats.threads_pushed_remote = 0;
+    cap->migration_stats.sparks_stolen         = 0;
+    cap->migration_stats.sparks_stolen_remote  = 0;
+    initBlockCache(&cap->block_cache);
+    cap->stable_ptr_cache.n = 0;
 #endif
     cap->total_allocated        = 0;
 
@@ -315,6 +344,10 @@ initCapability (Capability *cap, uint32_t i)
     cap->free_trec_chunks = END_STM_CHUNK_LIST;
     cap->free_trec_headers = NO_TREC;
     cap->transaction_tokens = 0;
+    cap->stm_stats.commits           = 0;
+    cap->stm_stats.read_only_commits = 0;
+    cap->stm_stats.aborts            = 0;
+    cap->stm_stats.revalidations     = 0;
     cap->context_switch = 0;
     cap->interrupt = 0;
     cap->pinned_object_block = NULL;
@@ -439,6 +472,138 @@ void initCapabilities (void)
     }
 }
 
+#if defined(THREADED_RTS)
+/* ---------------------------------------------------------------------------
+ * Note [Capability victim order]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * A capability with spare threads pushes them to idle capabilities
+ * (schedulePushWork), and an idle capability steals sparks from the others
+ * (findSpark).  Work that moves to a capability on another NUMA node or CPU
+ * package finds its heap in remote memory and its caches cold, so we would
+ * rather move it to a capability close by.
+ *
+ * Hence each capability has an array cap->victims of all the other
+ * capabilities, nearest first, and both loops walk that.  The distance
+ * between two capabilities is made of
+ *
+ *   - with +RTS --numa, the distance between their NUMA nodes as reported
+ *     by the OS (numa_distance(), which is 10 for the local node);
+ *
+ *   - with +RTS -qa, where capability n of N runs on CPUs n, n+N, n+2N etc.
+ *     (see setThreadAffinity), how much the two sets of CPUs share: a
+ *     physical core, a last level cache, or a package.  With fewer
+ *     capabilities than CPUs a capability's CPUs may not share a core or a
+ *     cache, or even a package, and then it is no closer to any other
+ *     capability on that level (getAffinityTopology).
+ *
+ * Capabilities at the same distance are kept in round-robin order starting
+ * from cap->no + 1, so that we don't always pick on the same neighbour.
+ * Without --numa or -qa all capabilities are equally far apart, and we get
+ * the round-robin order that schedulePushWork has always used.
+ *
+ * The orders are recomputed whenever capabilities are added, which happens
+ * with all capabilities stopped (see moreCapabilities()), so the loops can
+ * read them without synchronisation.
+ *
+ * To see whether this is working, each capability counts the threads it
+ * pushes and the sparks it steals, and how many of them crossed to a
+ * different node (cap->locality: the NUMA node, or under -qa the CPU
+ * package).  These are posted in the eventlog by CAP_MIGRATION_COUNTERS,
+ * next to SPARK_COUNTERS.
+ * ------------------------------------------------------------------------- */
+
+typedef struct {
+    bool known;         // do we know which package the capability runs on?
+    uint32_t package;
+    uint32_t cache;     // or UINT32_MAX if its CPUs don't share one
+    uint32_t core;      // or UINT32_MAX if its CPUs aren't all one core
+} CpuLocation;
+
+static uint32_t
+capDistance (Capability *a, CpuLocation *la, Capability *b, CpuLocation *lb)
+{
+    uint32_t node_distance = 0;
+    uint32_t cpu_distance;
+
+    if (n_numa_nodes > 1) {
+        node_distance = osNumaDistance(numa_map[a->node], numa_map[b->node]);
+    }
+
+    if (!la->known || !lb->known || la->package != lb->package) {
+        cpu_distance = 3;
+    } else if (la->core != UINT32_MAX && la->core == lb->core) {
+        cpu_distance = 0; // hyperthreads of the same core
+    } else if (la->cache != UINT32_MAX && la->cache == lb->cache) {
+        cpu_distance = 1;
+    } else {
+        cpu_distance = 2;
+    }
+
+    // Any difference in NUMA distance outweighs the CPU distance
+    return node_distance * 4 + cpu_distance;
+}
+
+static void
+initVictimOrders (uint32_t n)
+{
+    CpuLocation *loc;
+    uint32_t *dist;
+
+    loc = stgMallocBytes(n * sizeof(CpuLocation), "initVictimOrders");
+    dist = stgMallocBytes(n * sizeof(uint32_t), "initVictimOrders");
+
+    for (uint32_t i = 0; i < n; i++) {
+        Capability *cap = getCapability(i);
+        // See setThreadAffinity(): capability i of n may run on CPUs i,
+        // i+n, i+2n etc., so it is only as close to another capability as
+        // all of those CPUs are.
+        loc[i].known = RtsFlags.ParFlags.setAffinity &&
+            getAffinityTopology(i, n, &loc[i].package, &loc[i].cache,
+                                &loc[i].core);
+
+        if (n_numa_nodes > 1) {
+            cap->locality = cap->node;
+        } else if (loc[i].known) {
+            cap->locality = loc[i].package;
+        } else {
+            cap->locality = 0;
+        }
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        Capability *cap = getCapability(i);
+
+        if (cap->victims) {
+            stgFree(cap->victims);
+            cap->victims = NULL;
+        }
+        if (n == 1) {
+            continue;
+        }
+        cap->victims = stgMallocBytes((n - 1) * sizeof(uint32_t),
+                                      "initVictimOrders");
+
+        // Insertion sort by distance, starting from the round-robin order so
+        // that it is preserved among capabilities at the same distance.
+        for (uint32_t k = 0; k < n - 1; k++) {
+            uint32_t v = (i + 1 + k) % n;
+            uint32_t d = capDistance(cap, &loc[i], getCapability(v), &loc[v]);
+            uint32_t j = k;
+            while (j > 0 && dist[j-1] > d) {
+                cap->victims[j] = cap->victims[j-1];
+                dist[j] = dist[j-1];
+                j--;
+            }
+            cap->victims[j] = v;
+            dist[j] = d;
+        }
+    }
+
+    stgFree(dist);
+    stgFree(loc);
+}
+#endif
+
 void
 moreCapabilities (uint32_t from USED_IF_THREADS, uint32_t to USED_IF_THREADS)
 {
@@ -469,6 +634,8 @@ moreCapabilities (uint32_t from USED_IF_THREADS, uint32_t to USED_IF_THREADS)
         }
     }
 
+    initVictimOrders(to);
+
     debugTrace(DEBUG_sched, "allocated %d more capabilities", to - from);
 
     startTimer();
@@ -1286,6 +1453,9 @@ freeCapability (Capability *cap)
     }
 #if defined(THREADED_RTS)
     freeSparkPool(cap->sparks);
+    if (cap->victims) {
+        stgFree(cap->victims);
+    }
 #endif
     traceCapsetRemoveCap(CAPSET_OSPROCESS_DEFAULT, cap->no);
     traceCapsetRemoveCap(CAPSET_CLOCKDOMAIN_DEFAULT, cap->no);
@@ -24,6 +24,8 @@
 #include "Task.h"
 #include "Sparks.h"
 #include "sm/NonMovingMark.h" // for MarkQueue
+#include "sm/BlockAlloc.h" // for BlockCache
+#include "StablePtr.h" // for StablePtrCache
 
 #include "BeginPrivate.h"
 
@@ -40,6 +42,27 @@
 struct _CapIOManager;
 typedef struct _CapIOManager CapIOManager;
 
+/* Counts of the work a capability has moved between itself and other
+ * capabilities, and how much of it crossed to a different node. See
+ * Note [Capability victim order] in Capability.c.
+ */
+typedef struct {
+    StgWord threads_pushed;        // threads pushed to other capabilities
+    StgWord threads_pushed_remote; //   ... of which to another node
+    StgWord sparks_stolen;         // sparks stolen from other capabilities
+    StgWord sparks_stolen_remote;  //   ... of which from another node
+} MigrationCounters;
+
+/* Counts of the STM transactions run by a capability, reported by +RTS -s.
+ * See Note [STM version clock] in STM.c.
+ */
+typedef struct {
+    StgWord commits;           // top-level transactions committed
+    StgWord read_only_commits; //   ... of which did not update any TVar
+    StgWord aborts;            // top-level commits that failed validation
+    StgWord revalidations;     // read sets re-checked against the TVars
+} StmCounters;
+
 /* N.B. This must be consistent with CapabilityPublic in RtsAPI.h */
 struct Capability_ {
     // State required by the STG virtual machine when running Haskell
@@ -148,7 +171,6 @@ struct Capability_ {
     //    running_task
     //    returning_tasks_{hd,tl}
     //    wakeup_queue
-    //    inbox
     //    putMVars
     Mutex lock;
 
@@ -162,7 +184,7 @@ struct Capability_ {
     uint32_t n_returning_tasks;
 
     // Messages, or END_TSO_QUEUE.
-    // Locks required: cap->lock
+    // Lock-free, see Note [Lock-free capability inbox] in Messages.c.
     Message *inbox;
 
     // putMVars are really messages, but they're allocated with malloc() so they
@@ -173,6 +195,27 @@ struct Capability_ {
 
     // Stats on spark creation/conversion
     SparkCounters spark_stats;
+
+    // The other capabilities, nearest first, for pushing threads to and
+    // stealing sparks from.  getNumCapabilities()-1 entries.
+    // See Note [Capability victim order].
+    uint32_t *victims;
+
+    // The node of this capability for the purpose of migration_stats: the
+    // NUMA node, or with +RTS -qa the CPU package.
+    uint32_t locality;
+
+    // Stats on threads and sparks moved between capabilities
+    MigrationCounters migration_stats;
+
+    // Free block groups for allocation outside GC, so that we don't take
+    // sm_mutex for every block. See Note [Per-capability block caches].
+    BlockCache block_cache;
+
+    // Free stable pointer table entries, so that we don't take
+    // stable_ptr_mutex for every stable pointer. See Note [Stable pointer
+    // caches].
+    StablePtrCache stable_ptr_cache;
 #endif
 
     // I/O manager data structures for this capability
@@ -183,6 +226,7 @@ struct Capability_ {
     StgTRecChunk *free_trec_chunks;
     StgTRecHeader *free_trec_headers;
     uint32_t transaction_tokens;
+    StmCounters stm_stats;
 } // typedef Capability is defined in RtsAPI.h
   ATTRIBUTE_ALIGNED(CAPABILITY_ALIGNMENT)
 ;
@@ -448,7 +492,7 @@ recordMutableCap (const StgClosure *p, Capability *cap, uint32_t gen)
     bd = cap->mut_lists[gen];
     if (RELAXED_LOAD(&bd->free) >= bd->start + BLOCK_SIZE_W) {
         bdescr *new_bd;
-        new_bd = allocBlockOnNode_lock(cap->node);
+        new_bd = allocBlockOnCap(cap);
         new_bd->link = bd;
         new_bd->free = new_bd->start;
         bd = new_bd;
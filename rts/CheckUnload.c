@@ -70,43 +70,60 @@
 // objects back to `objects` during evacuation and when marking roots in
 // `checkUnload`. Any objects in `old_objects` after that is unloaded.
 //
-// TODO: We currently don't unload objects when non-moving GC is enabled. The
-// implementation would be similar to `nonmovingGcCafs`:
+// The non-moving collector does the same, but concurrently with the mutator.
+// See Note [Object unloading under the non-moving collector].
 //
-// - Maintain a "snapshot":
-//
-//   - Copy `loaded_objects` as the root set of the snapshot
+
 //
-//   - Stash `objects` to `old_objects` as the snapshot. We don't need a new
-//     list for this as `old_objects` won't be used by any other code when
-//     non-moving GC is enabled.
+// Note [Object unloading under the non-moving collector]
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 //
-//   - Copy `global_s_indices` table to be able to mark objects while mutators
-//     call `loadObj_` and `unloadObj_` concurrently.
+// When the non-moving collector is enabled, the moving collector doesn't mark
+// object code (`unload_mark_needed` is false), as it doesn't see the static
+// objects of the oldest generation (see Note [Static objects under the
+// nonmoving collector] in Storage.c). Instead the non-moving collector marks
+// object code as it marks static objects, which it does concurrently with
+// mutators that may load and unload objects. Like `nonmovingGcCafs` we work
+// with a snapshot taken in the preparation pause:
 //
-// - Don't mark object code in `evacuate`, marking will be done in the
-//   non-moving collector.
+// - `nonmovingPrepareUnloadCheck`, called in the preparation pause, stashes
+//   `objects` in `old_objects` (which the moving collector doesn't use when
+//   the non-moving collector is enabled), copies `global_s_indices` to
+//   `nonmoving_s_indices`, bumps `object_code_mark_bit`, and marks the root
+//   set `loaded_objects` and the object code of the dynamically loaded CAFs,
+//   as `markCAFs` would.
 //
-// - After preparation, bump the object code mark bit (`object_code_mark_bit`
-//   below) and mark static objects using a version of `markObjectCode` that
-//   basically does the same thing but:
+// - `mark_closure` calls `nonmovingMarkObjectCode` on every static object it
+//   marks. This looks the object up in `nonmoving_s_indices`, which mutators
+//   don't modify, and moves its object code and dependencies from
+//   `old_objects` back to `objects` with the `linker_mutex` held, as mutators
+//   may be adding objects to `objects` with `loadObj_`, or dependencies to an
+//   object they resolve.
 //
-//   - Needs to update `objects` list in a thread-safe way, as mutators will be
-//     concurrently calling `loadObj_` and add new stuff to `objects`.
-//     (alternatively we could have a new list for non-moving GC's objects list,
-//     and then merge it to the global list in the pause before moving to
-//     concurrent sweep phase)
+// - `nonmovingCheckUnload`, called in the final sync before sweeping, marks
+//   the current root set and the dependencies of objects loaded since the
+//   snapshot, and unloads the objects still in `old_objects`, as
+//   `checkUnload` does.
 //
-//   - Needs to use the copied `global_s_indices`
+// As the mark is snapshot-at-the-beginning, an object is in `old_objects` at
+// the end of the mark only if no static object in it was reachable at the
+// snapshot, and it was not in the root set at the snapshot or at the end. A
+// mutator can only make such an object reachable again with `lookupSymbol`,
+// which fails once the object is removed from the root set by `unloadObj`, so
+// it is safe to unload. An object loaded during the mark may depend on an
+// object in `old_objects`, which is why we mark the dependencies of the
+// objects loaded since the snapshot.
 //
-// - After marking anything left in `old_objects` are unreachable objects within
-//   the snapshot, unload those. The unload loop will be the same as in
-//   `checkUnload`. This step needs to happen in the final sync (before sweep
-//   begins) to avoid races when updating `global_s_indices`.
+// Both pauses need the `linker_mutex`, which a thread may hold in a safe
+// foreign call (e.g. `loadObj`) while the capabilities are stopped. Rather than
+// wait for it in the preparation pause we skip the unload check for the cycle
+// if it is taken. `nonmovingCheckUnload` must wait for it, to move the
+// surviving objects back to `objects`, as `markObjectLive` does in the moving
+// collector.
 //
-// - NOTE: We don't need write barriers in loadObj/unloadObj as we don't
-//   introduce a dependency from an already-loaded object to a newly loaded
-//   object and we don't delete existing dependencies.
+// We only unload objects with the non-moving collector if `unloadObj` has
+// asked for some to be (`n_unloaded_objects > 0`), so that applications that
+// never unload code don't pay for copying `global_s_indices`.
 //
 
 uint8_t object_code_mark_bit = 0;
@@ -165,6 +182,17 @@ ObjectCode *loaded_objects;
 // map static closures to their ObjectCode.
 static OCSectionIndices *global_s_indices = NULL;
 
+// Copy of `global_s_indices` used by the non-moving collector to mark objects
+// while mutators load and unload objects. See Note [Object unloading under the
+// non-moving collector].
+static OCSectionIndices *nonmoving_s_indices = NULL;
+
+// Whether the non-moving collector needs to mark object code for potential
+// unloading in its current cycle.
+//
+// Not static: checked in `mark_closure`.
+bool nonmoving_unload_mark_needed = false;
+
 // Is it safe for us to unload code?
 static bool tryToUnload(void)
 {
@@ -199,6 +227,18 @@ static void freeOCSectionIndices(OCSectionIndices *s_indices)
     stgFree(s_indices);
 }
 
+static OCSectionIndices *copyOCSectionIndices(OCSectionIndices *s_indices)
+{
+    OCSectionIndices *copy = stgMallocBytes(sizeof(OCSectionIndices), "OCSectionIndices");
+    *copy = *s_indices;
+    copy->capacity = stg_max(s_indices->n_sections, 1);
+    copy->indices = stgMallocBytes(copy->capacity * sizeof(OCSectionIndex),
+        "OCSectionIndices::indices");
+    memcpy(copy->indices, s_indices->indices,
+           s_indices->n_sections * sizeof(OCSectionIndex));
+    return copy;
+}
+
 void initUnloadCheck(void)
 {
     global_s_indices = createOCSectionIndices();
@@ -247,9 +287,25 @@ static void reserveOCSectionIndices(OCSectionIndices *s_indices, int len)
     stgFree(old_indices);
 }
 
-// Insert object section indices of a single ObjectCode. Invalidates 'sorted'
-// state.
+// Insert object section indices of a single ObjectCode, and add it to the
+// 'objects' list. Invalidates 'sorted' state.
 void insertOCSectionIndices(ObjectCode *oc)
+{
+    addOCSectionIndices(oc);
+
+    // Add object to 'objects' list
+    if (objects != NULL) {
+        objects->prev = oc;
+    }
+    oc->next = objects;
+    objects = oc;
+}
+
+// Insert object section indices of a single ObjectCode that is already in the
+// 'objects' list, i.e. an archive member that was read lazily (see Note
+// [Archive symbol index] in rts/linker/ArchiveIndex.c). Invalidates 'sorted'
+// state.
+void addOCSectionIndices(ObjectCode *oc)
 {
     // after we finish the section table will no longer be sorted.
     global_s_indices->sorted = false;
@@ -290,13 +346,6 @@ void insertOCSectionIndices(ObjectCode *oc)
 
         global_s_indices->n_sections = s_i;
     }
-
-    // Add object to 'objects' list
-    if (objects != NULL) {
-        objects->prev = oc;
-    }
-    oc->next = objects;
-    objects = oc;
 }
 
 static int findSectionIdx(OCSectionIndices *s_indices, const void *addr);
@@ -392,18 +441,9 @@ static ObjectCode *findOC(OCSectionIndices *s_indices, const void *addr) {
     return s_indices->indices[oc_idx].oc;
 }
 
-static bool markObjectLive(void *data STG_UNUSED, StgWord key, const void *value STG_UNUSED) {
-    ObjectCode *oc = (ObjectCode*)key;
-
-    // N.B. we may be called by the parallel GC and therefore this must be
-    // thread-safe. To avoid taking the linker_mutex in the fast path
-    // (when the object is already marked) we do an atomic exchange here and
-    // only take the lock in the case that the object is unmarked.
-    if (xchg(&oc->mark, object_code_mark_bit) == object_code_mark_bit) {
-        return true; // for hash table iteration
-    }
-
-    ACQUIRE_LOCK(&linker_mutex);
+// Move a newly marked object from 'old_objects' to 'objects'. The caller
+// must hold the linker_mutex.
+static void reviveObjectCode(ObjectCode *oc) {
     // Remove from 'old_objects' list
     if (oc->prev != NULL) {
         // TODO(osa): Maybe 'prev' should be a pointer to the referencing
@@ -423,6 +463,21 @@ static bool markObjectLive(void *data STG_UNUSED, StgWord key, const void *value
         objects->prev = oc;
     }
     objects = oc;
+}
+
+static bool markObjectLive(void *data STG_UNUSED, StgWord key, const void *value STG_UNUSED) {
+    ObjectCode *oc = (ObjectCode*)key;
+
+    // N.B. we may be called by the parallel GC and therefore this must be
+    // thread-safe. To avoid taking the linker_mutex in the fast path
+    // (when the object is already marked) we do an atomic exchange here and
+    // only take the lock in the case that the object is unmarked.
+    if (xchg(&oc->mark, object_code_mark_bit) == object_code_mark_bit) {
+        return true; // for hash table iteration
+    }
+
+    ACQUIRE_LOCK(&linker_mutex);
+    reviveObjectCode(oc);
     RELEASE_LOCK(&linker_mutex);
 
     // Mark its dependencies
@@ -511,3 +566,151 @@ void checkUnload(void)
 
     old_objects = NULL;
 }
+
+// Like markObjectLive, but for the non-moving collector, which marks
+// concurrently with mutators that may add dependencies to objects. The caller
+// must hold the linker_mutex.
+static bool nonmovingMarkObjectLive(void *data STG_UNUSED, StgWord key, const void *value STG_UNUSED) {
+    ObjectCode *oc = (ObjectCode*)key;
+
+    if (xchg(&oc->mark, object_code_mark_bit) == object_code_mark_bit) {
+        return true; // for hash table iteration
+    }
+
+    reviveObjectCode(oc);
+    iterHashTable(oc->dependencies, NULL, nonmovingMarkObjectLive);
+
+    return true; // for hash table iteration
+}
+
+static void nonmovingMarkCAFsObjectCode(StgIndStatic *list)
+{
+    for (StgIndStatic *c = list;
+         ((StgWord) c | STATIC_FLAG_LIST) != (StgWord)END_OF_CAF_LIST;
+         c = (StgIndStatic *)c->static_link)
+    {
+        c = (StgIndStatic *)UNTAG_STATIC_LIST_PTR(c);
+        ObjectCode *oc = findOC(nonmoving_s_indices, c);
+        if (oc != NULL) {
+            nonmovingMarkObjectLive(NULL, (W_)oc, NULL);
+        }
+    }
+}
+
+// Called in the preparation pause of the non-moving collector. Sets
+// `nonmoving_unload_mark_needed` if the collector needs to mark code for
+// potential unloading. See Note [Object unloading under the non-moving
+// collector].
+void nonmovingPrepareUnloadCheck(void)
+{
+    ASSERT(!nonmoving_unload_mark_needed);
+
+    if (!tryToUnload() || RELAXED_LOAD(&n_unloaded_objects) == 0) {
+        return;
+    }
+    if (TRY_ACQUIRE_LOCK(&linker_mutex) != 0) {
+        return;
+    }
+
+    removeRemovedOCSections(global_s_indices);
+    sortOCSectionIndices(global_s_indices);
+    nonmoving_s_indices = copyOCSectionIndices(global_s_indices);
+
+    ASSERT(old_objects == NULL);
+
+    object_code_mark_bit = ~object_code_mark_bit;
+    old_objects = objects;
+    objects = NULL;
+
+    // Mark the roots of the snapshot
+    for (ObjectCode *oc = loaded_objects; oc != NULL; oc = oc->next_loaded_object) {
+        nonmovingMarkObjectLive(NULL, (W_)oc, NULL);
+    }
+    // markCAFs only adds the indirectees of the CAFs to the mark queue
+    nonmovingMarkCAFsObjectCode(dyn_caf_list);
+    nonmovingMarkCAFsObjectCode(revertible_caf_list);
+
+    RELEASE_LOCK(&linker_mutex);
+
+    nonmoving_unload_mark_needed = true;
+}
+
+// Mark object code of a static closure address as 'live' in the non-moving
+// collector's mark.
+void nonmovingMarkObjectCode(const void *addr)
+{
+    ASSERT(!HEAP_ALLOCED(addr));
+
+    ObjectCode *oc = findOC(nonmoving_s_indices, addr);
+    if (oc != NULL && RELAXED_LOAD(&oc->mark) != object_code_mark_bit) {
+        ACQUIRE_LOCK(&linker_mutex);
+        nonmovingMarkObjectLive(NULL, (W_)oc, NULL);
+        RELEASE_LOCK(&linker_mutex);
+    }
+}
+
+// Called in the final sync of the non-moving collector. If `unload` is false
+// (e.g. when the mark was abandoned on shutdown) we keep all objects.
+void nonmovingCheckUnload(bool unload)
+{
+    if (!nonmoving_unload_mark_needed) {
+        return;
+    }
+    nonmoving_unload_mark_needed = false;
+
+    freeOCSectionIndices(nonmoving_s_indices);
+    nonmoving_s_indices = NULL;
+
+    ObjectCode *unloaded = NULL;
+    ACQUIRE_LOCK(&linker_mutex);
+    if (unload) {
+        // Mark the current roots, and the dependencies of the objects loaded
+        // since the snapshot, which are in 'objects' but aren't marked
+        for (ObjectCode *oc = loaded_objects; oc != NULL; oc = oc->next_loaded_object) {
+            nonmovingMarkObjectLive(NULL, (W_)oc, NULL);
+        }
+        for (ObjectCode *oc = objects; oc != NULL; oc = oc->next) {
+            iterHashTable(oc->dependencies, NULL, nonmovingMarkObjectLive);
+        }
+
+        removeRemovedOCSections(global_s_indices);
+        sortOCSectionIndices(global_s_indices);
+
+        while (old_objects != NULL) {
+            ObjectCode *oc = old_objects;
+            ASSERT(oc->status == OBJECT_UNLOADED);
+            // See checkUnload
+            ASSERT(oc->symbols == NULL);
+
+            if (oc->unloadable) {
+                old_objects = oc->next;
+                if (old_objects != NULL) {
+                    old_objects->prev = NULL;
+                }
+                removeOCSectionIndices(global_s_indices, oc);
+                n_unloaded_objects -= 1;
+                oc->next = unloaded;
+                unloaded = oc;
+            } else {
+                // If we don't have enough information to
+                // accurately determine the reachability of
+                // the object then hold onto it.
+                reviveObjectCode(oc);
+            }
+        }
+    } else {
+        while (old_objects != NULL) {
+            reviveObjectCode(old_objects);
+        }
+    }
+    ASSERT(old_objects == NULL);
+    RELEASE_LOCK(&linker_mutex);
+
+    // The unloaded objects are in no list, so we can free them without the
+    // lock (freeObjectCode takes it for dynamic objects)
+    ObjectCode *next = NULL;
+    for (ObjectCode *oc = unloaded; oc != NULL; oc = next) {
+        next = oc->next;
+        freeObjectCode(oc);
+    }
+}
@@ -39,7 +39,15 @@ void markObjectCode(const void *addr);
 // Call after major GC to unload unused and unmarked object code
 void checkUnload(void);
 
+// The same for the non-moving collector. See Note [Object unloading under the
+// non-moving collector] in CheckUnload.c.
+extern bool nonmoving_unload_mark_needed;
+void nonmovingPrepareUnloadCheck(void);
+void nonmovingMarkObjectCode(const void *addr);
+void nonmovingCheckUnload(bool unload);
+
 // Call on loaded object code
 void insertOCSectionIndices(ObjectCode *oc);
+void addOCSectionIndices(ObjectCode *oc);
 
 #include "EndPrivate.h"
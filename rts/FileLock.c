@@ -41,7 +41,7 @@ STATIC_INLINE int cmpLocks(StgWord w1, StgWord w2)
     return (l1->device == l2->device && l1->inode == l2->inode);
 }
 
-STATIC_INLINE int hashLock(const HashTable *table, StgWord w)
+STATIC_INLINE StgWord hashLock(const HashTable *table, StgWord w)
 {
     Lock *l = (Lock *)w;
     StgWord key = l->inode ^ (l->inode >> 32) ^ l->device ^ (l->device >> 32);
@@ -93,7 +93,8 @@ lockFile(StgWord64 id, StgWord64 dev, StgWord64 ino, int for_writing)
         lock->device = dev;
         lock->inode  = ino;
         lock->readers = for_writing ? -1 : 1;
-        insertHashTable_(obj_hash, (StgWord)lock, (void *)lock, hashLock);
+        insertHashTable_(obj_hash, (StgWord)lock, (void *)lock, hashLock,
+                         cmpLocks);
         insertHashTable(key_hash, id, lock);
         RELEASE_LOCK(&file_lock_mutex);
         return 0;
@@ -1,11 +1,10 @@
 /*-----------------------------------------------------------------------------
  *
  * (c) The AQUA Project, Glasgow University, 1995-1998
- * (c) The GHC Team, 1999
+ * (c) The GHC Team, 1999-2025
  *
- * Dynamically expanding linear hash tables, as described in
- * Per-\AAke Larson, ``Dynamic Hash Tables,'' CACM 31(4), April 1988,
- * pp. 446 -- 457.
+ * Open-addressing hash tables, in the style of Abseil's "Swiss tables":
+ * https://abseil.io/about/design/swisstables
  * -------------------------------------------------------------------------- */
 
 #include "rts/PosixSource.h"
@@ -20,37 +19,82 @@
 
 #include <string.h>
 
-#define HSEGSIZE    1024    /* Size of a single hash table segment */
-                            /* Also the minimum size of a hash table */
-#define HDIRSIZE    1024    /* Size of the segment directory */
-                            /* Maximum hash table size is HSEGSIZE * HDIRSIZE */
-#define HLOAD       5       /* Maximum average load of a single hash bucket */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(aarch64_HOST_ARCH)
+#include <arm_neon.h>
+#endif
+
+/* -----------------------------------------------------------------------------
+ * Note [Swiss hash tables]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~
+ * A HashTable is a single array of (key, data) slots with open addressing,
+ * plus an array of one control byte per slot:
+ *
+ *   HEMPTY   (0x80)  the slot has never been used,
+ *   HDELETED (0xfe)  the slot was used, but its entry has been removed,
+ *   0..0x7f          the slot is full, and this is H2 of the key's hash: the
+ *                    low 7 bits.
+ *
+ * We probe for a key in groups of HGROUP slots, starting at the slot given by
+ * H1, the rest of the hash. For each group we compare all of its control
+ * bytes with the key's H2 at once (with SSE2 or NEON where we have them),
+ * and only compare the keys in the slots that match, which is one slot in
+ * almost all cases. We stop at a group with an empty slot. So a lookup
+ * usually touches one cache line of control bytes and one of slots, where the
+ * chained hash table this replaces chased a pointer per entry.
+ *
+ * The groups start at any slot, not just multiples of HGROUP, so the control
+ * bytes array has HGROUP extra bytes at the end which mirror the first
+ * HGROUP, and a group starting near the end can be loaded in one go. The
+ * probe sequence is triangular, which visits every group as the capacity is
+ * a power of two.
+ *
+ * Removing an entry leaves a tombstone (HDELETED) unless no probe can have
+ * passed over the slot, so that lookups of other keys keep going. We keep at
+ * least one in eight slots empty, counting tombstones as used (growth_left),
+ * so that probes terminate quickly; when we run out we rehash, at the same
+ * size if most of the used slots are tombstones and at twice the size
+ * otherwise.
+ *
+ * The API allows a key to be inserted more than once: lookup returns the most
+ * recent data, and remove takes away the most recent (matching) entry and
+ * uncovers the one before. Few users ever do this, so the main table only
+ * has the most recent entry for each key, and the older ones are kept on a
+ * list of shadowed entries, which is normally empty.
+ * -------------------------------------------------------------------------- */
+
+#define HGROUP      16      /* Slots in a probing group */
+#define HMINSIZE    HGROUP  /* Minimum capacity of a table */
+
+#define HEMPTY      ((uint8_t) 0x80)
+#define HDELETED    ((uint8_t) 0xfe)
 
-#define HCHUNK      (1024 * sizeof(W_) / sizeof(HashList))
-                            /* Number of HashList cells to allocate in one go */
+#define H1(h)       ((h) >> 7)
+#define H2(h)       ((uint8_t) ((h) & 0x7f))
 
+#define NO_SLOT     (~(StgWord) 0)
 
-/* Linked list of (key, data) pairs for separate chaining */
+typedef struct {
+    StgWord key;
+    const void *data;
+} HashEntry;
+
+/* Linked list of (key, data) pairs, for the shadowed entries */
 typedef struct hashlist {
     StgWord key;
     const void *data;
-    struct hashlist *next;  /* Next cell in bucket chain (same hash value) */
+    struct hashlist *next;
 } HashList;
 
-typedef struct chunklist {
-  struct chunklist *next;
-} HashListChunk;
-
 struct hashtable {
-    int split;              /* Next bucket to split when expanding */
-    int max;                /* Max bucket of smaller table */
-    int mask1;              /* Mask for doing the mod of h_1 (smaller table) */
-    int mask2;              /* Mask for doing the mod of h_2 (larger table) */
-    int kcount;             /* Number of keys */
-    int bcount;             /* Number of buckets */
-    HashList **dir[HDIRSIZE];   /* Directory of segments */
-    HashList *freeList;         /* free list of HashLists */
-    HashListChunk *chunks;      /* list of HashListChunks so we can later free them */
+    HashEntry *slots;       /* capacity slots */
+    uint8_t *ctrl;          /* capacity + HGROUP control bytes */
+    StgWord mask;           /* capacity - 1, capacity is a power of 2 */
+    StgWord used;           /* Full slots */
+    StgWord growth_left;    /* Empty slots we may still fill before rehashing */
+    int kcount;             /* Number of keys, including shadowed ones */
+    HashList *shadowed;     /* Older entries for keys inserted again, newest first */
 };
 
 /* Create an identical structure, but is distinct on a type level,
@@ -60,49 +104,149 @@ struct hashtable {
 struct strhashtable { struct hashtable table; };
 
 /* -----------------------------------------------------------------------------
- * Hash first using the smaller table.  If the bucket is less than the
- * next bucket to be split, re-hash using the larger table.
+ * Matching a group of control bytes.
+ *
+ * Each function returns a bitmask with LANE_BITS bits for each of the HGROUP
+ * control bytes, of which only the top one is set for a match.
  * -------------------------------------------------------------------------- */
-int
-hashWord(const HashTable *table, StgWord key)
+
+typedef uint64_t GroupMask;
+
+#if defined(__SSE2__)
+
+#define LANE_BITS 1
+
+STATIC_INLINE GroupMask
+matchByte(const uint8_t *ctrl, uint8_t b)
 {
-    int bucket;
+    __m128i g = _mm_loadu_si128((const __m128i *) ctrl);
+    return (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(b)));
+}
 
-    /* Strip the boring zero bits */
-    key /= sizeof(StgWord);
+/* HEMPTY and HDELETED are the control bytes with the top bit set */
+STATIC_INLINE GroupMask
+matchEmptyOrDeleted(const uint8_t *ctrl)
+{
+    __m128i g = _mm_loadu_si128((const __m128i *) ctrl);
+    return (uint16_t) _mm_movemask_epi8(g);
+}
 
-    /* Mod the size of the hash table (a power of 2) */
-    bucket = key & table->mask1;
+#elif defined(__ARM_NEON) && defined(aarch64_HOST_ARCH)
 
-    if (bucket < table->split) {
-        /* Mod the size of the expanded hash table (also a power of 2) */
-        bucket = key & table->mask2;
-    }
-    return bucket;
+#define LANE_BITS 4
+
+/* Narrow each 0x00/0xff byte to a nibble, and keep the top bit of each */
+STATIC_INLINE GroupMask
+neonMask(uint8x16_t m)
+{
+    uint8x8_t n = vshrn_n_u16(vreinterpretq_u16_u8(m), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(n), 0) & UINT64_C(0x8888888888888888);
 }
 
-int
-hashBuffer(const HashTable *table, const void *buf, size_t len)
+STATIC_INLINE GroupMask
+matchByte(const uint8_t *ctrl, uint8_t b)
 {
-    const char *key = (char*) buf;
-#if WORD_SIZE_IN_BITS == 64
-    StgWord h = XXH3_64bits_withSeed (key, len, 1048583);
+    return neonMask(vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(b)));
+}
+
+STATIC_INLINE GroupMask
+matchEmptyOrDeleted(const uint8_t *ctrl)
+{
+    return neonMask(vcltzq_s8(vreinterpretq_s8_u8(vld1q_u8(ctrl))));
+}
+
 #else
-    StgWord h = XXH32 (key, len, 1048583);
-#endif
 
-    /* Mod the size of the hash table (a power of 2) */
-    int bucket = h & table->mask1;
+#define LANE_BITS 1
+
+STATIC_INLINE GroupMask
+matchByte(const uint8_t *ctrl, uint8_t b)
+{
+    GroupMask m = 0;
+    for (int i = 0; i < HGROUP; i++) {
+        m |= (GroupMask) (ctrl[i] == b) << i;
+    }
+    return m;
+}
 
-    if (bucket < table->split) {
-        /* Mod the size of the expanded hash table (also a power of 2) */
-        bucket = h & table->mask2;
+STATIC_INLINE GroupMask
+matchEmptyOrDeleted(const uint8_t *ctrl)
+{
+    GroupMask m = 0;
+    for (int i = 0; i < HGROUP; i++) {
+        m |= (GroupMask) (ctrl[i] >> 7) << i;
     }
+    return m;
+}
 
-    return bucket;
+#endif
+
+STATIC_INLINE GroupMask
+matchEmpty(const uint8_t *ctrl)
+{
+    return matchByte(ctrl, HEMPTY);
 }
 
-int
+/* The lane of the lowest match, which must exist */
+STATIC_INLINE StgWord
+lowestLane(GroupMask m)
+{
+    return __builtin_ctzll(m) / LANE_BITS;
+}
+
+/* Matching lanes before the first match, or HGROUP if there is none */
+STATIC_INLINE StgWord
+trailingLanes(GroupMask m)
+{
+    return m == 0 ? HGROUP : lowestLane(m);
+}
+
+/* Matching lanes after the last match, or HGROUP if there is none */
+STATIC_INLINE StgWord
+leadingLanes(GroupMask m)
+{
+    return m == 0 ? HGROUP
+        : (__builtin_clzll(m) - (64 - HGROUP * LANE_BITS)) / LANE_BITS;
+}
+
+/* -----------------------------------------------------------------------------
+ * Hash functions. These return a hash of the key, which the table reduces to
+ * a slot. The table argument is unused, and is there for the sake of
+ * the users' own HashFunctions.
+ * -------------------------------------------------------------------------- */
+StgWord
+hashWord(const HashTable *table STG_UNUSED, StgWord key)
+{
+    /* The finaliser of MurmurHash3, so that every bit of the key affects
+     * both H1 and H2. */
+#if WORD_SIZE_IN_BITS == 64
+    key ^= key >> 33;
+    key *= UINT64_C(0xff51afd7ed558ccd);
+    key ^= key >> 33;
+    key *= UINT64_C(0xc4ceb9fe1a85ec53);
+    key ^= key >> 33;
+#else
+    key ^= key >> 16;
+    key *= 0x85ebca6b;
+    key ^= key >> 13;
+    key *= 0xc2b2ae35;
+    key ^= key >> 16;
+#endif
+    return key;
+}
+
+StgWord
+hashBuffer(const HashTable *table STG_UNUSED, const void *buf, size_t len)
+{
+    const char *key = (char*) buf;
+#if WORD_SIZE_IN_BITS == 64
+    return XXH3_64bits_withSeed (key, len, 1048583);
+#else
+    return XXH32 (key, len, 1048583);
+#endif
+}
+
+StgWord
 hashStr(const HashTable *table, StgWord w)
 {
     const char *key = (char*) w;
@@ -121,102 +265,149 @@ compareStr(StgWord key1, StgWord key2)
     return (strcmp((char *)key1, (char *)key2) == 0);
 }
 
-
 /* -----------------------------------------------------------------------------
- * Allocate a new segment of the dynamically growing hash table.
+ * Slots and control bytes
  * -------------------------------------------------------------------------- */
 
-STATIC_INLINE void
-allocSegment(HashTable *table, int segment)
+STATIC_INLINE StgWord
+capacity(const HashTable *table)
 {
-    table->dir[segment] = stgMallocBytes(HSEGSIZE * sizeof(HashList *),
-                                         "allocSegment");
+    return table->mask + 1;
 }
 
+/* Keep one slot in eight empty */
+STATIC_INLINE StgWord
+maxLoad(StgWord cap)
+{
+    return cap - cap / 8;
+}
 
-/* -----------------------------------------------------------------------------
- * Expand the larger hash table by one bucket, and split one bucket
- * from the smaller table into two parts.  Only the bucket referenced
- * by @table->split@ is affected by the expansion.
- * -------------------------------------------------------------------------- */
+STATIC_INLINE bool
+isFull(uint8_t c)
+{
+    return c < 0x80;
+}
 
 STATIC_INLINE void
-expand(HashTable *table, HashFunction f)
-{
-    int oldsegment;
-    int oldindex;
-    int newbucket;
-    int newsegment;
-    int newindex;
-    HashList *hl;
-    HashList *next;
-    HashList *old, *new;
-
-    if (table->split + table->max >= HDIRSIZE * HSEGSIZE)
-        /* Wow!  That's big.  Too big, so don't expand. */
-        return;
-
-    /* Calculate indices of bucket to split */
-    oldsegment = table->split / HSEGSIZE;
-    oldindex = table->split % HSEGSIZE;
-
-    newbucket = table->max + table->split;
+setCtrl(HashTable *table, StgWord i, uint8_t c)
+{
+    table->ctrl[i] = c;
+    if (i < HGROUP) {
+        /* The mirror, see Note [Swiss hash tables] */
+        table->ctrl[capacity(table) + i] = c;
+    }
+}
 
-    /* And the indices of the new bucket */
-    newsegment = newbucket / HSEGSIZE;
-    newindex = newbucket % HSEGSIZE;
+static void
+allocSlots(HashTable *table, StgWord cap)
+{
+    /* One allocation, with the slots first for their alignment */
+    void *p = stgMallocBytes(cap * sizeof(HashEntry) + cap + HGROUP,
+                             "allocSlots");
+    table->slots = p;
+    table->ctrl = (uint8_t *) p + cap * sizeof(HashEntry);
+    memset(table->ctrl, HEMPTY, cap + HGROUP);
+    table->mask = cap - 1;
+    table->used = 0;
+    table->growth_left = maxLoad(cap);
+}
 
-    if (newindex == 0)
-        allocSegment(table, newsegment);
+/* The first slot in the probe sequence for hash h which is empty or deleted.
+ * There always is one.
+ */
+STATIC_INLINE StgWord
+findNonFull(const HashTable *table, StgWord h)
+{
+    StgWord pos = H1(h) & table->mask;
+    StgWord stride = 0;
+    while (true) {
+        GroupMask m = matchEmptyOrDeleted(&table->ctrl[pos]);
+        if (m != 0) {
+            return (pos + lowestLane(m)) & table->mask;
+        }
+        stride += HGROUP;
+        pos = (pos + stride) & table->mask;
+    }
+}
 
-    if (++table->split == table->max) {
-        table->split = 0;
-        table->max *= 2;
-        table->mask1 = table->mask2;
-        table->mask2 = table->mask2 << 1 | 1;
+STATIC_INLINE StgWord
+findSlot(const HashTable *table, StgWord key, StgWord h, CompareFunction cmp)
+{
+    const uint8_t h2 = H2(h);
+    StgWord pos = H1(h) & table->mask;
+    StgWord stride = 0;
+    while (true) {
+        const uint8_t *group = &table->ctrl[pos];
+        for (GroupMask m = matchByte(group, h2); m != 0; m &= m - 1) {
+            StgWord i = (pos + lowestLane(m)) & table->mask;
+            if (cmp(table->slots[i].key, key)) {
+                return i;
+            }
+        }
+        if (matchEmpty(group) != 0) {
+            return NO_SLOT;
+        }
+        stride += HGROUP;
+        pos = (pos + stride) & table->mask;
     }
-    table->bcount++;
+}
 
-    /* Split the bucket, paying no attention to the original order */
+/* -----------------------------------------------------------------------------
+ * Rehash into a table of the given capacity, which must be large enough.
+ * -------------------------------------------------------------------------- */
 
-    old = new = NULL;
-    for (hl = table->dir[oldsegment][oldindex]; hl != NULL; hl = next) {
-        next = hl->next;
-        if (f(table, hl->key) == newbucket) {
-            hl->next = new;
-            new = hl;
-        } else {
-            hl->next = old;
-            old = hl;
+static void
+rehash(HashTable *table, StgWord cap, HashFunction f)
+{
+    HashEntry *old_slots = table->slots;
+    uint8_t *old_ctrl = table->ctrl;
+    StgWord old_cap = capacity(table);
+
+    allocSlots(table, cap);
+
+    for (StgWord i = 0; i < old_cap; i++) {
+        if (isFull(old_ctrl[i])) {
+            StgWord key = old_slots[i].key;
+            StgWord h = f(table, key);
+            StgWord j = findNonFull(table, h);
+            setCtrl(table, j, H2(h));
+            table->slots[j].key = key;
+            table->slots[j].data = old_slots[i].data;
+            table->used++;
         }
     }
-    table->dir[oldsegment][oldindex] = old;
-    table->dir[newsegment][newindex] = new;
+    table->growth_left -= table->used;
+
+    stgFree(old_slots);
+}
 
-    return;
+/* Make room for an entry in an empty slot */
+static void
+grow(HashTable *table, HashFunction f)
+{
+    StgWord cap = capacity(table);
+    if (table->used <= maxLoad(cap) / 2) {
+        /* Mostly tombstones: clear them out */
+        rehash(table, cap, f);
+    } else {
+        rehash(table, cap * 2, f);
+    }
 }
 
+/* -----------------------------------------------------------------------------
+ * Lookup
+ * -------------------------------------------------------------------------- */
+
 STATIC_INLINE void*
 lookupHashTable_inlined(const HashTable *table, StgWord key,
                         HashFunction f, CompareFunction cmp)
 {
-    int bucket;
-    int segment;
-    int index;
-
-    HashList *hl;
-
-    bucket = f(table, key);
-    segment = bucket / HSEGSIZE;
-    index = bucket % HSEGSIZE;
-
-    for (hl = table->dir[segment][index]; hl != NULL; hl = hl->next) {
-        if (cmp(hl->key, key))
-            return (void *) hl->data;
+    StgWord i = findSlot(table, key, f(table, key), cmp);
+    if (i == NO_SLOT) {
+        /* It's not there */
+        return NULL;
     }
-
-    /* It's not there */
-    return NULL;
+    return (void *) table->slots[i].data;
 }
 
 void *
@@ -245,154 +436,140 @@ lookupStrHashTable(const StrHashTable* table, const char* key)
 // If the table is modified concurrently, the function behavior is undefined.
 //
 int keysHashTable(HashTable *table, StgWord keys[], int szKeys) {
-    int segment, index;
     int k = 0;
-    HashList *hl;
-
 
-    /* The last bucket with something in it is table->max + table->split - 1 */
-    segment = (table->max + table->split - 1) / HSEGSIZE;
-    index = (table->max + table->split - 1) % HSEGSIZE;
-
-    while (segment >= 0 && k < szKeys) {
-        while (index >= 0 && k < szKeys) {
-            hl = table->dir[segment][index];
-            while (hl && k < szKeys) {
-                keys[k] = hl->key;
-                k += 1;
-                hl = hl->next;
-            }
-            index--;
+    for (StgWord i = 0; i < capacity(table) && k < szKeys; i++) {
+        if (isFull(table->ctrl[i])) {
+            keys[k++] = table->slots[i].key;
         }
-        segment--;
-        index = HSEGSIZE - 1;
+    }
+    for (HashList *hl = table->shadowed; hl != NULL && k < szKeys;
+         hl = hl->next) {
+        keys[k++] = hl->key;
     }
     return k;
 }
 
 /* -----------------------------------------------------------------------------
- * We allocate the hashlist cells in large chunks to cut down on malloc
- * overhead.  Although we keep a free list of hashlist cells, we make
- * no effort to actually return the space to the malloc arena. Eventually
- * they will all be freed when we free the HashListChunks.
+ * Insert
  * -------------------------------------------------------------------------- */
 
-static HashList *
-allocHashList (HashTable *table)
-{
-    if (table->freeList != NULL) {
-        HashList *hl = table->freeList;
-        table->freeList = hl->next;
-        return hl;
-    } else {
-        /* We allocate one block of memory which contains:
-         *
-         *  1. A HashListChunk, which gets linked onto HashTable.chunks.
-         *     This forms a list of all chunks associated with the HashTable
-         *     and is what we will free when we free the HashTable.
-         *
-         *  2. Several HashLists. One of these will get returned. The rest are
-         *     placed on the freeList.
-         *
-         */
-        HashListChunk *cl = stgMallocBytes(sizeof(HashListChunk) + HCHUNK * sizeof(HashList), "allocHashList");
-        HashList *hl = (HashList *) &cl[1];
-        cl->next = table->chunks;
-        table->chunks = cl;
-
-        table->freeList = hl + 1;
-        HashList *p = table->freeList;
-        for (; p < hl + HCHUNK - 1; p++)
-            p->next = p + 1;
-        p->next = NULL;
-        return hl;
-    }
-}
-
-static void
-freeHashList (HashTable *table, HashList *hl)
-{
-    // We place the HashList on the freeList. We make no attempt to bound the
-    // size of the free list for the time being. The HashLists on the freeList
-    // are freed when the HashTable itself is freed as a result of freeing the
-    // HashListChunks.
-    hl->next = table->freeList;
-    table->freeList = hl;
-}
-
 STATIC_INLINE void
 insertHashTable_inlined(HashTable *table, StgWord key,
-                        const void *data, HashFunction f)
+                        const void *data, HashFunction f, CompareFunction cmp)
 {
-    int bucket;
-    int segment;
-    int index;
-    HashList *hl;
-
-    // Disable this assert; sometimes it's useful to be able to
-    // overwrite entries in the hash table.
-    // ASSERT(lookupHashTable(table, key) == NULL);
-
-    /* When the average load gets too high, we expand the table */
-    if (++table->kcount >= HLOAD * table->bcount)
-        expand(table, f);
-
-    bucket = f(table, key);
-    segment = bucket / HSEGSIZE;
-    index = bucket % HSEGSIZE;
-
-    hl = allocHashList(table);
+    // We don't assert that the key isn't there already; sometimes it's useful
+    // to be able to overwrite entries in the hash table.
+    StgWord h = f(table, key);
+    StgWord i = findSlot(table, key, h, cmp);
+
+    if (i != NO_SLOT) {
+        /* Shadow the existing entry, see Note [Swiss hash tables] */
+        HashList *hl = stgMallocBytes(sizeof(HashList), "insertHashTable");
+        hl->key = table->slots[i].key;
+        hl->data = table->slots[i].data;
+        hl->next = table->shadowed;
+        table->shadowed = hl;
+    } else {
+        i = findNonFull(table, h);
+        if (table->ctrl[i] == HEMPTY) {
+            if (table->growth_left == 0) {
+                grow(table, f);
+                i = findNonFull(table, h);
+            }
+            table->growth_left--;
+        }
+        setCtrl(table, i, H2(h));
+        table->used++;
+    }
 
-    hl->key = key;
-    hl->data = data;
-    hl->next = table->dir[segment][index];
-    table->dir[segment][index] = hl;
+    table->slots[i].key = key;
+    table->slots[i].data = data;
+    table->kcount++;
 }
 
 void
 insertHashTable_(HashTable *table, StgWord key,
-                 const void *data, HashFunction f)
+                 const void *data, HashFunction f, CompareFunction cmp)
 {
-    return insertHashTable_inlined(table, key, data, f);
+    insertHashTable_inlined(table, key, data, f, cmp);
 }
 
 void
 insertHashTable(HashTable *table, StgWord key, const void *data)
 {
-    insertHashTable_inlined(table, key, data, hashWord);
+    insertHashTable_inlined(table, key, data, hashWord, compareWord);
 }
 
 void
 insertStrHashTable(StrHashTable *table, const char * key, const void *data)
 {
-    insertHashTable_inlined(&table->table, (StgWord) key, data, hashStr);
+    insertHashTable_inlined(&table->table, (StgWord) key, data,
+                            hashStr, compareStr);
+}
+
+/* -----------------------------------------------------------------------------
+ * Remove
+ * -------------------------------------------------------------------------- */
+
+/* Empty slot i, leaving a tombstone if a probe may have passed over it */
+STATIC_INLINE void
+eraseSlot(HashTable *table, StgWord i)
+{
+    StgWord before = (i - HGROUP) & table->mask;
+    GroupMask empty_after = matchEmpty(&table->ctrl[i]);
+    GroupMask empty_before = matchEmpty(&table->ctrl[before]);
+
+    /* If there is an empty slot within HGROUP slots either side, then no
+     * group containing slot i has ever been full, and no probe has gone past
+     * it. */
+    if (trailingLanes(empty_after) + leadingLanes(empty_before) < HGROUP) {
+        setCtrl(table, i, HEMPTY);
+        table->growth_left++;
+    } else {
+        setCtrl(table, i, HDELETED);
+    }
+    table->used--;
 }
 
 STATIC_INLINE void*
 removeHashTable_inlined(HashTable *table, StgWord key, const void *data,
                         HashFunction f, CompareFunction cmp)
 {
-    int bucket;
-    int segment;
-    int index;
-    HashList *hl;
-    HashList *prev = NULL;
-
-    bucket = f(table, key);
-    segment = bucket / HSEGSIZE;
-    index = bucket % HSEGSIZE;
-
-    for (hl = table->dir[segment][index]; hl != NULL; hl = hl->next) {
-        if (cmp(hl->key, key) && (data == NULL || hl->data == data)) {
-            if (prev == NULL)
-                table->dir[segment][index] = hl->next;
-            else
-                prev->next = hl->next;
-            freeHashList(table,hl);
+    StgWord i = findSlot(table, key, f(table, key), cmp);
+
+    if (i != NO_SLOT) {
+        if (data == NULL || table->slots[i].data == data) {
+            void *old = (void *) table->slots[i].data;
+
+            /* Uncover the newest shadowed entry with this key, if any */
+            HashList **prev = &table->shadowed;
+            for (HashList *hl = *prev; hl != NULL; prev = &hl->next, hl = *prev) {
+                if (cmp(hl->key, key)) {
+                    table->slots[i].key = hl->key;
+                    table->slots[i].data = hl->data;
+                    *prev = hl->next;
+                    stgFree(hl);
+                    table->kcount--;
+                    return old;
+                }
+            }
+
+            eraseSlot(table, i);
             table->kcount--;
-            return (void *) hl->data;
+            return old;
+        }
+
+        /* Not the newest entry with this key: look at the older ones */
+        HashList **prev = &table->shadowed;
+        for (HashList *hl = *prev; hl != NULL; prev = &hl->next, hl = *prev) {
+            if (cmp(hl->key, key) && hl->data == data) {
+                *prev = hl->next;
+                stgFree(hl);
+                table->kcount--;
+                return (void *) data;
+            }
         }
-        prev = hl;
     }
 
     /* It's not there */
@@ -429,35 +606,24 @@ removeStrHashTable(StrHashTable *table, const char * key, const void *data)
 void
 freeHashTable(HashTable *table, void (*freeDataFun)(void *) )
 {
-    /* The last bucket with something in it is table->max + table->split - 1 */
-    long segment = (table->max + table->split - 1) / HSEGSIZE;
-    long index = (table->max + table->split - 1) % HSEGSIZE;
-
-    /* Free table segments */
-    while (segment >= 0) {
-        if (freeDataFun) {
-            while (index >= 0) {
-                HashList *next;
-                for (HashList *hl = table->dir[segment][index]; hl != NULL; hl = next) {
-                    next = hl->next;
-                    (*freeDataFun)((void *) hl->data);
-                }
-                index--;
+    if (freeDataFun) {
+        for (StgWord i = 0; i < capacity(table); i++) {
+            if (isFull(table->ctrl[i])) {
+                (*freeDataFun)((void *) table->slots[i].data);
             }
         }
-        stgFree(table->dir[segment]);
-        segment--;
-        index = HSEGSIZE - 1;
     }
 
-    /* Free chunks */
-    HashListChunk *cl = table->chunks;
-    while (cl != NULL) {
-        HashListChunk *old = cl;
-        cl = cl->next;
-        stgFree(old);
+    HashList *next;
+    for (HashList *hl = table->shadowed; hl != NULL; hl = next) {
+        next = hl->next;
+        if (freeDataFun) {
+            (*freeDataFun)((void *) hl->data);
+        }
+        stgFree(hl);
     }
 
+    stgFree(table->slots);
     stgFree(table);
 }
 
@@ -468,88 +634,60 @@ freeHashTable(HashTable *table, void (*freeDataFun)(void *) )
 void
 mapHashTable(HashTable *table, void *data, MapHashFn fn)
 {
-    /* The last bucket with something in it is table->max + table->split - 1 */
-    long segment = (table->max + table->split - 1) / HSEGSIZE;
-    long index = (table->max + table->split - 1) % HSEGSIZE;
-
-    while (segment >= 0) {
-        while (index >= 0) {
-            for (HashList *hl = table->dir[segment][index]; hl != NULL; hl = hl->next) {
-                fn(data, hl->key, hl->data);
-            }
-            index--;
+    for (StgWord i = 0; i < capacity(table); i++) {
+        if (isFull(table->ctrl[i])) {
+            fn(data, table->slots[i].key, table->slots[i].data);
         }
-        segment--;
-        index = HSEGSIZE - 1;
+    }
+    for (HashList *hl = table->shadowed; hl != NULL; hl = hl->next) {
+        fn(data, hl->key, hl->data);
     }
 }
 
 void
 mapHashTableKeys(HashTable *table, void *data, MapHashFnKeys fn)
 {
-    /* The last bucket with something in it is table->max + table->split - 1 */
-    long segment = (table->max + table->split - 1) / HSEGSIZE;
-    long index = (table->max + table->split - 1) % HSEGSIZE;
-
-    while (segment >= 0) {
-        while (index >= 0) {
-            for (HashList *hl = table->dir[segment][index]; hl != NULL; hl = hl->next) {
-                fn(data, &hl->key, hl->data);
-            }
-            index--;
+    for (StgWord i = 0; i < capacity(table); i++) {
+        if (isFull(table->ctrl[i])) {
+            fn(data, &table->slots[i].key, table->slots[i].data);
         }
-        segment--;
-        index = HSEGSIZE - 1;
+    }
+    for (HashList *hl = table->shadowed; hl != NULL; hl = hl->next) {
+        fn(data, &hl->key, hl->data);
     }
 }
 
 void
 iterHashTable(HashTable *table, void *data, IterHashFn fn)
 {
-    /* The last bucket with something in it is table->max + table->split - 1 */
-    long segment = (table->max + table->split - 1) / HSEGSIZE;
-    long index = (table->max + table->split - 1) % HSEGSIZE;
-
-    while (segment >= 0) {
-        while (index >= 0) {
-            for (HashList *hl = table->dir[segment][index]; hl != NULL; hl = hl->next) {
-                if (!fn(data, hl->key, hl->data)) {
-                    return;
-                }
+    for (StgWord i = 0; i < capacity(table); i++) {
+        if (isFull(table->ctrl[i])) {
+            if (!fn(data, table->slots[i].key, table->slots[i].data)) {
+                return;
             }
-            index--;
         }
-        segment--;
-        index = HSEGSIZE - 1;
+    }
+    for (HashList *hl = table->shadowed; hl != NULL; hl = hl->next) {
+        if (!fn(data, hl->key, hl->data)) {
+            return;
+        }
     }
 }
 
 /* -----------------------------------------------------------------------------
- * When we initialize a hash table, we set up the first segment as well,
- * initializing all of the first segment's hash buckets to NULL.
+ * A new hash table has room for a few entries, and grows as needed.
  * -------------------------------------------------------------------------- */
 
 HashTable *
 allocHashTable(void)
 {
     HashTable *table;
-    HashList **hb;
 
     table = stgMallocBytes(sizeof(HashTable),"allocHashTable");
 
-    allocSegment(table, 0);
-
-    for (hb = table->dir[0]; hb < table->dir[0] + HSEGSIZE; hb++)
-        *hb = NULL;
-
-    table->split = 0;
-    table->max = HSEGSIZE;
-    table->mask1 = HSEGSIZE - 1;
-    table->mask2 = 2 * HSEGSIZE - 1;
+    allocSlots(table, HMINSIZE);
     table->kcount = 0;
-    table->bcount = HSEGSIZE;
-    table->freeList = NULL;
-    table->chunks = NULL;
+    table->shadowed = NULL;
 
     return table;
 }
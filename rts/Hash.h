@@ -66,17 +66,22 @@ void *      removeStrHashTable ( StrHashTable *table, const char * key,
  * it's not guaranteed. Either way, the functions are parameters
  * as the types should be statically known and thus
  * storing them is unnecessary.
+ *
+ * A HashFunction returns a hash of the whole key, all of whose bits should
+ * be well mixed (as those of hashWord and hashBuffer are): the table uses
+ * both the low bits and the high bits. See Note [Swiss hash tables].
  */
-typedef int HashFunction(const HashTable *table, StgWord key);
+typedef StgWord HashFunction(const HashTable *table, StgWord key);
 typedef int CompareFunction(StgWord key1, StgWord key2);
 
 // Helper for implementing hash functions
-int hashBuffer(const HashTable *table, const void *buf, size_t len);
+StgWord hashBuffer(const HashTable *table, const void *buf, size_t len);
 
-int hashWord(const HashTable *table, StgWord key);
-int hashStr(const HashTable *table, StgWord w);
+StgWord hashWord(const HashTable *table, StgWord key);
+StgWord hashStr(const HashTable *table, StgWord w);
 void        insertHashTable_ ( HashTable *table, StgWord key,
-                               const void *data, HashFunction f );
+                               const void *data, HashFunction f,
+                               CompareFunction cmp );
 void *      lookupHashTable_ ( const HashTable *table, StgWord key,
                                HashFunction f, CompareFunction cmp );
 void *      removeHashTable_ ( HashTable *table, StgWord key,
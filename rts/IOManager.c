@@ -38,6 +38,16 @@
 #include "posix/Timeout.h"
 #endif
 
+#if defined(IOMGR_ENABLED_EPOLL)
+#include "posix/Epoll.h"
+#include "posix/Timeout.h"
+#endif
+
+#if defined(IOMGR_ENABLED_IOURING)
+#include "posix/IOUring.h"
+#include "posix/Timeout.h"
+#endif
+
 #if defined(IOMGR_ENABLED_MIO_POSIX)
 #include "posix/Signals.h"
 #include "Prelude.h"
@@ -125,6 +135,22 @@ parseIOManagerFlag(const char *iomgrstr, IO_MANAGER_FLAG *flag)
         return IOManagerAvailable;
 #else
         return IOManagerUnavailable;
+#endif
+    }
+    else if (strcmp("epoll", iomgrstr) == 0) {
+#if defined(IOMGR_ENABLED_EPOLL)
+        *flag = IO_MNGR_FLAG_EPOLL;
+        return IOManagerAvailable;
+#else
+        return IOManagerUnavailable;
+#endif
+    }
+    else if (strcmp("io_uring", iomgrstr) == 0) {
+#if defined(IOMGR_ENABLED_IOURING)
+        *flag = IO_MNGR_FLAG_IO_URING;
+        return IOManagerAvailable;
+#else
+        return IOManagerUnavailable;
 #endif
     }
     else if (strcmp("mio", iomgrstr) == 0) {
@@ -199,6 +225,31 @@ parseIOManagerFlag(const char *iomgrstr, IO_MANAGER_FLAG *flag)
     }
 }
 
+#if defined(IOMGR_ENABLED_IOURING)
+/* Unlike the other I/O managers, whether io_uring is usable is only known at
+ * runtime: the kernel may be too old, or io_uring may be disabled by the
+ * system administrator or a seccomp sandbox. So we check, and fall back to
+ * the poll I/O manager if it is not usable. We only warn about the fallback
+ * if the user explicitly asked for io_uring.
+ */
+static IOManagerType selectIOManagerIOUring(bool requested)
+{
+    if (probeIOManagerIOUring()) {
+        return IO_MANAGER_IOURING;
+    }
+#if defined(IOMGR_ENABLED_POLL)
+    if (requested) {
+        errorBelch("warning: the io_uring I/O manager is not available on "
+                   "this system, using the poll I/O manager instead");
+    }
+    return IO_MANAGER_POLL;
+#else
+    barf("the io_uring I/O manager is not available on this system "
+         "(requested: %s)", requested ? "yes" : "no");
+#endif
+}
+#endif
+
 /* Based on the I/O manager RTS flag, select an I/O manager to use.
  *
  * This fills in the iomgr_type and rts_IOManagerIsWin32Native globals.
@@ -228,6 +279,10 @@ void selectIOManager(void)
             iomgr_type = IO_MANAGER_SELECT;
 #elif defined(IOMGR_DEFAULT_NON_THREADED_POLL)
             iomgr_type = IO_MANAGER_POLL;
+#elif defined(IOMGR_DEFAULT_NON_THREADED_EPOLL)
+            iomgr_type = IO_MANAGER_EPOLL;
+#elif defined(IOMGR_DEFAULT_NON_THREADED_IOURING)
+            iomgr_type = selectIOManagerIOUring(false);
 #elif defined(IOMGR_DEFAULT_NON_THREADED_WINIO)
             iomgr_type = IO_MANAGER_WINIO;
 #elif defined(IOMGR_DEFAULT_NON_THREADED_WIN32_LEGACY)
@@ -250,6 +305,18 @@ void selectIOManager(void)
             break;
 #endif
 
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MNGR_FLAG_EPOLL:
+            iomgr_type = IO_MANAGER_EPOLL;
+            break;
+#endif
+
+#if defined(IOMGR_ENABLED_IOURING)
+        case IO_MNGR_FLAG_IO_URING:
+            iomgr_type = selectIOManagerIOUring(true);
+            break;
+#endif
+
 #if defined(IOMGR_ENABLED_MIO_POSIX)
         case IO_MNGR_FLAG_MIO:
             iomgr_type = IO_MANAGER_MIO_POSIX;
@@ -295,6 +362,14 @@ char * showIOManager(void)
         case IO_MANAGER_POLL:
             return "poll";
 #endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+            return "epoll";
+#endif
+#if defined(IOMGR_ENABLED_IOURING)
+        case IO_MANAGER_IOURING:
+            return "io_uring";
+#endif
 #if defined(IOMGR_ENABLED_MIO_POSIX)
         case IO_MANAGER_MIO_POSIX:
             return "mio";
@@ -348,6 +423,18 @@ void initCapabilityIOManager(Capability *cap)
             break;
 #endif
 
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+            initCapabilityIOManagerEpoll(iomgr);
+            break;
+#endif
+
+#if defined(IOMGR_ENABLED_IOURING)
+        case IO_MANAGER_IOURING:
+            initCapabilityIOManagerIOUring(iomgr);
+            break;
+#endif
+
 #if defined(IOMGR_ENABLED_WIN32_LEGACY)
         case IO_MANAGER_WIN32_LEGACY:
             iomgr->blocked_queue_hd = END_TSO_QUEUE;
@@ -376,12 +463,19 @@ void initIOManager(void)
 
     switch (iomgr_type) {
 
-#if defined(IOMGR_ENABLED_SELECT) || defined(IOMGR_ENABLED_POLL)
+#if defined(IOMGR_ENABLED_SELECT) || defined(IOMGR_ENABLED_POLL) \
+ || defined(IOMGR_ENABLED_EPOLL) || defined(IOMGR_ENABLED_IOURING)
 #if defined(IOMGR_ENABLED_SELECT)
         case IO_MANAGER_SELECT:
 #endif
 #if defined(IOMGR_ENABLED_POLL)
         case IO_MANAGER_POLL:
+#endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+#endif
+#if defined(IOMGR_ENABLED_IOURING)
+        case IO_MANAGER_IOURING:
 #endif
             /* Make the exception CAF a GC root. See initBuiltinGcRoots for
              * similar examples. We throw this exception if a thread tries to
@@ -454,6 +548,18 @@ initIOManagerAfterFork(Capability **pcap)
              */
             ioManagerStartCap(pcap);
             break;
+#endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+            /* The child must not share the epoll instance with the parent */
+            initIOManagerAfterForkEpoll((*pcap)->iomgr);
+            break;
+#endif
+#if defined(IOMGR_ENABLED_IOURING)
+        case IO_MANAGER_IOURING:
+            /* The child must not share the ring with the parent */
+            initIOManagerAfterForkIOUring((*pcap)->iomgr);
+            break;
 #endif
         /* The IO_MANAGER_SELECT needs no initialisation */
         /* The IO_MANAGER_POLL needs no initialisation */
@@ -530,6 +636,27 @@ exitIOManager(bool wait_threads)
         case IO_MANAGER_WIN32_LEGACY:
             shutdownAsyncIO(wait_threads);
             break;
+#endif
+#if defined(IOMGR_ENABLED_POLL)
+        case IO_MANAGER_POLL:
+            for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+                exitCapabilityTimeouts(getCapability(i)->iomgr);
+            }
+            break;
+#endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+            for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+                exitCapabilityIOManagerEpoll(getCapability(i)->iomgr);
+            }
+            break;
+#endif
+#if defined(IOMGR_ENABLED_IOURING)
+        case IO_MANAGER_IOURING:
+            for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+                exitCapabilityIOManagerIOUring(getCapability(i)->iomgr);
+            }
+            break;
 #endif
         default:
             break;
@@ -586,12 +713,21 @@ void markCapabilityIOManager(evac_fn evac, void *user, Capability *cap)
         }
 #endif
 
+#if defined(IOMGR_ENABLED_POLL) || defined(IOMGR_ENABLED_EPOLL) \
+ || defined(IOMGR_ENABLED_IOURING)
 #if defined(IOMGR_ENABLED_POLL)
         case IO_MANAGER_POLL:
+#endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+#endif
+#if defined(IOMGR_ENABLED_IOURING)
+        case IO_MANAGER_IOURING:
+#endif
         {
             CapIOManager *iomgr = cap->iomgr;
             markClosureTable(evac, user, &iomgr->aiop_table);
-            evac(user, (StgClosure **)(void *)&iomgr->timeout_queue);
+            markCapabilityTimeouts(evac, user, iomgr);
             break;
         }
 #endif
@@ -621,8 +757,17 @@ void scavengeTSOIOManager(StgTSO *tso)
              * both of these are not GC pointers, so there is nothing to do.
              */
 
+#if defined(IOMGR_ENABLED_POLL) || defined(IOMGR_ENABLED_EPOLL) \
+ || defined(IOMGR_ENABLED_IOURING)
 #if defined(IOMGR_ENABLED_POLL)
         case IO_MANAGER_POLL:
+#endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+#endif
+#if defined(IOMGR_ENABLED_IOURING)
+        case IO_MANAGER_IOURING:
+#endif
             /* BlockedOn{Read,Write} uses block_info.aiop
              * BlockedOnDelay        uses block_info.timeout
              * both of these are heap allocated, so we can do the same in all
@@ -682,6 +827,16 @@ bool anyPendingTimeoutsOrIO(Capability *cap)
             return anyPendingTimeoutsOrIOPoll(cap->iomgr);
 #endif
 
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+            return anyPendingTimeoutsOrIOEpoll(cap->iomgr);
+#endif
+
+#if defined(IOMGR_ENABLED_IOURING)
+        case IO_MANAGER_IOURING:
+            return anyPendingTimeoutsOrIOIOUring(cap->iomgr);
+#endif
+
 #if defined(IOMGR_ENABLED_WIN32_LEGACY)
         case IO_MANAGER_WIN32_LEGACY:
         {
@@ -745,6 +900,18 @@ void pollCompletedTimeoutsOrIO(Capability *cap)
           break;
 #endif
 
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+          pollCompletedTimeoutsOrIOEpoll(cap);
+          break;
+#endif
+
+#if defined(IOMGR_ENABLED_IOURING)
+        case IO_MANAGER_IOURING:
+          pollCompletedTimeoutsOrIOIOUring(cap);
+          break;
+#endif
+
 #if defined(IOMGR_ENABLED_WIN32_LEGACY) || \
    (defined(IOMGR_ENABLED_WINIO) && !defined(THREADED_RTS))
 #if defined(IOMGR_ENABLED_WIN32_LEGACY)
@@ -778,6 +945,18 @@ void awaitCompletedTimeoutsOrIO(Capability *cap)
           break;
 #endif
 
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+          awaitCompletedTimeoutsOrIOEpoll(cap);
+          break;
+#endif
+
+#if defined(IOMGR_ENABLED_IOURING)
+        case IO_MANAGER_IOURING:
+          awaitCompletedTimeoutsOrIOIOUring(cap);
+          break;
+#endif
+
 #if defined(IOMGR_ENABLED_WIN32_LEGACY) || \
    (defined(IOMGR_ENABLED_WINIO) && !defined(THREADED_RTS))
 #if defined(IOMGR_ENABLED_WIN32_LEGACY)
@@ -820,6 +999,14 @@ bool syncIOWaitReady(Capability   *cap,
         case IO_MANAGER_POLL:
             ASSERT(tso->why_blocked == NotBlocked);
             return syncIOWaitReadyPoll(cap, tso, rw, fd);
+#endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+            return syncIOWaitReadyEpoll(cap, tso, rw, fd);
+#endif
+#if defined(IOMGR_ENABLED_IOURING)
+        case IO_MANAGER_IOURING:
+            return syncIOWaitReadyIOUring(cap, tso, rw, fd);
 #endif
         default:
             barf("waitRead# / waitWrite# not available for current I/O manager");
@@ -842,6 +1029,16 @@ void syncIOCancel(Capability *cap, StgTSO *tso)
             syncIOCancelPoll(cap, tso);
             break;
 #endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+            syncIOCancelEpoll(cap, tso);
+            break;
+#endif
+#if defined(IOMGR_ENABLED_IOURING)
+        case IO_MANAGER_IOURING:
+            syncIOCancelIOUring(cap, tso);
+            break;
+#endif
 #if defined(IOMGR_ENABLED_WIN32_LEGACY)
         case IO_MANAGER_WIN32_LEGACY:
             removeThreadFromDeQueue(cap, &cap->iomgr->blocked_queue_hd,
@@ -879,6 +1076,14 @@ bool syncDelay(Capability *cap, StgTSO *tso, HsInt us_delay)
         case IO_MANAGER_POLL:
             return syncDelayTimeout(cap, tso, us_delay);
 #endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+            return syncDelayTimeout(cap, tso, us_delay);
+#endif
+#if defined(IOMGR_ENABLED_IOURING)
+        case IO_MANAGER_IOURING:
+            return syncDelayTimeout(cap, tso, us_delay);
+#endif
 #if defined(IOMGR_ENABLED_WIN32_LEGACY)
         case IO_MANAGER_WIN32_LEGACY:
             /* It would be nice to allocate this on the heap instead as it
@@ -920,6 +1125,16 @@ void syncDelayCancel(Capability *cap, StgTSO *tso)
         case IO_MANAGER_POLL:
             syncDelayCancelTimeout(cap, tso);
             break;
+#endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+            syncDelayCancelTimeout(cap, tso);
+            break;
+#endif
+#if defined(IOMGR_ENABLED_IOURING)
+        case IO_MANAGER_IOURING:
+            syncDelayCancelTimeout(cap, tso);
+            break;
 #endif
         /* Note: no case for IO_MANAGER_WIN32_LEGACY despite it having a case
          * for syncDelay above. This is because the win32 legacy I/O manager
@@ -46,6 +46,12 @@
 #if defined(IOMGR_BUILD_POLL) && !defined(THREADED_RTS)
     #define IOMGR_ENABLED_POLL
 #endif
+#if defined(IOMGR_BUILD_EPOLL) && !defined(THREADED_RTS)
+    #define IOMGR_ENABLED_EPOLL
+#endif
+#if defined(IOMGR_BUILD_IOURING) && !defined(THREADED_RTS)
+    #define IOMGR_ENABLED_IOURING
+#endif
 #if defined(IOMGR_BUILD_MIO) && defined(THREADED_RTS)
 /* For MIO, it is really two separate I/O manager implementations: one for
  * Windows and one for non-Windows. This is clear from both the C code on the
@@ -87,6 +93,10 @@
     #define IOMGR_DEFAULT_STR "select"
 #elif defined(IOMGR_DEFAULT_NON_THREADED_POLL)
     #define IOMGR_DEFAULT_STR "poll"
+#elif defined(IOMGR_DEFAULT_NON_THREADED_EPOLL)
+    #define IOMGR_DEFAULT_STR "epoll"
+#elif defined(IOMGR_DEFAULT_NON_THREADED_IOURING)
+    #define IOMGR_DEFAULT_STR "io_uring"
 #elif defined(IOMGR_DEFAULT_NON_THREADED_WINIO)
     #define IOMGR_DEFAULT_STR "winio"
 #elif defined(IOMGR_DEFAULT_NON_THREADED_WIN32_LEGACY)
@@ -110,6 +120,16 @@
 #else
     #define IOMGR_ENABLED_STR_POLL ""
 #endif
+#if defined(IOMGR_ENABLED_EPOLL)
+    #define IOMGR_ENABLED_STR_EPOLL " epoll"
+#else
+    #define IOMGR_ENABLED_STR_EPOLL ""
+#endif
+#if defined(IOMGR_ENABLED_IOURING)
+    #define IOMGR_ENABLED_STR_IOURING " io_uring"
+#else
+    #define IOMGR_ENABLED_STR_IOURING ""
+#endif
 #if defined(IOMGR_ENABLED_MIO_POSIX) || defined(IOMGR_ENABLED_MIO_WIN32)
     #define IOMGR_ENABLED_STR_MIO " mio"
 #else
@@ -128,6 +148,8 @@
 #define IOMGRS_ENABLED_STR \
           IOMGR_ENABLED_STR_SELECT \
           IOMGR_ENABLED_STR_POLL \
+          IOMGR_ENABLED_STR_EPOLL \
+          IOMGR_ENABLED_STR_IOURING \
           IOMGR_ENABLED_STR_MIO \
           IOMGR_ENABLED_STR_WINIO \
           IOMGR_ENABLED_STR_WIN32_LEGACY
@@ -143,6 +165,12 @@ typedef enum {
 #if defined(IOMGR_ENABLED_POLL)
     IO_MANAGER_POLL,
 #endif
+#if defined(IOMGR_ENABLED_EPOLL)
+    IO_MANAGER_EPOLL,
+#endif
+#if defined(IOMGR_ENABLED_IOURING)
+    IO_MANAGER_IOURING,
+#endif
 #if defined(IOMGR_ENABLED_MIO_POSIX)
     IO_MANAGER_MIO_POSIX,
 #endif
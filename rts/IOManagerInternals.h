@@ -16,8 +16,13 @@
 
 #if defined(IOMGR_ENABLED_POLL)
 #include <poll.h> /* for struct pollfd */
+#endif
+
+#if defined(IOMGR_ENABLED_POLL) || defined(IOMGR_ENABLED_EPOLL) \
+ || defined(IOMGR_ENABLED_IOURING)
 #include "ClosureTable.h"
 #include "TimeoutQueue.h"
+#include "TimerWheel.h"
 #endif
 
 #include "BeginPrivate.h"
@@ -42,10 +47,15 @@ struct _CapIOManager {
     StgTSO *sleeping_queue;
 #endif
 
-#if defined(IOMGR_ENABLED_POLL)
-    /* AIOP and timeout collections shared by several I/O manager impls */
+#if defined(IOMGR_ENABLED_POLL) || defined(IOMGR_ENABLED_EPOLL) \
+ || defined(IOMGR_ENABLED_IOURING)
+    /* AIOP and timeout collections shared by several I/O manager impls.
+     * Timeouts are in either the timeout_queue or the timer_wheel (when not
+     * NULL), depending on the --io-manager-timers RTS flag.
+     */
     ClosureTable     aiop_table;
     StgTimeoutQueue *timeout_queue;
+    TimerWheel      *timer_wheel;
 #endif
 
 #if defined(IOMGR_ENABLED_POLL)
@@ -53,6 +63,30 @@ struct _CapIOManager {
     struct pollfd *aiop_poll_table;
 #endif
 
+#if defined(IOMGR_ENABLED_EPOLL)
+    /* The epoll instance (an fd) for this capability */
+    int epoll_fd;
+
+    /* Auxiliary table with size and indexes matching the aiop_table */
+    struct EpollWaiter *aiop_epoll_table;
+
+    /* Table indexed by fd, of the aiops waiting on each fd */
+    struct EpollFdState *epoll_fd_table;
+    int epoll_fd_table_size;
+
+    /* List of aiops to complete without waiting, e.g. for bad fds */
+    int epoll_immediate_hd;
+
+    /* Buffer for the results of epoll_wait() */
+    struct epoll_event *epoll_events;
+#endif
+
+#if defined(IOMGR_ENABLED_IOURING)
+    /* The io_uring instance for this capability, including its auxiliary
+     * table with size and indexes matching the aiop_table */
+    struct IOURing *uring;
+#endif
+
 #if defined(IOMGR_ENABLED_WIN32_LEGACY)
     /* Thread queue for threads blocked on I/O completion. */
     StgTSO *blocked_queue_hd;
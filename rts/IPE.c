@@ -11,13 +11,13 @@
 #include "Rts.h"
 
 #include "Capability.h"
-#include "Hash.h"
 #include "IPE.h"
 #include "Printer.h"
 #include "Profiling.h"
 #include "RtsUtils.h"
 
 #include <fs_rts.h>
+#include <stdlib.h>
 #include <string.h>
 
 #if HAVE_LIBZSTD == 1
@@ -31,12 +31,12 @@
 /*
 Note [The Info Table Provenance Entry (IPE) Map]
 ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-IPEs are stored in a hash map from info table address (pointer) to IPE. This
-ensures cheap lookup and traversal.
+IPEs are found by info table address (pointer) in an index of the lists of
+IPEs that the code generator emits, described below.
 
-Unfortunately, inserting into the hash map is relatively expensive. To keep
-startup times low, there's a temporary data structure that is optimized for
-collecting IPE lists on registration.
+Building an index is relatively expensive. To keep startup times low, there's
+a temporary data structure that is optimized for collecting IPE lists on
+registration.
 
 It's a singly linked list of IPE list buffers (IpeBufferListNode). These are
 emitted by the code generator, with generally one produced per module. Each
@@ -54,13 +54,34 @@ string table. This allows us to halve the size of the buffer entries on
 relocations, reducing linking cost. Moreover, the code generator takes care
 to deduplicate strings when generating the string table.
 
-Building the hash map is done lazily, i.e. on first lookup or traversal. For
-this all IPE lists of all IpeBufferListNode are traversed to insert all IPEs.
-This involves allocating a IpeMapEntry for each IPE entry, pointing to the
-entry's containing IpeBufferListNode and its index in that node.
-
-When the user looks up an IPE entry, we convert it to the user-facing
-InfoProvEnt representation.
+Building the index is done lazily, i.e. on first lookup or traversal, and
+only does as much work as it must, as binaries built with -finfo-table-map may
+have millions of IPEs:
+
+ * updateIpeMap adds the pending nodes to the index, an array of the nodes
+   (IpeNodeRange) sorted by the lowest address of their info tables. Each
+   also records the highest address of its info tables, so that a lookup can
+   find the nodes whose range of addresses contains an info table by binary
+   search. The ranges of the nodes of different modules usually don't
+   overlap, but may (e.g. when the linker reorders sections), so we also
+   record for each node the highest address of the nodes up to it, to know
+   how far back to look (see findIpe).
+
+ * The info tables of a node are often in address order already, in which
+   case we find an info table in the node by binary search in
+   node->tables. Otherwise, the first lookup that falls inside the node
+   sorts a copy of its info tables (see nodeSortedTables).
+
+ * The entries and string table of a node are only decompressed when we
+   first convert one of its entries to the user-facing InfoProvEnt
+   representation, which lookupIPEId never needs to.
+
+When new nodes are registered, updateIpeMap builds a new index rather than
+modifying the current one, so that lookups don't need to take ipeMapLock,
+and parallel heap census threads can look up info tables concurrently (see
+Note [Parallel heap census] in ProfHeap.c). Replaced indices are only freed
+by exitIpe, as a lookup may still be using them; they are small, having an
+entry per module rather than per IPE.
 
 Note [Stable identifiers for IPE entries]
 ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -80,23 +101,46 @@ The unique key can be computed by using the `IPE_ENTRY_KEY` macro.
 
 */
 
+// An info table of a node whose info tables are not in address order, along
+// with its index in the node.
 typedef struct {
-    IpeBufferListNode *node;
+    const StgInfoTable *info;
     uint32_t idx;
-} IpeMapEntry;
+} IpeSortedTable;
 
-// See Note [Stable identifiers for IPE entries]
-#define IPE_ENTRY_KEY(entry) \
-    MAKE_IPE_KEY((entry).node->node_id, (entry).idx)
+typedef struct {
+    IpeBufferListNode *node;
+    // The lowest and highest addresses of the node's info tables
+    const StgInfoTable *lo, *hi;
+    // Whether node->tables is in address order
+    bool sorted;
+    // If not, a sorted copy of node->tables, made on the first lookup that
+    // falls inside the node. Accessed atomically.
+    IpeSortedTable *sorted_tables;
+} IpeNodeRange;
+
+typedef struct IpeIndex_ {
+    // The previous index, replaced by this one. See Note [The Info Table
+    // Provenance Entry (IPE) Map].
+    struct IpeIndex_ *prev;
+    uint32_t n_nodes;
+    struct {
+        IpeNodeRange *range;
+        // The highest address of the info tables of this node and the ones
+        // before it
+        const StgInfoTable *max_hi;
+    } nodes[]; // sorted by range->lo
+} IpeIndex;
 
+// See Note [Stable identifiers for IPE entries]
 #define MAKE_IPE_KEY(module_id, idx) \
     ((((uint64_t)(module_id)) << 32) | ((uint64_t)(idx)))
 
 #if defined(THREADED_RTS)
 static Mutex ipeMapLock;
 #endif
-// Protected by ipeMapLock
-static HashTable *ipeMap = NULL;
+// Written with ipeMapLock held, read atomically
+static IpeIndex *ipeIndex = NULL;
 
 // Accessed atomically
 static IpeBufferListNode *ipeBufferList = NULL;
@@ -105,7 +149,6 @@ static IpeBufferListNode *ipeBufferList = NULL;
 static StgWord next_module_id = 1; // Start at 1 to reserve 0 as "invalid"
 
 static void decompressIPEBufferListNodeIfCompressed(IpeBufferListNode*);
-static void updateIpeMap(void);
 
 // Check whether the IpeBufferListNode has the relevant magic words.
 // See Note [IPE Stripping and magic words]
@@ -117,17 +160,38 @@ static inline bool ipe_node_valid(const IpeBufferListNode *node) {
            node->string_table_block->magic == IPE_MAGIC_WORD;
 }
 
+static void freeIpeIndex(void)
+{
+    IpeIndex *index = ipeIndex;
+    if (index != NULL) {
+        // The ranges of the current index include those of the previous ones
+        for (uint32_t i = 0; i < index->n_nodes; i++) {
+            IpeNodeRange *range = index->nodes[i].range;
+            if (range->sorted_tables != NULL) {
+                stgFree(range->sorted_tables);
+            }
+            stgFree(range);
+        }
+    }
+    while (index != NULL) {
+        IpeIndex *prev = index->prev;
+        stgFree(index);
+        index = prev;
+    }
+    ipeIndex = NULL;
+}
+
 #if defined(THREADED_RTS)
 
 void initIpe(void) { initMutex(&ipeMapLock); }
 
-void exitIpe(void) { closeMutex(&ipeMapLock); }
+void exitIpe(void) { freeIpeIndex(); closeMutex(&ipeMapLock); }
 
 #else
 
 void initIpe(void) { }
 
-void exitIpe(void) { }
+void exitIpe(void) { freeIpeIndex(); }
 
 #endif // THREADED_RTS
 
@@ -155,15 +219,6 @@ static InfoProvEnt ipeBufferEntryToIpe(const IpeBufferListNode *node, uint32_t i
 
 
 #if defined(TRACING)
-static void traceIPEFromHashTable(void *data STG_UNUSED, StgWord key STG_UNUSED,
-                                  const void *value) {
-    const IpeMapEntry *map_ent = (const IpeMapEntry *)value;
-    if (ipe_node_valid(map_ent->node)){
-      const InfoProvEnt ipe = ipeBufferEntryToIpe(map_ent->node, map_ent->idx);
-      traceIPE(&ipe);
-    }
-}
-
 void dumpIPEToEventLog(void) {
     // Dump pending entries
     IpeBufferListNode *node = RELAXED_LOAD(&ipeBufferList);
@@ -179,10 +234,19 @@ void dumpIPEToEventLog(void) {
         node = node->next;
     }
 
-    // Dump entries already in hashmap
+    // Dump entries already in the index
     ACQUIRE_LOCK(&ipeMapLock);
-    if (ipeMap != NULL) {
-        mapHashTable(ipeMap, NULL, &traceIPEFromHashTable);
+    IpeIndex *index = ipeIndex;
+    for (uint32_t n = 0; index != NULL && n < index->n_nodes; n++) {
+        IpeBufferListNode *node = index->nodes[n].range->node;
+        if (ipe_node_valid(node)) {
+            decompressIPEBufferListNodeIfCompressed(node);
+
+            for (uint32_t i = 0; i < node->count; i++) {
+                const InfoProvEnt ent = ipeBufferEntryToIpe(node, i);
+                traceIPE(&ent);
+            }
+        }
     }
     RELEASE_LOCK(&ipeMapLock);
 }
@@ -240,11 +304,124 @@ void formatClosureDescIpe(const InfoProvEnt *ipe_buf, char *str_buf) {
     snprintf(str_buf, CLOSURE_DESC_BUFFER_SIZE, "%u", ipe_buf->prov.closure_desc);
 }
 
+static int cmpSortedTable(const void *a, const void *b)
+{
+    const StgInfoTable *x = ((const IpeSortedTable *) a)->info;
+    const StgInfoTable *y = ((const IpeSortedTable *) b)->info;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// The info tables of a node whose node->tables is not in address order,
+// sorted, made on first use. See Note [The Info Table Provenance Entry (IPE)
+// Map].
+static IpeSortedTable *nodeSortedTables(IpeNodeRange *range)
+{
+    IpeSortedTable *tables = ACQUIRE_LOAD(&range->sorted_tables);
+    if (tables != NULL) {
+        return tables;
+    }
+
+    const IpeBufferListNode *node = range->node;
+    tables = stgMallocBytes(node->count * sizeof(IpeSortedTable),
+                            "nodeSortedTables");
+    for (uint32_t i = 0; i < node->count; i++) {
+        tables[i].info = node->tables[i];
+        tables[i].idx = i;
+    }
+    qsort(tables, node->count, sizeof(IpeSortedTable), cmpSortedTable);
+
+    // Another thread may have beaten us to it
+    IpeSortedTable *old = cas_ptr((volatile void **) &range->sorted_tables,
+                                  NULL, tables);
+    if (old != NULL) {
+        stgFree(tables);
+        return old;
+    }
+    return tables;
+}
+
+// Find the index of an info table in a node, or return false.
+static bool findIpeInNode(IpeNodeRange *range, const StgInfoTable *info,
+                          uint32_t *idx)
+{
+    const IpeBufferListNode *node = range->node;
+    uint32_t lo = 0, hi = node->count;
+
+    if (range->sorted) {
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (node->tables[mid] < info) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo < node->count && node->tables[lo] == info) {
+            *idx = lo;
+            return true;
+        }
+    } else {
+        const IpeSortedTable *tables = nodeSortedTables(range);
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (tables[mid].info < info) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo < node->count && tables[lo].info == info) {
+            *idx = tables[lo].idx;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Find the node and index of the IPE of an info table, or return false.
+static bool findIpe(const StgInfoTable *info, IpeBufferListNode **node,
+                    uint32_t *idx)
+{
+    const IpeIndex *index = ACQUIRE_LOAD(&ipeIndex);
+    if (index == NULL) {
+        return false;
+    }
+
+    // Find the nodes whose lowest address is at most info
+    uint32_t lo = 0, hi = index->n_nodes;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (index->nodes[mid].range->lo <= info) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // Of those, look in the ones whose highest address is at least info,
+    // starting with the closest. None of the nodes before the first whose
+    // max_hi is below info can contain it.
+    for (uint32_t n = lo; n > 0 && index->nodes[n-1].max_hi >= info; n--) {
+        IpeNodeRange *range = index->nodes[n-1].range;
+        if (range->hi >= info && findIpeInNode(range, info, idx)) {
+            *node = range->node;
+            return true;
+        }
+    }
+    return false;
+}
+
 bool lookupIPE(const StgInfoTable *info, InfoProvEnt *out) {
     updateIpeMap();
-    IpeMapEntry *map_ent = (IpeMapEntry *) lookupHashTable(ipeMap, (StgWord)info);
-    if (map_ent && ipe_node_valid(map_ent->node)) {
-        *out = ipeBufferEntryToIpe(map_ent->node, map_ent->idx);
+    IpeBufferListNode *node;
+    uint32_t idx;
+    if (findIpe(info, &node, &idx) && ipe_node_valid(node)) {
+        if (ACQUIRE_LOAD(&node->compressed)) {
+            ACQUIRE_LOCK(&ipeMapLock);
+            decompressIPEBufferListNodeIfCompressed(node);
+            RELEASE_LOCK(&ipeMapLock);
+        }
+        *out = ipeBufferEntryToIpe(node, idx);
         return true;
     } else {
         return false;
@@ -255,45 +432,80 @@ bool lookupIPE(const StgInfoTable *info, InfoProvEnt *out) {
 // See Note [Stable identifiers for IPE entries]
 uint64_t lookupIPEId(const StgInfoTable *info) {
     updateIpeMap();
-    IpeMapEntry *map_ent = (IpeMapEntry *) lookupHashTable(ipeMap, (StgWord)(info));
-    if (map_ent){
-        return IPE_ENTRY_KEY(*map_ent);
+    IpeBufferListNode *node;
+    uint32_t idx;
+    if (findIpe(info, &node, &idx)) {
+        return MAKE_IPE_KEY(node->node_id, idx);
     } else {
         return 0;
     }
 }
 
+static int cmpNodeRange(const void *a, const void *b)
+{
+    const StgInfoTable *x = (*(IpeNodeRange * const *) a)->lo;
+    const StgInfoTable *y = (*(IpeNodeRange * const *) b)->lo;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
 void updateIpeMap(void) {
     // Check if there's any work at all. If not so, we can circumvent locking,
     // which decreases performance.
     IpeBufferListNode *pending = xchg_ptr((void **) &ipeBufferList, NULL);
-    if (ipeMap != NULL && pending == NULL) {
+    if (pending == NULL) {
         return;
     }
 
     ACQUIRE_LOCK(&ipeMapLock);
 
-    if (ipeMap == NULL) {
-        ipeMap = allocHashTable();
+    IpeIndex *old = ipeIndex;
+    uint32_t n_old = old != NULL ? old->n_nodes : 0;
+    uint32_t n_pending = 0;
+    for (IpeBufferListNode *node = pending; node != NULL; node = node->next) {
+        n_pending++;
     }
 
-    while (pending != NULL) {
-        IpeBufferListNode *node = pending;
-
-        // Decompress if compressed
-        decompressIPEBufferListNodeIfCompressed(node);
-
-        // Insert entries into ipeMap
-        IpeMapEntry *map_ents = stgMallocBytes(node->count * sizeof(IpeMapEntry), "updateIpeMap: ip_ents");
-        for (uint32_t i = 0; i < node->count; i++) {
+    // The ranges of the old and pending nodes, which we sort by their lowest
+    // address. Nodes without entries are left out.
+    IpeNodeRange **ranges = stgMallocBytes((n_old + n_pending) * sizeof(IpeNodeRange *),
+                                           "updateIpeMap: ranges");
+    uint32_t n_nodes = 0;
+    for (uint32_t i = 0; i < n_old; i++) {
+        ranges[n_nodes++] = old->nodes[i].range;
+    }
+    for (IpeBufferListNode *node = pending; node != NULL; node = node->next) {
+        if (node->count == 0) {
+            continue;
+        }
+        IpeNodeRange *range = stgMallocBytes(sizeof(IpeNodeRange),
+                                             "updateIpeMap: range");
+        range->node = node;
+        range->lo = range->hi = node->tables[0];
+        range->sorted = true;
+        range->sorted_tables = NULL;
+        for (uint32_t i = 1; i < node->count; i++) {
             const StgInfoTable *tbl = node->tables[i];
-            map_ents[i].node = node;
-            map_ents[i].idx = i;
-            insertHashTable(ipeMap, (StgWord) tbl, &map_ents[i]);
+            if (tbl < node->tables[i-1]) range->sorted = false;
+            if (tbl < range->lo) range->lo = tbl;
+            if (tbl > range->hi) range->hi = tbl;
         }
-
-        pending = node->next;
+        ranges[n_nodes++] = range;
     }
+    qsort(ranges, n_nodes, sizeof(IpeNodeRange *), cmpNodeRange);
+
+    IpeIndex *index = stgMallocBytes(sizeof(IpeIndex) + n_nodes * sizeof(index->nodes[0]),
+                                     "updateIpeMap: index");
+    index->prev = old;
+    index->n_nodes = n_nodes;
+    const StgInfoTable *max_hi = NULL;
+    for (uint32_t i = 0; i < n_nodes; i++) {
+        if (ranges[i]->hi > max_hi) max_hi = ranges[i]->hi;
+        index->nodes[i].range = ranges[i];
+        index->nodes[i].max_hi = max_hi;
+    }
+    stgFree(ranges);
+
+    RELEASE_STORE(&ipeIndex, index);
 
     RELEASE_LOCK(&ipeMapLock);
 }
@@ -304,7 +516,6 @@ void updateIpeMap(void) {
  */
 void decompressIPEBufferListNodeIfCompressed(IpeBufferListNode *node) {
     if (node->compressed == 1) {
-        node->compressed = 0;
 
         // The IPE list buffer node indicates that the strings table and
         // entries list has been compressed. If zstd is not available, fail.
@@ -350,6 +561,8 @@ void decompressIPEBufferListNodeIfCompressed(IpeBufferListNode *node) {
         node->entries_block = decompressed_entries;
 #endif // HAVE_LIBZSTD == 0
 
+        // Lookups check this without ipeMapLock, so it must be cleared last
+        RELEASE_STORE(&node->compressed, 0);
     }
 }
 
@@ -17,4 +17,9 @@ void dumpIPEToEventLog(void);
 void initIpe(void);
 void exitIpe(void);
 
+// Add any newly registered IPE entries to the index.  Lookups do this
+// themselves; it is exported so that a lookup from several threads at once
+// (e.g. a parallel heap census) can be preceded by the only update.
+void updateIpeMap(void);
+
 #include "EndPrivate.h"
@@ -65,6 +65,7 @@
 
 #if defined(OBJFORMAT_ELF)
 #  include "linker/Elf.h"
+#  include "linker/ArchiveIndex.h"
 #  include <regex.h>    // regex is already used by dlopen() so this is OK
                         // to use here without requiring an additional lib
 #elif defined(OBJFORMAT_PEi386)
@@ -934,6 +935,13 @@ SymbolAddr* loadSymbol(SymbolName *lbl, RtsSymbolInfo *pinfo) {
     /* Symbol can be found during linking, but hasn't been relocated. Do so now.
         See Note [runtime-linker-phases] */
     if (oc && lbl && oc->status == OBJECT_LOADED) {
+#if defined(OBJFORMAT_ELF)
+        /* The symbol came from an archive's symbol index, so we have yet to
+           read the object. See Note [Archive symbol index] */
+        if (oc->lazy && !loadLazyArchiveMember(oc)) {
+            return NULL;
+        }
+#endif
         oc->status = OBJECT_NEEDED;
         IF_DEBUG(linker, debugBelch("lookupSymbol: on-demand "
                                     "loading symbol '%s'\n", lbl));
@@ -1273,6 +1281,8 @@ mkOc( ObjectType type, pathchar *path, char *image, int imageSize,
    }
 
    oc->fileSize          = imageSize;
+   oc->lazy              = false;
+   oc->archiveOffset     = 0;
    oc->n_symbols         = 0;
    oc->symbols           = NULL;
    oc->n_sections        = 0;
@@ -1506,6 +1516,22 @@ HsInt loadObj (pathchar *path)
 }
 
 HsInt loadOc (ObjectCode* oc)
+{
+   return prepareOc(oc) && finishLoadOc(oc);
+}
+
+/* -----------------------------------------------------------------------------
+ * The first part of loadOc: verify the image, and do as much of the work of
+ * loading it as possible without touching the linker's global state. On ELF
+ * that includes mapping the sections and collecting the symbols; the other
+ * object formats still do that in finishLoadOc.
+ *
+ * This does not need linker_mutex, so archive members can be prepared in
+ * parallel; see Note [Parallel archive loading] in rts/linker/LoadArchive.c.
+ *
+ * Returns: 1 if ok, 0 on error.
+ */
+HsInt prepareOc (ObjectCode* oc)
 {
    int r;
 
@@ -1561,9 +1587,33 @@ HsInt loadOc (ObjectCode* oc)
 #  endif
 #endif
 
-   /* build the symbol list for this image */
 #  if defined(OBJFORMAT_ELF)
+   /* map the sections and collect the symbols of this image */
    r = ocGetNames_ELF ( oc );
+   if (!r) {
+       IF_DEBUG(linker, ocDebugBelch(oc, "ocGetNames_ELF failed\n"));
+       return r;
+   }
+#  endif
+
+   return 1;
+}
+
+/* -----------------------------------------------------------------------------
+ * The second part of loadOc: add the symbols of a prepared ObjectCode to the
+ * global symbol table.
+ *
+ * Returns: 1 if ok, 0 on error.
+ */
+HsInt finishLoadOc (ObjectCode* oc)
+{
+   int r;
+
+   ASSERT_LOCK_HELD(&linker_mutex);
+
+   /* build the symbol list for this image */
+#  if defined(OBJFORMAT_ELF)
+   r = ocInsertSymbols_ELF ( oc );
 #  elif defined(OBJFORMAT_PEi386)
    r = ocGetNames_PEi386 ( oc );
 #  elif defined(OBJFORMAT_MACHO)
@@ -246,6 +246,14 @@ struct _ObjectCode {
      */
     pathchar*      archiveMemberName;
 
+    /* True for a member of an archive whose symbols were taken from the
+     * archive's symbol index, and whose image has not been read yet; its
+     * image is at archiveOffset in the archive. See Note [Archive symbol
+     * index] in rts/linker/ArchiveIndex.c.
+     */
+    bool           lazy;
+    StgWord64      archiveOffset;
+
     /* An array containing ptrs to all the symbol names copied from
        this object into the global symbol hash table.  This is so that
        we know which parts of the latter mapping to nuke when this
@@ -486,6 +494,8 @@ HsInt isAlreadyLoaded( pathchar *path );
 OStatus getObjectLoadStatus_ (pathchar *path);
 ObjectCode *lookupObjectByPath(pathchar *path);
 HsInt loadOc( ObjectCode* oc );
+HsInt prepareOc( ObjectCode* oc );
+HsInt finishLoadOc( ObjectCode* oc );
 ObjectCode* mkOc( ObjectType type, pathchar *path, char *image, int imageSize,
                   bool mapped, pathchar *archiveMemberName,
                   int misalignment
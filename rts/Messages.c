@@ -23,9 +23,39 @@
 
 #if defined(THREADED_RTS)
 
+/* Note [Lock-free capability inbox]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   cap->inbox is a multi-producer/single-consumer stack of Messages.
+   Senders push onto it with a CAS on the head, and the owner of the
+   Capability takes the whole stack at once with an atomic exchange
+   (scheduleProcessInbox()).  Since the consumer never pops individual
+   messages there is no ABA problem, and neither side needs cap->lock,
+   which used to be a point of contention in programs that send a lot of
+   messages (throwTo, MVar wakeups, blackholes).
+
+   We must still ensure that a Capability never goes idle while its
+   inbox is non-empty.  The sender whose message makes the inbox go from
+   empty to non-empty is responsible for waking the Capability: it takes
+   cap->lock, and either hands the Capability to a worker if it is free,
+   or interrupts it if it is running.  Other senders know that the
+   Capability has yet to drain the inbox, and has been or is about to be
+   woken, so they need do nothing more.  This is race-free because
+   releaseCapability_() checks the inbox with cap->lock held:
+
+     - if the sender takes cap->lock first, releaseCapability_() sees the
+       message (the CAS happens before the sender releases the lock);
+     - otherwise the sender sees running_task == NULL and hands the
+       Capability to a worker.
+
+   cap->putMVars are allocated with malloc() rather than on the heap, so
+   they are still kept on a separate list protected by cap->lock.
+
+   See also Note [Heap memory barriers], section "Barriers on Messages".
+*/
+
 void sendMessage(Capability *from_cap, Capability *to_cap, Message *msg)
 {
-    ACQUIRE_LOCK(&to_cap->lock);
+    Message *head;
 
 #if defined(DEBUG)
     {
@@ -41,11 +71,23 @@ void sendMessage(Capability *from_cap, Capability *to_cap, Message *msg)
     }
 #endif
 
-    msg->link = to_cap->inbox;
-    RELAXED_STORE(&to_cap->inbox, msg);
+    // See Note [Lock-free capability inbox]
+    do {
+        head = RELAXED_LOAD(&to_cap->inbox);
+        msg->link = head;
+    } while (cas((StgVolatilePtr)&to_cap->inbox, (StgWord)head, (StgWord)msg)
+             != (StgWord)head);
 
     recordClosureMutated(from_cap,(StgClosure*)msg);
 
+    // Someone else has already woken up to_cap for the messages that
+    // are ahead of us in the inbox.
+    if (head != (Message*)END_TSO_QUEUE) {
+        return;
+    }
+
+    ACQUIRE_LOCK(&to_cap->lock);
+
     if (to_cap->running_task == NULL) {
         to_cap->running_task = myTask();
             // precond for releaseCapability_()
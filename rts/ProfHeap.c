@@ -23,6 +23,7 @@
 #include "Printer.h"
 #include "Trace.h"
 #include "sm/GCThread.h"
+#include "sm/GC.h"
 #include "IPE.h"
 
 #include <fs_rts.h>
@@ -495,6 +496,11 @@ initHeapProfiling(void)
         stg_exit(EXIT_FAILURE);
     }
 #endif
+    // See Note [Sampled heap census]
+    if (doingLDVProfiling() && RtsFlags.ProfFlags.heapCensusSampling > 1) {
+        errorBelch("-hb cannot be used with --heap-census-sampling");
+        stg_exit(EXIT_FAILURE);
+    }
 #endif
 
 #if defined(PROFILING)
@@ -546,6 +552,13 @@ initHeapProfiling(void)
     }
 #endif /* PROFILING */
 
+    // The totals of a sampled census are estimates,
+    // see Note [Sampled heap census]
+    if (RtsFlags.ProfFlags.heapCensusSampling > 1) {
+        fprintf(hp_file, " (census of 1 in %" FMT_Word32 " blocks)",
+                RtsFlags.ProfFlags.heapCensusSampling);
+    }
+
     fprintf(hp_file, "\"\n" );
 
     fprintf(hp_file, "DATE \"%s\"\n", time_str());
@@ -1080,12 +1093,39 @@ heapInsertNewCounter(Census *census, StgWord identity)
     return ctr;
 }
 
+/* Note [Sampled heap census]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * On a large heap a census takes a long time, and it is taken while the
+ * program is stopped.  With --heap-census-sampling=<n> we only take a census
+ * of 1 in n of the ordinary heap blocks (and nonmoving segments), and count
+ * each object we find in them n times over.  Which blocks are sampled
+ * rotates from one census to the next, so over n consecutive censuses of an
+ * unchanging heap every block is counted once.  Large and compact objects
+ * are few but can be very large, so they are always counted in full.
+ *
+ * The sampling ratio is recorded in the JOB line of the .hp file, since the
+ * totals it reports are then estimates.
+ */
+
+// Which of the heap blocks the current census samples
+static uint32_t census_sample_phase = 0;
+
+// Does the current census sample the block (or segment) with this index?
+STATIC_INLINE bool
+censusSampled (W_ index)
+{
+    uint32_t n = RtsFlags.ProfFlags.heapCensusSampling;
+    return n == 1 || (index + census_sample_phase) % n == 0;
+}
+
+// weight is the number of objects that this one stands for, see
+// Note [Sampled heap census]
 static void heapProfObject(Census *census, StgClosure *p, size_t size,
                            bool prim
 #if !defined(PROFILING)
                            STG_UNUSED
 #endif
-                           )
+                           , W_ weight)
 {
     const void *identity;
     size_t real_size;
@@ -1099,6 +1139,7 @@ static void heapProfObject(Census *census, StgClosure *p, size_t size,
 #else
             real_size = size;
 #endif
+            real_size *= weight;
 
             if (closureSatisfiesConstraints((StgClosure*)p)) {
 #if defined(PROFILING)
@@ -1165,7 +1206,7 @@ heapCensusCompactList(Census *census, bdescr *bd)
         StgCompactNFDataBlock *block = (StgCompactNFDataBlock*)bd->start;
         StgCompactNFData *str = block->owner;
         heapProfObject(census, (StgClosure*)str,
-                       compact_nfdata_full_sizeW(str), true);
+                       compact_nfdata_full_sizeW(str), true, 1);
     }
 }
 
@@ -1174,7 +1215,7 @@ heapCensusCompactList(Census *census, bdescr *bd)
  * heap block. This can, however, handle PINNED blocks.
  */
 static void
-heapCensusBlock(Census *census, bdescr *bd)
+heapCensusBlock(Census *census, bdescr *bd, W_ weight)
 {
     StgPtr p = bd->start;
 
@@ -1313,7 +1354,7 @@ heapCensusBlock(Census *census, bdescr *bd)
             barf("heapCensus, unknown object: %d", info->type);
         }
 
-        heapProfObject(census,(StgClosure*)p,size,prim);
+        heapProfObject(census,(StgClosure*)p,size,prim,weight);
 
         p += size;
 
@@ -1408,6 +1449,9 @@ closureIsPrim (StgPtr p)
 static void
 heapCensusSegment (Census* census, struct NonmovingSegment* seg )
 {
+  W_ weight = RtsFlags.ProfFlags.heapCensusSampling;
+  if (!censusSampled((W_)seg / NONMOVING_SEGMENT_SIZE)) return;
+
   unsigned int block_size = nonmovingSegmentBlockSize(seg);
   unsigned int block_count = nonmovingSegmentBlockCount(seg);
 
@@ -1417,7 +1461,8 @@ heapCensusSegment (Census* census, struct NonmovingSegment* seg )
     if (!nonmovingClosureMarkedThisCycle(p)) continue;
     // NB: We round up the size of objects to the segment block size.
     // This aligns with live bytes accounting for the nonmoving collector.
-    heapProfObject(census, (StgClosure*)p, block_size / sizeof(W_), closureIsPrim(p));
+    heapProfObject(census, (StgClosure*)p, block_size / sizeof(W_),
+                   closureIsPrim(p), weight);
   }
 }
 
@@ -1448,9 +1493,9 @@ heapCensusSegmentList (Census* census, struct NonmovingSegment* seg )
  * Code to perform a heap census.
  * -------------------------------------------------------------------------- */
 static void
-heapCensusChain( Census *census, bdescr *bd )
+heapCensusChain( Census *census, bdescr *bd, bdescr *end )
 {
-    for (; bd != NULL; bd = bd->link) {
+    for (; bd != end; bd = bd->link) {
         // When we shrink a large ARR_WORDS, we do not adjust the free pointer
         // of the associated block descriptor, thus introducing slop at the end
         // of the object.  This slop remains after GC, violating the assumption
@@ -1465,62 +1510,218 @@ heapCensusChain( Census *census, bdescr *bd )
             if (get_itbl((StgClosure *)p)->type == ARR_WORDS) {
                 size_t size = arr_words_sizeW((StgArrBytes *)p);
                 bool prim = true;
-                heapProfObject(census, (StgClosure *)p, size, prim);
+                heapProfObject(census, (StgClosure *)p, size, prim, 1);
                 continue;
             }
+            heapCensusBlock(census, bd, 1);
+        } else if (censusSampled((W_)bd->start / BLOCK_SIZE)) {
+            heapCensusBlock(census, bd, RtsFlags.ProfFlags.heapCensusSampling);
         }
+    }
+}
 
-        heapCensusBlock(census, bd);
+#if defined(THREADED_RTS)
+/* Note [Parallel heap census]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * A census is taken at the end of a GC, and with --parallel-heap-census it
+ * is taken by all of the threads of a parallel GC (see runParGcJob), rather
+ * than by the GC leader alone.  The leader splits the heap's block and
+ * segment lists into pieces (CensusPiece), and each GC thread takes pieces
+ * in turn and counts them into a Census of its own, so the threads share
+ * nothing but the counter of pieces taken.  At the end the leader adds the
+ * counters of each thread's Census into the real one.  The census of the
+ * compact objects and of the capabilities' current nonmoving segments is
+ * taken by the leader, since they are small.
+ *
+ * Retainer profiling is still done by the leader alone, before the census.
+ * LDV profiling can't be done with more than one capability (#12019), so we
+ * never take a parallel census for it.
+ */
+
+// The largest piece of a block or segment list for a GC thread
+#define CENSUS_PIECE_BLOCKS 64
+#define CENSUS_PIECE_SEGMENTS 16
+
+typedef struct {
+    // either a piece of a block list...
+    bdescr *bd;
+    bdescr *bd_end;
+    // ...or a piece of a nonmoving segment list
+    struct NonmovingSegment *seg;
+    struct NonmovingSegment *seg_end;
+} CensusPiece;
+
+static CensusPiece *census_pieces = NULL;
+static uint32_t n_census_pieces = 0;
+static uint32_t max_census_pieces = 0;
+static StgWord next_census_piece;
+
+// One Census for each GC thread
+static Census *census_parts = NULL;
+static uint32_t n_census_parts;
+static StgWord next_census_part;
+
+static CensusPiece *
+newCensusPiece (void)
+{
+    if (n_census_pieces == max_census_pieces) {
+        max_census_pieces = max_census_pieces == 0 ? 64 : max_census_pieces * 2;
+        census_pieces = stgReallocBytes(census_pieces,
+                                        max_census_pieces * sizeof(CensusPiece),
+                                        "newCensusPiece");
     }
+    CensusPiece *pc = &census_pieces[n_census_pieces++];
+    pc->bd = NULL;
+    pc->bd_end = NULL;
+    pc->seg = NULL;
+    pc->seg_end = NULL;
+    return pc;
 }
 
-// Time is process CPU time of beginning of current GC and is used as
-// the mutator CPU time reported as the census timestamp.
-void heapCensus (Time t)
+static void
+addCensusChain (bdescr *bd)
 {
-  uint32_t g, n;
-  Census *census;
-  gen_workspace *ws;
+    while (bd != NULL) {
+        CensusPiece *pc = newCensusPiece();
+        pc->bd = bd;
+        for (W_ n = 0; bd != NULL && n < CENSUS_PIECE_BLOCKS; bd = bd->link) {
+            n += bd->blocks;
+        }
+        pc->bd_end = bd;
+    }
+}
 
-  census = &censuses[era];
-  census->time  = TimeToSecondsDbl(t);
-  census->rtime = TimeToNS(stat_getElapsedTime());
+static void
+addCensusSegmentList (struct NonmovingSegment *seg)
+{
+    while (seg != NULL) {
+        CensusPiece *pc = newCensusPiece();
+        pc->seg = seg;
+        for (W_ n = 0; seg != NULL && n < CENSUS_PIECE_SEGMENTS; seg = seg->link) {
+            n++;
+        }
+        pc->seg_end = seg;
+    }
+}
+
+static void
+heapCensusJob (void)
+{
+    Census *census = &census_parts[atomic_inc(&next_census_part, 1) - 1];
+    for (;;) {
+        StgWord i = atomic_inc(&next_census_piece, 1) - 1;
+        if (i >= n_census_pieces) break;
+        CensusPiece *pc = &census_pieces[i];
+        if (pc->seg != NULL) {
+            for (struct NonmovingSegment *seg = pc->seg; seg != pc->seg_end;
+                 seg = seg->link) {
+                heapCensusSegment(census, seg);
+            }
+        } else {
+            heapCensusChain(census, pc->bd, pc->bd_end);
+        }
+    }
+}
 
+// Add the counters of part into census
+static void
+mergeCensus (Census *census, Census *part)
+{
+    for (counter *c = part->ctrs; c != NULL; c = c->next) {
+        counter *ctr = lookupHashTable(census->hash, (StgWord)c->identity);
+        if (ctr == NULL) {
+            ctr = heapInsertNewCounter(census, (StgWord)c->identity);
+        }
+        ctr->c.resid += c->c.resid;
+    }
+}
 
-  // calculate retainer sets if necessary
-#if defined(PROFILING)
-  if (doingRetainerProfiling()) {
-      retainerProfile();
-  }
+// Take the census of the pieces collected by heapCensusLists on all of the
+// GC threads, see Note [Parallel heap census]
+static void
+heapCensusParallel (Census *census)
+{
+    n_census_parts = parGcThreads();
+    census_parts = stgCallocBytes(n_census_parts, sizeof(Census),
+                                  "heapCensusParallel");
+    for (uint32_t i = 0; i < n_census_parts; i++) {
+        initEra(&census_parts[i]);
+    }
+
+    // Bring the IPE map up to date now, so that the GC threads only read
+    // it when they look up info tables for -hi selectors
+    updateIpeMap();
+
+    next_census_piece = 0;
+    next_census_part = 0;
+    runParGcJob(heapCensusJob);
+
+    for (uint32_t i = 0; i < n_census_parts; i++) {
+        mergeCensus(census, &census_parts[i]);
+        freeEra(&census_parts[i]);
+    }
+    stgFree(census_parts);
+    census_parts = NULL;
+
+    stgFree(census_pieces);
+    census_pieces = NULL;
+    n_census_pieces = 0;
+    max_census_pieces = 0;
+}
+#endif /* THREADED_RTS */
+
+// Take a census of a block list, or for a parallel census split it into
+// pieces for the GC threads.
+static void
+censusChain (Census *census, bdescr *bd, bool par USED_IF_THREADS)
+{
+#if defined(THREADED_RTS)
+    if (par) {
+        addCensusChain(bd);
+        return;
+    }
 #endif
+    heapCensusChain(census, bd, NULL);
+}
 
-#if defined(PROFILING)
-  stat_startHeapCensus();
+static void
+censusSegmentList (Census *census, struct NonmovingSegment *seg,
+                   bool par USED_IF_THREADS)
+{
+#if defined(THREADED_RTS)
+    if (par) {
+        addCensusSegmentList(seg);
+        return;
+    }
 #endif
+    heapCensusSegmentList(census, seg);
+}
 
-  // Traverse the heap, collecting the census info
-  for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
-      heapCensusChain( census, generations[g].blocks );
+static void
+heapCensusLists (Census *census, bool par)
+{
+  for (uint32_t g = 0; g < RtsFlags.GcFlags.generations; g++) {
+      censusChain( census, generations[g].blocks, par );
       // Are we interested in large objects?  might be
       // confusing to include the stack in a heap profile.
-      heapCensusChain( census, generations[g].large_objects );
+      censusChain( census, generations[g].large_objects, par );
       heapCensusCompactList ( census, generations[g].compact_objects );
 
-      for (n = 0; n < getNumCapabilities(); n++) {
-          ws = &gc_threads[n]->gens[g];
-          heapCensusChain(census, ws->todo_bd);
-          heapCensusChain(census, ws->part_list);
-          heapCensusChain(census, ws->scavd_list);
+      for (uint32_t n = 0; n < getNumCapabilities(); n++) {
+          gen_workspace *ws = &gc_threads[n]->gens[g];
+          censusChain(census, ws->todo_bd, par);
+          censusChain(census, ws->part_list, par);
+          censusChain(census, ws->scavd_list, par);
       }
   }
 
   if (RtsFlags.GcFlags.useNonmoving) {
     for (unsigned int i = 0; i < nonmoving_alloca_cnt; i++) {
-      heapCensusSegmentList(census, nonmovingHeap.allocators[i].filled);
-      heapCensusSegmentList(census, nonmovingHeap.allocators[i].saved_filled);
-      heapCensusSegmentList(census, nonmovingHeap.allocators[i].active);
+      censusSegmentList(census, nonmovingHeap.allocators[i].filled, par);
+      censusSegmentList(census, nonmovingHeap.allocators[i].saved_filled, par);
+      censusSegmentList(census, nonmovingHeap.allocators[i].active, par);
 
-      heapCensusChain(census, nonmoving_large_objects);
+      censusChain(census, nonmoving_large_objects, par);
       heapCensusCompactList(census, nonmoving_compact_objects);
 
       // segments living on capabilities
@@ -1531,6 +1732,46 @@ void heapCensus (Time t)
     }
 
   }
+}
+
+// Time is process CPU time of beginning of current GC and is used as
+// the mutator CPU time reported as the census timestamp.
+void heapCensus (Time t)
+{
+  Census *census;
+
+  census = &censuses[era];
+  census->time  = TimeToSecondsDbl(t);
+  census->rtime = TimeToNS(stat_getElapsedTime());
+
+
+  // calculate retainer sets if necessary
+#if defined(PROFILING)
+  if (doingRetainerProfiling()) {
+      retainerProfile();
+  }
+#endif
+
+#if defined(PROFILING)
+  stat_startHeapCensus();
+#endif
+
+  // Traverse the heap, collecting the census info
+  census_sample_phase++;
+#if defined(THREADED_RTS)
+  // See Note [Parallel heap census]
+  bool par = RtsFlags.ProfFlags.parallelHeapCensus && parGcThreads() > 1
+#if defined(PROFILING)
+      && !doingLDVProfiling()
+#endif
+      ;
+  heapCensusLists(census, par);
+  if (par) {
+      heapCensusParallel(census);
+  }
+#else
+  heapCensusLists(census, false);
+#endif
 
   // dump out the census info
 #if defined(PROFILING)
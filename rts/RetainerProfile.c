@@ -18,7 +18,6 @@
 #include "Profiling.h"
 #include "Stats.h"
 #include "StablePtr.h" /* markStablePtrTable */
-#include "StableName.h" /* rememberOldStableNameAddresses */
 #include "sm/Storage.h"
 
 /* Note [What is a retainer?]
@@ -407,8 +406,6 @@ computeRetainerSet( traverseState *ts )
 
     // Consider roots from the stable ptr table.
     markStablePtrTable(retainRoot, (void*)ts);
-    // Remember old stable name addresses.
-    rememberOldStableNameAddresses ();
 
     traverseWorkStack(ts, &retainVisitClosure);
 }
@@ -166,6 +166,7 @@ void initRtsFlagsDefaults(void)
     RtsFlags.GcFlags.returnDecayFactor  = 4;
     RtsFlags.GcFlags.useNonmoving       = false;
     RtsFlags.GcFlags.nonmovingDenseAllocatorCount = 16;
+    RtsFlags.GcFlags.nonmovingMarkThreads = 1;
     RtsFlags.GcFlags.generations        = 2;
     RtsFlags.GcFlags.squeezeUpdFrames   = true;
     RtsFlags.GcFlags.compact            = false;
@@ -182,6 +183,7 @@ void initRtsFlagsDefaults(void)
     RtsFlags.GcFlags.allocLimitGrace    = (100*1024) / BLOCK_SIZE;
     RtsFlags.GcFlags.numa               = false;
     RtsFlags.GcFlags.numaMask           = 1;
+    RtsFlags.GcFlags.hugePages          = false;
     RtsFlags.GcFlags.ringBell           = false;
     RtsFlags.GcFlags.longGCSync         = 0; /* detection turned off */
 
@@ -220,6 +222,8 @@ void initRtsFlagsDefaults(void)
     RtsFlags.ProfFlags.startHeapProfileAtStartup = true;
     RtsFlags.ProfFlags.startTimeProfileAtStartup = true;
     RtsFlags.ProfFlags.incrementUserEra = false;
+    RtsFlags.ProfFlags.parallelHeapCensus = false;
+    RtsFlags.ProfFlags.heapCensusSampling = 1;
 
 #if defined(PROFILING)
     RtsFlags.ProfFlags.showCCSOnException = false;
@@ -251,6 +255,9 @@ void initRtsFlagsDefaults(void)
     RtsFlags.TraceFlags.trace_output  = NULL;
 #  if defined(THREADED_RTS)
     RtsFlags.TraceFlags.eventlogFlushTime = 0;
+    RtsFlags.TraceFlags.eventlogAsyncBuffers = 0;
+    RtsFlags.TraceFlags.eventlogSocket = NULL;
+    RtsFlags.TraceFlags.eventlogSocketPolicy = EVENTLOG_SOCKET_BLOCK;
 #  endif
     RtsFlags.TraceFlags.nullWriter = false;
 #endif
@@ -274,7 +281,15 @@ void initRtsFlagsDefaults(void)
     RtsFlags.MiscFlags.linkerAlwaysPic         = DEFAULT_LINKER_ALWAYS_PIC;
     RtsFlags.MiscFlags.linkerOptimistic        = false;
     RtsFlags.MiscFlags.linkerMemBase           = 0;
+#if defined(THREADED_RTS)
+    RtsFlags.MiscFlags.linkerThreads           = getNumberOfProcessors();
+#else
+    RtsFlags.MiscFlags.linkerThreads           = 1;
+#endif
+    RtsFlags.MiscFlags.linkerStats             = false;
+    RtsFlags.MiscFlags.linkerSymbolCache       = NULL;
     RtsFlags.MiscFlags.ioManager               = IO_MNGR_FLAG_AUTO;
+    RtsFlags.MiscFlags.ioManagerTimers         = IO_MNGR_TIMERS_HEAP;
 #if defined(THREADED_RTS) && defined(mingw32_HOST_OS)
     RtsFlags.MiscFlags.numIoWorkerThreads      = getNumberOfProcessors();
 #else
@@ -290,7 +305,9 @@ void initRtsFlagsDefaults(void)
     RtsFlags.ParFlags.parGcLoadBalancingGen = ~0u; /* auto, based on -A */
     RtsFlags.ParFlags.parGcNoSyncWithIdle   = 0;
     RtsFlags.ParFlags.parGcThreads      = 0; /* defaults to -N */
+    RtsFlags.ParFlags.parGcLocality     = false;
     RtsFlags.ParFlags.setAffinity       = 0;
+    RtsFlags.ParFlags.stmVersionClock   = false;
 #endif
 
 #if defined(THREADED_RTS)
@@ -325,6 +342,9 @@ usage_text[] = {
 "  --nonmoving-gc",
 "            Selects the non-moving mark-and-sweep garbage collector to",
 "            manage the oldest generation.",
+"  --nonmoving-mark-threads=<n>",
+"            Use <n> threads for marking in the non-moving collector",
+"            (default: 1)",
 "  --copying-gc",
 "            Selects the copying garbage collector to manage all generations.",
 "",
@@ -354,6 +374,8 @@ usage_text[] = {
 "            will be searched from. This is useful if the default address",
 "            clashes with some third-party library.",
 "  -xn       Use the non-moving collector for the old generation.",
+"  --huge-pages",
+"            Back the heap with transparent huge pages, where available",
 "  -m<n>     Minimum % of heap which must be available (default 3%)",
 "  -G<n>     Number of generations (default: 2)",
 "  -c<n>     Use in-place compaction instead of copying in the oldest generation",
@@ -431,7 +453,12 @@ usage_text[] = {
 "  --no-automatic-heap-samples",
 "           Do not start the heap profile interval timer on start-up,",
 "           Rather, the application will be responsible for triggering",
-"           heap profiler samples."
+"           heap profiler samples.",
+"  --parallel-heap-census",
+"           Take heap profile censuses on all of the parallel GC threads",
+"  --heap-census-sampling=<n>",
+"           Take heap profile censuses of 1 in <n> heap blocks, and scale",
+"           up the results (default: 1)"
 
 #if defined(TRACING)
 "",
@@ -459,6 +486,16 @@ usage_text[] = {
 #  if defined(THREADED_RTS)
 " --eventlog-flush-interval=<secs>",
 "             Periodically flush the eventlog at the specified interval.",
+" --eventlog-async[=<n>]",
+"             Write the eventlog from a background thread, with <n> spare",
+"             buffers of 2MB (default: 8). Events are dropped when no spare",
+"             buffer is free.",
+" --eventlog-socket=<path>",
+"             Stream the eventlog to a consumer connected to the Unix domain",
+"             socket <path>, instead of writing it to a file (use with -l).",
+" --eventlog-socket-policy=<block|drop|sample>",
+"             What to do when the eventlog socket's consumer falls behind:",
+"             wait for it (default), drop events, or drop all but a sample.",
 #  endif
 #endif
 
@@ -516,6 +553,8 @@ usage_text[] = {
 "             (default: 1 for -A < 32M, 0 otherwise;",
 "              -qb alone turns off load-balancing)",
 "  -qn<n>     Use <n> threads for parallel GC (defaults to value of -N)",
+"  -ql        Keep the work of the parallel GC near the capabilities it",
+"             belongs to",
 "  -qa        Use the OS to set thread affinity (experimental)",
 "  -qm        Don't automatically migrate threads between CPUs",
 "  -qi<n>     If a processor has been idle for the last <n> GCs, do not",
@@ -523,6 +562,9 @@ usage_text[] = {
 "             (0 disables,  default: 0)",
 "  --numa[=<node_mask>]",
 "             Use NUMA, nodes given by <node_mask> (default: off)",
+"  --stm-version-clock",
+"             Validate STM transactions with a global version clock, so that",
+"             read-only transactions commit without locking (default: off)",
 #if defined(DEBUG)
 "  --debug-numa[=<num_nodes>]",
 "             Pretend NUMA: like --numa, but without the system calls.",
@@ -548,6 +590,9 @@ usage_text[] = {
 "             The I/O manager to use.",
 "             Options available: auto" IOMGRS_ENABLED_STR
               " (default: " IOMGR_DEFAULT_STR ")",
+"  --io-manager-timers=<heap|wheel>",
+"             The data structure the poll, epoll and io_uring I/O managers",
+"             use for timeouts. (default: heap)",
 #if defined(THREADED_RTS)
 #if defined(mingw32_HOST_OS)
 "  --io-manager-threads=<num>",
@@ -565,6 +610,14 @@ usage_text[] = {
 "  -xm        Base address to mmap memory in the GHCi linker",
 "             (hex; must be <80000000)",
 #endif
+"  --linker-threads=<n>",
+"             Number of threads on which the GHCi linker prepares the",
+"             members of an archive (default: num cores)",
+"  --linker-stats",
+"             Report the time taken by the GHCi linker to load each archive",
+"  --linker-symbol-cache=<dir>",
+"             Keep an index of the symbols of each archive the GHCi linker",
+"             loads in <dir>, and use it to load the archive lazily next time",
 "  -xq        The allocation limit given to a thread after it receives",
 "             an AllocationLimitExceeded exception. (default: 100k)",
 "",
@@ -1014,6 +1067,36 @@ error = true;
                        OPTION_UNSAFE;
                        RtsFlags.MiscFlags.linkerOptimistic = true;
                   }
+                  else if (!strncmp("linker-threads=",
+                               &rts_argv[arg][2], 15)) {
+                      OPTION_SAFE;
+                      THREADED_BUILD_ONLY(
+                      int32_t n = strtol(rts_argv[arg]+17, (char **) NULL, 10);
+                      if (n < 1) {
+                          errorBelch("%s: Expected number of threads to be at least 1.",
+                                     rts_argv[arg]);
+                          error = true;
+                          break;
+                      }
+                      RtsFlags.MiscFlags.linkerThreads = n;
+                      ) break;
+                  }
+                  else if (strequal("linker-stats",
+                              &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.MiscFlags.linkerStats = true;
+                  }
+                  else if (!strncmp("linker-symbol-cache=",
+                               &rts_argv[arg][2], 20)) {
+                      OPTION_UNSAFE;
+                      if (strlen(&rts_argv[arg][22]) == 0) {
+                          errorBelch("--linker-symbol-cache expects a directory");
+                          error = true;
+                      } else {
+                          RtsFlags.MiscFlags.linkerSymbolCache =
+                              strdup(&rts_argv[arg][22]);
+                      }
+                  }
                   else if (strequal("null-eventlog-writer",
                                &rts_argv[arg][2])) {
                       OPTION_UNSAFE;
@@ -1029,6 +1112,17 @@ error = true;
                       OPTION_UNSAFE;
                       RtsFlags.MiscFlags.disableDelayedOsMemoryReturn = true;
                   }
+                  else if (strequal("huge-pages",
+                               &rts_argv[arg][2])) {
+                      OPTION_UNSAFE;
+                      if (osHugePageSize() == 0) {
+                          errorBelch("%s: OS reports huge pages are not available",
+                                     rts_argv[arg]);
+                          error = true;
+                          break;
+                      }
+                      RtsFlags.GcFlags.hugePages = true;
+                  }
                   else if (strequal("internal-counters",
                                     &rts_argv[arg][2])) {
                       OPTION_SAFE;
@@ -1052,6 +1146,16 @@ error = true;
                           stg_exit(EXIT_FAILURE);
                       }
                   }
+                  else if (strequal("io-manager-timers=heap",
+                               &rts_argv[arg][2])) {
+                      OPTION_UNSAFE;
+                      RtsFlags.MiscFlags.ioManagerTimers = IO_MNGR_TIMERS_HEAP;
+                  }
+                  else if (strequal("io-manager-timers=wheel",
+                               &rts_argv[arg][2])) {
+                      OPTION_UNSAFE;
+                      RtsFlags.MiscFlags.ioManagerTimers = IO_MNGR_TIMERS_WHEEL;
+                  }
                   else if (strequal("info",
                                &rts_argv[arg][2])) {
                       OPTION_SAFE;
@@ -1070,6 +1174,67 @@ error = true;
                           fsecondsToTime(intervalSeconds);
                       ) break;
                   }
+                  else if (!strncmp("eventlog-async",
+                               &rts_argv[arg][2], 14)) {
+                      OPTION_SAFE;
+                      THREADED_BUILD_ONLY(
+                      if (rts_argv[arg][16] == '\0') {
+                          RtsFlags.TraceFlags.eventlogAsyncBuffers = 8;
+                      } else if (rts_argv[arg][16] == '=') {
+                          int n = strtol(rts_argv[arg]+17, (char **) NULL, 10);
+                          if (n < 1) {
+                              errorBelch("%s: Expected at least 1 buffer",
+                                         rts_argv[arg]);
+                              error = true;
+                          } else {
+                              RtsFlags.TraceFlags.eventlogAsyncBuffers = n;
+                          }
+                      } else {
+                          errorBelch("unknown RTS option: %s", rts_argv[arg]);
+                          error = true;
+                      }
+                      ) break;
+                  }
+                  else if (!strncmp("eventlog-socket=",
+                               &rts_argv[arg][2], 16)) {
+                      OPTION_UNSAFE;
+#if defined(mingw32_HOST_OS)
+                      errorBelch("%s: not supported on this platform",
+                                 rts_argv[arg]);
+                      error = true;
+#else
+                      THREADED_BUILD_ONLY(
+                      if (strlen(&rts_argv[arg][18]) == 0) {
+                          errorBelch("--eventlog-socket expects a path");
+                          error = true;
+                      } else {
+                          RtsFlags.TraceFlags.eventlogSocket =
+                              strdup(&rts_argv[arg][18]);
+                      }
+                      )
+#endif
+                      break;
+                  }
+                  else if (!strncmp("eventlog-socket-policy=",
+                               &rts_argv[arg][2], 23)) {
+                      OPTION_SAFE;
+                      THREADED_BUILD_ONLY(
+                      const char *policy = &rts_argv[arg][25];
+                      if (strequal(policy, "block")) {
+                          RtsFlags.TraceFlags.eventlogSocketPolicy =
+                              EVENTLOG_SOCKET_BLOCK;
+                      } else if (strequal(policy, "drop")) {
+                          RtsFlags.TraceFlags.eventlogSocketPolicy =
+                              EVENTLOG_SOCKET_DROP;
+                      } else if (strequal(policy, "sample")) {
+                          RtsFlags.TraceFlags.eventlogSocketPolicy =
+                              EVENTLOG_SOCKET_SAMPLE;
+                      } else {
+                          errorBelch("%s: unknown policy", rts_argv[arg]);
+                          error = true;
+                      }
+                      ) break;
+                  }
                   else if (strequal("copying-gc",
                                &rts_argv[arg][2])) {
                       OPTION_SAFE;
@@ -1091,6 +1256,34 @@ error = true;
                         RtsFlags.GcFlags.nonmovingDenseAllocatorCount = threshold;
                       }
                   }
+                  else if (!strncmp("nonmoving-mark-threads=",
+                               &rts_argv[arg][2], 23)) {
+                      OPTION_SAFE;
+                      THREADED_BUILD_ONLY(
+                      int32_t threads = strtol(rts_argv[arg]+25, (char **) NULL, 10);
+                      if (threads < 1) {
+                        errorBelch("bad value for --nonmoving-mark-threads");
+                        error = true;
+                      } else {
+                        RtsFlags.GcFlags.nonmovingMarkThreads = threads;
+                      }
+                      ) break;
+                  }
+                  else if (strequal("stm-version-clock",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+#if SIZEOF_VOID_P == 4
+                      // The TVar versions would wrap around, see
+                      // Note [STM version clock]
+                      errorBelch("%s: not supported on 32-bit platforms",
+                                 rts_argv[arg]);
+                      error = true;
+#else
+                      THREADED_BUILD_ONLY(
+                      RtsFlags.ParFlags.stmVersionClock = true;
+                      ) break;
+#endif
+                  }
                   else if (strequal("read-tix-file=yes",
                               &rts_argv[arg][2])) {
                        OPTION_UNSAFE;
@@ -1223,6 +1416,25 @@ error = true;
                       RtsFlags.ProfFlags.incrementUserEra = true;
                       break;
                   }
+                  else if (strequal("parallel-heap-census",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      THREADED_BUILD_ONLY(
+                      RtsFlags.ProfFlags.parallelHeapCensus = true;
+                      ) break;
+                  }
+                  else if (!strncmp("heap-census-sampling=",
+                               &rts_argv[arg][2], 21)) {
+                      OPTION_SAFE;
+                      int32_t n = strtol(rts_argv[arg]+23, (char **) NULL, 10);
+                      if (n < 1) {
+                          errorBelch("bad value for --heap-census-sampling");
+                          error = true;
+                      } else {
+                          RtsFlags.ProfFlags.heapCensusSampling = n;
+                      }
+                      break;
+                  }
                   else {
                       OPTION_SAFE;
                       errorBelch("unknown RTS option: %s",rts_argv[arg]);
@@ -1687,6 +1899,9 @@ error = true;
                     case 'a':
                         RtsFlags.ParFlags.setAffinity = true;
                         break;
+                    case 'l':
+                        RtsFlags.ParFlags.parGcLocality = true;
+                        break;
                     case 'm':
                         RtsFlags.ParFlags.migrate = false;
                         break;
@@ -12,6 +12,7 @@
 
 #include "sm/Storage.h"
 #include "linker/MMap.h"
+#include "linker/M32Alloc.h"
 #include "RtsFlags.h"
 #include "RtsUtils.h"
 #include "BuiltinClosures.h"
@@ -347,8 +348,9 @@ hs_init_ghc(int *argc, char **argv[], RtsConfig rts_config)
     /* Initialise the adjustors subsystem */
     initAdjustors();
 
-    /* Initialise mmapForLinker */
+    /* Initialise mmapForLinker and the m32 allocator */
     initLinkerMMap();
+    initM32Alloc();
 
     /* Initialise the stats department, phase 1 */
     initStats1();
@@ -68,6 +68,10 @@
  * values, (d) release the locks on the TVars, writing updates to them in the
  * case of a commit, (e) unlock the STM.
  *
+ * With +RTS --stm-version-clock, STM_FG_LOCKS commits top-level transactions
+ * against a global version clock instead, so that read-only transactions
+ * commit without locking anything: see Note [STM version clock].
+ *
  * Queues of waiting threads hang off the first_watch_queue_entry field of each
  * TVar.  This may only be manipulated when holding that TVar's lock.  In
  * particular, when a thread is putting itself to sleep, it mustn't release the
@@ -542,14 +546,34 @@ static TRecEntry *get_new_entry(Capability *cap,
   return result;
 }
 
+// The version of the TVar at which an entry's expected_value was read, kept
+// in the entry's num_updates field.  We load the version after the value; see
+// check_read_only for why this pairing is safe.
+
+static void read_entry_version(TRecEntry *e STG_UNUSED,
+                               StgTVar *s STG_UNUSED) {
+  IF_STM_FG_LOCKS({
+    e -> num_updates = SEQ_CST_LOAD(&s->num_updates);
+  });
+}
+
+static void copy_entry_version(TRecEntry *to STG_UNUSED,
+                               TRecEntry *from STG_UNUSED) {
+  IF_STM_FG_LOCKS({
+    to -> num_updates = from -> num_updates;
+  });
+}
+
 /*......................................................................*/
 
 static void merge_update_into(Capability *cap,
                               StgTRecHeader *t,
-                              StgTVar *tvar,
-                              StgClosure *expected_value,
-                              StgClosure *new_value)
+                              TRecEntry *from)
 {
+  StgTVar *tvar = from -> tvar;
+  StgClosure *expected_value = from -> expected_value;
+  StgClosure *new_value = from -> new_value;
+
   // Look for an entry in this trec
   bool found = false;
   FOR_EACH_ENTRY(t, e, {
@@ -575,6 +599,7 @@ static void merge_update_into(Capability *cap,
     ne -> tvar = tvar;
     ne -> expected_value = expected_value;
     ne -> new_value = new_value;
+    copy_entry_version(ne, from);
   }
 }
 
@@ -582,9 +607,10 @@ static void merge_update_into(Capability *cap,
 
 static void merge_read_into(Capability *cap,
                             StgTRecHeader *trec,
-                            StgTVar *tvar,
-                            StgClosure *expected_value)
+                            TRecEntry *from)
 {
+  StgTVar *tvar = from -> tvar;
+  StgClosure *expected_value = from -> expected_value;
   StgTRecHeader *t;
   bool found = false;
 
@@ -632,6 +658,7 @@ static void merge_read_into(Capability *cap,
     ne -> tvar = tvar;
     ne -> expected_value = expected_value;
     ne -> new_value = expected_value;
+    copy_entry_version(ne, from);
   }
 }
 
@@ -798,10 +825,16 @@ static StgBool validate_and_acquire_ownership (Capability *cap,
 // check_read_only : check that we've seen an atomic snapshot of the
 // non-updated TVars accessed by a trec.  This checks that the last TRec to
 // commit an update to the TVar is unchanged since the value was stashed in
-// validate_and_acquire_ownership.  If no update is seen to any TVar then
+// validate_and_acquire_ownership (or, with the version clock, since the
+// transaction read the TVar).  If no update is seen to any TVar then
 // all of them contained their expected values at the start of the call to
 // check_read_only.
 //
+// The version in an entry is always loaded after a value that matched the
+// entry's expected value.  An unchanged version therefore means that no
+// commit wrote the TVar between then and now, and the value we see now is
+// the value that the version was loaded with.
+//
 // The paper "Concurrent programming without locks" (under submission), or
 // Keir Fraser's PhD dissertation "Practical lock-free programming" discuss
 // this kind of algorithm.
@@ -894,6 +927,63 @@ static void getToken(Capability *cap STG_UNUSED) {
 }
 #endif
 
+/*......................................................................
+
+Note [STM version clock]
+~~~~~~~~~~~~~~~~~~~~~~~~
+With STM_FG_LOCKS, committing a transaction checks every TVar that it has read
+twice, in validate_and_acquire_ownership and again in check_read_only, even
+when the transaction has not updated anything.  For large read-mostly
+transactions each commit is linear in the size of the read set, and the
+committing capabilities all pull in the cache lines of the same TVars.
+
+With +RTS --stm-version-clock we commit top-level transactions in the style
+of TL2 (Dice, Shalev and Shavit, "Transactional Locking II", DISC 2006):
+
+ - stm_version_clock counts commits that update TVars.  A transaction
+   records the clock in the read_version field of its TRec when it starts.
+
+ - The num_updates field of a TVar holds the clock value of the last commit
+   that wrote to it, and each TRec entry records the version of its TVar when
+   the transaction read it (read_entry_version).
+
+ - An updating transaction locks the TVars that it updates, as before, and
+   then increments the clock to get its write version.  If that is
+   read_version + 1, no other update has committed since the transaction
+   started, so the TVars that it only read still hold what it read.
+   Otherwise we revalidate them with check_read_only, which compares the
+   recorded versions.  Each updated TVar gets the write version in its
+   num_updates before it is unlocked.
+
+ - A read-only transaction locks nothing and leaves the clock alone.  If the
+   clock still equals read_version it commits at once; otherwise it
+   revalidates with check_read_only, again without locking.
+
+Looking at the clock is enough because a committing transaction locks all of
+the TVars that it updates before incrementing the clock, and only unlocks
+them once its updates are written.  As read_current_value waits for locked
+TVars, everything read by a transaction that started at read_version was
+written by a commit with a write version of at most read_version, or by a
+commit that moved the clock since.
+
+Nested transactions, stmWait and stmReWait still validate as STM_FG_LOCKS
+does, and keep the versions in the entries they merge consistent with the
+expected values.  As versions are compared for equality they must not wrap
+around during a transaction, so the version clock is only available on 64-bit
+platforms.
+
+The commit, abort and revalidation counts for either scheme are reported by
++RTS -s; see StmCounters.
+*/
+
+#if defined(STM_FG_LOCKS)
+static StgWord stm_version_clock = 0;
+
+static bool use_version_clock(void) {
+  return RtsFlags.ParFlags.stmVersionClock;
+}
+#endif
+
 /*......................................................................*/
 
 StgTRecHeader *stmStartTransaction(Capability *cap,
@@ -906,6 +996,12 @@ StgTRecHeader *stmStartTransaction(Capability *cap,
   getToken(cap);
 
   t = alloc_stg_trec_header(cap, outer);
+  t -> read_version = 0;
+  IF_STM_FG_LOCKS({
+    if (use_version_clock()) {
+      t -> read_version = (StgInt) SEQ_CST_LOAD(&stm_version_clock);
+    }
+  });
   TRACE("%p : stmStartTransaction()=%p", outer, t);
   return t;
 }
@@ -938,8 +1034,7 @@ void stmAbortTransaction(Capability *cap,
     TRACE("%p : retaining read-set into parent %p", trec, et);
 
     FOR_EACH_ENTRY(trec, e, {
-      StgTVar *s = e -> tvar;
-      merge_read_into(cap, et, s, e -> expected_value);
+      merge_read_into(cap, et, e);
     });
   }
 
@@ -1211,8 +1306,88 @@ static TRecEntry *get_entry_for(StgTRecHeader *trec, StgTVar *tvar, StgTRecHeade
 
 /*......................................................................*/
 
+#if defined(STM_FG_LOCKS)
+// acquire_updated_tvars : lock the TVars that trec updates, checking that they
+// still hold their expected values, without looking at the TVars that it only
+// read.  Sets *updated if there are any.  On failure the caller must call
+// revert_ownership.
+
+static StgBool acquire_updated_tvars(Capability *cap,
+                                     StgTRecHeader *trec,
+                                     bool *updated) {
+  StgBool result = true;
+  FOR_EACH_ENTRY(trec, e, {
+    if (entry_is_update(e)) {
+      *updated = true;
+      if (!cond_lock_tvar(cap, trec, e -> tvar, e -> expected_value)) {
+        TRACE("%p : failed to acquire %p", trec, e -> tvar);
+        result = false;
+        BREAK_FOR_EACH;
+      }
+    }
+  });
+  return result;
+}
+
+// Commit a top-level transaction against the version clock.
+// See Note [STM version clock].
+static StgBool commit_with_version_clock(Capability *cap, StgTRecHeader *trec,
+                                         bool *updated) {
+  StgBool result;
+  StgWord clock = 0;
+  StgWord read_version = (StgWord) trec -> read_version;
+
+  TRACE("%p : commit_with_version_clock, read_version %" FMT_Word,
+        trec, read_version);
+
+  if (shake()) {
+    TRACE("%p : shake, pretending trec is invalid when it may not be", trec);
+    return false;
+  }
+
+  result = (trec -> state != TREC_CONDEMNED) &&
+           acquire_updated_tvars(cap, trec, updated);
+
+  if (result) {
+    if (*updated) {
+      clock = atomic_inc(&stm_version_clock, 1);
+      read_version++;
+    } else {
+      clock = SEQ_CST_LOAD(&stm_version_clock);
+    }
+
+    if (clock != read_version) {
+      // Other transactions have committed updates since we started: check
+      // that the TVars that we only read have not been updated since.
+      TRACE("%p : clock moved to %" FMT_Word ", doing read check", trec, clock);
+      cap -> stm_stats.revalidations++;
+      result = check_read_only(trec);
+    }
+  }
+
+  if (result && *updated) {
+    FOR_EACH_ENTRY(trec, e, {
+      if (entry_is_update(e)) {
+        StgTVar *s = e -> tvar;
+        ASSERT(tvar_is_locked(s, trec));
+        TRACE("%p : writing %p to %p, waking waiters", trec, e -> new_value, s);
+        unpark_waiters_on(cap, s);
+        SEQ_CST_STORE(&s->num_updates, (StgInt) clock);
+        unlock_tvar(cap, trec, s, e -> new_value, true);
+      }
+    });
+  } else if (!result) {
+    revert_ownership(cap, trec, false);
+  }
+
+  TRACE("%p : commit_with_version_clock()=%d", trec, result);
+  return result;
+}
+#endif
+
 StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
   StgInt64 max_commits_at_start = getMaxCommits();
+  bool updated = false;
 
   TRACE("%p : stmCommitTransaction()", trec);
   ASSERT(trec != NO_TREC);
@@ -1221,6 +1396,21 @@ StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
   ASSERT((trec -> state == TREC_ACTIVE) ||
          (trec -> state == TREC_CONDEMNED));
 
+#if defined(STM_FG_LOCKS)
+  if (use_version_clock()) {
+    bool result = commit_with_version_clock(cap, trec, &updated);
+    if (result) {
+      cap -> stm_stats.commits++;
+      if (!updated) cap -> stm_stats.read_only_commits++;
+    } else {
+      cap -> stm_stats.aborts++;
+    }
+    free_stg_trec_header(cap, trec);
+    TRACE("%p : stmCommitTransaction()=%d", trec, result);
+    return result;
+  }
+#endif
+
   // Use a read-phase (i.e. don't lock TVars we've read but not updated) if
   // the configuration lets us use a read phase.
 
@@ -1233,6 +1423,7 @@ StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
       StgInt64 max_commits_at_end;
       StgInt64 max_concurrent_commits;
       TRACE("%p : doing read check", trec);
+      cap -> stm_stats.revalidations++;
       result = check_read_only(trec);
       TRACE("%p : read-check %s", trec, result ? "succeeded" : "failed");
 
@@ -1254,6 +1445,9 @@ StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
       FOR_EACH_ENTRY(trec, e, {
         StgTVar *s;
         s = e -> tvar;
+        if (entry_is_update(e)) {
+          updated = true;
+        }
         if ((!config_use_read_phase) || (e -> new_value != e -> expected_value)) {
           // Either the entry is an update or we're not using a read phase:
           // write the value back to the TVar, unlocking it if necessary.
@@ -1274,6 +1468,13 @@ StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
     }
   }
 
+  if (result) {
+    cap -> stm_stats.commits++;
+    if (!updated) cap -> stm_stats.read_only_commits++;
+  } else {
+    cap -> stm_stats.aborts++;
+  }
+
   free_stg_trec_header(cap, trec);
 
   TRACE("%p : stmCommitTransaction()=%d", trec, result);
@@ -1313,7 +1514,7 @@ StgBool stmCommitNestedTransaction(Capability *cap, StgTRecHeader *trec) {
         if (entry_is_update(e)) {
             unlock_tvar(cap, trec, s, e -> expected_value, false);
         }
-        merge_update_into(cap, et, s, e -> expected_value, e -> new_value);
+        merge_update_into(cap, et, e);
         ACQ_ASSERT(ACQUIRE_LOAD(&s->current_value) != (StgClosure *)trec);
       });
     } else {
@@ -1383,6 +1584,7 @@ StgBool stmReWait(Capability *cap, StgTSO *tso) {
   ASSERT((trec -> state == TREC_WAITING) ||
          (trec -> state == TREC_CONDEMNED));
 
+  cap -> stm_stats.revalidations++;
   bool result = validate_and_acquire_ownership(cap, trec, true, true);
   TRACE("%p : validation %s", trec, result ? "succeeded" : "failed");
   if (result) {
@@ -1446,6 +1648,7 @@ StgClosure *stmReadTVar(Capability *cap,
       new_entry -> tvar = tvar;
       new_entry -> expected_value = entry -> expected_value;
       new_entry -> new_value = entry -> new_value;
+      copy_entry_version(new_entry, entry);
       result = new_entry -> new_value;
     }
   } else {
@@ -1455,6 +1658,7 @@ StgClosure *stmReadTVar(Capability *cap,
     new_entry -> tvar = tvar;
     new_entry -> expected_value = current_value;
     new_entry -> new_value = current_value;
+    read_entry_version(new_entry, tvar);
     result = current_value;
   }
 
@@ -1491,6 +1695,7 @@ void stmWriteTVar(Capability *cap,
       new_entry -> tvar = tvar;
       new_entry -> expected_value = entry -> expected_value;
       new_entry -> new_value = new_value;
+      copy_entry_version(new_entry, entry);
     }
   } else {
     // No entry found
@@ -1499,6 +1704,7 @@ void stmWriteTVar(Capability *cap,
     new_entry -> tvar = tvar;
     new_entry -> expected_value = current_value;
     new_entry -> new_value = new_value;
+    read_entry_version(new_entry, tvar);
   }
 
   TRACE("%p : stmWriteTVar done", trec);
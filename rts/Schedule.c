@@ -754,13 +754,13 @@ schedulePushWork(Capability *cap USED_IF_THREADS,
     n_wanted_caps = sparkPoolSizeCap(cap) + spare_threads;
     if (n_wanted_caps == 0) return;
 
-    // First grab as many free Capabilities as we can.  ToDo: we should use
-    // capabilities on the same NUMA node preferably, but not exclusively.
-    for (i = (cap->no + 1) % getNumCapabilities(), n_free_caps=0;
-         n_free_caps < n_wanted_caps && i != cap->no;
-         i = (i + 1) % getNumCapabilities()) {
-        Capability *cap0 = getCapability(i);
-        if (cap != cap0 && !cap0->disabled && tryGrabCapability(cap0,task)) {
+    // First grab as many free Capabilities as we can, nearest first.
+    // See Note [Capability victim order] in Capability.c.
+    for (i = 0, n_free_caps=0;
+         n_free_caps < n_wanted_caps && i < getNumCapabilities() - 1;
+         i++) {
+        Capability *cap0 = getCapability(cap->victims[i]);
+        if (!cap0->disabled && tryGrabCapability(cap0,task)) {
             if (!emptyRunQueue(cap0)
                 || RELAXED_LOAD(&cap0->n_returning_tasks) != 0
                 || !emptyInbox(cap0)) {
@@ -843,6 +843,10 @@ schedulePushWork(Capability *cap USED_IF_THREADS,
             else {
                 appendToRunQueue(free_caps[i],t);
                 traceEventMigrateThread (cap, t, free_caps[i]->no);
+                cap->migration_stats.threads_pushed++;
+                if (free_caps[i]->locality != cap->locality) {
+                    cap->migration_stats.threads_pushed_remote++;
+                }
 
                 // See Note [Benign data race due to work-pushing].
                 if (t->bound) {
@@ -1022,27 +1026,27 @@ scheduleProcessInbox (Capability **pcap USED_IF_THREADS)
             cap = *pcap;
         }
 
-        // don't use a blocking acquire; if the lock is held by
-        // another thread then just carry on.  This seems to avoid
-        // getting stuck in a message ping-pong situation with other
-        // processors.  We'll check the inbox again later anyway.
-        //
-        // We should really use a more efficient queue data structure
-        // here.  The trickiness is that we must ensure a Capability
-        // never goes idle if the inbox is non-empty, which is why we
-        // use cap->lock (cap->lock is released as the last thing
-        // before going idle; see Capability.c:releaseCapability()).
-        //
-        // See Note [Heap memory barriers], section "Barriers on messages"
-        r = TRY_ACQUIRE_LOCK(&cap->lock);
-        if (r != 0) return;
-
-        m = cap->inbox;
-        p = cap->putMVars;
-        cap->inbox = (Message*)END_TSO_QUEUE;
-        cap->putMVars = NULL;
-
-        RELEASE_LOCK(&cap->lock);
+        // Take all the messages at once; senders don't need cap->lock.
+        // See Note [Lock-free capability inbox] in Messages.c, and
+        // Note [Heap memory barriers], section "Barriers on messages"
+        m = (Message*)xchg((StgPtr)&cap->inbox, (StgWord)END_TSO_QUEUE);
+
+        // The putMVars are still protected by cap->lock.  Don't use a
+        // blocking acquire; if the lock is held by another thread then
+        // just carry on.  This seems to avoid getting stuck in a
+        // ping-pong situation with other processors.  We'll check
+        // again later anyway.
+        p = NULL;
+        if (RELAXED_LOAD(&cap->putMVars) != NULL) {
+            r = TRY_ACQUIRE_LOCK(&cap->lock);
+            if (r == 0) {
+                p = cap->putMVars;
+                cap->putMVars = NULL;
+                RELEASE_LOCK(&cap->lock);
+            } else if (m == (Message*)END_TSO_QUEUE) {
+                return;
+            }
+        }
 
         while (m != (Message*)END_TSO_QUEUE) {
             next = m->link;
@@ -1190,7 +1194,7 @@ scheduleHandleHeapOverflow( Capability *cap, StgTSO *t )
                                                // nursery has only one
                                                // block.
 
-            bd = allocGroupOnNode_lock(cap->node,blocks);
+            bd = allocGroupOnCap(cap,blocks);
             cap->r.rNursery->n_blocks += blocks;
 
             // link the new group after CurrentNursery
@@ -2087,7 +2091,7 @@ forkProcess(HsStablePtr *entry
     ACQUIRE_LOCK(&sched_mutex);
     ACQUIRE_LOCK(&sm_mutex);
     ACQUIRE_LOCK(&stable_ptr_mutex);
-    ACQUIRE_LOCK(&stable_name_mutex);
+    stableNameLock();
 
     for (i=0; i < n_capabilities; i++) {
         ACQUIRE_LOCK(&getCapability(i)->lock);
@@ -2115,7 +2119,7 @@ forkProcess(HsStablePtr *entry
         RELEASE_LOCK(&sched_mutex);
         RELEASE_LOCK(&sm_mutex);
         RELEASE_LOCK(&stable_ptr_mutex);
-        RELEASE_LOCK(&stable_name_mutex);
+        stableNameUnlock();
         RELEASE_LOCK(&task->lock);
 
 #if defined(THREADED_RTS)
@@ -2143,7 +2147,7 @@ forkProcess(HsStablePtr *entry
         initMutex(&sched_mutex);
         initMutex(&sm_mutex);
         initMutex(&stable_ptr_mutex);
-        initMutex(&stable_name_mutex);
+        initStableNameLocks();
         initMutex(&task->lock);
 
         for (i=0; i < n_capabilities; i++) {
@@ -32,7 +32,7 @@ typedef WSDeque SparkPool;
 SparkPool *allocSparkPool (void);
 
 // Take a spark from the "write" end of the pool.  Can be called
-// by the pool owner only.
+// by the pool owner only.  NB. not safe together with tryStealSparks().
 INLINE_HEADER StgClosure* reclaimSpark(SparkPool *pool);
 
 // Returns True if the spark pool is empty (can give a false positive
@@ -40,8 +40,15 @@ INLINE_HEADER StgClosure* reclaimSpark(SparkPool *pool);
 INLINE_HEADER bool looksEmpty(SparkPool* deque);
 
 INLINE_HEADER StgClosure * tryStealSpark (SparkPool *pool);
+INLINE_HEADER uint32_t     tryStealSparks (SparkPool *pool,
+                                           StgClosure **sparks, uint32_t max);
+INLINE_HEADER uint32_t     pushSparks    (SparkPool *pool,
+                                          StgClosure **sparks, uint32_t n);
 INLINE_HEADER bool         fizzledSpark  (StgClosure *);
 
+// The most sparks that tryStealSparks() takes from another pool at once.
+#define SPARK_STEAL_BATCH 64
+
 void         freeSparkPool     (SparkPool *pool);
 void         createSparkThread (Capability *cap);
 void         traverseSparkQueue(evac_fn evac, void *user, Capability *cap);
@@ -95,6 +102,33 @@ INLINE_HEADER StgClosure * tryStealSpark (SparkPool *pool)
     // other pools before trying again.
 }
 
+/* ----------------------------------------------------------------------------
+ *
+ * tryStealSparks: try to steal half of the sparks of a Capability, but no
+ * more than max, into sparks[].
+ *
+ * Returns the number of sparks stolen, some of which may have fizzled, or 0
+ * if the pool was empty or there was a race with another thread.  Like
+ * tryStealSpark(), this is safe because the owner of a spark pool also
+ * takes its own sparks from the "read" end; it must not use reclaimSpark().
+ * See Note [Stealing half a WSDeque] in WSDeque.c.
+ *
+ -------------------------------------------------------------------------- */
+
+INLINE_HEADER uint32_t tryStealSparks (SparkPool *pool,
+                                       StgClosure **sparks, uint32_t max)
+{
+    return stealHalfWSDeque_(pool, (void **)sparks, max);
+}
+
+// Add several sparks to our own pool at once. Returns the number added,
+// which is less than n if the pool fills up.
+INLINE_HEADER uint32_t pushSparks (SparkPool *pool,
+                                   StgClosure **sparks, uint32_t n)
+{
+    return pushWSDequeN(pool, (void **)sparks, n);
+}
+
 INLINE_HEADER bool fizzledSpark (StgClosure *spark)
 {
     return (GET_CLOSURE_TAG(spark) != 0 || !closure_SHOULD_SPARK(spark));
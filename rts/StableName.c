@@ -19,29 +19,128 @@
 
 #include <string.h>
 
-snEntry *stable_name_table = NULL;
-static snEntry *stable_name_free = NULL;
+// the global stable name table: a directory of segments, each holding
+// SNT_SEGMENT_SIZE entries (see Note [Concurrent stable names])
+snEntry **stable_name_table = NULL;
+
+// the number of entries, SNT_SEGMENT_SIZE times the number of segments
 unsigned int SNT_size = 0;
-#define INIT_SNT_SIZE 64
 
-#if defined(THREADED_RTS)
-Mutex stable_name_mutex;
+// the number of segments, and the size of the directory
+static uint32_t n_snt_segments = 0;
+static uint32_t snt_dir_size = 0;
+#define INIT_SNT_DIR_SIZE 4
+
+// the free entries that are not held by a shard, as a stack of indices.
+// Free entries hold NULL.
+static uint32_t *stable_name_free = NULL;
+static uint32_t n_stable_name_free = 0;
+
+/* As with the stable pointer table, we retain the old versions of the
+ * directory until the next GC, because lookupStableName and
+ * stg_makeStableNamezh read it without taking stable_name_mutex.  The
+ * directory doubles each time, so there are at most N old versions on an
+ * N-bit machine.
+ */
+#if SIZEOF_VOID_P == 4
+#define MAX_N_OLD_SNTS 32
+#elif SIZEOF_VOID_P == 8
+#define MAX_N_OLD_SNTS 64
+#else
+#error unknown SIZEOF_VOID_P
 #endif
 
-static void enlargeStableNameTable(void);
+static snEntry **old_SNTs[MAX_N_OLD_SNTS];
+static uint32_t n_old_SNTs = 0;
+
+// the entries whose object moved or died in the current GC, see
+// gcStableNameTable and updateStableNameTable
+static uint32_t *moved_stable_names = NULL;
+static uint32_t n_moved_stable_names = 0;
+static uint32_t moved_stable_names_size = 0;
+
+#if defined(THREADED_RTS)
+static Mutex stable_name_mutex;
+#endif
 
 /*
- * This hash table maps Haskell objects to stable names, so that every
+ * The hash tables map Haskell objects to stable names, so that every
  * call to lookupStableName on a given object will return the same
- * stable name.
+ * stable name.  They are sharded by the address of the object, see
+ * Note [Concurrent stable names].
  */
 
-static HashTable *addrToStableHash = NULL;
+#define SNT_SHARDS      32      // must be a power of 2
+#define SNT_SHARD_CHUNK 32      // free entries taken by a shard at once
+
+typedef struct {
+#if defined(THREADED_RTS)
+    Mutex lock;
+#endif
+    HashTable *addrToStableHash;
+    uint32_t n_free;
+    uint32_t free[SNT_SHARD_CHUNK];
+} SnShard;
+
+static SnShard sn_shards[SNT_SHARDS];
+
+static void enlargeStableNameTable(void);
+
+/* Note [Concurrent stable names]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * Programs that memoise with StableNames call makeStableName# from many
+ * capabilities at once, so lookupStableName must not serialise them all on
+ * one lock.  We therefore split the map from objects to stable names into
+ * SNT_SHARDS shards, chosen by a hash of the (untagged) address of the
+ * object.  Each shard has its own lock, its own hash table, and a small stack
+ * of free entries, so a lookup or insertion only takes the lock of one shard.
+ * stable_name_mutex is only taken to refill a shard's free stack, which
+ * happens once every SNT_SHARD_CHUNK new stable names in that shard.
+ *
+ * Entries must not move under the feet of a lookup in another shard, so the
+ * table is a directory of segments that never move, as for stable pointers
+ * (see Note [Enlarging the stable pointer table] in StablePtr.c), and a
+ * stable name is an index into the concatenation of the segments.
+ *
+ * The key of an entry in its shard's hash table is sn->old, which is always
+ * the address of the object as of the last GC (or creation), or NULL if the
+ * object has died.  Rather than rebuilding the hash tables after each major
+ * GC, gcStableNameTable remembers the entries whose object moved or died in
+ * moved_stable_names, and updateStableNameTable re-hashes just those.  The
+ * exception is a compacting GC, which moves objects after gcStableNameTable,
+ * so then updateStableNameTable compares addr with old for all entries.
+ *
+ * The GC and the nonmoving collector's sweep (which runs concurrently with
+ * the mutators) need the whole table, so stableNameLock takes the locks of
+ * all the shards followed by stable_name_mutex.  lookupStableName takes
+ * stable_name_mutex while holding a shard lock, so that order avoids
+ * deadlock.  Free entries, whether on the global stack or a shard's, hold
+ * NULL and are ignored by FOR_EACH_STABLE_NAME's users.
+ */
+
+STATIC_INLINE SnShard *
+addrShard(StgPtr p)
+{
+    // Closures are at least word aligned; mix the remaining bits so that
+    // neighbouring objects fall into different shards.
+    StgWord h = ((StgWord)p >> 3) * 0x9e3779b1;
+    return &sn_shards[(h >> 16) & (SNT_SHARDS - 1)];
+}
+
+STATIC_INLINE snEntry *
+stableNameEntry(StgWord sn)
+{
+    snEntry **dir = ACQUIRE_LOAD(&stable_name_table);
+    return &dir[sn >> SNT_SEGMENT_BITS][sn & SNT_SEGMENT_MASK];
+}
 
 void
 stableNameLock(void)
 {
     initStableNameTable();
+    for (uint32_t i = 0; i < SNT_SHARDS; i++) {
+        ACQUIRE_LOCK(&sn_shards[i].lock);
+    }
     ACQUIRE_LOCK(&stable_name_mutex);
 }
 
@@ -49,92 +148,193 @@ void
 stableNameUnlock(void)
 {
     RELEASE_LOCK(&stable_name_mutex);
+    for (uint32_t i = SNT_SHARDS; i > 0; i--) {
+        RELEASE_LOCK(&sn_shards[i-1].lock);
+    }
+}
+
+// Re-initialise the locks in the child of forkProcess(), where the thread
+// that held them no longer exists.
+void
+initStableNameLocks(void)
+{
+#if defined(THREADED_RTS)
+    initMutex(&stable_name_mutex);
+    for (uint32_t i = 0; i < SNT_SHARDS; i++) {
+        initMutex(&sn_shards[i].lock);
+    }
+#endif
 }
 
 /* -----------------------------------------------------------------------------
  * Initialising the table
  * -------------------------------------------------------------------------- */
 
-STATIC_INLINE void
-initSnEntryFreeList(snEntry *table, uint32_t n, snEntry *free)
-{
-  snEntry *p;
-  for (p = table + n - 1; p >= table; p--) {
-    p->addr   = (P_)free;
-    p->old    = NULL;
-    p->sn_obj = NULL;
-    free = p;
-  }
-  stable_name_free = table;
-}
-
 void
 initStableNameTable(void)
 {
-    if (SNT_size > 0) return;
-    SNT_size = INIT_SNT_SIZE;
-    stable_name_table = stgMallocBytes(SNT_size * sizeof(snEntry),
+    if (stable_name_table != NULL) return;
+    snt_dir_size = INIT_SNT_DIR_SIZE;
+    stable_name_table = stgMallocBytes(snt_dir_size * sizeof(snEntry *),
                                        "initStableNameTable");
-    /* we don't use index 0 in the stable name table, because that
-     * would conflict with the hash table lookup operations which
-     * return NULL if an entry isn't found in the hash table.
-     */
-    initSnEntryFreeList(stable_name_table + 1,INIT_SNT_SIZE-1,NULL);
-    addrToStableHash = allocHashTable();
+    for (uint32_t i = 0; i < SNT_SHARDS; i++) {
+        sn_shards[i].addrToStableHash = allocHashTable();
+        sn_shards[i].n_free = 0;
+    }
+    initStableNameLocks();
 
-#if defined(THREADED_RTS)
-    initMutex(&stable_name_mutex);
-#endif
+    ACQUIRE_LOCK(&stable_name_mutex);
+    enlargeStableNameTable();
+    RELEASE_LOCK(&stable_name_mutex);
 }
 
 /* -----------------------------------------------------------------------------
- * Enlarging the tables
+ * Enlarging the table
  * -------------------------------------------------------------------------- */
 
+// Must be holding stable_name_mutex
 static void
 enlargeStableNameTable(void)
 {
-    uint32_t old_SNT_size = SNT_size;
+    ASSERT_LOCK_HELD(&stable_name_mutex);
 
-    // 2nd and subsequent times
-    SNT_size *= 2;
-    stable_name_table =
-        stgReallocBytes(stable_name_table,
-                        SNT_size * sizeof(snEntry),
-                        "enlargeStableNameTable");
+    if (n_snt_segments == (uint32_t)1 << (32 - SNT_SEGMENT_BITS)) {
+        barf("enlargeStableNameTable: too many stable names");
+    }
+
+    if (n_snt_segments == snt_dir_size) {
+        snEntry **new_dir;
+
+        new_dir = stgMallocBytes(2 * snt_dir_size * sizeof(snEntry *),
+                                 "enlargeStableNameTable");
+        memcpy(new_dir, stable_name_table, snt_dir_size * sizeof(snEntry *));
+        ASSERT(n_old_SNTs < MAX_N_OLD_SNTS);
+        old_SNTs[n_old_SNTs++] = stable_name_table;
+        snt_dir_size *= 2;
+        RELEASE_STORE(&stable_name_table, new_dir);
+    }
 
-    initSnEntryFreeList(stable_name_table + old_SNT_size, old_SNT_size, NULL);
+    // Free entries hold NULL
+    snEntry *seg = stgCallocBytes(SNT_SEGMENT_SIZE, sizeof(snEntry),
+                                  "enlargeStableNameTable");
+    RELEASE_STORE(&stable_name_table[n_snt_segments], seg);
+
+    // add the new entries to the free stack, lowest index on top
+    uint32_t first = n_snt_segments * SNT_SEGMENT_SIZE;
+    n_snt_segments++;
+    SNT_size = n_snt_segments * SNT_SEGMENT_SIZE;
+    stable_name_free = stgReallocBytes(stable_name_free,
+                                       SNT_size * sizeof(uint32_t),
+                                       "enlargeStableNameTable");
+    for (uint32_t i = SNT_SEGMENT_SIZE; i > 0; i--) {
+        /* we don't use index 0 in the stable name table, because that
+         * would conflict with the hash table lookup operations which
+         * return NULL if an entry isn't found in the hash table.
+         */
+        if (first + i - 1 != 0) {
+            stable_name_free[n_stable_name_free++] = first + i - 1;
+        }
+    }
 }
 
+// Take a chunk of free entries for a shard.  Must be holding the shard's lock.
+static void
+refillShard(SnShard *shard)
+{
+    ACQUIRE_LOCK(&stable_name_mutex);
+    if (n_stable_name_free == 0) {
+        enlargeStableNameTable();
+    }
+    // keep the lowest index on top of the shard's stack too
+    uint32_t n = stg_min(n_stable_name_free, SNT_SHARD_CHUNK);
+    n_stable_name_free -= n;
+    for (uint32_t i = 0; i < n; i++) {
+        shard->free[i] = stable_name_free[n_stable_name_free + i];
+    }
+    shard->n_free = n;
+    RELEASE_LOCK(&stable_name_mutex);
+}
 
 /* -----------------------------------------------------------------------------
  * Freeing entries and tables
  * -------------------------------------------------------------------------- */
 
+static void
+freeOldSNTs(void)
+{
+    for (uint32_t i = 0; i < n_old_SNTs; i++) {
+        stgFree(old_SNTs[i]);
+    }
+    n_old_SNTs = 0;
+}
+
 void
 exitStableNameTable(void)
 {
-    if (addrToStableHash)
-        freeHashTable(addrToStableHash, NULL);
-    addrToStableHash = NULL;
+    for (uint32_t i = 0; i < SNT_SHARDS; i++) {
+        if (sn_shards[i].addrToStableHash)
+            freeHashTable(sn_shards[i].addrToStableHash, NULL);
+        sn_shards[i].addrToStableHash = NULL;
+        sn_shards[i].n_free = 0;
+    }
 
-    if (stable_name_table)
+    if (stable_name_table) {
+        for (uint32_t i = 0; i < n_snt_segments; i++) {
+            stgFree(stable_name_table[i]);
+        }
         stgFree(stable_name_table);
+    }
     stable_name_table = NULL;
+    n_snt_segments = 0;
+    snt_dir_size = 0;
     SNT_size = 0;
 
+    if (stable_name_free)
+        stgFree(stable_name_free);
+    stable_name_free = NULL;
+    n_stable_name_free = 0;
+
+    if (moved_stable_names)
+        stgFree(moved_stable_names);
+    moved_stable_names = NULL;
+    n_moved_stable_names = 0;
+    moved_stable_names_size = 0;
+
+    freeOldSNTs();
+
 #if defined(THREADED_RTS)
     closeMutex(&stable_name_mutex);
+    for (uint32_t i = 0; i < SNT_SHARDS; i++) {
+        closeMutex(&sn_shards[i].lock);
+    }
 #endif
 }
 
+// Must be holding the stable name lock
 void
-freeSnEntry(snEntry *sn)
+freeSnEntry(StgWord sn)
 {
-  ASSERT(sn->sn_obj == NULL);
-  removeHashTable(addrToStableHash, (W_)sn->old, NULL);
-  sn->addr = (P_)stable_name_free;
-  stable_name_free = sn;
+  snEntry *p = stableNameEntry(sn);
+  ASSERT(p->sn_obj == NULL);
+  if (p->old != NULL) {
+      removeHashTable(addrShard(p->old)->addrToStableHash, (W_)p->old, NULL);
+  }
+  p->addr = NULL;
+  p->old  = NULL;
+  stable_name_free[n_stable_name_free++] = sn;
+}
+
+// The object of a stable name died outside of a moving GC, i.e. in the
+// nonmoving collector's sweep.  Must be holding the stable name lock.
+void
+clearSnEntryAddr(StgWord sn)
+{
+  snEntry *p = stableNameEntry(sn);
+  if (p->old != NULL) {
+      removeHashTable(addrShard(p->old)->addrToStableHash, (W_)p->old, NULL);
+  }
+  p->addr = NULL;
+  p->old  = NULL;
 }
 
 /* -----------------------------------------------------------------------------
@@ -177,12 +377,6 @@ removeIndirections (StgClosure* p)
 StgWord
 lookupStableName (StgPtr p)
 {
-  stableNameLock();
-
-  if (stable_name_free == NULL) {
-    enlargeStableNameTable();
-  }
-
   /* removing indirections increases the likelihood
    * of finding a match in the stable name hash table.
    */
@@ -191,40 +385,37 @@ lookupStableName (StgPtr p)
   // register the untagged pointer.  This just makes things simpler.
   p = (StgPtr)UNTAG_CLOSURE((StgClosure*)p);
 
-  StgWord sn = (StgWord)lookupHashTable(addrToStableHash,(W_)p);
+  SnShard *shard = addrShard(p);
+  ACQUIRE_LOCK(&shard->lock);
+
+  StgWord sn = (StgWord)lookupHashTable(shard->addrToStableHash,(W_)p);
 
   if (sn != 0) {
-    ASSERT(stable_name_table[sn].addr == p);
+    ASSERT(stableNameEntry(sn)->addr == p);
     debugTrace(DEBUG_stable, "cached stable name %ld at %p",sn,p);
-    stableNameUnlock();
+    RELEASE_LOCK(&shard->lock);
     return sn;
   }
 
-  sn = stable_name_free - stable_name_table;
-  stable_name_free  = (snEntry*)(stable_name_free->addr);
-  stable_name_table[sn].addr = p;
-  stable_name_table[sn].sn_obj = NULL;
+  if (shard->n_free == 0) {
+    refillShard(shard);
+  }
+  sn = shard->free[--shard->n_free];
+
+  snEntry *e = stableNameEntry(sn);
+  e->addr = p;
+  e->old = p;
+  e->sn_obj = NULL;
   /* debugTrace(DEBUG_stable, "new stable name %d at %p\n",sn,p); */
 
   /* add the new stable name to the hash table */
-  insertHashTable(addrToStableHash, (W_)p, (void *)sn);
+  insertHashTable(shard->addrToStableHash, (W_)p, (void *)sn);
 
-  stableNameUnlock();
+  RELEASE_LOCK(&shard->lock);
 
   return sn;
 }
 
-/* -----------------------------------------------------------------------------
- * Remember old stable name addresses
- * -------------------------------------------------------------------------- */
-
-void
-rememberOldStableNameAddresses(void)
-{
-    /* TODO: Only if !full GC */
-    FOR_EACH_STABLE_NAME(p, p->old = p->addr;);
-}
-
 /* -----------------------------------------------------------------------------
  * Thread the stable name table for compacting GC.
  *
@@ -236,7 +427,7 @@ rememberOldStableNameAddresses(void)
 void
 threadStableNameTable( evac_fn evac, void *user )
 {
-    FOR_EACH_STABLE_NAME(p, {
+    FOR_EACH_STABLE_NAME(sn, p, {
         if (p->sn_obj != NULL) {
             evac(user, (StgClosure **)&p->sn_obj);
         }
@@ -260,31 +451,52 @@ threadStableNameTable( evac_fn evac, void *user )
  * refer to the entry.
  * -------------------------------------------------------------------------- */
 
+static void
+rememberMovedStableName(StgWord sn)
+{
+    if (n_moved_stable_names == moved_stable_names_size) {
+        moved_stable_names_size =
+            moved_stable_names_size ? 2 * moved_stable_names_size : 64;
+        moved_stable_names =
+            stgReallocBytes(moved_stable_names,
+                            moved_stable_names_size * sizeof(uint32_t),
+                            "rememberMovedStableName");
+    }
+    moved_stable_names[n_moved_stable_names++] = sn;
+}
+
 void
 gcStableNameTable( void )
 {
     // We must take the stable name lock lest we race with the nonmoving
     // collector (namely nonmovingSweepStableNameTable).
     stableNameLock();
+
+    // No mutator can be looking at an old version of the directory now.
+    freeOldSNTs();
+
+    n_moved_stable_names = 0;
     FOR_EACH_STABLE_NAME(
-        p, {
-            // FOR_EACH_STABLE_NAME traverses free entries too, so
-            // check sn_obj
+        sn, p, {
+            // Free entries hold NULL, so check sn_obj
             if (p->sn_obj != NULL) {
                 // Update the pointer to the StableName object, if there is one
                 p->sn_obj = isAlive(p->sn_obj);
                 if (p->sn_obj == NULL) {
                     // StableName object died
                     debugTrace(DEBUG_stable, "GC'd StableName %ld (addr=%p)",
-                               (long)(p - stable_name_table), p->addr);
-                    freeSnEntry(p);
+                               (long)sn, p->addr);
+                    freeSnEntry(sn);
                 } else if (p->addr != NULL) {
                     // sn_obj is alive, update pointee
                     p->addr = (StgPtr)isAlive((StgClosure *)p->addr);
                     if (p->addr == NULL) {
                         // Pointee died
                         debugTrace(DEBUG_stable, "GC'd pointee %ld",
-                                   (long)(p - stable_name_table));
+                                   (long)sn);
+                    }
+                    if (p->addr != p->old) {
+                        rememberMovedStableName(sn);
                     }
                 }
             }
@@ -293,40 +505,51 @@ gcStableNameTable( void )
 }
 
 /* -----------------------------------------------------------------------------
- * Update the StableName hash table
+ * Update the StableName hash tables
  *
- * The boolean argument 'full' indicates that a major collection is
- * being done, so we might as well throw away the hash table and build
- * a new one.  For a minor collection, we just re-hash the elements
- * that changed.
+ * We re-hash the entries whose object moved or died, as remembered by
+ * gcStableNameTable.  The boolean argument 'full' indicates that the
+ * compacting collector has moved objects since then, so we look for
+ * such entries in the whole table instead.
  * -------------------------------------------------------------------------- */
 
 void
 updateStableNameTable(bool full)
 {
-    if (full && addrToStableHash != NULL && 0 != keyCountHashTable(addrToStableHash)) {
-        freeHashTable(addrToStableHash,NULL);
-        addrToStableHash = allocHashTable();
-    }
+    stableNameLock();
 
-    if(full) {
+    if (full) {
+        n_moved_stable_names = 0;
         FOR_EACH_STABLE_NAME(
-            p, {
-                if (p->addr != NULL) {
-                    // Target still alive, Re-hash this stable name
-                    insertHashTable(addrToStableHash, (W_)p->addr, (void *)(p - stable_name_table));
-                }
-            });
-    } else {
-        FOR_EACH_STABLE_NAME(
-            p, {
+            sn, p, {
                 if (p->addr != p->old) {
-                    removeHashTable(addrToStableHash, (W_)p->old, NULL);
-                    /* Movement happened: */
-                    if (p->addr != NULL) {
-                        insertHashTable(addrToStableHash, (W_)p->addr, (void *)(p - stable_name_table));
-                    }
+                    rememberMovedStableName(sn);
                 }
             });
     }
+
+    // Remove all of the old keys before inserting any of the new ones, so
+    // that an object moving to where another one was cannot confuse us.
+    for (uint32_t i = 0; i < n_moved_stable_names; i++) {
+        snEntry *p = stableNameEntry(moved_stable_names[i]);
+        if (p->addr != p->old && p->old != NULL) {
+            removeHashTable(addrShard(p->old)->addrToStableHash,
+                            (W_)p->old, NULL);
+        }
+    }
+    for (uint32_t i = 0; i < n_moved_stable_names; i++) {
+        StgWord sn = moved_stable_names[i];
+        snEntry *p = stableNameEntry(sn);
+        if (p->addr != p->old) {
+            if (p->addr != NULL) {
+                // Target still alive, Re-hash this stable name
+                insertHashTable(addrShard(p->addr)->addrToStableHash,
+                                (W_)p->addr, (void *)sn);
+            }
+            p->old = p->addr;
+        }
+    }
+    n_moved_stable_names = 0;
+
+    stableNameUnlock();
 }
@@ -11,45 +11,40 @@
 #include "BeginPrivate.h"
 
 void    initStableNameTable   ( void );
-void    freeSnEntry           ( snEntry *sn );
+void    freeSnEntry           ( StgWord sn );
+void    clearSnEntryAddr      ( StgWord sn );
 void    exitStableNameTable   ( void );
 StgWord lookupStableName      ( StgPtr p );
 
-void    rememberOldStableNameAddresses ( void );
-
 void    threadStableNameTable ( evac_fn evac, void *user );
 void    gcStableNameTable     ( void );
 void    updateStableNameTable ( bool full );
 
 void    stableNameLock            ( void );
 void    stableNameUnlock          ( void );
+// needed by Schedule.c:forkProcess()
+void    initStableNameLocks       ( void );
 
 extern unsigned int SNT_size;
 
-#define FOR_EACH_STABLE_NAME(p, CODE)                                   \
+// Visit the entries of the table, with sn the index (the stable name) and p
+// the entry.  Free entries hold NULL, and if p->addr == NULL but p->sn_obj
+// is not, it's a stable name where the object has been GC'd, but the
+// StableName object (sn_obj) is still alive.
+#define FOR_EACH_STABLE_NAME(sn, p, CODE)                               \
     do {                                                                \
-        snEntry *p;                                                     \
-        snEntry *__end_ptr = &stable_name_table[SNT_size];              \
-        for (p = stable_name_table + 1; p < __end_ptr; p++) {           \
-            /* Internal pointers are free slots.  */                    \
-            /* If p->addr == NULL, it's a */                            \
-            /* stable name where the object has been GC'd, but the */   \
-            /* StableName object (sn_obj) is still alive. */            \
-            if ((p->addr < (P_)stable_name_table ||                     \
-                 p->addr >= (P_)__end_ptr))                             \
-            {                                                           \
-                /* NOTE: There is an ambiguity here if p->addr == NULL */ \
-                /* it is either the last item in the free list or it */ \
-                /* is a stable name whose pointee died. sn_obj == NULL */ \
-                /* disambiguates as last free list item. */             \
+        uint32_t __seg;                                                 \
+        for (__seg = 0; __seg < SNT_size / SNT_SEGMENT_SIZE; __seg++) { \
+            snEntry *__seg_ptr = stable_name_table[__seg];              \
+            StgWord __i;                                                \
+            for (__i = 0; __i < SNT_SEGMENT_SIZE; __i++) {              \
+                StgWord sn STG_UNUSED =                                 \
+                    (StgWord)__seg * SNT_SEGMENT_SIZE + __i;            \
+                snEntry *p = &__seg_ptr[__i];                           \
+                if (sn == 0) continue;                                  \
                 do { CODE } while(0);                                   \
             }                                                           \
         }                                                               \
     } while(0)
 
-#if defined(THREADED_RTS)
-// needed by Schedule.c:forkProcess()
-extern Mutex stable_name_mutex;
-#endif
-
 #include "EndPrivate.h"
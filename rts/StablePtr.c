@@ -16,6 +16,8 @@
 #include "RtsUtils.h"
 #include "Trace.h"
 #include "StablePtr.h"
+#include "Capability.h"
+#include "Task.h"
 
 #include <string.h>
 
@@ -98,21 +100,25 @@
  */
 
 
-// the global stable pointer entry table
-spEntry *stable_ptr_table = NULL;
+// the global stable pointer table: a directory of segments, each holding
+// SPT_SEGMENT_SIZE entries (see Note [Enlarging the stable pointer table])
+spEntry **stable_ptr_table = NULL;
 
-// the next free stable ptr, the free entries form a linked list where spEntry.addr points to the next after
-static spEntry *stable_ptr_free = NULL;
+// the number of segments, and the size of the directory
+static uint32_t n_spt_segments = 0;
+static uint32_t spt_dir_size = 0;
+#define INIT_SPT_DIR_SIZE 4
 
-// current stable pointer table size
-static unsigned int SPT_size = 0;
-#define INIT_SPT_SIZE 64
+// the free entries that are not in a capability's cache, as a stack of
+// indices.  Free entries hold NULL.
+static uint32_t *stable_ptr_free = NULL;
+static uint32_t n_stable_ptr_free = 0;
 
-/* Each time the stable pointer table is enlarged, we temporarily retain the old
- * version to ensure dereferences are thread-safe (see Note [Enlarging the
- * stable pointer table]).  Since we double the size of the table each time, we
+/* Each time the directory is enlarged, we temporarily retain the old version
+ * to ensure dereferences are thread-safe (see Note [Enlarging the stable
+ * pointer table]).  Since we double the size of the directory each time, we
  * can (theoretically) enlarge it at most N times on an N-bit machine.  Thus,
- * there will never be more than N old versions of the table.
+ * there will never be more than N old versions of the directory.
  */
 #if SIZEOF_VOID_P == 4
 #define MAX_N_OLD_SPTS 32
@@ -122,8 +128,8 @@ static unsigned int SPT_size = 0;
 #error unknown SIZEOF_VOID_P
 #endif
 
-// old stable pointer tables
-static spEntry *old_SPTs[MAX_N_OLD_SPTS];
+// old stable pointer table directories
+static spEntry **old_SPTs[MAX_N_OLD_SPTS];
 static uint32_t n_old_SPTs = 0;
 
 #if defined(THREADED_RTS)
@@ -154,30 +160,19 @@ stablePtrUnlock(void)
  * Initialising the table
  * -------------------------------------------------------------------------- */
 
-STATIC_INLINE void
-initSpEntryFreeList(spEntry *table, uint32_t n)
-{
-  spEntry* free = NULL;
-  spEntry *p;
-  for (p = table + n - 1; p >= table; p--) {
-      p->addr = (P_)free;
-      free = p;
-  }
-  stable_ptr_free = table;
-}
-
 void
 initStablePtrTable(void)
 {
-    if (SPT_size > 0) return;
-    SPT_size = INIT_SPT_SIZE;
-    stable_ptr_table = stgMallocBytes(SPT_size * sizeof(spEntry),
+    if (stable_ptr_table != NULL) return;
+    spt_dir_size = INIT_SPT_DIR_SIZE;
+    stable_ptr_table = stgMallocBytes(spt_dir_size * sizeof(spEntry *),
                                       "initStablePtrTable");
-    initSpEntryFreeList(stable_ptr_table,INIT_SPT_SIZE);
-
 #if defined(THREADED_RTS)
     initMutex(&stable_ptr_mutex);
 #endif
+    ACQUIRE_LOCK(&stable_ptr_mutex);
+    enlargeStablePtrTable();
+    RELEASE_LOCK(&stable_ptr_mutex);
 }
 
 /* -----------------------------------------------------------------------------
@@ -190,48 +185,90 @@ enlargeStablePtrTable(void)
 {
     ASSERT_LOCK_HELD(&stable_ptr_mutex);
 
-    uint32_t old_SPT_size = SPT_size;
-    spEntry *new_stable_ptr_table;
-
-    // 2nd and subsequent times
-    SPT_size *= 2;
+    if (n_spt_segments == (uint32_t)1 << (32 - SPT_SEGMENT_BITS)) {
+        barf("enlargeStablePtrTable: too many stable pointers");
+    }
 
-    /* We temporarily retain the old version instead of freeing it; see Note
-     * [Enlarging the stable pointer table].
-     */
-    new_stable_ptr_table =
-        stgMallocBytes(SPT_size * sizeof(spEntry),
-                       "enlargeStablePtrTable");
-    memcpy(new_stable_ptr_table,
-           stable_ptr_table,
-           old_SPT_size * sizeof(spEntry));
-    ASSERT(n_old_SPTs < MAX_N_OLD_SPTS);
-    old_SPTs[n_old_SPTs++] = stable_ptr_table;
-
-    /* When using the threaded RTS, the update of stable_ptr_table is assumed to
-     * be atomic, so that another thread simultaneously dereferencing a stable
-     * pointer will always read a valid address. Release ordering to ensure
-     * that the new table is visible to others.
-     */
-    RELEASE_STORE(&stable_ptr_table, new_stable_ptr_table);
+    if (n_spt_segments == spt_dir_size) {
+        spEntry **new_dir;
+
+        /* We temporarily retain the old version instead of freeing it; see
+         * Note [Enlarging the stable pointer table].
+         */
+        new_dir = stgMallocBytes(2 * spt_dir_size * sizeof(spEntry *),
+                                 "enlargeStablePtrTable");
+        memcpy(new_dir, stable_ptr_table, spt_dir_size * sizeof(spEntry *));
+        ASSERT(n_old_SPTs < MAX_N_OLD_SPTS);
+        old_SPTs[n_old_SPTs++] = stable_ptr_table;
+        spt_dir_size *= 2;
+
+        /* Release ordering to ensure that the new directory is visible to
+         * others.
+         */
+        RELEASE_STORE(&stable_ptr_table, new_dir);
+    }
 
-    // add the new entries to the free list
-    initSpEntryFreeList(stable_ptr_table + old_SPT_size, old_SPT_size);
+    // Free entries hold NULL
+    spEntry *seg = stgCallocBytes(SPT_SEGMENT_SIZE, sizeof(spEntry),
+                                  "enlargeStablePtrTable");
+    RELEASE_STORE(&stable_ptr_table[n_spt_segments], seg);
+
+    // add the new entries to the free stack, lowest index on top
+    uint32_t first = n_spt_segments * SPT_SEGMENT_SIZE;
+    n_spt_segments++;
+    stable_ptr_free = stgReallocBytes(stable_ptr_free,
+                                      n_spt_segments * SPT_SEGMENT_SIZE
+                                        * sizeof(uint32_t),
+                                      "enlargeStablePtrTable");
+    for (uint32_t i = SPT_SEGMENT_SIZE; i > 0; i--) {
+        stable_ptr_free[n_stable_ptr_free++] = first + i - 1;
+    }
 }
 
 /* Note [Enlarging the stable pointer table]
  * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
- * To enlarge the stable pointer table, we allocate a new table, copy the
- * existing entries, and then store the old version of the table in old_SPTs
- * until we free it during GC.  By not immediately freeing the old version
- * (or equivalently by not growing the table using realloc()), we ensure that
- * another thread simultaneously dereferencing a stable pointer using the old
- * version can safely access the table without causing a segfault (see Trac
- * #10296).
+ * The stable pointer table is a directory of segments of SPT_SEGMENT_SIZE
+ * entries, and a stable pointer is an index into the concatenation of the
+ * segments (see deRefStablePtr).  To enlarge the table we add a segment.
+ * Entries never move, so a thread dereferencing a stable pointer, or
+ * allocating or freeing one from its capability's cache (see Note [Stable
+ * pointer caches]), never has to wait for the table to be enlarged.
  *
- * Note that because the stable pointer table is doubled in size each time it is
- * enlarged, the total memory needed to store the old versions is always less
- * than that required to hold the current version.
+ * When the directory itself is full we allocate a new one of twice the size,
+ * copy the segment pointers, and then store the old version of the directory
+ * in old_SPTs until we free it during GC.  By not immediately freeing the old
+ * version (or equivalently by not growing the directory using realloc()), we
+ * ensure that another thread simultaneously dereferencing a stable pointer
+ * using the old version can safely access the table without causing a
+ * segfault (see Trac #10296).  A segment pointer never changes once it has
+ * been written, so both versions lead to the same entries.
+ */
+
+/* Note [Stable pointer caches]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FFI-heavy programs create and free stable pointers from many capabilities
+ * at once: callbacks, hs_try_putmvar, and handles passed to C.  So that they
+ * don't all serialise on stable_ptr_mutex, each capability keeps a cache of
+ * up to STABLE_PTR_CACHE_SIZE free entries (cap->stable_ptr_cache).
+ *
+ *  - getStablePtrCap takes an entry from the cache, and only when the cache
+ *    is empty refills it with STABLE_PTR_CACHE_CHUNK entries from the global
+ *    free stack, taking the lock.
+ *
+ *  - freeStablePtrCap puts the entry in the cache, and only when the cache is
+ *    full returns STABLE_PTR_CACHE_CHUNK entries to the global free stack.
+ *
+ * The cache may only be used by the thread that holds the capability, so the
+ * stable pointer functions that are called from C (getStablePtr,
+ * freeStablePtr) use it only if the calling thread holds a capability.  In
+ * the non-threaded RTS there is no cache.
+ *
+ * Because the entries never move (Note [Enlarging the stable pointer table])
+ * the cached entries can be written without the lock.  A free entry, cached
+ * or not, holds NULL, which the GC ignores, so the GC need not know about
+ * the caches.  The lock therefore no longer excludes allocations and frees
+ * from the caches, but everything that needs exclusion from them (GC and
+ * forkProcess) runs with all of the capabilities stopped anyway.
  */
 
 
@@ -253,11 +290,22 @@ freeOldSPTs(void)
 void
 exitStablePtrTable(void)
 {
-    if (stable_ptr_table)
+    if (stable_ptr_table) {
+        for (uint32_t i = 0; i < n_spt_segments; i++) {
+            stgFree(stable_ptr_table[i]);
+        }
         stgFree(stable_ptr_table);
+    }
 
     stable_ptr_table = NULL;
-    SPT_size = 0;
+    n_spt_segments = 0;
+    spt_dir_size = 0;
+
+    if (stable_ptr_free) {
+        stgFree(stable_ptr_free);
+    }
+    stable_ptr_free = NULL;
+    n_stable_ptr_free = 0;
 
     freeOldSPTs();
 
@@ -266,11 +314,28 @@ exitStablePtrTable(void)
 #endif
 }
 
-STATIC_INLINE void
-freeSpEntry(spEntry *sp)
+STATIC_INLINE spEntry *
+stablePtrEntry(StgWord spw)
 {
-    RELAXED_STORE(&sp->addr, (P_)stable_ptr_free);
-    stable_ptr_free = sp;
+    ASSERT(spw < (StgWord)n_spt_segments * SPT_SEGMENT_SIZE);
+    return &stable_ptr_table[spw >> SPT_SEGMENT_BITS][spw & SPT_SEGMENT_MASK];
+}
+
+// The capability that the calling thread holds, if any, whose stable pointer
+// cache it may use. See Note [Stable pointer caches].
+STATIC_INLINE Capability *
+heldCapability(void)
+{
+#if defined(THREADED_RTS)
+    Task *task = myTask();
+    if (task == NULL || task->cap == NULL) {
+        return NULL;
+    }
+    Capability *cap = task->cap;
+    return RELAXED_LOAD(&cap->running_task) == task ? cap : NULL;
+#else
+    return NULL;
+#endif
 }
 
 void
@@ -285,14 +350,38 @@ freeStablePtrUnsafe(StgStablePtr sp)
 
     StgWord spw = (StgWord)sp - 1;
 
-    ASSERT(spw < SPT_size);
-
-    freeSpEntry(&stable_ptr_table[spw]);
+    RELAXED_STORE(&stablePtrEntry(spw)->addr, NULL);
+    stable_ptr_free[n_stable_ptr_free++] = (uint32_t)spw;
 }
 
 void
-freeStablePtr(StgStablePtr sp)
+freeStablePtrCap(Capability *cap STG_UNUSED, StgStablePtr sp)
 {
+#if defined(THREADED_RTS)
+    // see Note [NULL StgStablePtr]
+    if (cap != NULL && sp != NULL) {
+        StablePtrCache *cache = &cap->stable_ptr_cache;
+        StgWord spw = (StgWord)sp - 1;
+
+        if (cache->n == STABLE_PTR_CACHE_SIZE) {
+            // Return the oldest entries to the global free stack
+            stablePtrLock();
+            memcpy(&stable_ptr_free[n_stable_ptr_free], cache->entries,
+                   STABLE_PTR_CACHE_CHUNK * sizeof(uint32_t));
+            n_stable_ptr_free += STABLE_PTR_CACHE_CHUNK;
+            stablePtrUnlock();
+            memmove(cache->entries, &cache->entries[STABLE_PTR_CACHE_CHUNK],
+                    (STABLE_PTR_CACHE_SIZE - STABLE_PTR_CACHE_CHUNK)
+                      * sizeof(uint32_t));
+            cache->n -= STABLE_PTR_CACHE_CHUNK;
+        }
+
+        RELAXED_STORE(&stablePtrEntry(spw)->addr, NULL);
+        cache->entries[cache->n++] = (uint32_t)spw;
+        return;
+    }
+#endif
+
     stablePtrLock();
 
     freeStablePtrUnsafe(sp);
@@ -300,49 +389,85 @@ freeStablePtr(StgStablePtr sp)
     stablePtrUnlock();
 }
 
+void
+freeStablePtr(StgStablePtr sp)
+{
+    freeStablePtrCap(heldCapability(), sp);
+}
+
 /* -----------------------------------------------------------------------------
  * Allocating stable pointers
  * -------------------------------------------------------------------------- */
 
 StgStablePtr
-getStablePtr(StgPtr p)
+getStablePtrCap(Capability *cap STG_UNUSED, StgPtr p)
 {
-  stablePtrLock();
+  StgWord sp;
 
-  if (!stable_ptr_free)
-      enlargeStablePtrTable();
+#if defined(THREADED_RTS)
+  if (cap != NULL) {
+      StablePtrCache *cache = &cap->stable_ptr_cache;
+
+      if (cache->n == 0) {
+          // Refill the cache from the global free stack
+          stablePtrLock();
+          while (n_stable_ptr_free < STABLE_PTR_CACHE_CHUNK) {
+              enlargeStablePtrTable();
+          }
+          n_stable_ptr_free -= STABLE_PTR_CACHE_CHUNK;
+          // keep the lowest index on top of the cache
+          for (uint32_t i = 0; i < STABLE_PTR_CACHE_CHUNK; i++) {
+              cache->entries[i] =
+                  stable_ptr_free[n_stable_ptr_free + STABLE_PTR_CACHE_CHUNK - 1 - i];
+          }
+          cache->n = STABLE_PTR_CACHE_CHUNK;
+          stablePtrUnlock();
+      }
+
+      sp = cache->entries[--cache->n];
+  } else
+#endif
+  {
+      stablePtrLock();
 
-  // find the index of free stable ptr
-  StgWord sp = stable_ptr_free - stable_ptr_table;
+      if (n_stable_ptr_free == 0)
+          enlargeStablePtrTable();
 
-  // unlink the table entry we grabbed from the free list
-  stable_ptr_free = (spEntry*)(stable_ptr_free->addr);
+      // take the index of a free stable ptr
+      sp = stable_ptr_free[--n_stable_ptr_free];
 
-  // release store to pair with acquire load in deRefStablePtr
-  RELEASE_STORE(&stable_ptr_table[sp].addr, p);
+      stablePtrUnlock();
+  }
 
-  stablePtrUnlock();
+  // release store to pair with acquire load in deRefStablePtr
+  RELEASE_STORE(&stablePtrEntry(sp)->addr, p);
 
   // see Note [NULL StgStablePtr]
   sp = sp + 1;
   return (StgStablePtr)(sp);
 }
 
+StgStablePtr
+getStablePtr(StgPtr p)
+{
+  return getStablePtrCap(heldCapability(), p);
+}
+
 /* -----------------------------------------------------------------------------
  * Treat stable pointers as roots for the garbage collector.
  * -------------------------------------------------------------------------- */
 
 #define FOR_EACH_STABLE_PTR(p, CODE)                                    \
     do {                                                                \
-        spEntry *p;                                                     \
-        spEntry *__end_ptr = &stable_ptr_table[SPT_size];               \
-        for (p = stable_ptr_table; p < __end_ptr; p++) {                \
-            /* Internal pointers are free slots. NULL is last in free */ \
-            /* list. */                                                 \
-            if (p->addr &&                                              \
-                (p->addr < (P_)stable_ptr_table || p->addr >= (P_)__end_ptr)) \
-            {                                                           \
-                do { CODE } while(0);                                   \
+        uint32_t __s;                                                   \
+        for (__s = 0; __s < n_spt_segments; __s++) {                    \
+            spEntry *p;                                                 \
+            spEntry *__end_ptr = &stable_ptr_table[__s][SPT_SEGMENT_SIZE]; \
+            for (p = stable_ptr_table[__s]; p < __end_ptr; p++) {       \
+                /* Free entries hold NULL */                            \
+                if (p->addr) {                                          \
+                    do { CODE } while(0);                               \
+                }                                                       \
             }                                                           \
         }                                                               \
     } while(0)
@@ -18,8 +18,24 @@
 
 #include "BeginPrivate.h"
 
+/* A capability's cache of free stable pointer table entries.
+ * See Note [Stable pointer caches] in StablePtr.c.
+ */
+#define STABLE_PTR_CACHE_CHUNK 32
+#define STABLE_PTR_CACHE_SIZE  (2 * STABLE_PTR_CACHE_CHUNK)
+
+typedef struct {
+    uint32_t n;
+    uint32_t entries[STABLE_PTR_CACHE_SIZE]; // indices, see deRefStablePtr
+} StablePtrCache;
+
 void    freeStablePtr         ( StgStablePtr sp );
 
+/* Allocate and free stable pointers using the cache of cap, which the
+   caller must hold, or the global table if cap is NULL. */
+StgStablePtr getStablePtrCap  ( Capability *cap, StgPtr p );
+void    freeStablePtrCap      ( Capability *cap, StgStablePtr sp );
+
 /* Use the "Unsafe" one after only when manually locking and
    unlocking with stablePtrLock/stablePtrUnlock */
 void    freeStablePtrUnsafe   ( StgStablePtr sp );
@@ -21,7 +21,7 @@ static Mutex spt_lock;
 #endif
 
 /// Hash function for the SPT.
-STATIC_INLINE int hashFingerprint(const HashTable *table, StgWord key) {
+STATIC_INLINE StgWord hashFingerprint(const HashTable *table, StgWord key) {
   const StgWord64* ptr = (StgWord64*) key;
   // Take half of the key to compute the hash.
   return hashWord(table, *(ptr + 1));
@@ -45,7 +45,8 @@ void hs_spt_insert_stableptr(StgWord64 key[2], StgStablePtr *entry) {
   }
 
   ACQUIRE_LOCK(&spt_lock);
-  insertHashTable_(spt, (StgWord)key, entry, hashFingerprint);
+  insertHashTable_(spt, (StgWord)key, entry, hashFingerprint,
+                   compareFingerprint);
   RELEASE_LOCK(&spt_lock);
 }
 
@@ -18,6 +18,7 @@
 #include "sm/Storage.h"
 #include "sm/GCThread.h"
 #include "sm/BlockAlloc.h"
+#include "sm/OSMem.h"
 
 // for spin/yield counters
 #include "sm/GC.h"
@@ -69,6 +70,30 @@ static Time *GC_coll_cpu = NULL;
 static Time *GC_coll_elapsed = NULL;
 static Time *GC_coll_max_pause = NULL;
 
+// CPU time used by the nonmoving collector's helper threads since the start of
+// the current nonmoving collection.
+static Time nonmoving_gc_worker_cpu = 0;
+
+// Elapsed time spent sweeping by each nonmoving collector worker.
+static Time *nonmoving_sweep_elapsed = NULL;
+static uint32_t n_nonmoving_sweep_workers = 0;
+
+// The latencies of the GC barriers of all parallel GCs, see
+// Note [Adaptive GC synchronisation] in sm/GC.c
+static uint64_t gc_sync_hist[GC_SYNC_HIST_BUCKETS];
+
+// The most memory we have seen backed by huge pages, sampled after each major
+// GC with +RTS --huge-pages. See Note [Huge pages] in MBlock.c.
+static uint64_t max_huge_page_bytes = 0;
+
+static void sampleHugePageBytes(void)
+{
+    uint64_t bytes = osHugePageBytes();
+    if (bytes > max_huge_page_bytes) {
+        max_huge_page_bytes = bytes;
+    }
+}
+
 static int statsPrintf( char *s, ... ) STG_PRINTF_ATTR(1, 2);
 static void statsFlush( void );
 static void statsClose( void );
@@ -118,6 +143,7 @@ initStats0(void)
     start_nonmoving_gc_cpu = 0;
     start_nonmoving_gc_elapsed = 0;
     start_nonmoving_gc_sync_elapsed = 0;
+    nonmoving_gc_worker_cpu = 0;
 
     start_exit_cpu    = 0;
     start_exit_elapsed = 0;
@@ -218,6 +244,11 @@ initStats1 (void)
         (Time *)stgMallocBytes(
             sizeof(Time)*RtsFlags.GcFlags.generations,
             "initStats");
+    n_nonmoving_sweep_workers = RtsFlags.GcFlags.nonmovingMarkThreads;
+    nonmoving_sweep_elapsed =
+        (Time *)stgMallocBytes(
+            sizeof(Time)*n_nonmoving_sweep_workers,
+            "initStats");
     initGenerationStats();
 }
 
@@ -229,6 +260,12 @@ initGenerationStats(void)
         GC_coll_elapsed[i] = 0;
         GC_coll_max_pause[i] = 0;
     }
+    for (uint32_t i = 0; i < n_nonmoving_sweep_workers; i++) {
+        nonmoving_sweep_elapsed[i] = 0;
+    }
+    for (uint32_t i = 0; i < GC_SYNC_HIST_BUCKETS; i++) {
+        gc_sync_hist[i] = 0;
+    }
 }
 
 /* ---------------------------------------------------------------------------
@@ -313,8 +350,10 @@ stat_endNonmovingGc (void)
     stats.gc.nonmoving_gc_elapsed_ns = elapsed - start_nonmoving_gc_elapsed;
     stats.nonmoving_gc_elapsed_ns += stats.gc.nonmoving_gc_elapsed_ns;
 
-    stats.gc.nonmoving_gc_cpu_ns = cpu - start_nonmoving_gc_cpu;
+    stats.gc.nonmoving_gc_cpu_ns =
+      cpu - start_nonmoving_gc_cpu + nonmoving_gc_worker_cpu;
     stats.nonmoving_gc_cpu_ns += stats.gc.nonmoving_gc_cpu_ns;
+    nonmoving_gc_worker_cpu = 0;
 
     stats.nonmoving_gc_max_elapsed_ns =
       stg_max(stats.gc.nonmoving_gc_elapsed_ns,
@@ -322,6 +361,41 @@ stat_endNonmovingGc (void)
     RELEASE_LOCK(&stats_mutex);
 }
 
+/* CPU time used by a helper thread of the nonmoving collector (see
+ * nonmovingRunWorkers), which is added to the time of the current collection.
+ */
+void
+stat_nonmovingWorkerCpu (Time cpu)
+{
+    ACQUIRE_LOCK(&stats_mutex);
+    nonmoving_gc_worker_cpu += cpu;
+    RELEASE_LOCK(&stats_mutex);
+}
+
+/* Elapsed time spent by a nonmoving collector worker sweeping segments */
+void
+stat_nonmovingSweepWorker (uint32_t worker, Time elapsed)
+{
+    ACQUIRE_LOCK(&stats_mutex);
+    if (worker < n_nonmoving_sweep_workers) {
+        nonmoving_sweep_elapsed[worker] += elapsed;
+    }
+    RELEASE_LOCK(&stats_mutex);
+}
+
+/* The histogram of the latencies of the GC barriers in a parallel GC, called
+ * by the leader at the end of the GC.  See Note [Adaptive GC synchronisation]
+ * in sm/GC.c.
+ */
+void
+stat_gcSyncHistogram (Capability *cap, const StgWord *hist)
+{
+    for (uint32_t i = 0; i < GC_SYNC_HIST_BUCKETS; i++) {
+        gc_sync_hist[i] += hist[i];
+    }
+    traceEventGcSyncHistogram(cap, CAPSET_HEAP_DEFAULT, hist);
+}
+
 void
 stat_startNonmovingGcSync (void)
 {
@@ -528,6 +602,10 @@ stat_endGC (Capability *cap, gc_thread *initiating_gct, W_ live, W_ copied, W_ s
     stats.gcs++;
     stats.allocated_bytes = tot_alloc_bytes;
     stats.max_mem_in_use_bytes = peak_mblocks_allocated * MBLOCK_SIZE;
+    if (RtsFlags.GcFlags.hugePages
+        && gen == RtsFlags.GcFlags.generations - 1) {
+        sampleHugePageBytes();
+    }
 
     GC_coll_cpu[gen] += stats.gc.cpu_ns;
     GC_coll_elapsed[gen] += stats.gc.elapsed_ns;
@@ -841,9 +919,14 @@ static void report_summary(const RTSSummaryStats* sum)
     statsPrintf("%16s bytes maximum slop\n", temp);
 
     statsPrintf("%16" FMT_Word64 " MiB total memory in use (%"
-                FMT_Word64 " MiB lost due to fragmentation)\n\n",
+                FMT_Word64 " MiB lost due to fragmentation)\n",
                 stats.max_mem_in_use_bytes  / (1024 * 1024),
                 sum->fragmentation_bytes / (1024 * 1024));
+    if (RtsFlags.GcFlags.hugePages) {
+        statsPrintf("%16" FMT_Word64 " MiB maximum in huge pages\n",
+                    max_huge_page_bytes / (1024 * 1024));
+    }
+    statsPrintf("\n");
 
     /* Print garbage collections in each gen */
     statsPrintf("                                     Tot time (elapsed)  Avg pause  Max pause\n");
@@ -878,6 +961,14 @@ static void report_summary(const RTSSummaryStats* sum)
                     TimeToSecondsDbl(stats.nonmoving_gc_elapsed_ns),
                     TimeToSecondsDbl(stats.nonmoving_gc_elapsed_ns) / n_major_colls,
                     TimeToSecondsDbl(stats.nonmoving_gc_max_elapsed_ns));
+        if (n_nonmoving_sweep_workers > 1) {
+            statsPrintf("  Gen %2d      sweep time per worker:", nonmoving_gen);
+            for (uint32_t i = 0; i < n_nonmoving_sweep_workers; i++) {
+                statsPrintf(" %.3fs",
+                            TimeToSecondsDbl(nonmoving_sweep_elapsed[i]));
+            }
+            statsPrintf("\n");
+        }
     }
 
     statsPrintf("\n");
@@ -903,8 +994,20 @@ static void report_summary(const RTSSummaryStats* sum)
                 sum->sparks.converted, sum->sparks.overflowed,
                 sum->sparks.dud, sum->sparks.gcd,
                 sum->sparks.fizzled);
+
+    statsPrintf("  BLOCK CACHE: %" FMT_Word64 " hits, %" FMT_Word64
+                " misses\n\n",
+                sum->block_cache_hits, sum->block_cache_misses);
 #endif
 
+    if (sum->stm_commits + sum->stm_aborts > 0) {
+        statsPrintf("  STM: %" FMT_Word64 " commits (%" FMT_Word64
+                    " read-only), %" FMT_Word64 " aborts, %" FMT_Word64
+                    " revalidations\n\n",
+                    sum->stm_commits, sum->stm_read_only_commits,
+                    sum->stm_aborts, sum->stm_revalidations);
+    }
+
     statsPrintf("  INIT    time  %7.3fs  (%7.3fs elapsed)\n",
                 TimeToSecondsDbl(stats.init_cpu_ns),
                 TimeToSecondsDbl(stats.init_elapsed_ns));
@@ -1102,6 +1205,9 @@ static void report_machine_readable (const RTSSummaryStats * sum)
     MR_STAT("max_slop_bytes", FMT_Word64, stats.max_slop_bytes);
     // This duplicates, except for unit, peak_megabytes_allocated above
     MR_STAT("max_mem_in_use_bytes", FMT_Word64, stats.max_mem_in_use_bytes);
+    if (RtsFlags.GcFlags.hugePages) {
+        MR_STAT("max_huge_page_bytes", FMT_Word64, max_huge_page_bytes);
+    }
     MR_STAT("cumulative_live_bytes", FMT_Word64, stats.cumulative_live_bytes);
     MR_STAT("copied_bytes", FMT_Word64, stats.copied_bytes);
     MR_STAT("par_copied_bytes", FMT_Word64, stats.par_copied_bytes);
@@ -1115,6 +1221,10 @@ static void report_machine_readable (const RTSSummaryStats * sum)
     MR_STAT("gc_cpu_percent", "f", sum->gc_cpu_percent);
     MR_STAT("gc_wall_percent", "f", sum->gc_cpu_percent);
 #endif
+    MR_STAT("stm_commits", FMT_Word64, sum->stm_commits);
+    MR_STAT("stm_read_only_commits", FMT_Word64, sum->stm_read_only_commits);
+    MR_STAT("stm_aborts", FMT_Word64, sum->stm_aborts);
+    MR_STAT("stm_revalidations", FMT_Word64, sum->stm_revalidations);
     MR_STAT("fragmentation_bytes", FMT_Word64, sum->fragmentation_bytes);
     // average_bytes_used is done above
     MR_STAT("alloc_rate", FMT_Word64, sum->alloc_rate);
@@ -1133,6 +1243,19 @@ static void report_machine_readable (const RTSSummaryStats * sum)
     MR_STAT("sparks_gcd", FMT_Word, sum->sparks.gcd);
     MR_STAT("sparks_fizzled", FMT_Word, sum->sparks.fizzled);
     MR_STAT("work_balance", "f", sum->work_balance);
+    MR_STAT("block_cache_hits", FMT_Word64, sum->block_cache_hits);
+    MR_STAT("block_cache_misses", FMT_Word64, sum->block_cache_misses);
+    // the histogram of GC synchronisation latencies, as gc_sync_lt_1us,
+    // gc_sync_lt_2us, ..., gc_sync_ge_1024us
+    for (uint32_t i = 0; i < GC_SYNC_HIST_BUCKETS; i++) {
+        if (i < GC_SYNC_HIST_BUCKETS - 1) {
+            statsPrintf(" ,(\"gc_sync_lt_%" FMT_Word32 "us\", \"%" FMT_Word64
+                        "\")\n", (uint32_t)1 << i, gc_sync_hist[i]);
+        } else {
+            statsPrintf(" ,(\"gc_sync_ge_%" FMT_Word32 "us\", \"%" FMT_Word64
+                        "\")\n", (uint32_t)1 << (i-1), gc_sync_hist[i]);
+        }
+    }
 
     // next, globals (other than internal counters)
     MR_STAT("n_capabilities", FMT_Word32, getNumCapabilities());
@@ -1203,6 +1326,13 @@ static void report_machine_readable (const RTSSummaryStats * sum)
                 TimeToSecondsDbl(stats.nonmoving_gc_max_elapsed_ns));
         MR_STAT("nonmoving_concurrent_avg_pause_seconds", "f",
                 TimeToSecondsDbl(stats.nonmoving_gc_elapsed_ns) / n_major_colls);
+        if (n_nonmoving_sweep_workers > 1) {
+            for (uint32_t i = 0; i < n_nonmoving_sweep_workers; i++) {
+                statsPrintf(" ,(\"nonmoving_sweep_worker_%" FMT_Word32
+                            "_seconds\", \"%f\")\n",
+                            i, TimeToSecondsDbl(nonmoving_sweep_elapsed[i]));
+            }
+        }
     }
 
 
@@ -1359,6 +1489,10 @@ stat_exitReport (void)
                   getCapability(i)->spark_stats.converted;
                 sum.sparks.gcd       += getCapability(i)->spark_stats.gcd;
                 sum.sparks.fizzled   += getCapability(i)->spark_stats.fizzled;
+                sum.block_cache_hits +=
+                  getCapability(i)->block_cache.hits;
+                sum.block_cache_misses +=
+                  getCapability(i)->block_cache.misses;
             }
 
             sum.sparks_count = sum.sparks.created
@@ -1382,6 +1516,14 @@ stat_exitReport (void)
                                   / stats.elapsed_ns;
     #endif // THREADED_RTS
 
+            for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+                StmCounters *stm = &getCapability(i)->stm_stats;
+                sum.stm_commits           += stm->commits;
+                sum.stm_read_only_commits += stm->read_only_commits;
+                sum.stm_aborts            += stm->aborts;
+                sum.stm_revalidations     += stm->revalidations;
+            }
+
             sum.fragmentation_bytes =
                 (uint64_t)(peak_mblocks_allocated
                          * BLOCKS_PER_MBLOCK
@@ -1432,6 +1574,10 @@ stat_exitReport (void)
             }
         }
 
+        if (RtsFlags.GcFlags.hugePages) {
+            sampleHugePageBytes();
+        }
+
         // Now we generate the report
         if (RtsFlags.GcFlags.giveStats >= SUMMARY_GC_STATS) {
             report_summary(&sum);
@@ -1465,6 +1611,11 @@ stat_exitReport (void)
       stgFree(GC_coll_max_pause);
       GC_coll_max_pause = NULL;
     }
+    if (nonmoving_sweep_elapsed) {
+      stgFree(nonmoving_sweep_elapsed);
+      nonmoving_sweep_elapsed = NULL;
+      n_nonmoving_sweep_workers = 0;
+    }
 
     RELEASE_LOCK(&all_tasks_mutex);
 }
@@ -29,10 +29,14 @@ void      stat_endGC  (Capability *cap, struct gc_thread_ *initiating_gct, W_ li
                        W_ par_max_copied, W_ par_balanced_copied,
                        W_ any_work, W_ scav_find_work, W_ max_n_todo_overflow);
 
+void      stat_gcSyncHistogram(Capability *cap, const StgWord *hist);
+
 void      stat_startNonmovingGcSync(void);
 void      stat_endNonmovingGcSync(void);
 void      stat_startNonmovingGc (void);
 void      stat_endNonmovingGc (void);
+void      stat_nonmovingWorkerCpu (Time cpu);
+void      stat_nonmovingSweepWorker (uint32_t worker, Time elapsed);
 
 #if defined(PROFILING)
 void      stat_startRP(void);
@@ -91,10 +95,16 @@ typedef struct RTSSummaryStats_ {
     uint64_t sparks_count;
     SparkCounters sparks;
     double work_balance;
+    uint64_t block_cache_hits;
+    uint64_t block_cache_misses;
 #else // THREADED_RTS
     double gc_cpu_percent;
     double gc_elapsed_percent;
 #endif
+    uint64_t stm_commits;
+    uint64_t stm_read_only_commits;
+    uint64_t stm_aborts;
+    uint64_t stm_revalidations;
     uint64_t fragmentation_bytes;
     uint64_t average_bytes_used; // This is not shown in the '+RTS -s' report
     uint64_t alloc_rate;
@@ -0,0 +1,325 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2025
+ *
+ * A hierarchical timer wheel for managing a collection of timeouts
+ *
+ * ---------------------------------------------------------------------------*/
+
+#include "rts/PosixSource.h"
+#include "Rts.h"
+
+#include "TimerWheel.h"
+#include "RtsUtils.h"
+
+/* See TimerWheel.h for an overview.
+
+   Placement: a timeout with wake tick T, when the wheel's current tick is N,
+   lives in:
+
+    * the expired list, if T < N;
+    * level 0, slot (N mod 64), if T == N;
+    * otherwise level L, slot ((T >> 6L) mod 64), where L is the highest group
+      of 6 bits in which T and N differ.
+
+   So a timeout at level L > 0 has the same bits above group L as the current
+   tick, and a larger digit in group L. This is what makes insert and delete
+   O(1): we can compute the slot directly, and each slot is a doubly-linked
+   list.
+
+   Advancing: the next time anything needs doing is the start of the first
+   non-empty slot ahead of the current tick. Because of the placement rule
+   this is in the lowest level that has any non-empty slots ahead. We can
+   jump straight there, using the per-level occupancy bitmaps, rather than
+   stepping through every tick. If it is a level 0 slot, its timeouts expire.
+   If it is a higher level slot, we move the current tick to the start of the
+   slot and re-insert its timeouts, which will place them in lower levels.
+   Each timeout can be cascaded at most once per level, so this is amortised
+   O(1) per timeout.
+
+   Time is signed 64bit nanoseconds, so wake ticks are at most 2^47, which
+   fits within the 8 * 6 = 48 bits covered by the levels. So unlike many timer
+   wheels we do not need an overflow list for timeouts in the far future.
+*/
+
+#define EMPTY ((StgTimeout *) &stg_TIMEOUT_QUEUE_EMPTY_closure)
+
+GHC_STATIC_ASSERT(TIMER_WHEEL_SLOTS == 64,
+                  "TimerWheel.c: occupancy bitmaps are 64bit words");
+GHC_STATIC_ASSERT(TIMER_WHEEL_TICK_SHIFT
+                  + TIMER_WHEEL_LEVELS * TIMER_WHEEL_LEVEL_BITS >= 63,
+                  "TimerWheel.c: levels must cover the range of Time");
+
+/******************************************************************************
+ * Helpers
+ */
+
+static inline uint64_t timeToTick(Time t)
+{
+    return t < 0 ? 0 : ((uint64_t) t) >> TIMER_WHEEL_TICK_SHIFT;
+}
+
+static inline Time tickToTime(uint64_t tick)
+{
+    return (Time) (tick << TIMER_WHEEL_TICK_SHIFT);
+}
+
+static inline uint32_t slotIndex(uint32_t level, uint32_t slot)
+{
+    return level * TIMER_WHEEL_SLOTS + slot;
+}
+
+/* The digit of the given tick in the given level */
+static inline uint32_t tickDigit(uint64_t tick, uint32_t level)
+{
+    return (tick >> (level * TIMER_WHEEL_LEVEL_BITS)) & (TIMER_WHEEL_SLOTS - 1);
+}
+
+/* The slot index where a timeout with wake tick 'tick' belongs */
+static uint32_t slotFor(uint64_t now_tick, uint64_t tick)
+{
+    if (tick < now_tick) {
+        return TIMER_WHEEL_EXPIRED;
+    } else if (tick == now_tick) {
+        return slotIndex(0, tickDigit(tick, 0));
+    } else {
+        uint32_t highbit = 63 - __builtin_clzll(tick ^ now_tick);
+        uint32_t level   = highbit / TIMER_WHEEL_LEVEL_BITS;
+        return slotIndex(level, tickDigit(tick, level));
+    }
+}
+
+static void linkSlot(TimerWheel *w, uint32_t ix, StgTimeout *t)
+{
+    StgTimeout *hd = w->slots[ix];
+    t->a          = hd;
+    t->b          = EMPTY;
+    t->wheel_slot = ix;
+    if (hd != EMPTY) {
+        hd->b = t;
+    }
+    w->slots[ix] = t;
+    if (ix != TIMER_WHEEL_EXPIRED) {
+        w->occupied[ix / TIMER_WHEEL_SLOTS] |=
+          (uint64_t) 1 << (ix % TIMER_WHEEL_SLOTS);
+    }
+}
+
+static void unlinkSlot(TimerWheel *w, StgTimeout *t)
+{
+    uint32_t ix = t->wheel_slot;
+    if (t->b != EMPTY) {
+        t->b->a = t->a;
+    } else {
+        ASSERT(w->slots[ix] == t);
+        w->slots[ix] = t->a;
+    }
+    if (t->a != EMPTY) {
+        t->a->b = t->b;
+    }
+    t->a = EMPTY;
+    t->b = EMPTY;
+    if (w->slots[ix] == EMPTY && ix != TIMER_WHEEL_EXPIRED) {
+        w->occupied[ix / TIMER_WHEEL_SLOTS] &=
+          ~((uint64_t) 1 << (ix % TIMER_WHEEL_SLOTS));
+    }
+}
+
+/* Detach a whole slot list, leaving the slot empty */
+static StgTimeout *takeSlot(TimerWheel *w, uint32_t ix)
+{
+    StgTimeout *hd = w->slots[ix];
+    w->slots[ix] = EMPTY;
+    w->occupied[ix / TIMER_WHEEL_SLOTS] &=
+      ~((uint64_t) 1 << (ix % TIMER_WHEEL_SLOTS));
+    return hd;
+}
+
+/* Find the first non-empty slot strictly after the current tick. Returns the
+ * slot index and the tick at which the slot starts, or false if there is no
+ * such slot.
+ */
+static bool nextEvent(TimerWheel *w, uint32_t *ix, uint64_t *event_tick)
+{
+    for (uint32_t level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        uint32_t digit = tickDigit(w->now_tick, level);
+        uint64_t ahead = digit == TIMER_WHEEL_SLOTS - 1
+                       ? 0 : (~(uint64_t) 0) << (digit + 1);
+        uint64_t bits  = w->occupied[level] & ahead;
+        if (bits != 0) {
+            uint32_t slot   = __builtin_ctzll(bits);
+            uint32_t shift  = level * TIMER_WHEEL_LEVEL_BITS;
+            uint32_t above  = shift + TIMER_WHEEL_LEVEL_BITS;
+            uint64_t prefix = above >= 64 ? 0 : (w->now_tick >> above) << above;
+            *ix         = slotIndex(level, slot);
+            *event_tick = prefix | ((uint64_t) slot << shift);
+            return true;
+        }
+    }
+    return false;
+}
+
+static Time minWaketimeSlot(TimerWheel *w, uint32_t ix)
+{
+    StgTimeout *t = w->slots[ix];
+    ASSERT(t != EMPTY);
+    Time min = t->waketime;
+    for (t = t->a; t != EMPTY; t = t->a) {
+        if (t->waketime < min) min = t->waketime;
+    }
+    return min;
+}
+
+/* Algorithmic performance counters, as in TimeoutQueue.c */
+#if defined(DEBUG)
+int timer_wheel_cascade_count;
+int timer_wheel_scan_count;
+#endif
+
+/******************************************************************************
+ * The main functions, declared in TimerWheel.h
+ */
+
+TimerWheel *newTimerWheel(void)
+{
+    TimerWheel *w = stgMallocBytes(sizeof(TimerWheel), "newTimerWheel");
+    w->now_tick = 0;
+    w->count    = 0;
+    for (uint32_t l = 0; l < TIMER_WHEEL_LEVELS; l++) {
+        w->occupied[l] = 0;
+    }
+    for (uint32_t i = 0; i <= TIMER_WHEEL_EXPIRED; i++) {
+        w->slots[i] = EMPTY;
+    }
+    return w;
+}
+
+void freeTimerWheel(TimerWheel *w)
+{
+    stgFree(w);
+}
+
+void insertTimerWheel(TimerWheel *w, StgTimeout *t, Time waketime)
+{
+    ASSERT(t->header.info == &stg_TIMEOUT_QUEUE_info);
+    ASSERT(t->a == EMPTY && t->b == EMPTY);
+    t->waketime = waketime;
+    linkSlot(w, slotFor(w->now_tick, timeToTick(waketime)), t);
+    w->count++;
+}
+
+void deleteTimerWheel(TimerWheel *w, StgTimeout *t)
+{
+    ASSERT(t->header.info == &stg_TIMEOUT_QUEUE_info);
+    ASSERT(t->wheel_slot <= TIMER_WHEEL_EXPIRED);
+    ASSERT(w->count > 0);
+    unlinkSlot(w, t);
+    w->count--;
+}
+
+void advanceTimerWheel(TimerWheel *w, Time now)
+{
+    uint64_t target = timeToTick(now);
+    while (w->now_tick < target) {
+        /* Everything in the current tick's slot is now due */
+        uint32_t cur = slotIndex(0, tickDigit(w->now_tick, 0));
+        if (w->slots[cur] != EMPTY) {
+            StgTimeout *t = takeSlot(w, cur);
+            while (t != EMPTY) {
+                StgTimeout *next = t->a;
+                linkSlot(w, TIMER_WHEEL_EXPIRED, t);
+                t = next;
+            }
+        }
+
+        uint32_t ix;
+        uint64_t event_tick;
+        if (!nextEvent(w, &ix, &event_tick) || event_tick > target) {
+            /* Nothing happens before the target, so we can jump straight
+             * there. No timeout changes slot by doing so.
+             */
+            w->now_tick = target;
+            break;
+        }
+        w->now_tick = event_tick;
+        if (ix >= TIMER_WHEEL_SLOTS) {
+            /* A higher level slot: cascade its timeouts to lower levels */
+            StgTimeout *t = takeSlot(w, ix);
+            while (t != EMPTY) {
+                StgTimeout *next = t->a;
+                linkSlot(w, slotFor(w->now_tick, timeToTick(t->waketime)), t);
+                t = next;
+#if defined(DEBUG)
+                timer_wheel_cascade_count++;
+#endif
+            }
+        }
+        /* A level 0 slot becomes the current tick's slot, and is expired on
+         * the next iteration (if the target is later still).
+         */
+    }
+
+    /* Timeouts in the current tick's slot may or may not be due */
+    uint32_t cur = slotIndex(0, tickDigit(w->now_tick, 0));
+    StgTimeout *t = w->slots[cur];
+    while (t != EMPTY) {
+        StgTimeout *next = t->a;
+        if (t->waketime <= now) {
+            unlinkSlot(w, t);
+            linkSlot(w, TIMER_WHEEL_EXPIRED, t);
+        }
+        t = next;
+#if defined(DEBUG)
+        timer_wheel_scan_count++;
+#endif
+    }
+}
+
+StgTimeout *popExpiredTimerWheel(TimerWheel *w)
+{
+    StgTimeout *t = w->slots[TIMER_WHEEL_EXPIRED];
+    if (t == EMPTY) {
+        return NULL;
+    }
+    unlinkSlot(w, t);
+    w->count--;
+    return t;
+}
+
+Time nextWaketimeTimerWheel(TimerWheel *w)
+{
+    ASSERT(!isEmptyTimerWheel(w));
+    ASSERT(w->slots[TIMER_WHEEL_EXPIRED] == EMPTY);
+
+    uint32_t cur = slotIndex(0, tickDigit(w->now_tick, 0));
+    if (w->slots[cur] != EMPTY) {
+        return minWaketimeSlot(w, cur);
+    }
+
+    uint32_t ix;
+    uint64_t event_tick;
+    bool found = nextEvent(w, &ix, &event_tick);
+    ASSERT(found);
+    (void) found;
+    if (ix < TIMER_WHEEL_SLOTS) {
+        return minWaketimeSlot(w, ix);
+    } else {
+        return tickToTime(event_tick);
+    }
+}
+
+void markTimerWheel(evac_fn evac, void *user, TimerWheel *w)
+{
+    for (uint32_t level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        uint64_t bits = w->occupied[level];
+        while (bits != 0) {
+            uint32_t slot = __builtin_ctzll(bits);
+            bits &= bits - 1;
+            evac(user, (StgClosure **)(void *)
+                       &w->slots[slotIndex(level, slot)]);
+        }
+    }
+    if (w->slots[TIMER_WHEEL_EXPIRED] != EMPTY) {
+        evac(user, (StgClosure **)(void *)&w->slots[TIMER_WHEEL_EXPIRED]);
+    }
+}
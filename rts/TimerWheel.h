@@ -0,0 +1,148 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2025
+ *
+ * Prototypes for functions in TimerWheel.c
+ *
+ * A hierarchical timer wheel: an alternative to the leftist heap in
+ * TimeoutQueue.c for managing a collection of timeouts.
+ *
+ * Like the TimeoutQueue, it uses 64bit high-precision Time for the keys (see
+ * Time.h) and the elements are StgTimeout heap objects, initialised using
+ * initElemTimeoutQueue. An element can be in either kind of queue (but not
+ * both at once).
+ *
+ * The difference is in the cost model. The leftist heap has O(log n) insert
+ * and deleteMin, and typically O(1) delete. The timer wheel has O(1) insert
+ * and delete, while expiring timeouts costs amortised O(1) per timeout plus
+ * O(1) per wheel slot that time passes over. This suits applications with
+ * very many timeouts, most of which are cancelled before they expire (e.g. a
+ * timeout per network request). The price is that expired timeouts are not
+ * delivered in order of their wake time within a batch, and finding the next
+ * wake time is only exact for timeouts in the near future.
+ *
+ * The wheel has 8 levels of 64 slots. Level 0 slots each cover one tick of
+ * 2^16 ns (about 65us), and each level up covers 64 times the range of the one
+ * below. Each timeout lives in the lowest level slot in which its wake tick
+ * differs from the current tick. As time advances, the timeouts in higher
+ * level slots are redistributed ("cascaded") to lower levels, until they
+ * reach level 0 and expire.
+ *
+ * See https://www.cs.columbia.edu/~nahum/w6998/papers/ton97-timing-wheels.pdf
+ *
+ * -------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "TimeoutQueue.h"
+#include "sm/GC.h" // for evac_fn
+
+#include "BeginPrivate.h"
+
+#define TIMER_WHEEL_TICK_SHIFT 16
+#define TIMER_WHEEL_LEVEL_BITS 6
+#define TIMER_WHEEL_SLOTS      (1 << TIMER_WHEEL_LEVEL_BITS)
+#define TIMER_WHEEL_LEVELS     8
+
+/* The slot index used for the list of expired timeouts. */
+#define TIMER_WHEEL_EXPIRED    (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS)
+
+typedef struct TimerWheel_ {
+    /* The current tick. Every timeout with an earlier wake tick has been
+     * moved to the expired list.
+     */
+    uint64_t    now_tick;
+
+    /* Number of timeouts in the wheel, including the expired list. */
+    StgWord     count;
+
+    /* Bitmap of the non-empty slots in each level. */
+    uint64_t    occupied[TIMER_WHEEL_LEVELS];
+
+    /* The slots, indexed by level * TIMER_WHEEL_SLOTS + slot, with one extra
+     * at the end for the expired list. Each is a doubly-linked list of
+     * StgTimeout (using the a and b fields as next and prev links), or
+     * stg_TIMEOUT_QUEUE_EMPTY_closure for an empty list.
+     *
+     * These are pointers into the GC heap. Callers /must/ arrange to call
+     * markTimerWheel in the GC mark phase.
+     */
+    StgTimeout *slots[TIMER_WHEEL_EXPIRED + 1];
+} TimerWheel;
+
+
+/* Allocate and free a timer wheel. It is allocated on the C heap, so this may
+ * be called before the storage manager is initialised.
+ */
+TimerWheel *newTimerWheel(void);
+void freeTimerWheel(TimerWheel *w);
+
+
+/* Is the wheel empty?
+ */
+INLINE_HEADER
+bool isEmptyTimerWheel(TimerWheel *w);
+
+
+/* Insert an element into the wheel, which must have been initialised using
+ * initElemTimeoutQueue, and not be in any queue.
+ *
+ * This is O(1).
+ */
+void insertTimerWheel(TimerWheel *w, StgTimeout *t, Time waketime);
+
+
+/* Delete the given element from the wheel.
+ *
+ * This is O(1).
+ *
+ * The timeout remains the caller's responsiblity (in particular for GC).
+ */
+void deleteTimerWheel(TimerWheel *w, StgTimeout *t);
+
+
+/* Advance the wheel's notion of the current time to now, moving all the
+ * timeouts with a wake time no later than now onto the expired list.
+ */
+void advanceTimerWheel(TimerWheel *w, Time now);
+
+
+/* Remove and return a timeout from the expired list, or return NULL if there
+ * are none. Use advanceTimerWheel first to find the expired timeouts.
+ *
+ * The returned timeout becomes the caller's responsiblity, in particular for
+ * GC since the timeout will no longer be accessible from the wheel.
+ */
+StgTimeout *popExpiredTimerWheel(TimerWheel *w);
+
+
+/* Return a time at which the caller should next advance the wheel. The wheel
+ * must not be empty, and the expired list must be empty (i.e. the wheel has
+ * been advanced to the current time, and all expired timeouts popped).
+ *
+ * If the earliest timeout is due within the current level 0 rotation, then
+ * this is its exact wake time. Otherwise it is the time at which the next
+ * non-empty higher level slot must be cascaded, which is earlier than the wake
+ * time of any timeout it contains. Either way it is later than the time the
+ * wheel was last advanced to.
+ */
+Time nextWaketimeTimerWheel(TimerWheel *w);
+
+
+/* Mark the wheel's slots as GC roots.
+ */
+void markTimerWheel(evac_fn evac, void *user, TimerWheel *w);
+
+
+/* -----------------------------------------------------------------------------
+ * Private from here on down.
+ * -----------------------------------------------------------------------------
+ */
+
+INLINE_HEADER
+bool isEmptyTimerWheel(TimerWheel *w)
+{
+    return (w->count == 0);
+}
+
+#include "EndPrivate.h"
@@ -111,6 +111,12 @@ void initTracing (void)
             && RtsFlags.TraceFlags.nullWriter) {
         startEventLogging(&NullEventLogWriter);
     }
+#if defined(THREADED_RTS) && !defined(mingw32_HOST_OS)
+    else if (RtsFlags.TraceFlags.tracing == TRACE_EVENTLOG
+            && RtsFlags.TraceFlags.eventlogSocket != NULL) {
+        startEventLogging(&SocketEventLogWriter);
+    }
+#endif
     else if (RtsFlags.TraceFlags.tracing == TRACE_EVENTLOG
             && rtsConfig.eventlog_writer != NULL) {
         startEventLogging(rtsConfig.eventlog_writer);
@@ -390,6 +396,20 @@ void traceEventGcStats_  (Capability *cap,
     }
 }
 
+void traceEventGcSyncHistogram_ (Capability *cap,
+                                 CapsetID    heap_capset,
+                                 const StgWord *hist)
+{
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        /* no stderr equivalent for these ones */
+    } else
+#endif
+    {
+        postEventGcSyncHistogram(cap, heap_capset, hist);
+    }
+}
+
 void traceEventMemReturn_ (Capability *cap,
                           uint32_t    current_mblocks,
                           uint32_t    needed_mblocks,
@@ -598,6 +618,19 @@ void traceSparkCounters_ (Capability *cap,
     }
 }
 
+void traceMigrationCounters_ (Capability *cap,
+                              MigrationCounters counters)
+{
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        /* as for traceSparkCounters_ */
+    } else
+#endif
+    {
+        postMigrationCountersEvent(cap, counters);
+    }
+}
+
 void traceTaskCreate_ (Task       *task,
                        Capability *cap)
 {
@@ -885,10 +918,11 @@ void traceConcMarkBegin(void)
         postEventNoCap(EVENT_CONC_MARK_BEGIN);
 }
 
-void traceConcMarkEnd(StgWord32 marked_obj_count)
+void traceConcMarkEnd(StgWord32 marked_obj_count,
+                      uint32_t n_workers, const StgWord32 *worker_counts)
 {
     if (eventlog_enabled)
-        postConcMarkEnd(marked_obj_count);
+        postConcMarkEnd(marked_obj_count, n_workers, worker_counts);
 }
 
 void traceConcSyncBegin(void)
@@ -166,6 +166,10 @@ void traceEventGcStats_  (Capability *cap,
                           W_        par_tot_copied,
                           W_        par_balanced_copied);
 
+void traceEventGcSyncHistogram_ (Capability *cap,
+                                 CapsetID    heap_capset,
+                                 const StgWord *hist);
+
 void traceEventMemReturn_  (Capability *cap,
                           uint32_t    current_mblocks,
                           uint32_t    needed_mblocks,
@@ -294,6 +298,9 @@ void traceSparkCounters_ (Capability *cap,
                           SparkCounters counters,
                           StgWord remaining);
 
+void traceMigrationCounters_ (Capability *cap,
+                              MigrationCounters counters);
+
 void traceTaskCreate_ (Task       *task,
                        Capability *cap);
 
@@ -322,7 +329,8 @@ void traceProfBegin(void);
 #endif /* PROFILING */
 
 void traceConcMarkBegin(void);
-void traceConcMarkEnd(StgWord32 marked_obj_count);
+void traceConcMarkEnd(StgWord32 marked_obj_count,
+                      uint32_t n_workers, const StgWord32 *worker_counts);
 void traceConcSyncBegin(void);
 void traceConcSyncEnd(void);
 void traceConcSweepBegin(void);
@@ -346,6 +354,7 @@ void flushTrace(void);
                            copied, slop, fragmentation, \
                            par_n_threads, par_max_copied, \
                            par_tot_copied, par_balanced_copied) /* nothing */
+#define traceEventGcSyncHistogram_(cap, heap_capset, hist) /* nothing */
 #define traceEventMemReturn_(cap, current, needed, returned) /* nothing */
 #define traceHeapEvent(cap, tag, heap_capset, info1) /* nothing */
 #define traceEventHeapInfo_(heap_capset, gens, \
@@ -364,6 +373,7 @@ void flushTrace(void);
 #define traceWallClockTime_() /* nothing */
 #define traceOSProcessInfo_()  /* nothing */
 #define traceSparkCounters_(cap, counters, remaining) /* nothing */
+#define traceMigrationCounters_(cap, counters) /* nothing */
 #define traceTaskCreate_(taskID, cap) /* nothing */
 #define traceTaskMigrate_(taskID, cap, new_cap) /* nothing */
 #define traceTaskDelete_(taskID) /* nothing */
@@ -377,7 +387,7 @@ void flushTrace(void);
 #define traceHeapProfSampleString(label, residency) /* nothing */
 
 #define traceConcMarkBegin() /* nothing */
-#define traceConcMarkEnd(marked_obj_count) /* nothing */
+#define traceConcMarkEnd(marked_obj_count, n_workers, worker_counts) /* nothing */
 #define traceConcSyncBegin() /* nothing */
 #define traceConcSyncEnd() /* nothing */
 #define traceConcSweepBegin() /* nothing */
@@ -758,6 +768,15 @@ INLINE_HEADER void traceEventGcStats(Capability *cap            STG_UNUSED,
                        par_tot_copied, par_balanced_copied);
 }
 
+INLINE_HEADER void traceEventGcSyncHistogram(Capability *cap      STG_UNUSED,
+                                             CapsetID    heap_capset STG_UNUSED,
+                                             const StgWord *hist     STG_UNUSED)
+{
+    if (RTS_UNLIKELY(TRACE_gc)) {
+        traceEventGcSyncHistogram_(cap, heap_capset, hist);
+    }
+}
+
 INLINE_HEADER void traceEventMemReturn(Capability *cap            STG_UNUSED,
                                      uint32_t    current_mblocks STG_UNUSED,
                                      uint32_t    needed_mblocks  STG_UNUSED,
@@ -870,6 +889,7 @@ INLINE_HEADER void traceSparkCounters(Capability *cap STG_UNUSED)
 #if defined(THREADED_RTS)
     if (RTS_UNLIKELY(TRACE_spark_sampled)) {
         traceSparkCounters_(cap, cap->spark_stats, sparkPoolSize(cap->sparks));
+        traceMigrationCounters_(cap, cap->migration_stats);
     }
     dtraceSparkCounters((EventCapNo)cap->no,
                         cap->spark_stats.created,
@@ -40,6 +40,10 @@
  *
  * Both popWSDeque and stealWSDeque also return NULL when the queue is empty.
  *
+ * Thieves can also take half of the elements at once with
+ * stealHalfWSDeque_(), and the owner can push several elements at once with
+ * pushWSDequeN(); see Note [Stealing half a WSDeque].
+ *
  * Testing: see testsuite/tests/rts/testwsdeque.c.  If
  * there's anything wrong with the deque implementation, this test
  * will probably catch it.
@@ -193,6 +197,55 @@ stealWSDeque (WSDeque *q)
     return stolen;
 }
 
+/* -----------------------------------------------------------------------------
+ * stealHalfWSDeque
+ *
+ * Note [Stealing half a WSDeque]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * When there are many small items of work (e.g. sparks), stealing them one
+ * at a time means a fence and a cas on the victim's top for every item.  A
+ * thief can instead claim n elements [t, t+n) at once, by reading them and
+ * then moving top from t to t+n with a single cas, as stealWSDeque_() does
+ * for n = 1.  Other thieves race on the same cas, so each element is still
+ * taken by exactly one of them.
+ *
+ * However, this is not safe against popWSDeque().  The owner only uses a cas
+ * to take the last element, t == b; for any other element it relies on
+ * thieves taking at most the element at top.  Between our reading bottom
+ * and our cas, the owner may pop elements down to t+1 without a cas, and
+ * then we would take them as well.  Hence stealHalfWSDeque_() may only be
+ * used on deques whose owner takes its own work from the top too, using
+ * stealWSDeque_(), as the spark pools do (see findSpark()).
+ *
+ * We take half of the elements so that the victim keeps some work, and
+ * thieves spread the work out among themselves by stealing from each other.
+ * -------------------------------------------------------------------------- */
+
+uint32_t
+stealHalfWSDeque_ (WSDeque *q, void **elems, uint32_t max)
+{
+    StgInt t = ACQUIRE_LOAD(&q->top);
+    SEQ_CST_FENCE();
+    StgInt b = ACQUIRE_LOAD(&q->bottom);
+
+    if (t >= b) {
+        /* Empty queue */
+        return 0;
+    }
+
+    StgInt n = (b - t + 1) / 2;
+    if (n > (StgInt)max) {
+        n = max;
+    }
+    for (StgInt i = 0; i < n; i++) {
+        elems[i] = RELAXED_LOAD(&q->elements[(t + i) & q->moduloSize]);
+    }
+    if (!cas_top(q, t, t+n)) {
+        return 0;
+    }
+    return n;
+}
+
 /* -----------------------------------------------------------------------------
  * pushWSQueue
  * -------------------------------------------------------------------------- */
@@ -224,3 +277,35 @@ pushWSDeque (WSDeque* q, void * elem)
 #endif
     return true;
 }
+
+/* Enqueue n elements, with a single barrier before making them visible to
+ * thieves. Must only be called by owner. Returns the number of elements
+ * pushed, which is less than n if the queue fills up.
+ */
+uint32_t
+pushWSDequeN (WSDeque* q, void **elems, uint32_t n)
+{
+    StgInt b = ACQUIRE_LOAD(&q->bottom);
+    StgInt t = ACQUIRE_LOAD(&q->top);
+
+    StgInt room = q->size - (b - t);
+    if (room <= 0) {
+        return 0;
+    }
+    if ((StgInt)n > room) {
+        /* We don't implement resizing, just push what fits. */
+        n = room;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        RELAXED_STORE(&q->elements[(b + i) & q->moduloSize], elems[i]);
+    }
+#if defined(TSAN_ENABLED)
+    // See pushWSDeque
+    RELEASE_STORE(&q->bottom, b+n);
+#else
+    RELEASE_FENCE();
+    RELAXED_STORE(&q->bottom, b+n);
+#endif
+    return n;
+}
@@ -55,7 +55,8 @@ typedef struct WSDeque_ {
  *
  * A WSDeque has an *owner* thread.  The owner can perform any operation;
  * other threads are only allowed to call stealWSDeque_(),
- * stealWSDeque(), looksEmptyWSDeque(), and dequeElements().
+ * stealWSDeque(), stealHalfWSDeque_(), looksEmptyWSDeque(), and
+ * dequeElements().
  *
  * -------------------------------------------------------------------------- */
 
@@ -71,6 +72,11 @@ void* popWSDeque (WSDeque *q);
 // succeeded, or false if the deque is full.
 bool pushWSDeque (WSDeque *q, void *elem);
 
+// (owner-only) Push n elements onto the "write" end of the pool, publishing
+// them all at once.  Returns the number of elements pushed, which is less
+// than n if the deque fills up.
+uint32_t pushWSDequeN (WSDeque *q, void **elems, uint32_t n);
+
 // (owner-only) Removes all elements from the deque.
 EXTERN_INLINE void discardElements (WSDeque *q);
 
@@ -83,6 +89,13 @@ void * stealWSDeque_ (WSDeque *q);
 // NULL if the pool is empty.
 void * stealWSDeque (WSDeque *q);
 
+// Removes half of the elements of the deque (rounding up), but no more than
+// max, from the "read" end into elems.  Returns the number of elements
+// removed, which is 0 if the pool is empty or if there was a collision with
+// another thief.  Must not be used on a deque whose owner calls
+// popWSDeque(); see Note [Stealing half a WSDeque].
+uint32_t stealHalfWSDeque_ (WSDeque *q, void **elems, uint32_t max);
+
 // "guesses" whether a deque is empty. Can return false negatives in
 // presence of concurrent steal() calls, and false positives in
 // presence of a concurrent pushBottom().
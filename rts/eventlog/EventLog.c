@@ -89,6 +89,43 @@ bool eventlog_enabled; // protected by state_change_mutex to ensure
  * flushLocalEventsBuf in traceCapDisable.
  *
  *
+ * Note [Asynchronous eventlog writer]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * Normally a full event buffer is written out by the capability that filled
+ * it, so a slow writer (e.g. a slow disk) stalls the mutator. With
+ * +RTS --eventlog-async the threaded RTS instead starts a writer thread
+ * (see startAsyncWriter), and printAndClearEventBuf hands full buffers over to
+ * it:
+ *
+ *  - There is a fixed pool of spare buffers (async_blocks), each of
+ *    EVENT_LOG_SIZE. A capability with a full buffer claims a spare one with a
+ *    CAS on its free flag, swaps the memory of the two, and carries on
+ *    posting events into the spare.
+ *
+ *  - The full buffer is pushed onto async_queue, a lock-free stack. The
+ *    writer thread takes the whole stack with one atomic exchange and
+ *    reverses it, so buffers are written in the order they were pushed, and
+ *    then returns each block to the pool.
+ *
+ *  - If there is no spare buffer the events in the full buffer are dropped,
+ *    rather than blocking the capability. Every buffer is a self-contained
+ *    block (it begins with a block marker), so the rest of the eventlog is
+ *    still well-formed. We count the dropped events and warn about them when
+ *    eventlogging stops.
+ *
+ * The header is written before the writer thread starts, and the end-of-data
+ * marker after it has stopped, so neither can be dropped. The writer thread is
+ * stopped with all of the capabilities stopped (see stopAsyncWriter), as
+ * events may still be posted for a while after eventlog_enabled is cleared.
+ * flushEventLog waits until the writer thread has written everything that was
+ * handed over to it (drainAsyncWriter), so it still guarantees that all events
+ * posted so far have reached the EventLogWriter.
+ *
+ * The writer thread is the only caller of the EventLogWriter's writeEventLog
+ * while it is running. After fork() the child has no writer thread, so
+ * restartEventLogging forgets about the parent's (forgetAsyncWriter) and
+ * starts a new one.
+ *
  * Note [Maximum event length]
  * ~~~~~~~~~~~~~~~~~~~~~~~~~~~
  * The maximum length of an eventlog event is determined by the maximum event
@@ -124,6 +161,7 @@ typedef struct _EventsBuf {
   StgInt8 *marker;
   StgWord64 size;
   EventCapNo capno; // which capability this buffer belongs to, or -1
+  StgWord32 n_events; // number of events in the buffer
 } EventsBuf;
 
 static EventsBuf *capEventBuf; // one EventsBuf for each Capability
@@ -133,6 +171,37 @@ static EventsBuf eventBuf; // an EventsBuf not associated with any Capability
 static Mutex eventBufMutex; // protected by this mutex
 #endif
 
+#if defined(THREADED_RTS)
+// A buffer owned by the asynchronous writer.
+// See Note [Asynchronous eventlog writer].
+typedef struct _EventBlock {
+    StgInt8 *data;             // EVENT_LOG_SIZE bytes
+    size_t size;               // bytes of events, while on async_queue
+    struct _EventBlock *next;  // link in async_queue
+    StgWord free;              // is this a spare buffer?
+} EventBlock;
+
+static bool async_writer_running = false;
+static EventBlock *async_blocks = NULL;
+static uint32_t n_async_blocks = 0;
+static EventBlock *async_queue = NULL;  // lock-free stack, newest first
+static OSThreadId async_writer_thread;
+
+static Mutex async_mutex;
+static Condition async_wakeup_cond;  // the writer thread waits on this
+static Condition async_idle_cond;    // drainAsyncWriter waits on this
+static bool async_writing = false;   // protected by async_mutex
+static bool async_stop = false;      // protected by async_mutex
+
+static StgWord async_dropped_events = 0;
+static StgWord async_dropped_bufs = 0;
+
+static void startAsyncWriter(void);
+static void stopAsyncWriter(void);
+static void forgetAsyncWriter(void);
+static void drainAsyncWriter(void);
+#endif
+
 // Event type
 typedef struct _EventType {
   EventTypeNum etNum;  // Event Type number.
@@ -209,7 +278,7 @@ static inline StgWord64 time_ns(void)
 { return TimeToNS(stat_getElapsedTime()); }
 
 static inline void postEventTypeNum(EventsBuf *eb, EventTypeNum etNum)
-{ postWord16(eb, etNum); }
+{ postWord16(eb, etNum); eb->n_events++; }
 
 static inline void postTimestamp(EventsBuf *eb)
 { postWord64(eb, time_ns()); }
@@ -291,32 +360,45 @@ flushEventLogWriter(void)
 }
 
 static void
-postHeaderEvents(void)
+postHeaderEvents(EventsBuf *eb)
 {
     // The header must appear first in the output stream, without the
     // the block start marker we previously added in printAndClearEventBuf.
-    resetEventsBuf(&eventBuf);
+    resetEventsBuf(eb);
 
     // Write in buffer: the header begin marker.
-    postInt32(&eventBuf, EVENT_HEADER_BEGIN);
+    postInt32(eb, EVENT_HEADER_BEGIN);
 
     // Mark beginning of event types in the header.
-    postInt32(&eventBuf, EVENT_HET_BEGIN);
+    postInt32(eb, EVENT_HET_BEGIN);
 
     for (int t = 0; t < NUM_GHC_EVENT_TAGS; ++t) {
         // Write in buffer: the start event type.
         if (eventTypes[t].desc)
-            postEventType(&eventBuf, &eventTypes[t]);
+            postEventType(eb, &eventTypes[t]);
     }
 
     // Mark end of event types in the header.
-    postInt32(&eventBuf, EVENT_HET_END);
+    postInt32(eb, EVENT_HET_END);
 
     // Write in buffer: the header end marker.
-    postInt32(&eventBuf, EVENT_HEADER_END);
+    postInt32(eb, EVENT_HEADER_END);
 
     // Prepare event buffer for events (data).
-    postInt32(&eventBuf, EVENT_DATA_BEGIN);
+    postInt32(eb, EVENT_DATA_BEGIN);
+}
+
+// The header, up to and including the data begin marker, in a fresh buffer
+// which the caller must free. For EventLogWriters whose consumer can
+// reconnect, see Note [Eventlog socket writer] in EventLogWriter.c.
+StgInt8 *
+serialiseEventLogHeader(size_t *size)
+{
+    EventsBuf eb;
+    initEventsBuf(&eb, EVENT_LOG_SIZE, (EventCapNo)(-1));
+    postHeaderEvents(&eb);
+    *size = eb.pos - eb.begin;
+    return eb.begin;
 }
 
 // These events will be reposted every time we restart the eventlog
@@ -348,6 +430,25 @@ static void repostInitEvents(void){
     return;
 }
 
+// Post the initialisation events again for a consumer which has just
+// connected to the EventLogWriter, and write them out straight away.
+void
+repostEventLogInitEvents(void)
+{
+    // If the lock is taken then eventlogging is either starting, which
+    // posts them anyway, or stopping.
+    if (TRY_ACQUIRE_LOCK(&state_change_mutex) != 0) {
+        return;
+    }
+    if (eventlog_enabled) {
+        repostInitEvents();
+        ACQUIRE_LOCK(&eventBufMutex);
+        printAndClearEventBuf(&eventBuf);
+        RELEASE_LOCK(&eventBufMutex);
+    }
+    RELEASE_LOCK(&state_change_mutex);
+}
+
 // Clear the eventlog_header_funcs list and free the memory
 void resetInitEvents(void){
     eventlog_init_func_t * tmp;
@@ -415,7 +516,7 @@ startEventLogging_(void)
     initEventLogWriter();
 
     ACQUIRE_LOCK(&eventBufMutex);
-    postHeaderEvents();
+    postHeaderEvents(&eventBuf);
 
     /*
      * Flush header and data begin marker to the file, thus preparing the
@@ -425,6 +526,11 @@ startEventLogging_(void)
 
     RELEASE_LOCK(&eventBufMutex);
 
+#if defined(THREADED_RTS)
+    // Only now, so that the header is never dropped.
+    startAsyncWriter();
+#endif
+
     return true;
 }
 
@@ -454,6 +560,9 @@ startEventLogging(const EventLogWriter *ev_writer)
 void
 restartEventLogging(void)
 {
+#if defined(THREADED_RTS)
+    forgetAsyncWriter();
+#endif
     freeEventLoggingBuffer();
     stopEventLogWriter();
     initEventLogging();  // allocate new per-capability buffers
@@ -493,6 +602,11 @@ endEventLogging(void)
 
     flushEventLog(NULL);
 
+#if defined(THREADED_RTS)
+    // Write the end of data marker ourselves, so that it cannot be dropped.
+    stopAsyncWriter();
+#endif
+
     ACQUIRE_LOCK(&eventBufMutex);
 
     // Mark end of events (data).
@@ -660,6 +774,21 @@ postSparkCountersEvent (Capability *cap,
     postWord64(eb,remaining);
 }
 
+void
+postMigrationCountersEvent (Capability *cap,
+                            MigrationCounters counters)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    ensureRoomForEvent(eb, EVENT_CAP_MIGRATION_COUNTERS);
+
+    postEventHeader(eb, EVENT_CAP_MIGRATION_COUNTERS);
+    /* EVENT_CAP_MIGRATION_COUNTERS (pushed,pushed_remote,stolen,stolen_remote) */
+    postWord64(eb,counters.threads_pushed);
+    postWord64(eb,counters.threads_pushed_remote);
+    postWord64(eb,counters.sparks_stolen);
+    postWord64(eb,counters.sparks_stolen_remote);
+}
+
 void
 postCapEvent (EventTypeNum  tag,
               EventCapNo    capno)
@@ -930,6 +1059,21 @@ void postEventGcStats  (Capability    *cap,
     postWord64(eb, par_balanced_copied);
 }
 
+void postEventGcSyncHistogram (Capability    *cap,
+                               EventCapsetID  heap_capset,
+                               const StgWord *hist)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    ensureRoomForEvent(eb, EVENT_GC_SYNC_HISTOGRAM);
+
+    postEventHeader(eb, EVENT_GC_SYNC_HISTOGRAM);
+    /* EVENT_GC_SYNC_HISTOGRAM (heap_capset, bucket counts) */
+    postCapsetID(eb, heap_capset);
+    for (uint32_t i = 0; i < GC_SYNC_HIST_BUCKETS; i++) {
+        postWord64(eb, hist[i]);
+    }
+}
+
 void postEventMemReturn  (Capability    *cap,
                           EventCapsetID heap_capset,
                           uint32_t current_mblocks,
@@ -1134,12 +1278,19 @@ void postConcUpdRemSetFlush(Capability *cap)
     postCapNo(eb, cap->no);
 }
 
-void postConcMarkEnd(StgWord32 marked_obj_count)
+void postConcMarkEnd(StgWord32 marked_obj_count,
+                     uint32_t n_workers, const StgWord32 *worker_counts)
 {
     ACQUIRE_LOCK(&eventBufMutex);
     ensureRoomForEvent(&eventBuf, EVENT_CONC_MARK_END);
     postEventHeader(&eventBuf, EVENT_CONC_MARK_END);
     postWord32(&eventBuf, marked_obj_count);
+    for (uint32_t i = 0; i < n_workers; i++) {
+        ensureRoomForEvent(&eventBuf, EVENT_CONC_MARK_WORKER_END);
+        postEventHeader(&eventBuf, EVENT_CONC_MARK_WORKER_END);
+        postWord32(&eventBuf, i);
+        postWord32(&eventBuf, worker_counts[i]);
+    }
     RELEASE_LOCK(&eventBufMutex);
 }
 
@@ -1490,12 +1641,257 @@ void postIPE(const InfoProvEnt *ipe)
     RELEASE_LOCK(&eventBufMutex);
 }
 
+#if defined(THREADED_RTS)
+/* -----------------------------------------------------------------------------
+   The asynchronous writer. See Note [Asynchronous eventlog writer].
+   -------------------------------------------------------------------------- */
+
+static void
+writeEventBlocks (EventBlock *list)
+{
+    // The list is newest first: reverse it to write the buffers in order.
+    EventBlock *prev = NULL;
+    while (list != NULL) {
+        EventBlock *next = list->next;
+        list->next = prev;
+        prev = list;
+        list = next;
+    }
+
+    for (EventBlock *b = prev; b != NULL; ) {
+        EventBlock *next = b->next;
+        if (!writeEventLog(b->data, b->size)) {
+            debugBelch("eventlog writer: could not write event log\n");
+            flushEventLogWriter();
+        }
+        // The block may be claimed by a capability from here on.
+        RELEASE_STORE(&b->free, 1);
+        b = next;
+    }
+}
+
+static void *
+asyncWriterThread (void *arg STG_UNUSED)
+{
+    ACQUIRE_LOCK(&async_mutex);
+    while (true) {
+        if (ACQUIRE_LOAD(&async_queue) == NULL) {
+            async_writing = false;
+            broadcastCondition(&async_idle_cond);
+            if (async_stop) {
+                break;
+            }
+            waitCondition(&async_wakeup_cond, &async_mutex);
+            continue;
+        }
+        async_writing = true;
+        RELEASE_LOCK(&async_mutex);
+
+        EventBlock *list =
+            (EventBlock *) xchg((StgPtr) &async_queue, (StgWord) NULL);
+        writeEventBlocks(list);
+
+        ACQUIRE_LOCK(&async_mutex);
+    }
+    RELEASE_LOCK(&async_mutex);
+    return NULL;
+}
+
+static EventBlock *
+claimSpareBlock (void)
+{
+    for (uint32_t i = 0; i < n_async_blocks; i++) {
+        EventBlock *b = &async_blocks[i];
+        if (RELAXED_LOAD(&b->free) &&
+            cas((StgVolatilePtr) &b->free, 1, 0) == 1) {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+static void
+pushAsyncBlock (EventBlock *b)
+{
+    EventBlock *old;
+    do {
+        old = RELAXED_LOAD(&async_queue);
+        b->next = old;
+    } while (cas((StgVolatilePtr) &async_queue, (StgWord) old, (StgWord) b)
+             != (StgWord) old);
+
+    ACQUIRE_LOCK(&async_mutex);
+    signalCondition(&async_wakeup_cond);
+    RELEASE_LOCK(&async_mutex);
+}
+
+// Hand a full buffer over to the writer thread, leaving ebuf empty.
+static void
+handOverEventBuf (EventsBuf *ebuf)
+{
+    ASSERT(ebuf->size == EVENT_LOG_SIZE);
+
+    EventBlock *b = claimSpareBlock();
+    if (b == NULL) {
+        // No spare buffer: drop the events rather than wait for the writer.
+        // The block marker at the start of the buffer doesn't count.
+        StgWord n = ebuf->n_events > 0 ? ebuf->n_events - 1 : 0;
+        atomic_inc(&async_dropped_events, n);
+        atomic_inc(&async_dropped_bufs, 1);
+        resetEventsBuf(ebuf);
+        return;
+    }
+
+    StgInt8 *full = ebuf->begin;
+    b->size = ebuf->pos - ebuf->begin;
+    ebuf->begin = b->data;
+    b->data = full;
+    resetEventsBuf(ebuf);
+    pushAsyncBlock(b);
+}
+
+static void
+startAsyncWriter (void)
+{
+    uint32_t n = RtsFlags.TraceFlags.eventlogAsyncBuffers;
+    if (n == 0) {
+        return;
+    }
+
+    async_blocks = stgMallocBytes(n * sizeof(EventBlock), "startAsyncWriter");
+    for (uint32_t i = 0; i < n; i++) {
+        async_blocks[i].data = stgMallocBytes(EVENT_LOG_SIZE,
+                                              "startAsyncWriter");
+        async_blocks[i].size = 0;
+        async_blocks[i].next = NULL;
+        async_blocks[i].free = 1;
+    }
+    n_async_blocks = n;
+    async_queue = NULL;
+    async_writing = false;
+    async_stop = false;
+    async_dropped_events = 0;
+    async_dropped_bufs = 0;
+
+    initMutex(&async_mutex);
+    initCondition(&async_wakeup_cond);
+    initCondition(&async_idle_cond);
+
+    if (createOSThread(&async_writer_thread, "eventlog-writer",
+                       asyncWriterThread, NULL) != 0) {
+        barf("startAsyncWriter: failed to spawn eventlog writer: %s",
+             strerror(errno));
+    }
+    RELAXED_STORE(&async_writer_running, true);
+}
+
+static void
+freeAsyncBlocks (void)
+{
+    for (uint32_t i = 0; i < n_async_blocks; i++) {
+        stgFree(async_blocks[i].data);
+    }
+    stgFree(async_blocks);
+    async_blocks = NULL;
+    n_async_blocks = 0;
+    async_queue = NULL;
+}
+
+// Wait until the writer thread has written every buffer handed over to it.
+static void
+drainAsyncWriter (void)
+{
+    if (!RELAXED_LOAD(&async_writer_running)) {
+        return;
+    }
+
+    ACQUIRE_LOCK(&async_mutex);
+    while (ACQUIRE_LOAD(&async_queue) != NULL || async_writing) {
+        waitCondition(&async_idle_cond, &async_mutex);
+    }
+    RELEASE_LOCK(&async_mutex);
+}
+
+// Stop the writer thread, once it has written everything handed over to it.
+//
+// Clearing eventlog_enabled doesn't stop events from being posted at once: a
+// capability, or a thread posting into eventBuf, may have seen it set just
+// before. Such a poster may hand a buffer over while we stop the writer, or
+// after we have freed the spare buffers, so we stop the writer with all of
+// the capabilities stopped and eventBufMutex held. Afterwards, buffers are
+// written out by whoever fills them, as without the writer thread. At
+// shutdown the capabilities have been freed already, but there are no
+// mutators left to post events either.
+static void
+stopAsyncWriter (void)
+{
+    if (!RELAXED_LOAD(&async_writer_running)) {
+        return;
+    }
+
+    Task *task = NULL;
+    if (getSchedState() != SCHED_SHUTTING_DOWN) {
+        task = newBoundTask();
+        stopAllCapabilitiesWith(NULL, task, SYNC_FLUSH_EVENT_LOG);
+        flushAllCapsEventsBufs();
+    }
+    ACQUIRE_LOCK(&eventBufMutex);
+
+    drainAsyncWriter();
+    RELAXED_STORE(&async_writer_running, false);
+
+    ACQUIRE_LOCK(&async_mutex);
+    async_stop = true;
+    signalCondition(&async_wakeup_cond);
+    RELEASE_LOCK(&async_mutex);
+    joinOSThread(async_writer_thread);
+
+    closeMutex(&async_mutex);
+    closeCondition(&async_wakeup_cond);
+    closeCondition(&async_idle_cond);
+    freeAsyncBlocks();
+
+    RELEASE_LOCK(&eventBufMutex);
+    if (task != NULL) {
+        releaseAllCapabilities(getNumCapabilities(), NULL, task);
+        exitMyTask();
+    }
+
+    if (async_dropped_bufs > 0) {
+        errorBelch("warning: dropped %" FMT_Word " events (%" FMT_Word
+                   " buffers) because the eventlog writer fell behind; "
+                   "use more buffers with --eventlog-async=<n>",
+                   async_dropped_events, async_dropped_bufs);
+    }
+}
+
+// After fork() the writer thread is gone, and anything it had not yet
+// written belongs to the parent's eventlog.
+static void
+forgetAsyncWriter (void)
+{
+    if (!async_writer_running) {
+        return;
+    }
+    async_writer_running = false;
+    freeAsyncBlocks();
+}
+#endif
+
 void printAndClearEventBuf (EventsBuf *ebuf)
 {
     closeBlockMarker(ebuf);
 
     if (ebuf->begin != NULL && ebuf->pos != ebuf->begin)
     {
+#if defined(THREADED_RTS)
+        if (RELAXED_LOAD(&async_writer_running)) {
+            handOverEventBuf(ebuf);
+            flushCount++;
+            postBlockMarker(ebuf);
+            return;
+        }
+#endif
         size_t elog_size = ebuf->pos - ebuf->begin;
         if (!writeEventLog(ebuf->begin, elog_size)) {
             debugBelch(
@@ -1519,6 +1915,7 @@ void initEventsBuf(EventsBuf* eb, StgWord64 size, EventCapNo capno)
     eb->size = size;
     eb->marker = NULL;
     eb->capno = capno;
+    eb->n_events = 0;
     postBlockMarker(eb);
 }
 
@@ -1526,6 +1923,7 @@ void resetEventsBuf(EventsBuf* eb)
 {
     eb->pos = eb->begin;
     eb->marker = NULL;
+    eb->n_events = 0;
 }
 
 STG_WARN_UNUSED_RESULT
@@ -1611,6 +2009,9 @@ void flushAllCapsEventsBufs(void)
     for (unsigned int i=0; i < getNumCapabilities(); i++) {
         flushLocalEventsBuf(getCapability(i));
     }
+#if defined(THREADED_RTS)
+    drainAsyncWriter();
+#endif
     flushEventLogWriter();
 }
 
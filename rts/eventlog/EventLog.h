@@ -39,6 +39,17 @@ void postInitEvent(EventlogInitPost post_init);
 // Clear the init events buffer on program exit
 void resetInitEvents(void);
 
+// For EventLogWriters which may get a new consumer while running: the header
+// to send to it first, and re-posting the initialisation events.
+StgInt8 *serialiseEventLogHeader(size_t *size);
+void repostEventLogInitEvents(void);
+
+#if defined(THREADED_RTS) && !defined(mingw32_HOST_OS)
+// Streams the eventlog to a consumer connected to a Unix domain socket,
+// selected by +RTS --eventlog-socket. See Note [Eventlog socket writer].
+extern const EventLogWriter SocketEventLogWriter;
+#endif
+
 typedef struct eventlog_init_func {
     EventlogInitPost init_func;
     struct eventlog_init_func * next;
@@ -112,6 +123,13 @@ void postSparkCountersEvent (Capability *cap,
                              SparkCounters counters,
                              StgWord remaining);
 
+/*
+ * Post an event with the counts of threads and sparks moved between
+ * capabilities.
+ */
+void postMigrationCountersEvent (Capability *cap,
+                                 MigrationCounters counters);
+
 /*
  * Post an event to annotate a thread with a label
  */
@@ -146,6 +164,14 @@ void postEventGcStats  (Capability    *cap,
                         W_           par_tot_copied,
                         W_           par_balanced_copied);
 
+/*
+ * Post an event with the histogram of the latencies of the GC barriers in a
+ * parallel GC, with GC_SYNC_HIST_BUCKETS buckets.
+ */
+void postEventGcSyncHistogram (Capability    *cap,
+                               EventCapsetID  heap_capset,
+                               const StgWord *hist);
+
 void postEventMemReturn (Capability *cap,
                         EventCapsetID  heap_capset,
                          uint32_t current_mblocks,
@@ -191,7 +217,8 @@ void postProfBegin(void);
 void postIPE(const InfoProvEnt *ipe);
 
 void postConcUpdRemSetFlush(Capability *cap);
-void postConcMarkEnd(StgWord32 marked_obj_count);
+void postConcMarkEnd(StgWord32 marked_obj_count,
+                     uint32_t n_workers, const StgWord32 *worker_counts);
 void postNonmovingHeapCensus(uint16_t blk_size,
                              const struct NonmovingAllocCensus *census);
 void postNonmovingPrunedSegments(uint32_t pruned_segments, uint32_t free_segments);
@@ -11,6 +11,7 @@
 
 #include "RtsUtils.h"
 #include "rts/EventLogWriter.h"
+#include "eventlog/EventLog.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -21,6 +22,14 @@
 #if defined(HAVE_UNISTD_H)
 #include <unistd.h>
 #endif
+#if defined(THREADED_RTS) && !defined(mingw32_HOST_OS)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
 
 // PID of the process that writes to event_log_filename (#4512)
 static pid_t event_log_pid = -1;
@@ -178,3 +187,368 @@ const EventLogWriter NullEventLogWriter = {
     .flushEventLog = flushEventLogFileNoop,
     .stopEventLogWriter = stopEventLogFileWriterNoop
 };
+
+#if defined(THREADED_RTS) && !defined(mingw32_HOST_OS)
+/*
+ * Note [Eventlog socket writer]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * With +RTS --eventlog-socket=<path> the eventlog is streamed to a consumer
+ * connected to a Unix domain socket, rather than written to a file, so that a
+ * long-running program can be monitored without filling up the disk.
+ *
+ * We listen on the socket from startup, but only accept consumers on a
+ * separate thread (socketAcceptorThread), started after the first write. The
+ * first write is always the header, which goes nowhere; after that, each
+ * consumer that connects is sent a header of its own
+ * (serialiseEventLogHeader), followed by the initialisation events
+ * (repostEventLogInitEvents), and then the event blocks as they are written.
+ * Every block is self-contained, so a consumer can join at any point. There
+ * is one consumer at a time: a new connection replaces the old one. While
+ * there is no consumer the events are discarded.
+ *
+ * The --eventlog-socket-policy flag selects what happens when the consumer
+ * falls behind, i.e. when the socket's send buffer is full:
+ *
+ *  - block: wait for the consumer. This stalls whichever capability (or the
+ *    --eventlog-async writer thread) is writing the block.
+ *
+ *  - drop: drop the block. We must never send part of a block, so if only a
+ *    part fits we keep the rest (socket_pending) and drop the following blocks
+ *    until the rest has been sent.
+ *
+ *  - sample: as drop, but wait for the consumer once every
+ *    EVENTLOG_SOCKET_SAMPLE_RATE blocks while it is behind, so that it sees a
+ *    regular sample of the events rather than nothing at all.
+ *
+ * The number of dropped blocks is reported when eventlogging stops.
+ *
+ * A forked child has no acceptor thread, and listens on <path>.<pid> rather
+ * than taking over the parent's socket, like the file writer.
+ */
+
+// While the consumer is behind, the sample policy waits for it once in this
+// many blocks.
+#define EVENTLOG_SOCKET_SAMPLE_RATE 8
+
+#if !defined(MSG_NOSIGNAL)
+// We use SO_NOSIGPIPE instead (e.g. Darwin), and the RTS ignores SIGPIPE anyway.
+#define MSG_NOSIGNAL 0
+#endif
+
+// Protects everything below, apart from the acceptor thread's own state
+static Mutex socket_mutex;
+
+static pid_t socket_pid = -1;          // the process listening on socket_path
+static char *socket_path = NULL;
+static int socket_listen_fd = -1;
+static int socket_consumer_fd = -1;    // or -1 if there is no consumer
+
+// The unsent rest of a block which the consumer could only take part of
+static unsigned char *socket_pending = NULL;
+static size_t socket_pending_size = 0; // bytes left to send
+static size_t socket_pending_off = 0;  // offset of them in socket_pending
+static size_t socket_pending_cap = 0;  // allocated size of socket_pending
+
+static uint32_t socket_behind_count = 0;
+static StgWord64 socket_dropped_blocks = 0;
+
+static bool socket_acceptor_running = false;
+static OSThreadId socket_acceptor;
+static int socket_stop_pipe[2] = { -1, -1 };
+
+static void
+setCloseOnExec(int fd)
+{
+    int flags = fcntl(fd, F_GETFD);
+    if (flags != -1) {
+        fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+    }
+}
+
+// Send as much of the buffer as we can, or all of it if block. Returns the
+// number of bytes sent, or -1 if the consumer has gone away.
+static ssize_t
+sendSocket(const void *buf, size_t size, bool block)
+{
+    size_t sent = 0;
+    while (sent < size) {
+        ssize_t r = send(socket_consumer_fd, (const char *) buf + sent,
+                         size - sent,
+                         MSG_NOSIGNAL | (block ? 0 : MSG_DONTWAIT));
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return -1;
+        }
+        sent += r;
+    }
+    return sent;
+}
+
+static void
+dropSocketConsumer(void)
+{
+    if (socket_consumer_fd >= 0) {
+        close(socket_consumer_fd);
+        socket_consumer_fd = -1;
+    }
+    socket_pending_size = 0;
+    socket_pending_off = 0;
+    socket_behind_count = 0;
+}
+
+// Returns false if the consumer has gone away.
+static bool
+sendSocketPending(bool block)
+{
+    if (socket_pending_size > 0) {
+        ssize_t r = sendSocket(socket_pending + socket_pending_off,
+                               socket_pending_size, block);
+        if (r < 0) {
+            return false;
+        }
+        socket_pending_off += r;
+        socket_pending_size -= r;
+    }
+    return true;
+}
+
+static void
+savePending(const unsigned char *buf, size_t size)
+{
+    if (size > socket_pending_cap) {
+        socket_pending = stgReallocBytes(socket_pending, size,
+                                         "savePending");
+        socket_pending_cap = size;
+    }
+    memcpy(socket_pending, buf, size);
+    socket_pending_size = size;
+    socket_pending_off = 0;
+}
+
+static void *
+socketAcceptorThread(void *arg STG_UNUSED)
+{
+    struct pollfd fds[2] = {
+        { .fd = socket_listen_fd,    .events = POLLIN },
+        { .fd = socket_stop_pipe[0], .events = POLLIN },
+    };
+
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            sysErrorBelch("eventlog socket: poll failed");
+            break;
+        }
+        if (fds[1].revents != 0) {
+            break; // stopEventLogSocketWriter
+        }
+        if (fds[0].revents == 0) {
+            continue;
+        }
+
+        int fd = accept(socket_listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue; // the consumer may have given up already
+        }
+        setCloseOnExec(fd);
+#if defined(SO_NOSIGPIPE)
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+        size_t header_size;
+        StgInt8 *header = serialiseEventLogHeader(&header_size);
+
+        ACQUIRE_LOCK(&socket_mutex);
+        dropSocketConsumer();
+        socket_consumer_fd = fd;
+        bool ok = sendSocket(header, header_size, true) == (ssize_t) header_size;
+        if (!ok) {
+            dropSocketConsumer();
+        }
+        RELEASE_LOCK(&socket_mutex);
+        stgFree(header);
+
+        if (ok) {
+            repostEventLogInitEvents();
+        }
+    }
+    return NULL;
+}
+
+static void
+initEventLogSocketWriter(void)
+{
+    const char *path = RtsFlags.TraceFlags.eventlogSocket;
+    struct sockaddr_un addr;
+
+    if (socket_pid != -1 && socket_pid != getpid()) {
+        // Forked process, the parent is still listening on the socket
+        char *child_path = stgMallocBytes(strlen(path) + 22,
+                                          "initEventLogSocketWriter");
+        sprintf(child_path, "%s.%" FMT_Word64, path, (StgWord64) getpid());
+        socket_path = child_path;
+    } else {
+        socket_path = strdup(path);
+    }
+    socket_pid = getpid();
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        errorBelch("initEventLogSocketWriter: socket path too long: %s",
+                   socket_path);
+        stg_exit(EXIT_FAILURE);
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    // Remove a stale socket left behind by an earlier run, but nothing else.
+    struct stat st;
+    if (lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(socket_path);
+    }
+
+    socket_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket_listen_fd < 0
+        || bind(socket_listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+        || listen(socket_listen_fd, 1) != 0) {
+        sysErrorBelch("initEventLogSocketWriter: can't listen on %s",
+                      socket_path);
+        stg_exit(EXIT_FAILURE);
+    }
+    if (pipe(socket_stop_pipe) != 0) {
+        sysErrorBelch("initEventLogSocketWriter: can't create pipe");
+        stg_exit(EXIT_FAILURE);
+    }
+    setCloseOnExec(socket_listen_fd);
+    setCloseOnExec(socket_stop_pipe[0]);
+    setCloseOnExec(socket_stop_pipe[1]);
+
+    socket_consumer_fd = -1;
+    socket_pending_size = 0;
+    socket_behind_count = 0;
+    socket_dropped_blocks = 0;
+    initMutex(&socket_mutex);
+}
+
+static bool
+writeEventLogSocket(void *eventlog, size_t eventlog_size)
+{
+    ACQUIRE_LOCK(&socket_mutex);
+
+    if (!socket_acceptor_running) {
+        // This is the header: see Note [Eventlog socket writer].
+        if (createOSThread(&socket_acceptor, "eventlog-socket",
+                           socketAcceptorThread, NULL) != 0) {
+            barf("writeEventLogSocket: failed to spawn acceptor: %s",
+                 strerror(errno));
+        }
+        socket_acceptor_running = true;
+    }
+
+    if (socket_consumer_fd < 0) {
+        RELEASE_LOCK(&socket_mutex);
+        return true;
+    }
+
+    bool block;
+    switch (RtsFlags.TraceFlags.eventlogSocketPolicy) {
+    case EVENTLOG_SOCKET_DROP:
+        block = false;
+        break;
+    case EVENTLOG_SOCKET_SAMPLE:
+        block = socket_pending_size > 0
+            && ++socket_behind_count % EVENTLOG_SOCKET_SAMPLE_RATE == 0;
+        break;
+    default:
+        block = true;
+        break;
+    }
+
+    bool ok = sendSocketPending(block);
+    if (ok && socket_pending_size == 0) {
+        ssize_t r = sendSocket(eventlog, eventlog_size, block);
+        if (r < 0) {
+            ok = false;
+        } else if ((size_t) r < eventlog_size) {
+            savePending((unsigned char *) eventlog + r, eventlog_size - r);
+        } else {
+            socket_behind_count = 0;
+        }
+    } else if (ok) {
+        socket_dropped_blocks++;
+    }
+
+    if (!ok) {
+        // The consumer has gone away, which is not an error
+        dropSocketConsumer();
+    }
+    RELEASE_LOCK(&socket_mutex);
+    return true;
+}
+
+static void
+flushEventLogSocket(void)
+{
+    ACQUIRE_LOCK(&socket_mutex);
+    if (socket_consumer_fd >= 0 && !sendSocketPending(false)) {
+        dropSocketConsumer();
+    }
+    RELEASE_LOCK(&socket_mutex);
+}
+
+static void
+stopEventLogSocketWriter(void)
+{
+    bool forked = socket_pid != getpid();
+
+    if (socket_acceptor_running) {
+        // After fork() the acceptor thread only exists in the parent
+        if (!forked) {
+            if (write(socket_stop_pipe[1], "x", 1) != 1) {
+                barf("stopEventLogSocketWriter: can't stop acceptor: %s",
+                     strerror(errno));
+            }
+            joinOSThread(socket_acceptor);
+        }
+        socket_acceptor_running = false;
+    }
+
+    if (socket_consumer_fd >= 0 && !forked) {
+        sendSocketPending(true);
+    }
+    dropSocketConsumer();
+    close(socket_listen_fd);
+    close(socket_stop_pipe[0]);
+    close(socket_stop_pipe[1]);
+    socket_listen_fd = -1;
+    if (!forked) {
+        unlink(socket_path);
+    }
+    stgFree(socket_path);
+    socket_path = NULL;
+    stgFree(socket_pending);
+    socket_pending = NULL;
+    socket_pending_cap = 0;
+    closeMutex(&socket_mutex);
+
+    if (socket_dropped_blocks > 0 && !forked) {
+        errorBelch("warning: dropped %" FMT_Word64 " eventlog blocks because "
+                   "the consumer of %s fell behind",
+                   socket_dropped_blocks, RtsFlags.TraceFlags.eventlogSocket);
+    }
+}
+
+const EventLogWriter SocketEventLogWriter = {
+    .initEventLogWriter = initEventLogSocketWriter,
+    .writeEventLog = writeEventLogSocket,
+    .flushEventLog = flushEventLogSocket,
+    .stopEventLogWriter = stopEventLogSocketWriter
+};
+#endif
@@ -102,6 +102,8 @@ event_types = [
 
     EventType(90, 'MEM_RETURN',       [CapsetId, Word32, Word32, Word32],    'The RTS attempted to return heap memory to the OS'),
     EventType(91, 'BLOCKS_SIZE',      [CapsetId, Word64],                 'Report the size of the heap in blocks'),
+    EventType(92, 'CAP_MIGRATION_COUNTERS', 4*[Word64],               'Capability migration counters'),
+    EventType(93, 'GC_SYNC_HISTOGRAM', [CapsetId] + 12*[Word64],      'Histogram of GC synchronisation latencies'),
 
     # Range 100 - 139 is reserved for Mercury.
 
@@ -134,6 +136,7 @@ event_types = [
     EventType(206, 'CONC_UPD_REM_SET_FLUSH',       [CapNo],               'Update remembered set flushed'),
     EventType(207, 'NONMOVING_HEAP_CENSUS',        [Word16, Word32, Word32, Word32], 'Nonmoving heap census'),
     EventType(208, 'NONMOVING_PRUNED_SEGMENTS',    [Word32, Word32],      'Report the amount of segments pruned and remaining on the free list.'),
+    EventType(209, 'CONC_MARK_WORKER_END',         [Word32, Word32],      'Objects marked by a parallel mark worker'),
 
     # Ticky-ticky profiling
     EventType(210, 'TICKY_COUNTER_DEF',            VariableLength,        'Ticky-ticky entry counter definition'),
@@ -75,6 +75,21 @@
  */
 #define MUT_ARR_PTRS_CARD_BITS 7
 
+/* The stable pointer table is a directory of segments of
+ * (1<<SPT_SEGMENT_BITS) entries, which never move.  See Note [Enlarging the
+ * stable pointer table] in rts/StablePtr.c.
+ */
+#define SPT_SEGMENT_BITS 10
+#define SPT_SEGMENT_SIZE (1 << SPT_SEGMENT_BITS)
+#define SPT_SEGMENT_MASK (SPT_SEGMENT_SIZE - 1)
+
+/* Likewise the stable name table.  See Note [Concurrent stable names] in
+ * rts/StableName.c.
+ */
+#define SNT_SEGMENT_BITS 10
+#define SNT_SEGMENT_SIZE (1 << SNT_SEGMENT_BITS)
+#define SNT_SEGMENT_MASK (SNT_SEGMENT_SIZE - 1)
+
 /* -----------------------------------------------------------------------------
    STG Registers.
 
@@ -55,6 +55,7 @@ typedef struct _GC_FLAGS {
 
     bool         useNonmoving; // default = false
     uint16_t     nonmovingDenseAllocatorCount; // Amount of dense nonmoving allocators. See Note [Allocator sizes]
+    uint32_t     nonmovingMarkThreads; // Number of nonmoving mark workers. See Note [Parallel nonmoving mark]
     uint32_t     generations;
     bool squeezeUpdFrames;
 
@@ -90,6 +91,9 @@ typedef struct _GC_FLAGS {
     bool numa;                   /* Use NUMA */
     StgWord numaMask;
 
+    bool hugePages;              /* Back the heap with huge pages.
+                                  * See Note [Huge pages] in MBlock.c */
+
     StgWord64 addressSpaceSize;  /* large address space size in bytes */
 } GC_FLAGS;
 
@@ -154,6 +158,8 @@ typedef struct _PROFILING_FLAGS {
     bool        startHeapProfileAtStartup; /* true if we start profiling from program startup */
     bool        startTimeProfileAtStartup; /* true if we start profiling from program startup */
     bool        incrementUserEra;
+    bool        parallelHeapCensus; /* census on all of the GC threads */
+    uint32_t    heapCensusSampling; /* census 1 in this many blocks */
 
 
     bool        showCCSOnException;
@@ -179,6 +185,11 @@ typedef struct _PROFILING_FLAGS {
 #define TRACE_EVENTLOG  1
 #define TRACE_STDERR    2
 
+/* See Note [Eventlog socket writer] */
+#define EVENTLOG_SOCKET_BLOCK  0
+#define EVENTLOG_SOCKET_DROP   1
+#define EVENTLOG_SOCKET_SAMPLE 2
+
 /* See Note [Synchronization of flags and base APIs] */
 typedef struct _TRACE_FLAGS {
     int tracing;
@@ -194,6 +205,13 @@ typedef struct _TRACE_FLAGS {
     /* Time between force eventlog flushes (or 0 if disabled) */
     Time eventlogFlushTime;
     int eventlogFlushTicks;
+    /* Spare buffers for the asynchronous eventlog writer (or 0 to write
+     * synchronously). See Note [Asynchronous eventlog writer] */
+    uint32_t eventlogAsyncBuffers;
+    /* Unix domain socket to stream the eventlog to (or NULL), and what to do
+     * when its consumer falls behind. See Note [Eventlog socket writer] */
+    char *eventlogSocket;
+    int eventlogSocketPolicy;
 #endif
     char *trace_output;  /* output filename for eventlog */
     bool nullWriter; /* use null writer instead of file writer */
@@ -257,11 +275,21 @@ typedef enum _IO_MANAGER_FLAG {
     /* All other choices pick only the requested one, with no fallback. */
     IO_MNGR_FLAG_SELECT,          /* Unix only,    non-threaded RTS only */
     IO_MNGR_FLAG_POLL,            /* Unix only,    non-threaded RTS only */
+    IO_MNGR_FLAG_EPOLL,           /* Linux only,   non-threaded RTS only */
+    IO_MNGR_FLAG_IO_URING,        /* Linux only,   non-threaded RTS only */
     IO_MNGR_FLAG_MIO,             /* cross-platform,   threaded RTS only */
     IO_MNGR_FLAG_WINIO,           /* Windows only                        */
     IO_MNGR_FLAG_WIN32_LEGACY,    /* Windows only, non-threaded RTS only */
   } IO_MANAGER_FLAG;
 
+/* The data structure used for timeouts by the in-RTS I/O managers that
+ * support a choice (currently poll, epoll and io_uring).
+ */
+typedef enum _IO_MANAGER_TIMERS_FLAG {
+    IO_MNGR_TIMERS_HEAP,          /* leftist heap, see TimeoutQueue.c  */
+    IO_MNGR_TIMERS_WHEEL,         /* timer wheel, see TimerWheel.c     */
+  } IO_MANAGER_TIMERS_FLAG;
+
 /* See Note [Synchronization of flags and base APIs] */
 typedef struct _MISC_FLAGS {
     Time    tickInterval;        /* units: TIME_RESOLUTION */
@@ -281,8 +309,13 @@ typedef struct _MISC_FLAGS {
     bool linkerOptimistic;       /* Should the runtime linker optimistically continue */
     StgWord linkerMemBase;       /* address to ask the OS for memory
                                   * for the linker, NULL ==> off */
+    uint32_t linkerThreads;      /* threads to prepare archive members on */
+    bool linkerStats;            /* report the time taken to load archives */
+    char *linkerSymbolCache;     /* directory of archive symbol indices,
+                                  * NULL ==> off */
     IO_MANAGER_FLAG ioManager;   /* The I/O manager to use.  */
     uint32_t numIoWorkerThreads; /* Number of I/O worker threads to use.  */
+    IO_MANAGER_TIMERS_FLAG ioManagerTimers; /* The timeout data structure. */
 } MISC_FLAGS;
 
 /* See Note [Synchronization of flags and base APIs] */
@@ -311,7 +344,15 @@ typedef struct _PAR_FLAGS {
                                  /* Use this many threads for parallel
                                   * GC (default: use all nNodes). */
 
+  bool           parGcLocality;  /* mark idle capabilities and steal
+                                  * GC work nearest first */
+
   bool           setAffinity;    /* force thread affinity with CPUs */
+
+  bool           stmVersionClock;
+                                 /* commit STM transactions against a
+                                  * global version clock, see
+                                  * Note [STM version clock] */
 } PAR_FLAGS;
 
 /* Corresponds to the RTS flag `--read-tix-file=<yes|no>`.
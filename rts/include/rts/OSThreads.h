@@ -215,6 +215,10 @@ extern void closeMutex            ( Mutex* pMut );
 
 // Processors and affinity
 void setThreadAffinity (uint32_t n, uint32_t m);
+bool getCpuTopology (uint32_t n, uint32_t *package, uint32_t *cache,
+                     uint32_t *core);
+bool getAffinityTopology (uint32_t n, uint32_t m, uint32_t *package,
+                          uint32_t *cache, uint32_t *core);
 void setThreadNode (uint32_t node);
 void releaseThreadNode (void);
 #endif // !CMINUSMINUS
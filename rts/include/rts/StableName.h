@@ -18,15 +18,17 @@
    -------------------------------------------------------------------------- */
 
 typedef struct {
-    StgPtr  addr;        // Haskell object when entry is in use, next free
-                         // entry (NULL when this is the last free entry)
-                         // otherwise. May be NULL temporarily during GC (when
-                         // pointee dies).
+    StgPtr  addr;        // Haskell object when entry is in use, NULL when the
+                         // entry is free. May also be NULL when the pointee
+                         // has died but the StableName object is still alive.
 
-    StgPtr  old;         // Old Haskell object, used during GC
+    StgPtr  old;         // The key of the entry in the hash table: the
+                         // address of the object as of the last GC, or NULL
 
     StgClosure *sn_obj;  // The StableName object, or NULL when the entry is
                          // free
 } snEntry;
 
-extern snEntry *stable_name_table;
+// a directory of segments of SNT_SEGMENT_SIZE entries, see
+// Note [Concurrent stable names] in rts/StableName.c
+extern snEntry **stable_name_table;
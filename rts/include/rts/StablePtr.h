@@ -21,12 +21,12 @@ StgStablePtr getStablePtr  (StgPtr p);
    -------------------------------------------------------------------------- */
 
 typedef struct {
-    StgPtr addr;         // Haskell object when entry is in use, next free
-                         // entry (NULL when this is the last free entry)
-                         // otherwise.
+    StgPtr addr;         // Haskell object when entry is in use, NULL when the
+                         // entry is free.
 } spEntry;
 
-extern spEntry *stable_ptr_table;
+// A directory of segments of SPT_SEGMENT_SIZE entries
+extern spEntry **stable_ptr_table;
 
 ATTR_ALWAYS_INLINE EXTERN_INLINE
 StgPtr deRefStablePtr(StgStablePtr sp)
@@ -36,9 +36,10 @@ StgPtr deRefStablePtr(StgStablePtr sp)
         return NULL;
     }
     StgWord spw = (StgWord)sp - 1;
-    // acquire load to ensure that we see the new SPT if it has been recently
-    // enlarged.
-    const spEntry *spt = ACQUIRE_LOAD(&stable_ptr_table);
+    // acquire load to ensure that we see the new directory if it has been
+    // recently enlarged.
+    spEntry *const *spt = ACQUIRE_LOAD(&stable_ptr_table);
+    const spEntry *seg = ACQUIRE_LOAD(&spt[spw >> SPT_SEGMENT_BITS]);
     // acquire load to ensure that the referenced object is visible.
-    return ACQUIRE_LOAD(&spt[spw].addr);
+    return ACQUIRE_LOAD(&seg[spw & SPT_SEGMENT_MASK].addr);
 }
@@ -557,6 +557,7 @@ struct StgTRecHeader_ {
   struct StgTRecHeader_     *enclosing_trec;
   StgTRecChunk              *current_chunk MUT_FIELD;
   TRecState                  state;
+  StgInt                     read_version; /* see Note [STM version clock] */
 };
 
 /* A stack frame delimiting an STM transaction */
@@ -735,13 +736,21 @@ typedef struct StgTimeoutQueue_ {
      */
     union NotifyCompletion notify;
 
-    /* Left and right sub-trees, plus parent pointer */
+    /* Left and right sub-trees, plus parent pointer. When the node is in a
+     * timer wheel (see TimerWheel.{h,c}) instead, a and b are the next and
+     * previous links in the list for its wheel slot, and parent is unused.
+     */
     struct StgTimeoutQueue_ *parent;
     struct StgTimeoutQueue_ *a;
     struct StgTimeoutQueue_ *b;
 
-    /* In a leftist heap we track the "rank" of each node. */
-    uint32_t rank;
+    union {
+        /* In a leftist heap we track the "rank" of each node. */
+        uint32_t rank;
+
+        /* In a timer wheel we track which slot the node is in. */
+        uint32_t wheel_slot;
+    };
 
     /* In the threaded way there is one timeout heap per capability. We have to
      * handle cross-capability timeout cancellation specially, so we need to
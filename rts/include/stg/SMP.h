@@ -354,21 +354,18 @@ EXTERN_INLINE void busy_wait_nop(void);
  * Barriers on Messages
  * --------------------
  * The RTS uses the Message mechanism to convey information between capabilities.
- * To send a message (see Messages.c:sendMessage) the sender must first take
- * the `lock` of the recipient capability. The Message can then be linked
- * onto the recipient's `inbox` list and release the lock (implying a release
- * barrier).
- *
- * To process its inbox (see Schedule.c:scheduleProcessInbox) the recipient must
- * take the capability lock before examining the inbox. This implies an acquire
- * barrier, ensuring that the messages in the inbox are visible.
- *
- * Under the above story there is no need for accesses to `inbox` to be
- * atomic at all as all accesses are under the capability lock. However, there
- * is a slight wrinkle here:
- * Capability.h:emptyInbox wants to test whether `inbox` is empty without
- * holding the capability lock. Consequently, accesses to `inbox` must be
- * atomic, although may use the relaxed ordering.
+ * To send a message (see Messages.c:sendMessage) the sender links the Message
+ * onto the recipient's `inbox` list with a CAS, which implies a release
+ * barrier.
+ *
+ * To process its inbox (see Schedule.c:scheduleProcessInbox) the recipient
+ * takes the whole list with an atomic exchange. This implies an acquire
+ * barrier, ensuring that the contents of the messages are visible.
+ *
+ * Capability.h:emptyInbox tests whether `inbox` is empty without either, so
+ * it may use the relaxed ordering. See Note [Lock-free capability inbox] in
+ * Messages.c for how we ensure that a capability does not go idle with a
+ * non-empty inbox.
  *
  * Barriers during GC
  * ------------------
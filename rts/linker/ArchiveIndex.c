@@ -0,0 +1,441 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team, 2025
+ *
+ * RTS Object Linker: persistent symbol indices of archives
+ *
+ * ---------------------------------------------------------------------------*/
+
+#include "rts/PosixSource.h"
+#include "Rts.h"
+
+#if defined(OBJFORMAT_ELF)
+
+#include "RtsUtils.h"
+#include "Hash.h"
+#include "LinkerInternals.h"
+#include "RtsSymbolInfo.h"
+#include "CheckUnload.h" // loaded_objects, insertOCSectionIndices
+#include "PathUtils.h"
+#include "linker/Elf.h"
+#include "linker/ArchiveIndex.h"
+
+#include <fs_rts.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/* Note [Archive symbol index]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Loading an archive reads, verifies and maps every one of its members, and
+   adds all of their symbols to the symbol table, even though a GHCi session
+   typically ends up needing only a few of the members (see Note
+   [runtime-linker-phases] in rts/Linker.c). When the same archives are loaded
+   by every session, as the libraries of a project are, that is a lot of
+   repeated work.
+
+   With --linker-symbol-cache=<dir>, after loading an archive in full we write
+   an index of it to <dir>: for each member its name and where its image is in
+   the archive, and for each symbol that loading it added to the symbol table
+   its name, type and strength, and the member that defines it. Indices are
+   keyed by the path of the archive (the file name is a hash of the path, and
+   the index records the path itself), and record the size and modification
+   time of the archive, so that we ignore the index of an archive that has
+   changed since.
+
+   The next time the archive is loaded, loadArchiveFromIndex maps the index
+   and makes an ObjectCode for each member without reading it (oc->lazy), and
+   adds the symbols of the index to the symbol table, owned by their members
+   but with no value yet. The symbol names are those of the index, which
+   therefore stays mapped for the rest of the program. The symbol table then
+   looks as it would after loading the archive in full, with every member
+   OBJECT_LOADED, except that the members have no image and no sections. When
+   a symbol of a member is first needed, loadSymbol calls
+   loadLazyArchiveMember, which reads the member from the archive, prepares it
+   (prepareOc), and fills in the values of its symbols, before resolving the
+   member as usual.
+
+   The index is written in the host's byte order, and has a version number in
+   its magic number; any index we can't use is ignored, and rewritten after
+   loading the archive in full. Writing an index is best-effort: if we fail to,
+   the archive is loaded as it would be without the cache.
+
+   Thin archives, whose members are separate files, are not indexed.
+*/
+
+/* "GHCLIDX" followed by the version of the format */
+#define ARCHIVE_INDEX_MAGIC 0x58444943484c4701ULL
+
+typedef struct {
+    StgWord64 magic;
+    StgWord64 archive_size;
+    StgWord64 archive_mtime;
+    uint32_t n_members;
+    uint32_t n_symbols;
+    uint32_t strings_size;  /* the strings start with the path of the archive */
+    uint32_t unused;
+} ArchiveIndexHeader;
+
+typedef struct {
+    StgWord64 offset;       /* of the image of the member in the archive */
+    uint32_t size;
+    uint32_t name;          /* the archiveMemberName, an offset in the strings */
+} ArchiveIndexMember;
+
+typedef struct {
+    uint32_t name;          /* an offset in the strings */
+    uint32_t member;
+    uint16_t type;          /* SymType */
+    uint16_t strength;      /* SymStrength */
+} ArchiveIndexSymbol;
+
+/* Returns the path of the index of the archive at `path`, or NULL if indices
+ * are not enabled. The result must be freed with stgFree. */
+static char *archiveIndexPath (pathchar *path)
+{
+    const char *dir = RtsFlags.MiscFlags.linkerSymbolCache;
+    if (dir == NULL) {
+        return NULL;
+    }
+    StgWord hash = hashBuffer(NULL, path, strlen(path));
+    size_t len = strlen(dir) + 1 + 2 * sizeof(StgWord) + 4 + 1;
+    char *index_path = stgMallocBytes(len, "archiveIndexPath");
+    snprintf(index_path, len, "%s/%0*" FMT_HexWord ".idx",
+             dir, (int) (2 * sizeof(StgWord)), hash);
+    return index_path;
+}
+
+static bool archiveStat (pathchar *path, StgWord64 *size, StgWord64 *mtime)
+{
+    struct_stat st;
+    if (pathstat(path, &st) != 0) {
+        return false;
+    }
+    *size = (StgWord64) st.st_size;
+    *mtime = (StgWord64) st.st_mtime;
+    return true;
+}
+
+/* -----------------------------------------------------------------------------
+ * Loading an archive from its index
+ */
+
+/* Map the index of the archive at `path` and check that it is up to date and
+ * well-formed. Returns NULL if there is no such index. */
+static ArchiveIndexHeader *mapArchiveIndex (pathchar *path, size_t *index_size)
+{
+    ArchiveIndexHeader *hdr = NULL;
+    StgWord64 archive_size, archive_mtime;
+    char *index_path = archiveIndexPath(path);
+    int fd = -1;
+
+    if (index_path == NULL || !archiveStat(path, &archive_size, &archive_mtime)) {
+        goto fail;
+    }
+
+    fd = open(index_path, O_RDONLY);
+    if (fd < 0) {
+        IF_DEBUG(linker, debugBelch("mapArchiveIndex: no index %s for %s\n",
+                                    index_path, path));
+        goto fail;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(ArchiveIndexHeader)) {
+        goto fail;
+    }
+    size_t size = st.st_size;
+    void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        goto fail;
+    }
+    hdr = p;
+
+    const size_t members_size = (size_t) hdr->n_members * sizeof(ArchiveIndexMember);
+    const size_t symbols_size = (size_t) hdr->n_symbols * sizeof(ArchiveIndexSymbol);
+    const char *strings =
+        (char *) p + sizeof(ArchiveIndexHeader) + members_size + symbols_size;
+
+    if (hdr->magic != ARCHIVE_INDEX_MAGIC
+        || hdr->archive_size != archive_size
+        || hdr->archive_mtime != archive_mtime
+        || sizeof(ArchiveIndexHeader) + members_size + symbols_size
+             + hdr->strings_size != size
+        || hdr->strings_size == 0
+        || strings[hdr->strings_size - 1] != '\0'
+        || strcmp(strings, path) != 0) {
+        IF_DEBUG(linker, debugBelch("mapArchiveIndex: index %s of %s is stale\n",
+                                    index_path, path));
+        munmap(p, size);
+        hdr = NULL;
+        goto fail;
+    }
+
+    *index_size = size;
+fail:
+    if (fd >= 0) close(fd);
+    if (index_path != NULL) stgFree(index_path);
+    return hdr;
+}
+
+HsInt loadArchiveFromIndex (pathchar *path)
+{
+    size_t index_size;
+    ArchiveIndexHeader *hdr = mapArchiveIndex(path, &index_size);
+    if (hdr == NULL) {
+        return -1;
+    }
+
+    ArchiveIndexMember *members = (ArchiveIndexMember *) (hdr + 1);
+    ArchiveIndexSymbol *symbols =
+        (ArchiveIndexSymbol *) (members + hdr->n_members);
+    char *strings = (char *) (symbols + hdr->n_symbols);
+
+    for (uint32_t i = 0; i < hdr->n_members; i++) {
+        if (members[i].name >= hdr->strings_size) goto corrupt;
+    }
+    for (uint32_t i = 0; i < hdr->n_symbols; i++) {
+        if (symbols[i].name >= hdr->strings_size
+            || symbols[i].member >= hdr->n_members) goto corrupt;
+    }
+
+    IF_DEBUG(linker, debugBelch("loadArchiveFromIndex: %" PATH_FMT ": %"
+                                FMT_Word32 " members, %" FMT_Word32 " symbols\n",
+                                path, hdr->n_members, hdr->n_symbols));
+
+    ObjectCode **ocs = stgMallocBytes(hdr->n_members * sizeof(ObjectCode *),
+                                      "loadArchiveFromIndex");
+    for (uint32_t i = 0; i < hdr->n_members; i++) {
+        ObjectCode *oc = mkOc(STATIC_OBJECT, path, NULL, members[i].size, false,
+                              strings + members[i].name, 0);
+        oc->lazy = true;
+        oc->archiveOffset = members[i].offset;
+        ocs[i] = oc;
+    }
+
+    // The symbols of each member, so that unloading the archive removes them
+    for (uint32_t i = 0; i < hdr->n_symbols; i++) {
+        ocs[symbols[i].member]->n_symbols++;
+    }
+    for (uint32_t i = 0; i < hdr->n_members; i++) {
+        ocs[i]->symbols = stgCallocBytes(ocs[i]->n_symbols + 1, sizeof(Symbol_t),
+                                         "loadArchiveFromIndex");
+        ocs[i]->n_symbols = 0;
+    }
+
+    HsInt r = 1;
+    for (uint32_t i = 0; i < hdr->n_symbols; i++) {
+        ObjectCode *oc = ocs[symbols[i].member];
+        SymbolName *name = strings + symbols[i].name;
+        if (symbols[i].strength == STRENGTH_WEAK) {
+            setWeakSymbol(oc, name);
+        }
+        if (!ghciInsertSymbolTable(oc->fileName, symhash, name, NULL,
+                                   symbols[i].strength, symbols[i].type, oc)) {
+            r = 0;
+            break;
+        }
+        oc->symbols[oc->n_symbols].name = name;
+        oc->symbols[oc->n_symbols].addr = NULL;
+        oc->symbols[oc->n_symbols].type = symbols[i].type;
+        oc->n_symbols++;
+    }
+
+    // As in loadArchive_, the members are loaded even if one of them fails,
+    // as they may have symbols in the symbol table.
+    for (uint32_t i = 0; i < hdr->n_members; i++) {
+        insertOCSectionIndices(ocs[i]); // also adds the object to `objects` list
+        ocs[i]->next_loaded_object = loaded_objects;
+        loaded_objects = ocs[i];
+    }
+    stgFree(ocs);
+
+    // N.B. We never unmap the index, as the symbol table refers to its strings
+    return r;
+
+corrupt:
+    errorBelch("loadArchive: ignoring corrupt symbol index of `%" PATH_FMT "'",
+               path);
+    munmap(hdr, index_size);
+    return -1;
+}
+
+HsInt loadLazyArchiveMember (ObjectCode *oc)
+{
+    ASSERT(oc->lazy);
+    ASSERT(oc->image == NULL);
+
+    IF_DEBUG(linker, ocDebugBelch(oc, "reading lazily loaded member\n"));
+
+    FILE *f = pathopen(oc->fileName, WSTR("rb"));
+    if (f == NULL) {
+        errorBelch("loadArchive: can't read `%" PATH_FMT "'", oc->fileName);
+        return 0;
+    }
+    char *image = stgMallocBytes(oc->fileSize, "loadLazyArchiveMember");
+    if (fseek(f, oc->archiveOffset, SEEK_SET) != 0
+        || fread(image, 1, oc->fileSize, f) != (size_t) oc->fileSize) {
+        errorBelch("loadArchive: error whilst reading `%" PATH_FMT "'",
+                   OC_INFORMATIVE_FILENAME(oc));
+        stgFree(image);
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+
+    // prepareOc collects the symbols afresh
+    Symbol_t *index_symbols = oc->symbols;
+    int n_index_symbols = oc->n_symbols;
+    oc->symbols = NULL;
+    oc->n_symbols = 0;
+
+    oc->image = image;
+    oc->lazy = false;
+    ocInit_ELF(oc);
+
+    if (!prepareOc(oc)) {
+        // Keep the symbols of the index, so that unloading the archive
+        // removes them from the symbol table.
+        if (oc->symbols != NULL) stgFree(oc->symbols);
+        oc->symbols = index_symbols;
+        oc->n_symbols = n_index_symbols;
+        oc->status = OBJECT_DONT_RESOLVE;
+        return 0;
+    }
+
+    // Fill in the values of the symbols that loadArchiveFromIndex added
+    for (int i = 0; i < oc->n_symbols; i++) {
+        Symbol_t *sym = &oc->symbols[i];
+        if (sym->name == NULL) break;
+        RtsSymbolInfo *pinfo = lookupStrHashTable(symhash, sym->name);
+        if (pinfo != NULL && pinfo->owner == oc) {
+            pinfo->value = sym->addr;
+            pinfo->type = sym->type;
+        } else {
+            SymStrength strength = isSymbolWeak(oc, sym->name)
+                                 ? STRENGTH_WEAK : STRENGTH_NORMAL;
+            if (!ghciInsertSymbolTable(oc->fileName, symhash, sym->name,
+                                       sym->addr, strength, sym->type, oc)) {
+                stgFree(index_symbols);
+                return 0;
+            }
+        }
+    }
+    stgFree(index_symbols);
+
+    addOCSectionIndices(oc);
+    return 1;
+}
+
+/* -----------------------------------------------------------------------------
+ * Writing the index of an archive
+ */
+
+/* Copy a string to the strings of an index at offset *next, and return that
+ * offset. */
+static uint32_t addIndexString (char *strings, uint32_t *next, const char *s)
+{
+    uint32_t offset = *next;
+    size_t len = strlen(s) + 1;
+    memcpy(strings + offset, s, len);
+    *next += len;
+    return offset;
+}
+
+void writeArchiveIndex (pathchar *path, ObjectCode **ocs,
+                        StgWord64 *offsets, uint32_t n_ocs)
+{
+    ArchiveIndexHeader hdr;
+    char *index_path = archiveIndexPath(path);
+    char *tmp_path = NULL;
+    FILE *f = NULL;
+
+    if (index_path == NULL) {
+        return;
+    }
+    if (!archiveStat(path, &hdr.archive_size, &hdr.archive_mtime)) {
+        goto done;
+    }
+
+    hdr.magic = ARCHIVE_INDEX_MAGIC;
+    hdr.n_members = n_ocs;
+    hdr.n_symbols = 0;
+    hdr.strings_size = strlen(path) + 1;
+    hdr.unused = 0;
+    for (uint32_t i = 0; i < n_ocs; i++) {
+        ObjectCode *oc = ocs[i];
+        hdr.strings_size += strlen(oc->archiveMemberName) + 1;
+        for (int j = 0; j < oc->n_symbols && oc->symbols[j].name != NULL; j++) {
+            hdr.n_symbols++;
+            hdr.strings_size += strlen(oc->symbols[j].name) + 1;
+        }
+    }
+
+    ArchiveIndexMember *members =
+        stgMallocBytes(n_ocs * sizeof(ArchiveIndexMember), "writeArchiveIndex");
+    ArchiveIndexSymbol *symbols =
+        stgMallocBytes(hdr.n_symbols * sizeof(ArchiveIndexSymbol),
+                       "writeArchiveIndex");
+    char *strings = stgMallocBytes(hdr.strings_size, "writeArchiveIndex");
+
+    uint32_t next_string = 0, next_symbol = 0;
+
+    addIndexString(strings, &next_string, path);
+    for (uint32_t i = 0; i < n_ocs; i++) {
+        ObjectCode *oc = ocs[i];
+        members[i].offset = offsets[i];
+        members[i].size = oc->fileSize;
+        members[i].name = addIndexString(strings, &next_string,
+                                         oc->archiveMemberName);
+        for (int j = 0; j < oc->n_symbols && oc->symbols[j].name != NULL; j++) {
+            ArchiveIndexSymbol *sym = &symbols[next_symbol++];
+            sym->name = addIndexString(strings, &next_string,
+                                       oc->symbols[j].name);
+            sym->member = i;
+            sym->type = oc->symbols[j].type;
+            sym->strength = isSymbolWeak(oc, oc->symbols[j].name)
+                          ? STRENGTH_WEAK : STRENGTH_NORMAL;
+        }
+    }
+
+    // Write to a temporary file and rename it, so that other processes never
+    // see a partially written index.
+    size_t tmp_len = strlen(index_path) + 32;
+    tmp_path = stgMallocBytes(tmp_len, "writeArchiveIndex");
+    snprintf(tmp_path, tmp_len, "%s.%d", index_path, (int) getpid());
+
+    mkdir(RtsFlags.MiscFlags.linkerSymbolCache, 0777);
+    f = fopen(tmp_path, "wb");
+    bool ok = f != NULL
+        && fwrite(&hdr, sizeof(hdr), 1, f) == 1
+        && fwrite(members, sizeof(ArchiveIndexMember), n_ocs, f) == n_ocs
+        && fwrite(symbols, sizeof(ArchiveIndexSymbol), hdr.n_symbols, f)
+             == hdr.n_symbols
+        && fwrite(strings, 1, hdr.strings_size, f) == hdr.strings_size;
+    // Close the file whether or not the writes succeeded, before we rename
+    // or unlink it.
+    if (f != NULL && fclose(f) != 0) {
+        ok = false;
+    }
+    if (!ok || rename(tmp_path, index_path) != 0) {
+        IF_DEBUG(linker, debugBelch("writeArchiveIndex: failed to write %s: %s\n",
+                                    index_path, strerror(errno)));
+        unlink(tmp_path);
+    } else {
+        IF_DEBUG(linker, debugBelch("writeArchiveIndex: wrote %s for %" PATH_FMT
+                                    "\n", index_path, path));
+    }
+
+    stgFree(members);
+    stgFree(symbols);
+    stgFree(strings);
+done:
+    if (tmp_path != NULL) stgFree(tmp_path);
+    stgFree(index_path);
+}
+
+#endif /* OBJFORMAT_ELF */
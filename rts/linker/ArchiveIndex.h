@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Rts.h"
+#include "LinkerInternals.h"
+
+#include "BeginPrivate.h"
+
+#if defined(OBJFORMAT_ELF)
+
+/* Load an archive from its symbol index, without reading its members. Returns
+ * 1 if ok, 0 on error, and -1 if there is no valid index for the archive. */
+HsInt loadArchiveFromIndex ( pathchar *path );
+
+/* Write the symbol index of an archive whose members have all been loaded;
+ * offsets[i] is the offset of the image of ocs[i] in the archive. */
+void writeArchiveIndex ( pathchar *path, ObjectCode **ocs,
+                         StgWord64 *offsets, uint32_t n_ocs );
+
+/* Read and prepare a member of an archive loaded from its symbol index. */
+HsInt loadLazyArchiveMember ( ObjectCode *oc );
+
+#endif
+
+#include "EndPrivate.h"
@@ -670,10 +670,52 @@ static SectionKind getSectionKind_ELF( Elf_Shdr *hdr, int *is_bss )
     return SECTIONKIND_OTHER;
 }
 
+/* Note [Shared read-only sections (ELF)]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   When preloadObjectFile maps an object file (oc->imageMapped), the image is
+   a private mapping of the file, whose pages are shared with the page cache
+   until they are written to. ocGetNames_ELF copies each small section into
+   m32 pages, and maps each large one from the file separately, so that its
+   pages can be made executable or written by relocations. Either way a
+   copied or relocated page becomes private memory of the process.
+
+   A section that is read-only (neither writable nor executable) and is not
+   the target of any relocation section is never written, so we don't copy
+   it: a small one stays where it is in the image, and a large one is mapped
+   from the file read-only. Its pages then remain shared with the page cache,
+   and with other processes loading the same object. This is typically most
+   of .rodata and string literals (.rodata.str*, .rodata.cst*), as well as
+   large tables that code refers to but which contain no addresses.
+
+   The image is mapped near the RTS (see mmapForLinker), so sections left in
+   it are as reachable by relocations as the m32 pages would be. Archive
+   members are read into malloc'd memory rather than mapped, so their
+   sections are still copied.
+
+   --linker-stats reports how many bytes of sections each object shares in
+   this way.
+*/
+
+/* Which sections are the target of a relocation section, and so may be
+ * written by ocResolve_ELF. The result must be freed with stgFree. */
+static bool *
+relocatedSections (Elf_Shdr *shdr, Elf_Word shnum)
+{
+    bool *relocated = stgCallocBytes(shnum, sizeof(bool), "relocatedSections");
+    for (Elf_Word i = 0; i < shnum; i++) {
+        if ((shdr[i].sh_type == SHT_REL || shdr[i].sh_type == SHT_RELA)
+            && shdr[i].sh_info < shnum) {
+            relocated[shdr[i].sh_info] = true;
+        }
+    }
+    return relocated;
+}
+
 #if !defined(NEED_PLT)
 
 static void *
 mapObjectFileSection (int fd, Elf_Word offset, Elf_Word size,
+                      MemoryAccess access,
                       void **mapped_start, StgWord *mapped_size,
                       StgWord *mapped_offset)
 {
@@ -682,7 +724,7 @@ mapObjectFileSection (int fd, Elf_Word offset, Elf_Word size,
 
     pageOffset = roundDownToPage(offset);
     pageSize = roundUpToPage(offset-pageOffset+size);
-    p = mmapForLinker(pageSize, MEM_READ_WRITE, 0, fd, pageOffset);
+    p = mmapForLinker(pageSize, access, 0, fd, pageOffset);
     if (p == NULL) return NULL;
     *mapped_size = pageSize;
     *mapped_offset = pageOffset;
@@ -707,13 +749,15 @@ ocGetNames_ELF ( ObjectCode* oc )
 #endif
    const Elf_Word shnum = elf_shnum(ehdr);
 
-   ASSERT(symhash != NULL);
-
    sections = (Section*)stgCallocBytes(shnum, sizeof(Section),
                                        "ocGetNames_ELF(sections)");
    oc->sections = sections;
    oc->n_sections = shnum;
 
+   // See Note [Shared read-only sections (ELF)]
+   bool *relocated = relocatedSections(shdr, shnum);
+   StgWord shared_size = 0;
+
    if (oc->imageMapped) {
 #if defined(openbsd_HOST_OS)
        fd = open(oc->fileName, O_RDONLY, S_IRUSR);
@@ -722,7 +766,7 @@ ocGetNames_ELF ( ObjectCode* oc )
 #endif
        if (fd == -1) {
            errorBelch("loadObj: can't open %" PATH_FMT, oc->fileName);
-           return 0;
+           goto fail;
        }
    }
 
@@ -879,11 +923,20 @@ ocGetNames_ELF ( ObjectCode* oc )
            */
           memcpy(start, oc->image + offset, size);
 #else
+          // See Note [Shared read-only sections (ELF)]
+          bool shared = oc->imageMapped && !relocated[i]
+                        && !(shdr[i].sh_flags & (SHF_WRITE | SHF_EXECINSTR))
+                        && (align <= 1 || offset % align == 0);
           if (USE_CONTIGUOUS_MMAP || RtsFlags.MiscFlags.linkerAlwaysPic) {
               // already mapped.
               start = oc->image + offset;
               alloc = SECTION_NOMEM;
           }
+          else if (shared && size < getPageSize() / 3) {
+              start = oc->image + offset;
+              alloc = SECTION_NOMEM;
+              shared_size += size;
+          }
           // use the m32 allocator if either the image is not mapped
           // (i.e. we cannot map the sections separately), or if the section
           // size is small.
@@ -903,10 +956,12 @@ ocGetNames_ELF ( ObjectCode* oc )
               alloc = SECTION_M32;
           } else {
               start = mapObjectFileSection(fd, offset, size,
+                                           shared ? MEM_READ_ONLY : MEM_READ_WRITE,
                                            &mapped_start, &mapped_size,
                                            &mapped_offset);
               if (start == NULL) goto fail;
               alloc = SECTION_MMAP;
+              if (shared) shared_size += size;
           }
 #endif
           addSection(&sections[i], kind, alloc, start, size,
@@ -948,9 +1003,9 @@ ocGetNames_ELF ( ObjectCode* oc )
 
       oc->symbols = stgCallocBytes(oc->n_symbols, sizeof(Symbol_t),
                                    "ocGetNames_ELF(oc->symbols)");
-      // Note calloc: if we fail partway through initializing symbols, we need
-      // to undo the additions to the symbol table so far. We know which ones
-      // have been added by whether the entry is NULL or not.
+      // Note calloc: the entries after the last symbol we collect stay NULL,
+      // which is how ocInsertSymbols_ELF and removeOcSymbols know where the
+      // symbols end.
 
       unsigned curSymbol = 0;
 
@@ -1085,11 +1140,7 @@ ocGetNames_ELF ( ObjectCode* oc )
                        if (isWeak == HS_BOOL_TRUE) {
                            setWeakSymbol(oc, nm);
                        }
-                       if (!ghciInsertSymbolTable(oc->fileName, symhash,
-                                                  nm, symbol->addr, isWeak, sym_type, oc)
-                           ) {
-                           goto fail;
-                       }
+                       /* Inserted into symhash by ocInsertSymbols_ELF */
                        oc->symbols[curSymbol].name = nm;
                        oc->symbols[curSymbol].addr = symbol->addr;
                        oc->symbols[curSymbol].type = sym_type;
@@ -1121,6 +1172,12 @@ ocGetNames_ELF ( ObjectCode* oc )
                   oc->archiveMemberName
                   ? oc->archiveMemberName
                   : oc->fileName);
+
+   if (RtsFlags.MiscFlags.linkerStats && shared_size > 0) {
+       debugBelch("loadObj: %" PATH_FMT ": %" FMT_Word " bytes of read-only "
+                  "sections shared with the page cache\n",
+                  OC_INFORMATIVE_FILENAME(oc), shared_size);
+   }
    result = 1;
    goto end;
 
@@ -1129,10 +1186,36 @@ fail:
    goto end;
 
 end:
+   stgFree(relocated);
    if (fd >= 0) close(fd);
    return result;
 }
 
+/*
+ * Add the symbols collected by ocGetNames_ELF to the global symbol table.
+ *
+ * ocGetNames_ELF only touches the ObjectCode itself, so it can run on any
+ * thread; this is the part of loading an object that must be serialised. See
+ * Note [Parallel archive loading] in rts/linker/LoadArchive.c.
+ */
+int
+ocInsertSymbols_ELF ( ObjectCode* oc )
+{
+   ASSERT(symhash != NULL);
+
+   for (int i = 0; i < oc->n_symbols; i++) {
+      Symbol_t *sym = &oc->symbols[i];
+      if (sym->name == NULL) break;
+      SymStrength strength = isSymbolWeak(oc, sym->name)
+                           ? STRENGTH_WEAK : STRENGTH_NORMAL;
+      if (!ghciInsertSymbolTable(oc->fileName, symhash, sym->name, sym->addr,
+                                 strength, sym->type, oc)) {
+         return 0;
+      }
+   }
+   return 1;
+}
+
 // the aarch64 and riscv64 linkers use relocateObjectCodeAarch64() and
 // relocateObjectCodeRISCV64() (respectively), see elf_reloc_aarch64.{h,c} and
 // elf_reloc_riscv64.{h,c}
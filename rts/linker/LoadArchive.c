@@ -19,6 +19,7 @@
 #  include <mach-o/fat.h>
 #elif defined(OBJFORMAT_ELF)
 #include "linker/Elf.h"
+#include "linker/ArchiveIndex.h"
 #endif
 
 #include <string.h>
@@ -33,6 +34,187 @@
 
 #define DEBUG_LOG(...) IF_DEBUG(linker, debugBelch("loadArchive: " __VA_ARGS__))
 
+/* Note [Parallel archive loading]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Loading a large archive (e.g. the libHS*.a of a big package in GHCi) is
+   dominated by work on each member in turn: verifying the object image,
+   mapping its sections and walking its symbol tables. Almost none of that
+   depends on the other members, so loadArchive_ loads an archive in three
+   phases:
+
+   1. Read the members, serially, and make an ObjectCode for each (mkOc and
+      ocInit_*). This reads a single FILE, so there's little to gain from
+      doing it in parallel.
+
+   2. Prepare the members (prepareOc) on a pool of --linker-threads threads,
+      the thread loading the archive being one of them. prepareOc only touches
+      the ObjectCode, apart from allocating memory for its sections: the m32
+      allocators belong to the ObjectCode, and the state they share (the m32
+      free page pool and the region that mmapForLinker maps into) has locks of
+      its own.
+
+   3. Add the symbols of each member to the global symbol table and the member
+      to the object lists (finishLoadOc), serially and in archive order, under
+      linker_mutex as before. Doing this in order means that the outcome for a
+      symbol defined by several members is the same as when loading serially.
+
+   Only ELF objects are prepared in parallel: on the other formats ocGetNames_*
+   also does the symbol table insertion, so it stays in finishLoadOc and there
+   is too little left in prepareOc for it to be worth it.
+
+   As before, the members preceding one that fails to load stay loaded; the
+   members after it are freed. If reading the archive fails, none of its
+   members are loaded.
+
+   With --linker-stats we report how long each phase took, and how long the
+   workers spent preparing members in total, which is about how long phase 2
+   would have taken serially.
+*/
+
+/* The least number of members worth handing each linker thread */
+#define LINKER_MEMBERS_PER_THREAD 4
+
+/* The members of an archive that have been read but not yet loaded. */
+typedef struct {
+    ObjectCode **ocs;
+    StgWord64 *offsets;       /* of each image in the archive, if not thin */
+    HsInt *prepared;          /* result of prepareOc on each member */
+    uint32_t n_ocs;
+    uint32_t size;
+    StgWord next;             /* the next member to prepare */
+} ArchiveMembers;
+
+typedef struct {
+    ArchiveMembers *members;
+    Time busy;                /* time spent preparing members */
+#if defined(THREADED_RTS)
+    OSThreadId id;
+#endif
+} LinkerWorker;
+
+static void addArchiveMember (ArchiveMembers *members, ObjectCode *oc,
+                              StgWord64 offset)
+{
+    if (members->n_ocs == members->size) {
+        members->size = members->size ? members->size * 2 : 16;
+        members->ocs = stgReallocBytes(members->ocs,
+                                       members->size * sizeof(ObjectCode *),
+                                       "addArchiveMember");
+        members->offsets = stgReallocBytes(members->offsets,
+                                           members->size * sizeof(StgWord64),
+                                           "addArchiveMember");
+    }
+    members->offsets[members->n_ocs] = offset;
+    members->ocs[members->n_ocs++] = oc;
+}
+
+/* Free the members from index `from` onwards, which have not been loaded. */
+static void freeArchiveMembers (ArchiveMembers *members, uint32_t from)
+{
+    for (uint32_t i = from; i < members->n_ocs; i++) {
+        freeObjectCode(members->ocs[i]);
+    }
+    members->n_ocs = from;
+}
+
+static void prepareArchiveMembers_ (LinkerWorker *w)
+{
+    ArchiveMembers *members = w->members;
+    while (true) {
+        StgWord i = atomic_inc(&members->next, 1) - 1;
+        if (i >= members->n_ocs) break;
+        Time t0 = getProcessElapsedTime();
+        members->prepared[i] = prepareOc(members->ocs[i]);
+        w->busy += getProcessElapsedTime() - t0;
+    }
+}
+
+#if defined(THREADED_RTS)
+static void* OSThreadProcAttr
+linkerWorker (void *info)
+{
+    prepareArchiveMembers_((LinkerWorker *) info);
+    return NULL;
+}
+#endif
+
+/* Phase 2 of Note [Parallel archive loading]. Returns the number of threads
+ * used, and the time they spent preparing members in *busy. */
+static uint32_t prepareArchiveMembers (ArchiveMembers *members, Time *busy)
+{
+    uint32_t n_threads = 1;
+
+#if defined(THREADED_RTS) && defined(OBJFORMAT_ELF)
+    n_threads = members->n_ocs / LINKER_MEMBERS_PER_THREAD;
+    if (n_threads > RtsFlags.MiscFlags.linkerThreads) {
+        n_threads = RtsFlags.MiscFlags.linkerThreads;
+    }
+    if (n_threads < 1) {
+        n_threads = 1;
+    }
+#endif
+
+    members->prepared = stgMallocBytes(members->n_ocs * sizeof(HsInt),
+                                       "prepareArchiveMembers");
+    members->next = 0;
+
+    LinkerWorker *workers = stgMallocBytes(n_threads * sizeof(LinkerWorker),
+                                           "prepareArchiveMembers");
+    for (uint32_t i = 0; i < n_threads; i++) {
+        workers[i].members = members;
+        workers[i].busy = 0;
+    }
+
+#if defined(THREADED_RTS)
+    // The loading thread is worker 0. If we can't start a thread, the
+    // others just take its share.
+    uint32_t started = 1;
+    for (; started < n_threads; started++) {
+        if (createOSThread(&workers[started].id, "ghc_linker",
+                           linkerWorker, &workers[started]) != 0) {
+            IF_DEBUG(linker, debugBelch("loadArchive: failed to start "
+                                        "linker thread %d\n", started));
+            break;
+        }
+    }
+    n_threads = started;
+#endif
+
+    prepareArchiveMembers_(&workers[0]);
+
+    *busy = workers[0].busy;
+#if defined(THREADED_RTS)
+    for (uint32_t i = 1; i < n_threads; i++) {
+        joinOSThread(workers[i].id);
+        *busy += workers[i].busy;
+    }
+#endif
+
+    stgFree(workers);
+    return n_threads;
+}
+
+/* Phase 3 of Note [Parallel archive loading]. Returns false if a member failed
+ * to load. On success the members are left in `members` for the caller to
+ * index, and must not be freed. */
+static bool loadArchiveMembers (ArchiveMembers *members)
+{
+    for (uint32_t i = 0; i < members->n_ocs; i++) {
+        ObjectCode *oc = members->ocs[i];
+        if (!members->prepared[i] || !finishLoadOc(oc)) {
+            // The failed member may have symbols in the symbol table, so
+            // keep it, as we always have.
+            freeArchiveMembers(members, i + 1);
+            members->n_ocs = 0;
+            return false;
+        }
+        insertOCSectionIndices(oc); // also adds the object to `objects` list
+        oc->next_loaded_object = loaded_objects;
+        loaded_objects = oc;
+    }
+    return true;
+}
+
 
 #if defined(darwin_HOST_OS) || defined(ios_HOST_OS)
 /* Read 4 bytes and convert to host byte order */
@@ -392,9 +574,29 @@ HsInt loadArchive_ (pathchar *path)
         return 1; /* success */
     }
 
+#if defined(OBJFORMAT_ELF)
+    // See Note [Archive symbol index] in rts/linker/ArchiveIndex.c
+    if (RtsFlags.MiscFlags.linkerSymbolCache != NULL) {
+        Time t_index = getProcessElapsedTime();
+        HsInt r = loadArchiveFromIndex(path);
+        if (r != -1) {
+            if (RtsFlags.MiscFlags.linkerStats) {
+                debugBelch("loadArchive: %" PATH_FMT ": from symbol index, "
+                           "%.3fs\n", path,
+                           TimeToSecondsDbl(getProcessElapsedTime() - t_index));
+            }
+            return r;
+        }
+    }
+#endif
+
     char *gnuFileIndex = NULL;
     int gnuFileIndexSize = 0;
 
+    ArchiveMembers members = { .ocs = NULL, .offsets = NULL, .prepared = NULL,
+                               .n_ocs = 0, .size = 0, .next = 0 };
+    Time t_start = getProcessElapsedTime();
+
     size_t fileNameSize = 32;
     char *fileName = stgMallocBytes(fileNameSize, "loadArchive(fileName)");
 
@@ -588,6 +790,7 @@ HsInt loadArchive_ (pathchar *path)
 #else // not darwin
             image = stgMallocBytes(memberSize, "loadArchive(image)");
 #endif
+            StgWord64 offset = isThin ? 0 : (StgWord64) ftell(f);
             if (isThin) {
                 if (!readThinArchiveMember(n, memberSize, path, fileName, image)) {
                     goto fail;
@@ -623,15 +826,8 @@ HsInt loadArchive_ (pathchar *path)
 
             stgFree(archiveMemberName);
 
-            if (0 == loadOc(oc)) {
-                stgFree(fileName);
-                fclose(f);
-                return 0;
-            } else {
-                insertOCSectionIndices(oc); // also adds the object to `objects` list
-                oc->next_loaded_object = loaded_objects;
-                loaded_objects = oc;
-            }
+            // See Note [Parallel archive loading]
+            addArchiveMember(&members, oc, offset);
         }
         else if (isGnuIndex) {
             if (gnuFileIndex != NULL) {
@@ -696,11 +892,46 @@ while reading filename from `%" PATH_FMT "'", path);
         memberIdx ++;
         DEBUG_LOG("reached end of archive loading while loop\n");
     }
+
+    Time t_read = getProcessElapsedTime();
+    Time busy;
+    uint32_t n_threads = prepareArchiveMembers(&members, &busy);
+    Time t_prepared = getProcessElapsedTime();
+    uint32_t n_members = members.n_ocs;
+
+    if (!loadArchiveMembers(&members)) {
+        goto fail;
+    }
+
+#if defined(OBJFORMAT_ELF)
+    if (RtsFlags.MiscFlags.linkerSymbolCache != NULL && !isThin) {
+        writeArchiveIndex(path, members.ocs, members.offsets, members.n_ocs);
+    }
+#endif
+    members.n_ocs = 0; // they are loaded now
+
+    if (RtsFlags.MiscFlags.linkerStats) {
+        Time t_loaded = getProcessElapsedTime();
+        debugBelch("loadArchive: %" PATH_FMT ": %" FMT_Word32 " members, "
+                   "read %.3fs, prepare %.3fs (%.3fs on %" FMT_Word32
+                   " threads), insert %.3fs\n",
+                   path, n_members,
+                   TimeToSecondsDbl(t_read - t_start),
+                   TimeToSecondsDbl(t_prepared - t_read),
+                   TimeToSecondsDbl(busy), n_threads,
+                   TimeToSecondsDbl(t_loaded - t_prepared));
+    }
+
     retcode = 1;
 fail:
     if (f != NULL)
         fclose(f);
 
+    freeArchiveMembers(&members, 0);
+    stgFree(members.ocs);
+    stgFree(members.offsets);
+    stgFree(members.prepared);
+
     if (fileName != NULL)
         stgFree(fileName);
     if (gnuFileIndex != NULL) {
@@ -128,7 +128,11 @@ m32_page_t.free_page.next. When run out of free pages we allocate a chunk of
 M32_MAP_PAGES to both avoid fragmenting our address space and amortize the
 runtime cost of the mapping.
 
-The allocator is *not* thread-safe.
+An allocator is *not* thread-safe: each one must only be used by one thread at
+a time. The global free page pool is shared by all allocators, and is protected
+by m32_pool_mutex, so different allocators (e.g. those of different
+ObjectCodes) can be used concurrently. See Note [Parallel archive loading] in
+rts/linker/LoadArchive.c.
 
 */
 
@@ -277,6 +281,22 @@ struct m32_page_t *m32_free_page_pool = NULL;
 /** Number of pages in free page pool */
 unsigned int m32_free_page_pool_size = 0;
 
+#if defined(THREADED_RTS)
+/** Protects the free page pool */
+static Mutex m32_pool_mutex;
+#endif
+
+/**
+ * Initialise the global state of the allocator.
+ */
+void
+initM32Alloc(void)
+{
+#if defined(THREADED_RTS)
+  initMutex(&m32_pool_mutex);
+#endif
+}
+
 /**
  * Free a filled page or, if possible, place it in the free page pool.
  */
@@ -292,6 +312,7 @@ m32_release_page(struct m32_page_t *page)
 
   // Break the page, which may be a large multi-page allocation, into
   // individual pages for the page pool
+  ACQUIRE_LOCK(&m32_pool_mutex);
   while (sz > 0) {
     if (m32_free_page_pool_size < M32_MAX_FREE_PAGE_POOL_SIZE) {
       mprotectForLinker(page, pgsz, MEM_READ_WRITE);
@@ -306,6 +327,7 @@ m32_release_page(struct m32_page_t *page)
     page = (struct m32_page_t *) ((uint8_t *) page + pgsz);
     sz -= pgsz;
   }
+  RELEASE_LOCK(&m32_pool_mutex);
 
   // The free page pool is full, release the rest back to the system
   if (sz > 0) {
@@ -320,6 +342,7 @@ m32_release_page(struct m32_page_t *page)
 static struct m32_page_t *
 m32_alloc_page(void)
 {
+  ACQUIRE_LOCK(&m32_pool_mutex);
   if (m32_free_page_pool_size == 0) {
     /*
      * Free page pool is empty; refill it with a new batch of M32_MAP_PAGES
@@ -350,6 +373,7 @@ m32_alloc_page(void)
   struct m32_page_t *page = m32_free_page_pool;
   m32_free_page_pool = page->free_page.next;
   m32_free_page_pool_size --;
+  RELEASE_LOCK(&m32_pool_mutex);
   ASSERT_PAGE_TYPE(page, FREE_PAGE);
   return page;
 }
@@ -566,6 +590,11 @@ m32_alloc(struct m32_allocator_t *alloc, size_t size, size_t alignment)
 // they are, there is a bug at the call site.
 // See the note titled "Compile Time Trickery" at the top of this file.
 
+void
+initM32Alloc(void)
+{
+}
+
 m32_allocator *
 m32_allocator_new(bool executable STG_UNUSED)
 {
@@ -27,6 +27,8 @@
 struct m32_allocator_t;
 typedef struct m32_allocator_t m32_allocator;
 
+void initM32Alloc(void);
+
 m32_allocator *m32_allocator_new(bool executable) M32_NO_RETURN;
 
 void m32_allocator_free(m32_allocator *alloc) M32_NO_RETURN;
@@ -40,11 +40,21 @@
 
 void *mmap_32bit_base = LINKER_LOAD_BASE;
 
+#if defined(THREADED_RTS)
+/* Protects the region we map into near the image, as mappings may be made
+ * from several threads at once; see Note [Parallel archive loading] in
+ * rts/linker/LoadArchive.c. */
+static Mutex linker_mmap_mutex;
+#endif
+
 void initLinkerMMap(void) {
     if (RtsFlags.MiscFlags.linkerMemBase != 0) {
         // User-override for mmap_32bit_base
         mmap_32bit_base = (void*)RtsFlags.MiscFlags.linkerMemBase;
     }
+#if defined(THREADED_RTS)
+    initMutex(&linker_mmap_mutex);
+#endif
 }
 
 static const char *memoryAccessDescription(MemoryAccess mode)
@@ -311,6 +321,8 @@ doMmap(void *map_addr, size_t bytes, int prot, uint32_t flags, int fd, int offse
 }
 
 
+// Must be called with linker_mmap_mutex held, as it initialises the region
+// on first use.
 static struct MemoryRegion *
 nearImage(void) {
     static struct MemoryRegion region = { NULL, NULL, NULL };
@@ -387,27 +399,23 @@ void *
 mmapForLinker (size_t bytes, MemoryAccess access, uint32_t flags, int fd, int offset)
 {
     bytes = roundUpToPage(bytes);
-    struct MemoryRegion *region;
+    void *result;
 
     IF_DEBUG(linker_verbose, debugBelch("mmapForLinker: start\n"));
     if (RtsFlags.MiscFlags.linkerAlwaysPic) {
         /* make no attempt at mapping low memory if we are assuming PIC */
-        region = NULL;
+        result = mmapAnywhere(bytes, access, flags, fd, offset);
     } else {
-        region = nearImage();
-    }
+        ACQUIRE_LOCK(&linker_mmap_mutex);
+        struct MemoryRegion *region = nearImage();
 
-    /* Use MAP_32BIT if appropriate */
-    if (region && region->end <= (void *) 0xffffffff) {
-        flags |= TRY_MAP_32BIT;
-    }
+        /* Use MAP_32BIT if appropriate */
+        if (region->end <= (void *) 0xffffffff) {
+            flags |= TRY_MAP_32BIT;
+        }
 
-    void *result;
-    if (region) {
         result = mmapInRegion(region, bytes, access, flags, fd, offset);
-    }
-    else {
-        result = mmapAnywhere(bytes, access, flags, fd, offset);
+        RELEASE_LOCK(&linker_mmap_mutex);
     }
     IF_DEBUG(linker_verbose,
              debugBelch("mmapForLinker: mapped %zd bytes starting at %p\n",
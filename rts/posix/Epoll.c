@@ -0,0 +1,716 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2020-2025
+ *
+ * An I/O manager based on the Linux epoll() API.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#include "rts/PosixSource.h"
+#include "Rts.h"
+#include "RtsFlags.h" // needed by SET_HDR macro
+
+#include "IOManager.h" // defines IOMGR_ENABLED_EPOLL
+
+#if defined(IOMGR_ENABLED_EPOLL)
+
+#include "Capability.h"
+#include "Threads.h"
+#include "Schedule.h"
+#include "Prelude.h"
+#include "RtsUtils.h"
+#include "rts/Time.h"
+#include "RaiseAsync.h"
+#include "Trace.h"
+
+#include "Epoll.h"
+#include "RtsSignals.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "IOManagerInternals.h"
+#include "Timeout.h"
+
+/******************************************************************************
+
+This I/O manager is based on the Linux epoll API.
+
+    int epoll_create1(int flags);
+    int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+    int epoll_wait(int epfd, struct epoll_event *events,
+                   int maxevents, int timeout);
+
+The poll I/O manager (see Poll.c) passes the whole array of waiting
+operations to the kernel on every call to poll(), and then scans the whole
+array to find the ones that completed. Both cost O(n) in the number of threads
+blocked on I/O, which is the dominant cost for programs that have tens of
+thousands of mostly idle sockets. With epoll the kernel keeps the set of fds
+of interest (the "interest list") across calls, and epoll_wait() returns only
+the fds that are ready. So the cost of waiting is O(ready) rather than O(n).
+
+The flip side is that epoll is organised around fds rather than around
+individual operations, so unlike the poll I/O manager we have to keep track of
+the mapping from fds to the operations waiting on them.
+
+As in the poll I/O manager, the primary data structure is the aiop_table,
+a ClosureTable of StgAsyncIOOps with one entry per in-flight operation. Here
+however we use the table in non-compact mode, so that an aiop's index is
+stable for the duration of the operation. We then use two auxiliary tables:
+
+ * The aiop_epoll_table is indexed by aiop_table index. Each entry records the
+   fd and events the aiop is waiting for, and forms a doubly linked list (using
+   table indexes) of all the aiops waiting on the same fd.
+
+ * The epoll_fd_table is indexed by fd. Each entry records the head of the
+   list of aiops waiting on that fd, and the set of events we have currently
+   armed in the kernel for that fd. We grow this table on demand, as the fds
+   used by the process are dense small integers anyway.
+
+We register each fd in the kernel interest list once, the first time any
+thread waits on it, and thereafter re-arm it with EPOLL_CTL_MOD. We use
+EPOLLONESHOT so that an fd is disarmed automatically once it has reported an
+event. This is important because we use level triggered notifications: if we
+left an fd armed after the thread waiting on it had been woken up, every
+subsequent epoll_wait() would report it again until the thread gets around to
+doing the I/O. With one-shot arming an fd with no waiters simply stays quiet
+in the interest list. It also means we do not need a hook for fds being
+closed: the kernel drops closed fds from the interest list by itself, and if
+an fd number is reused we notice when EPOLL_CTL_MOD reports ENOENT and add it
+again.
+
+We only make an epoll_ctl() call when an fd goes from having no waiters to
+having some, or when a new waiter wants an event that is not yet armed (e.g. a
+writer joining a reader on the same socket). Additional waiters for an
+already-armed event cost no system calls at all.
+
+Some fds cannot be used with epoll at all: notably regular files and
+directories, for which epoll_ctl() fails with EPERM. For these poll() reports
+that the fd is always ready, and we do the same. Similarly invalid fds
+(EBADF) must cause an exception to be raised in the waiting thread. We cannot
+complete the operation within syncIOWaitReady (the thread is about to block)
+so we put such aiops onto an "immediate" list that is completed on the next
+poll or wait, without blocking.
+
+As with the poll I/O manager we use a StgTimeoutQueue to track timeouts, and
+use the delay to the next timeout (if any) as the epoll_wait() timeout.
+
+The CapIOManager structure for this I/O manager contains:
+
+    ClosureTable          aiop_table;
+    StgTimeoutQueue      *timeout_queue;
+    TimerWheel           *timer_wheel;
+    int                   epoll_fd;
+    struct EpollWaiter   *aiop_epoll_table;
+    struct EpollFdState  *epoll_fd_table;
+    int                   epoll_fd_table_size;
+    int                   epoll_immediate_hd;
+    struct epoll_event   *epoll_events;
+
+******************************************************************************/
+
+/* The maximum number of ready fds we reap in one call to epoll_wait(). Any
+ * further ready fds will be reported by the next call.
+ */
+#define MAX_EPOLL_EVENTS 256
+
+/* End of list marker for the aiop_epoll_table lists */
+#define EPOLL_IX_NULL (-1)
+
+struct EpollWaiter {
+    int      fd;
+    uint32_t events;   /* EPOLLIN or EPOLLOUT */
+    int      error;    /* only used for aiops on the immediate list */
+    int      next;
+    int      prev;
+};
+
+struct EpollFdState {
+    int      waiters_hd;  /* list of aiop_table indexes waiting on this fd */
+    uint32_t armed;       /* events currently armed in the kernel, or 0 */
+    bool     registered;  /* we have previously added this fd */
+};
+
+/* Forward declarations */
+static bool enlargeTables(Capability *cap, CapIOManager *iomgr);
+static void enlargeFdTable(CapIOManager *iomgr, int fd);
+static int  armFd(CapIOManager *iomgr, int fd, struct EpollFdState *st);
+static void completeWaiter(Capability *cap, CapIOManager *iomgr, int ix,
+                           enum IOOpOutcome outcome, int error);
+static void notifyIOCompletion(Capability *cap, StgAsyncIOOp *aiop);
+static void ioCancel(Capability *cap, StgAsyncIOOp *aiop);
+static void reportEpollError(const char *what, int res) STG_NORETURN;
+
+
+static int createEpollFd(void)
+{
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        reportEpollError("epoll_create1", epfd);
+    }
+    return epfd;
+}
+
+
+/* Note that during RTS startup this is called _before_ the storage manager
+ * is initialised, so we must not allocate on the GC heap here.
+ */
+void initCapabilityIOManagerEpoll(CapIOManager *iomgr)
+{
+    initClosureTable(&iomgr->aiop_table, ClosureTableNonCompact);
+    initCapabilityTimeouts(iomgr);
+    iomgr->epoll_fd            = createEpollFd();
+    iomgr->aiop_epoll_table    = NULL;
+    iomgr->epoll_fd_table      = NULL;
+    iomgr->epoll_fd_table_size = 0;
+    iomgr->epoll_immediate_hd  = EPOLL_IX_NULL;
+    iomgr->epoll_events        =
+      stgMallocBytes(sizeof(struct epoll_event) * MAX_EPOLL_EVENTS,
+                     "initCapabilityIOManagerEpoll");
+}
+
+
+/* After a fork the child shares the epoll instance (and thus its interest
+ * list) with the parent, so we must make a fresh one and re-register the fds
+ * that still have waiters.
+ */
+void initIOManagerAfterForkEpoll(CapIOManager *iomgr)
+{
+    close(iomgr->epoll_fd);
+    iomgr->epoll_fd = createEpollFd();
+
+    for (int fd = 0; fd < iomgr->epoll_fd_table_size; fd++) {
+        struct EpollFdState *st = &iomgr->epoll_fd_table[fd];
+        st->armed      = 0;
+        st->registered = false;
+        if (st->waiters_hd != EPOLL_IX_NULL) {
+            int err = armFd(iomgr, fd, st);
+            if (err != 0) {
+                errno = err;
+                reportEpollError("epoll_ctl", -1);
+            }
+        }
+    }
+}
+
+
+void exitCapabilityIOManagerEpoll(CapIOManager *iomgr)
+{
+    close(iomgr->epoll_fd);
+    iomgr->epoll_fd = -1;
+    stgFree(iomgr->aiop_epoll_table);
+    stgFree(iomgr->epoll_fd_table);
+    stgFree(iomgr->epoll_events);
+    iomgr->aiop_epoll_table    = NULL;
+    iomgr->epoll_fd_table      = NULL;
+    iomgr->epoll_fd_table_size = 0;
+    iomgr->epoll_events        = NULL;
+    exitCapabilityTimeouts(iomgr);
+}
+
+
+/* Used to implement syncIOWaitReady.
+ * Result is true on success, or false on allocation failure. */
+bool syncIOWaitReadyEpoll(Capability *cap, StgTSO *tso,
+                          IOReadOrWrite rw, HsInt fd)
+{
+    StgAsyncIOOp *aiop;
+    aiop = (StgAsyncIOOp *)allocateMightFail(cap, sizeofW(StgAsyncIOOp));
+    if (RTS_UNLIKELY(aiop == NULL)) return false;
+    SET_HDR(aiop, &stg_ASYNCIOOP_info, cap->r.rCCCS);
+    aiop->notify.tso     = tso;
+    aiop->notify_type    = NotifyTSO;
+    aiop->live           = &stg_ASYNCIO_LIVE0_closure;
+    tso->why_blocked     = rw == IORead ? BlockedOnRead : BlockedOnWrite;
+    tso->block_info.aiop = aiop;
+    return asyncIOWaitReadyEpoll(cap, aiop, rw, fd);
+}
+
+
+/* Link aiop_epoll_table entry ix onto the front of the list at *hd */
+static void pushWaiter(CapIOManager *iomgr, int *hd, int ix)
+{
+    struct EpollWaiter *waiters = iomgr->aiop_epoll_table;
+    waiters[ix].prev = EPOLL_IX_NULL;
+    waiters[ix].next = *hd;
+    if (*hd != EPOLL_IX_NULL) {
+        waiters[*hd].prev = ix;
+    }
+    *hd = ix;
+}
+
+
+/* Unlink aiop_epoll_table entry ix from whichever list it is on */
+static void unlinkWaiter(CapIOManager *iomgr, int ix)
+{
+    struct EpollWaiter *waiters = iomgr->aiop_epoll_table;
+    struct EpollWaiter *w = &waiters[ix];
+    if (w->prev != EPOLL_IX_NULL) {
+        waiters[w->prev].next = w->next;
+    } else if (w->error != 0) {
+        iomgr->epoll_immediate_hd = w->next;
+    } else {
+        iomgr->epoll_fd_table[w->fd].waiters_hd = w->next;
+    }
+    if (w->next != EPOLL_IX_NULL) {
+        waiters[w->next].prev = w->prev;
+    }
+    w->next = EPOLL_IX_NULL;
+    w->prev = EPOLL_IX_NULL;
+}
+
+
+/* The union of the events wanted by all the waiters on an fd */
+static uint32_t wantedEvents(CapIOManager *iomgr, struct EpollFdState *st)
+{
+    uint32_t events = 0;
+    for (int ix = st->waiters_hd; ix != EPOLL_IX_NULL;
+         ix = iomgr->aiop_epoll_table[ix].next) {
+        events |= iomgr->aiop_epoll_table[ix].events;
+    }
+    return events;
+}
+
+
+/* (Re-)arm an fd in the kernel for the events wanted by its waiters.
+ * Returns 0 on success or an errno value.
+ */
+static int armFd(CapIOManager *iomgr, int fd, struct EpollFdState *st)
+{
+    uint32_t events = wantedEvents(iomgr, st);
+    struct epoll_event ev = { .events = events | EPOLLONESHOT,
+                              .data   = { .fd = fd } };
+    int op  = st->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    int res = epoll_ctl(iomgr->epoll_fd, op, fd, &ev);
+    if (res != 0 && op == EPOLL_CTL_MOD && errno == ENOENT) {
+        /* The fd was closed (and the kernel dropped it from the interest
+         * list) and the fd number has since been reused.
+         */
+        op  = EPOLL_CTL_ADD;
+        res = epoll_ctl(iomgr->epoll_fd, op, fd, &ev);
+    } else if (res != 0 && op == EPOLL_CTL_ADD && errno == EEXIST) {
+        /* Registered already, e.g. a dup of an fd we registered earlier
+         * that was closed, sharing the same open file description.
+         */
+        op  = EPOLL_CTL_MOD;
+        res = epoll_ctl(iomgr->epoll_fd, op, fd, &ev);
+    }
+    debugTrace(DEBUG_iomanager,
+               "epoll_ctl(%s, fd = %d, events = 0x%x) = %d",
+               op == EPOLL_CTL_ADD ? "ADD" : "MOD", fd, events, res);
+    if (res != 0) {
+        return errno;
+    }
+    st->registered = true;
+    st->armed      = events;
+    return 0;
+}
+
+
+/* Result is true on success, or false on allocation failure. */
+bool asyncIOWaitReadyEpoll(Capability *cap, StgAsyncIOOp *aiop,
+                           IOReadOrWrite rw, int fd)
+{
+    CapIOManager *iomgr = cap->iomgr;
+    if (RTS_UNLIKELY(isFullClosureTable(&iomgr->aiop_table))) {
+        bool ok = enlargeTables(cap, iomgr);
+        if (RTS_UNLIKELY(!ok)) return false;
+    }
+
+    int ix = insertClosureTable(cap, &iomgr->aiop_table, aiop);
+
+    /* The syncIO wrapper or CMM primop filled in the notify and live fields,
+     * we fill the rest.
+     */
+    aiop->capno   = cap->no;
+    aiop->index   = ix;
+    aiop->outcome = IOOpOutcomeInFlight;
+
+    uint32_t events = rw == IORead ? EPOLLIN : EPOLLOUT;
+    iomgr->aiop_epoll_table[ix] = (struct EpollWaiter) {
+                                    .fd     = fd,
+                                    .events = events,
+                                    .error  = 0,
+                                    .next   = EPOLL_IX_NULL,
+                                    .prev   = EPOLL_IX_NULL
+                                  };
+
+    if (fd < 0) {
+        iomgr->aiop_epoll_table[ix].error = EBADF;
+        pushWaiter(iomgr, &iomgr->epoll_immediate_hd, ix);
+        return true;
+    }
+
+    if (RTS_UNLIKELY(fd >= iomgr->epoll_fd_table_size)) {
+        enlargeFdTable(iomgr, fd);
+    }
+    struct EpollFdState *st = &iomgr->epoll_fd_table[fd];
+    pushWaiter(iomgr, &st->waiters_hd, ix);
+
+    /* Only talk to the kernel if the fd is not already armed for the events
+     * this aiop is waiting for.
+     */
+    if ((st->armed & events) != events) {
+        int err = armFd(iomgr, fd, st);
+        switch (err) {
+            case 0:
+                break;
+            case EPERM:
+                /* The fd does not support epoll, e.g. a regular file. These
+                 * are always ready, just as poll() would report.
+                 */
+            case EBADF:
+                unlinkWaiter(iomgr, ix);
+                iomgr->aiop_epoll_table[ix].error = err;
+                pushWaiter(iomgr, &iomgr->epoll_immediate_hd, ix);
+                break;
+            default:
+                errno = err;
+                reportEpollError("epoll_ctl", -1);
+        }
+    }
+    return true;
+}
+
+
+void syncIOCancelEpoll(Capability *cap, StgTSO *tso)
+{
+    StgAsyncIOOp *aiop  = tso->block_info.aiop;
+    ASSERT(aiop->notify_type == NotifyTSO);
+    ASSERT(indexClosureTable(&cap->iomgr->aiop_table, aiop->index) == aiop);
+    ioCancel(cap, aiop);
+    /* We cannot use the normal notifyIOCompletion here. We are in the context
+     * of throwTo, interrupting a thread blocked on IO via an async exception.
+     * We don't put the TSO back on the run queue or change the why_blocked
+     * status, as that is done by removeFromQueues (in the throwTo* functions).
+     */
+    tso->block_info.closure = (StgClosure *)END_TSO_QUEUE;
+}
+
+
+void asyncIOCancelEpoll(Capability *cap, StgAsyncIOOp *aiop)
+{
+    /* As in the poll I/O manager, the aiop is still in progress iff the
+     * aiop_table still points to it at its index.
+     */
+    ASSERT(aiop->notify_type != NotifyTSO);
+    if (aiop->outcome == IOOpOutcomeInFlight
+     && indexClosureTable(&cap->iomgr->aiop_table, aiop->index) == aiop) {
+        ioCancel(cap, aiop);
+        notifyIOCompletion(cap, aiop);
+    }
+}
+
+
+/* Remove the aiop at index ix from the aiop_table and its fd's waiter list.
+ *
+ * We do not disarm the fd in the kernel even if this was the last waiter on
+ * it. It will report at most one more event (since it is armed one-shot),
+ * which we will find has no waiters and ignore. That is cheaper than an extra
+ * epoll_ctl() call. We do however forget that it is armed, so that the next
+ * waiter re-arms it. Otherwise if the fd were closed and its number reused in
+ * the meantime, the next waiter would wait on a registration that the kernel
+ * has already dropped.
+ */
+static void removeWaiter(Capability *cap, CapIOManager *iomgr, int ix)
+{
+    struct EpollWaiter *w = &iomgr->aiop_epoll_table[ix];
+    bool immediate = w->error != 0;
+    int fd = w->fd;
+    unlinkWaiter(iomgr, ix);
+    if (!immediate && iomgr->epoll_fd_table[fd].waiters_hd == EPOLL_IX_NULL) {
+        iomgr->epoll_fd_table[fd].armed = 0;
+    }
+    removeClosureTable(cap, &iomgr->aiop_table, ix);
+}
+
+
+static void ioCancel(Capability *cap, StgAsyncIOOp *aiop)
+{
+    removeWaiter(cap, cap->iomgr, aiop->index);
+    aiop->outcome = IOOpOutcomeCancelled;
+}
+
+
+bool anyPendingTimeoutsOrIOEpoll(CapIOManager *iomgr)
+{
+    return anyPendingTimeouts(iomgr)
+        || !isEmptyClosureTable(&iomgr->aiop_table);
+}
+
+
+static void notifyIOCompletion(Capability *cap, StgAsyncIOOp *aiop)
+{
+    ASSERT(aiop->outcome != IOOpOutcomeInFlight);
+    switch (aiop->notify_type) {
+        case NotifyTSO:
+        {
+            /* We should be guaranteed that the tso is still on the same
+             * cap because the tso was not on the run queue of any cap and
+             * so is not subject to thread migration.
+             */
+            StgTSO *tso      = aiop->notify.tso;
+            tso->why_blocked = NotBlocked;
+            tso->_link       = END_TSO_QUEUE;
+            pushOnRunQueue(cap, tso);
+            break;
+        }
+        case NotifyMVar:
+            barf("epoll iomgr: MVar notification not yet supported");
+            break;
+
+        case NotifyTVar:
+            barf("epoll iomgr: TVar notification not yet supported");
+            break;
+    }
+}
+
+
+static void completeWaiter(Capability *cap, CapIOManager *iomgr, int ix,
+                           enum IOOpOutcome outcome, int error)
+{
+    StgAsyncIOOp *aiop = indexClosureTable(&iomgr->aiop_table, ix);
+
+    if (outcome == IOOpOutcomeFailed && error == EBADF
+     && aiop->notify_type == NotifyTSO) {
+        /* The fd is invalid: raise an IOError exception in the blocked
+         * thread. (See bug #4934 for what happens without this.)
+         *
+         * Note that raiseAsync removes the thread from the I/O manager via
+         * syncIOCancel, so we must leave the aiop in the tables here.
+         */
+        StgTSO *tso = aiop->notify.tso;
+        debugTrace(DEBUG_iomanager,
+                   "Raising exception in thread %" FMT_StgThreadID
+                   " blocked on an invalid fd", tso->id);
+        raiseAsync(cap, tso, (StgClosure *)blockedOnBadFD_closure,
+                   false, NULL);
+        return;
+    }
+
+    removeWaiter(cap, iomgr, ix);
+    aiop->outcome = outcome;
+    if (outcome == IOOpOutcomeSuccess) {
+        aiop->result = 0;
+    } else {
+        aiop->error  = error;
+    }
+    notifyIOCompletion(cap, aiop);
+}
+
+
+/* Complete all the aiops on the immediate list. Returns how many there were.
+ */
+static int processImmediateCompletions(Capability *cap, CapIOManager *iomgr)
+{
+    int n = 0;
+    while (iomgr->epoll_immediate_hd != EPOLL_IX_NULL) {
+        int ix    = iomgr->epoll_immediate_hd;
+        int error = iomgr->aiop_epoll_table[ix].error;
+        if (error == EBADF) {
+            completeWaiter(cap, iomgr, ix, IOOpOutcomeFailed, EBADF);
+        } else {
+            completeWaiter(cap, iomgr, ix, IOOpOutcomeSuccess, 0);
+        }
+        n++;
+    }
+    return n;
+}
+
+
+static void processIOCompletions(Capability *cap, CapIOManager *iomgr,
+                                 int nevents)
+{
+    debugTrace(DEBUG_iomanager, "processIOCompletions(nevents = %d)",
+                                nevents);
+    struct epoll_event *events = iomgr->epoll_events;
+
+    for (int i = 0; i < nevents; i++) {
+        int fd           = events[i].data.fd;
+        uint32_t revents = events[i].events;
+        ASSERT(fd >= 0 && fd < iomgr->epoll_fd_table_size);
+        struct EpollFdState *st = &iomgr->epoll_fd_table[fd];
+
+        /* The fd was armed one-shot, so the kernel has now disarmed it. */
+        st->armed = 0;
+
+        /* As in the poll I/O manager, we don't need to do anything special
+         * for EPOLLERR or EPOLLHUP, other than to wake up all the waiters.
+         * They will discover the error or EOF when they next do the I/O.
+         */
+        if (revents & (EPOLLERR | EPOLLHUP)) {
+            revents |= EPOLLIN | EPOLLOUT;
+        }
+
+        int ix = st->waiters_hd;
+        while (ix != EPOLL_IX_NULL) {
+            struct EpollWaiter *w = &iomgr->aiop_epoll_table[ix];
+            int next = w->next;
+            if (revents & w->events) {
+                completeWaiter(cap, iomgr, ix, IOOpOutcomeSuccess, 0);
+            }
+            ix = next;
+        }
+
+        /* If any waiters remain (e.g. a writer, when the fd only became
+         * readable) we must re-arm the fd for them.
+         */
+        if (st->waiters_hd != EPOLL_IX_NULL) {
+            int err = armFd(iomgr, fd, st);
+            if (err != 0) {
+                /* The fd was closed from under the remaining waiters. Let
+                 * them discover this for themselves.
+                 */
+                while (st->waiters_hd != EPOLL_IX_NULL) {
+                    completeWaiter(cap, iomgr, st->waiters_hd,
+                                   IOOpOutcomeSuccess, 0);
+                }
+            }
+        }
+    }
+}
+
+
+/* Wait for I/O readiness, with a timeout in milliseconds (-1 for indefinite
+ * and 0 for no wait). Returns the number of ready fds, or -1 if interrupted.
+ */
+static int waitForEvents(Capability *cap, CapIOManager *iomgr, int timeout_ms)
+{
+    int res = epoll_wait(iomgr->epoll_fd, iomgr->epoll_events,
+                         MAX_EPOLL_EVENTS, timeout_ms);
+
+    debugTrace(DEBUG_iomanager,
+               "epoll_wait(nwaiting = %d, timeout_ms = %d) = %d",
+               sizeClosureTable(&iomgr->aiop_table), timeout_ms, res);
+
+    if (res > 0) {
+        processIOCompletions(cap, iomgr, res);
+    } else if (res < 0 && errno != EINTR) {
+        reportEpollError("epoll_wait", res);
+    }
+    return res;
+}
+
+
+void pollCompletedTimeoutsOrIOEpoll(Capability *cap)
+{
+    CapIOManager *iomgr = cap->iomgr;
+
+    if (anyPendingTimeouts(iomgr)) {
+        Time now = getProcessElapsedTime();
+        processTimeoutCompletions(cap, now);
+    }
+
+    if (!isEmptyClosureTable(&iomgr->aiop_table)) {
+        processImmediateCompletions(cap, iomgr);
+
+        /* Poll for I/O readiness, without waiting. If we get interrupted by
+         * a signal we'll just return to the scheduler.
+         */
+        if (!isEmptyClosureTable(&iomgr->aiop_table)) {
+            waitForEvents(cap, iomgr, 0);
+        }
+    }
+}
+
+
+void awaitCompletedTimeoutsOrIOEpoll(Capability *cap)
+{
+    CapIOManager *iomgr = cap->iomgr;
+
+    /* Loop until we've woken up some threads. See the comments in
+     * awaitCompletedTimeoutsOrIOPoll for why this is necessary.
+     */
+    do {
+        /* There is either pending I/O or pending timers. */
+        ASSERT(anyPendingTimeouts(iomgr) ||
+               !isEmptyClosureTable(&iomgr->aiop_table));
+
+        Time now = getProcessElapsedTime();
+        processTimeoutCompletions(cap, now);
+        processImmediateCompletions(cap, iomgr);
+
+        /* Even if we did wake some threads, we'll still poll (but not wait)
+         * for I/O, to avoid starving threads blocked on I/O.
+         */
+        bool wait = emptyRunQueue(cap);
+        int timeout_ms = timeoutInMilliseconds(iomgr, wait, now);
+
+        int res = waitForEvents(cap, iomgr, timeout_ms);
+
+        if (res < 0) {
+            /* We got interrupted by a signal. In the non-threaded RTS, if the
+             * signal is one of ours we need to return to the scheduler to let
+             * it handle it. See awaitCompletedTimeoutsOrIOPoll.
+             */
+#if defined(RTS_USER_SIGNALS)
+            if (startPendingSignalHandlers(cap)) break;
+#endif
+        }
+
+    } while (emptyRunQueue(cap)
+         && (getSchedState() == SCHED_RUNNING));
+}
+
+
+static void reportEpollError(const char *what, int res)
+{
+    if (errno == ENOSPC) {
+        errorBelch("epoll iomgr: exceeded the limit on the number of watched "
+                   "fds (see /proc/sys/fs/epoll/max_user_watches)");
+        stg_exit(EXIT_FAILURE);
+    } else {
+        sysErrorBelch("epoll iomgr: %s res = %d", what, res);
+        stg_exit(EXIT_FAILURE);
+    }
+}
+
+
+/* Helper function to double the size of the aiop_table and aiop_epoll_table.
+ */
+static bool enlargeTables(Capability *cap, CapIOManager *iomgr)
+{
+    int oldcapacity = capacityClosureTable(&iomgr->aiop_table);
+    int newcapacity = (oldcapacity == 0) ? 1 : (oldcapacity * 2);
+
+    bool ok = enlargeClosureTable(cap, &iomgr->aiop_table, newcapacity);
+    if (RTS_UNLIKELY(!ok)) return false;
+
+    /* Update the auxiliary aiop_epoll_table to match. Since the aiop_table is
+     * not compact, the new entries need no initialisation: they are filled
+     * in when they are used.
+     */
+    iomgr->aiop_epoll_table =
+      stgReallocBytes(iomgr->aiop_epoll_table,
+                      sizeof(struct EpollWaiter) * newcapacity,
+                      "Epoll.c: enlargeTables");
+    return true;
+}
+
+
+/* Helper function to enlarge the epoll_fd_table to cover the given fd.
+ */
+static void enlargeFdTable(CapIOManager *iomgr, int fd)
+{
+    int oldsize = iomgr->epoll_fd_table_size;
+    int newsize = (oldsize == 0) ? 64 : oldsize;
+    while (newsize <= fd) {
+        newsize *= 2;
+    }
+
+    iomgr->epoll_fd_table =
+      stgReallocBytes(iomgr->epoll_fd_table,
+                      sizeof(struct EpollFdState) * newsize,
+                      "Epoll.c: enlargeFdTable");
+    for (int i = oldsize; i < newsize; i++) {
+        iomgr->epoll_fd_table[i] = (struct EpollFdState) {
+                                     .waiters_hd = EPOLL_IX_NULL,
+                                     .armed      = 0,
+                                     .registered = false
+                                   };
+    }
+    iomgr->epoll_fd_table_size = newsize;
+}
+
+#endif /* IOMGR_ENABLED_EPOLL */
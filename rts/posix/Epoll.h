@@ -0,0 +1,40 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2020-2025
+ *
+ * An I/O manager based on the Linux epoll() API.
+ *
+ * Prototypes for functions in Epoll.c
+ *
+ * -------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "IOManager.h"
+
+#include "BeginPrivate.h"
+
+#if defined(IOMGR_ENABLED_EPOLL)
+
+void initCapabilityIOManagerEpoll(CapIOManager *iomgr);
+void initIOManagerAfterForkEpoll(CapIOManager *iomgr);
+void exitCapabilityIOManagerEpoll(CapIOManager *iomgr);
+
+/* Synchronous I/O and timer operations */
+bool syncIOWaitReadyEpoll(Capability *cap, StgTSO *tso,
+                          IOReadOrWrite rw, HsInt fd);
+void syncIOCancelEpoll(Capability *cap, StgTSO *tso);
+
+/* Asynchronous operations */
+bool asyncIOWaitReadyEpoll(Capability *cap, StgAsyncIOOp *aiop,
+                           IOReadOrWrite rw, int fd);
+void asyncIOCancelEpoll(Capability *cap, StgAsyncIOOp *aiop);
+
+/* Scheduler operations */
+bool anyPendingTimeoutsOrIOEpoll(CapIOManager *iomgr);
+void pollCompletedTimeoutsOrIOEpoll(Capability *cap);
+void awaitCompletedTimeoutsOrIOEpoll(Capability *cap);
+
+#endif /* IOMGR_ENABLED_EPOLL */
+
+#include "EndPrivate.h"
@@ -0,0 +1,747 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2020-2025
+ *
+ * An I/O manager based on the Linux io_uring API.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+
+#include "rts/PosixSource.h"
+#include "Rts.h"
+#include "RtsFlags.h" // needed by SET_HDR macro
+
+#include "IOManager.h" // defines IOMGR_ENABLED_IOURING
+
+#if defined(IOMGR_ENABLED_IOURING)
+
+#include "Capability.h"
+#include "Threads.h"
+#include "Schedule.h"
+#include "Prelude.h"
+#include "RtsUtils.h"
+#include "rts/Time.h"
+#include "RaiseAsync.h"
+#include "Trace.h"
+
+#include "IOUring.h"
+#include "RtsSignals.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+#include "IOManagerInternals.h"
+#include "Timeout.h"
+
+/******************************************************************************
+
+This I/O manager is based on the Linux io_uring API.
+
+An io_uring is a pair of ring buffers shared between the process and the
+kernel: a submission queue (SQ) of operations for the kernel to perform, and a
+completion queue (CQ) of results. Both are plain memory, so we can queue
+operations and collect results without making any system calls at all. We
+only need to enter the kernel (with io_uring_enter) to tell it about newly
+queued operations, or to wait for completions.
+
+    int io_uring_setup(u32 entries, struct io_uring_params *p);
+    int io_uring_enter(unsigned int fd, unsigned int to_submit,
+                       unsigned int min_complete, unsigned int flags,
+                       const void *arg, size_t argsz);
+
+We use the kernel's IORING_OP_POLL_ADD operation to implement waiting for I/O
+readiness. Each thread calling waitRead#/waitWrite# gets an StgAsyncIOOp in
+the aiop_table (as with the poll and epoll I/O managers) and a corresponding
+POLL_ADD submission queue entry. We do not submit the entry immediately.
+Instead entries accumulate in the SQ while Haskell threads run, and are
+submitted as a batch the next time the scheduler polls or waits for I/O. That
+same io_uring_enter call also waits for completions, so a scheduler loop that
+has to block makes exactly one system call, however many threads started or
+finished waiting in the meantime. Polling without blocking makes no system
+calls at all unless there is something to submit.
+
+Timers use the same StgTimeoutQueue as the poll I/O manager. The delay until
+the next timeout is passed as the timeout of the io_uring_enter call (using
+IORING_ENTER_EXT_ARG), so timers and I/O are waited on together in the ring.
+
+We pass the aiop_table index as the user_data of each operation, so we can
+find the aiop again when the completion arrives. Since a completion may arrive
+after the aiop has been cancelled, and its table index reused, we also keep a
+generation counter per table index, and include it in the user_data. A
+completion whose generation does not match is stale and is ignored.
+Cancelling an operation queues an IORING_OP_POLL_REMOVE for it.
+
+We need a few kernel features that have not been around forever:
+
+ * IORING_FEAT_NODROP (Linux 5.5), so completions are never lost if the CQ
+   overflows, which could otherwise happen with many in-flight operations.
+ * IORING_FEAT_EXT_ARG (Linux 5.11), so we can wait with a timeout.
+
+io_uring can also be disabled by system policy (sysctl kernel.io_uring_disabled
+or seccomp filters). So selectIOManager probes whether it can set up a ring
+with these features and falls back to the poll I/O manager if not.
+
+The CapIOManager structure for this I/O manager contains:
+
+    ClosureTable     aiop_table;
+    StgTimeoutQueue *timeout_queue;
+    TimerWheel      *timer_wheel;
+    struct IOURing  *uring;
+
+******************************************************************************/
+
+/* The size of the submission queue. We can have more operations than this in
+ * flight: it limits only how many we can queue before we must submit.
+ */
+#define IOURING_SQ_ENTRIES 256
+
+/* user_data for operations whose completions we do not care about */
+#define IOURING_UDATA_IGNORE UINT64_MAX
+
+enum IOURingOpState {
+    IOURingOpFree      = 0,
+    IOURingOpInFlight  = 1,
+    IOURingOpCompleted = 2  /* completed, but not yet removed from the table */
+};
+
+/* Auxiliary per-aiop information, indexed by aiop_table index */
+struct IOURingOp {
+    int      fd;
+    uint16_t events;  /* POLLIN or POLLOUT */
+    uint8_t  state;   /* enum IOURingOpState */
+    uint32_t gen;
+};
+
+struct IOURing {
+    int      ring_fd;
+
+    /* Submission queue, mapped from the kernel */
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_flags;
+    unsigned *sq_array;
+    unsigned  sq_mask;
+    unsigned  sq_entries;
+    struct io_uring_sqe *sqes;
+
+    /* Our local SQ tail: entries up to here are filled in, but only the ones
+     * up to *sq_tail have been published to the kernel.
+     */
+    unsigned  sq_tail_local;
+
+    /* Completion queue, mapped from the kernel */
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned  cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /* The mappings, so we can unmap them again */
+    void   *sq_ring_ptr;
+    size_t  sq_ring_sz;
+    void   *cq_ring_ptr;
+    size_t  cq_ring_sz;
+    size_t  sqes_sz;
+
+    /* Auxiliary table with size and indexes matching the aiop_table */
+    struct IOURingOp *ops;
+};
+
+/* Forward declarations */
+static bool enlargeTables(Capability *cap, CapIOManager *iomgr);
+static void queuePollAdd(struct IOURing *ring, int ix);
+static void notifyIOCompletion(Capability *cap, StgAsyncIOOp *aiop);
+static void ioCancel(Capability *cap, StgAsyncIOOp *aiop);
+static void reportIOUringError(const char *what, int res) STG_NORETURN;
+
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit,
+                              unsigned min_complete, unsigned flags,
+                              void *arg, size_t argsz)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                         flags, arg, argsz);
+}
+
+
+#define IOURING_REQUIRED_FEATURES (IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG)
+
+/* Set up a ring and map it into memory. Returns false if the kernel refuses.
+ */
+static bool setupRing(struct IOURing *ring)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    int fd = sys_io_uring_setup(IOURING_SQ_ENTRIES, &p);
+    if (fd < 0) {
+        debugTrace(DEBUG_iomanager, "io_uring_setup failed: %s",
+                   strerror(errno));
+        return false;
+    }
+    if ((p.features & IOURING_REQUIRED_FEATURES) != IOURING_REQUIRED_FEATURES) {
+        debugTrace(DEBUG_iomanager,
+                   "io_uring lacks required features (features = 0x%x)",
+                   p.features);
+        close(fd);
+        return false;
+    }
+
+    size_t sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_ring_sz = p.cq_off.cqes
+                      + p.cq_entries * sizeof(struct io_uring_cqe);
+    size_t sqes_sz    = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    /* With IORING_FEAT_SINGLE_MMAP the SQ and CQ rings share one mapping */
+    bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && cq_ring_sz > sq_ring_sz) {
+        sq_ring_sz = cq_ring_sz;
+    }
+
+    void *sq_ptr = mmap(NULL, sq_ring_sz, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED) goto fail;
+
+    void *cq_ptr = sq_ptr;
+    if (!single_mmap) {
+        cq_ptr = mmap(NULL, cq_ring_sz, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED) goto fail_sq;
+    }
+
+    void *sqes = mmap(NULL, sqes_sz, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) goto fail_cq;
+
+    ring->ring_fd       = fd;
+    ring->sq_head       = (unsigned *)((char *)sq_ptr + p.sq_off.head);
+    ring->sq_tail       = (unsigned *)((char *)sq_ptr + p.sq_off.tail);
+    ring->sq_flags      = (unsigned *)((char *)sq_ptr + p.sq_off.flags);
+    ring->sq_array      = (unsigned *)((char *)sq_ptr + p.sq_off.array);
+    ring->sq_mask       = *(unsigned *)((char *)sq_ptr + p.sq_off.ring_mask);
+    ring->sq_entries    = *(unsigned *)((char *)sq_ptr + p.sq_off.ring_entries);
+    ring->sqes          = sqes;
+    ring->sq_tail_local = *ring->sq_tail;
+    ring->cq_head       = (unsigned *)((char *)cq_ptr + p.cq_off.head);
+    ring->cq_tail       = (unsigned *)((char *)cq_ptr + p.cq_off.tail);
+    ring->cq_mask       = *(unsigned *)((char *)cq_ptr + p.cq_off.ring_mask);
+    ring->cqes          = (struct io_uring_cqe *)((char *)cq_ptr
+                                                  + p.cq_off.cqes);
+    ring->sq_ring_ptr   = sq_ptr;
+    ring->sq_ring_sz    = sq_ring_sz;
+    ring->cq_ring_ptr   = cq_ptr;
+    ring->cq_ring_sz    = cq_ring_sz;
+    ring->sqes_sz       = sqes_sz;
+
+    debugTrace(DEBUG_iomanager,
+               "io_uring_setup: sq_entries = %u, cq_entries = %u, "
+               "features = 0x%x", p.sq_entries, p.cq_entries, p.features);
+    return true;
+
+fail_cq:
+    if (!single_mmap) munmap(cq_ptr, cq_ring_sz);
+fail_sq:
+    munmap(sq_ptr, sq_ring_sz);
+fail:
+    debugTrace(DEBUG_iomanager, "io_uring mmap failed: %s", strerror(errno));
+    close(fd);
+    return false;
+}
+
+
+static void teardownRing(struct IOURing *ring)
+{
+    munmap(ring->sqes, ring->sqes_sz);
+    if (ring->cq_ring_ptr != ring->sq_ring_ptr) {
+        munmap(ring->cq_ring_ptr, ring->cq_ring_sz);
+    }
+    munmap(ring->sq_ring_ptr, ring->sq_ring_sz);
+    close(ring->ring_fd);
+    ring->ring_fd = -1;
+}
+
+
+bool probeIOManagerIOUring(void)
+{
+    struct IOURing ring;
+    if (!setupRing(&ring)) {
+        return false;
+    }
+    teardownRing(&ring);
+    return true;
+}
+
+
+/* Note that during RTS startup this is called _before_ the storage manager
+ * is initialised, so we must not allocate on the GC heap here.
+ */
+void initCapabilityIOManagerIOUring(CapIOManager *iomgr)
+{
+    initClosureTable(&iomgr->aiop_table, ClosureTableNonCompact);
+    initCapabilityTimeouts(iomgr);
+
+    struct IOURing *ring = stgMallocBytes(sizeof(struct IOURing),
+                                          "initCapabilityIOManagerIOUring");
+    /* selectIOManager already checked that we can set up a ring */
+    if (!setupRing(ring)) {
+        reportIOUringError("io_uring_setup", -1);
+    }
+    ring->ops    = NULL;
+    iomgr->uring = ring;
+}
+
+
+/* After a fork the child shares the ring mappings with the parent, so we must
+ * make a fresh ring and resubmit all the operations still in flight.
+ */
+void initIOManagerAfterForkIOUring(CapIOManager *iomgr)
+{
+    struct IOURing *ring = iomgr->uring;
+    teardownRing(ring);
+    if (!setupRing(ring)) {
+        reportIOUringError("io_uring_setup", -1);
+    }
+    int capacity = capacityClosureTable(&iomgr->aiop_table);
+    for (int ix = 0; ix < capacity; ix++) {
+        if (ring->ops[ix].state == IOURingOpInFlight) {
+            ring->ops[ix].gen++;
+            queuePollAdd(ring, ix);
+        }
+    }
+}
+
+
+void exitCapabilityIOManagerIOUring(CapIOManager *iomgr)
+{
+    struct IOURing *ring = iomgr->uring;
+    teardownRing(ring);
+    stgFree(ring->ops);
+    stgFree(ring);
+    iomgr->uring = NULL;
+    exitCapabilityTimeouts(iomgr);
+}
+
+
+/* Submit all the queued SQEs, and optionally wait for completions.
+ * Returns the io_uring_enter result.
+ */
+static int enterRing(struct IOURing *ring, unsigned min_complete,
+                     struct __kernel_timespec *ts)
+{
+    unsigned to_submit = ring->sq_tail_local - *ring->sq_tail;
+    RELEASE_STORE_ALWAYS(ring->sq_tail, ring->sq_tail_local);
+
+    unsigned flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    struct io_uring_getevents_arg arg = {
+        .sigmask    = 0,
+        .sigmask_sz = 0,
+        .pad        = 0,
+        .ts         = (uint64_t)(uintptr_t) ts
+    };
+    int res = sys_io_uring_enter(ring->ring_fd, to_submit, min_complete,
+                                 flags, &arg, sizeof(arg));
+
+    debugTrace(DEBUG_iomanager,
+               "io_uring_enter(to_submit = %u, min_complete = %u, "
+               "timeout.sec = %lld, timeout.nsec = %lld) = %d",
+               to_submit, min_complete,
+               ts == NULL ? -1 : (long long) ts->tv_sec,
+               ts == NULL ?  0 : (long long) ts->tv_nsec, res);
+    return res;
+}
+
+
+/* Get the next free SQE, submitting the queued ones first if the SQ is full.
+ */
+static struct io_uring_sqe *getSqe(struct IOURing *ring)
+{
+    unsigned head = ACQUIRE_LOAD_ALWAYS(ring->sq_head);
+    if (ring->sq_tail_local - head >= ring->sq_entries) {
+        struct __kernel_timespec ts = { .tv_sec = 0, .tv_nsec = 0 };
+        int res = enterRing(ring, 0, &ts);
+        if (res < 0 && errno != EINTR && errno != ETIME) {
+            reportIOUringError("io_uring_enter", res);
+        }
+        head = ACQUIRE_LOAD_ALWAYS(ring->sq_head);
+        if (ring->sq_tail_local - head >= ring->sq_entries) {
+            /* The kernel could not take any entries. */
+            errno = EBUSY;
+            reportIOUringError("io_uring_enter", res);
+        }
+    }
+    unsigned idx = ring->sq_tail_local & ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[idx] = idx;
+    ring->sq_tail_local++;
+    return sqe;
+}
+
+
+static uint64_t opUserData(struct IOURing *ring, int ix)
+{
+    return ((uint64_t) ring->ops[ix].gen << 32) | (uint32_t) ix;
+}
+
+
+static void queuePollAdd(struct IOURing *ring, int ix)
+{
+    struct io_uring_sqe *sqe = getSqe(ring);
+    sqe->opcode      = IORING_OP_POLL_ADD;
+    sqe->fd          = ring->ops[ix].fd;
+    sqe->poll_events = ring->ops[ix].events;
+    sqe->user_data   = opUserData(ring, ix);
+}
+
+
+static void queuePollRemove(struct IOURing *ring, int ix)
+{
+    struct io_uring_sqe *sqe = getSqe(ring);
+    sqe->opcode    = IORING_OP_POLL_REMOVE;
+    sqe->fd        = -1;
+    sqe->addr      = opUserData(ring, ix);
+    sqe->user_data = IOURING_UDATA_IGNORE;
+}
+
+
+/* Used to implement syncIOWaitReady.
+ * Result is true on success, or false on allocation failure. */
+bool syncIOWaitReadyIOUring(Capability *cap, StgTSO *tso,
+                            IOReadOrWrite rw, HsInt fd)
+{
+    StgAsyncIOOp *aiop;
+    aiop = (StgAsyncIOOp *)allocateMightFail(cap, sizeofW(StgAsyncIOOp));
+    if (RTS_UNLIKELY(aiop == NULL)) return false;
+    SET_HDR(aiop, &stg_ASYNCIOOP_info, cap->r.rCCCS);
+    aiop->notify.tso     = tso;
+    aiop->notify_type    = NotifyTSO;
+    aiop->live           = &stg_ASYNCIO_LIVE0_closure;
+    tso->why_blocked     = rw == IORead ? BlockedOnRead : BlockedOnWrite;
+    tso->block_info.aiop = aiop;
+    return asyncIOWaitReadyIOUring(cap, aiop, rw, fd);
+}
+
+
+/* Result is true on success, or false on allocation failure. */
+bool asyncIOWaitReadyIOUring(Capability *cap, StgAsyncIOOp *aiop,
+                             IOReadOrWrite rw, int fd)
+{
+    CapIOManager *iomgr = cap->iomgr;
+    if (RTS_UNLIKELY(isFullClosureTable(&iomgr->aiop_table))) {
+        bool ok = enlargeTables(cap, iomgr);
+        if (RTS_UNLIKELY(!ok)) return false;
+    }
+
+    int ix = insertClosureTable(cap, &iomgr->aiop_table, aiop);
+
+    /* The syncIO wrapper or CMM primop filled in the notify and live fields,
+     * we fill the rest.
+     */
+    aiop->capno   = cap->no;
+    aiop->index   = ix;
+    aiop->outcome = IOOpOutcomeInFlight;
+
+    /* Queue the operation. It gets submitted along with any others the next
+     * time the scheduler polls or waits.
+     */
+    struct IOURing *ring = iomgr->uring;
+    ring->ops[ix].fd     = fd;
+    ring->ops[ix].events = rw == IORead ? POLLIN : POLLOUT;
+    ring->ops[ix].state  = IOURingOpInFlight;
+    queuePollAdd(ring, ix);
+    return true;
+}
+
+
+void syncIOCancelIOUring(Capability *cap, StgTSO *tso)
+{
+    StgAsyncIOOp *aiop  = tso->block_info.aiop;
+    ASSERT(aiop->notify_type == NotifyTSO);
+    ASSERT(indexClosureTable(&cap->iomgr->aiop_table, aiop->index) == aiop);
+    ioCancel(cap, aiop);
+    /* We cannot use the normal notifyIOCompletion here. We are in the context
+     * of throwTo, interrupting a thread blocked on IO via an async exception.
+     * We don't put the TSO back on the run queue or change the why_blocked
+     * status, as that is done by removeFromQueues (in the throwTo* functions).
+     */
+    tso->block_info.closure = (StgClosure *)END_TSO_QUEUE;
+}
+
+
+void asyncIOCancelIOUring(Capability *cap, StgAsyncIOOp *aiop)
+{
+    ASSERT(aiop->notify_type != NotifyTSO);
+    if (aiop->outcome == IOOpOutcomeInFlight
+     && indexClosureTable(&cap->iomgr->aiop_table, aiop->index) == aiop) {
+        ioCancel(cap, aiop);
+        notifyIOCompletion(cap, aiop);
+    }
+}
+
+
+/* Remove an aiop from the table. Bumping the generation means that any
+ * completion for it that the kernel posts later will be ignored.
+ */
+static void removeOp(Capability *cap, CapIOManager *iomgr, int ix)
+{
+    struct IOURing *ring = iomgr->uring;
+    ring->ops[ix].state = IOURingOpFree;
+    ring->ops[ix].gen++;
+    removeClosureTable(cap, &iomgr->aiop_table, ix);
+}
+
+
+static void ioCancel(Capability *cap, StgAsyncIOOp *aiop)
+{
+    CapIOManager *iomgr  = cap->iomgr;
+    struct IOURing *ring = iomgr->uring;
+    int ix = aiop->index;
+    /* If the kernel still has the operation, ask it to drop it. */
+    if (ring->ops[ix].state == IOURingOpInFlight) {
+        queuePollRemove(ring, ix);
+    }
+    removeOp(cap, iomgr, ix);
+    aiop->outcome = IOOpOutcomeCancelled;
+}
+
+
+bool anyPendingTimeoutsOrIOIOUring(CapIOManager *iomgr)
+{
+    return anyPendingTimeouts(iomgr)
+        || !isEmptyClosureTable(&iomgr->aiop_table);
+}
+
+
+static void notifyIOCompletion(Capability *cap, StgAsyncIOOp *aiop)
+{
+    ASSERT(aiop->outcome != IOOpOutcomeInFlight);
+    switch (aiop->notify_type) {
+        case NotifyTSO:
+        {
+            /* We should be guaranteed that the tso is still on the same
+             * cap because the tso was not on the run queue of any cap and
+             * so is not subject to thread migration.
+             */
+            StgTSO *tso      = aiop->notify.tso;
+            tso->why_blocked = NotBlocked;
+            tso->_link       = END_TSO_QUEUE;
+            pushOnRunQueue(cap, tso);
+            break;
+        }
+        case NotifyMVar:
+            barf("io_uring iomgr: MVar notification not yet supported");
+            break;
+
+        case NotifyTVar:
+            barf("io_uring iomgr: TVar notification not yet supported");
+            break;
+    }
+}
+
+
+static void processCompletion(Capability *cap, CapIOManager *iomgr,
+                              uint64_t user_data, int res)
+{
+    struct IOURing *ring = iomgr->uring;
+    if (user_data == IOURING_UDATA_IGNORE) return;
+
+    uint32_t ix  = (uint32_t) user_data;
+    uint32_t gen = (uint32_t) (user_data >> 32);
+    if ((int) ix >= capacityClosureTable(&iomgr->aiop_table)
+     || ring->ops[ix].gen != gen
+     || ring->ops[ix].state != IOURingOpInFlight) {
+        /* A stale completion for an operation we already cancelled */
+        return;
+    }
+    ring->ops[ix].state = IOURingOpCompleted;
+    StgAsyncIOOp *aiop  = indexClosureTable(&iomgr->aiop_table, ix);
+
+    /* The result is the returned poll events, or a negative errno. As in the
+     * poll I/O manager we only need to handle invalid fds specially.
+     */
+    if (res == -EBADF || (res >= 0 && (res & POLLNVAL))) {
+        if (aiop->notify_type == NotifyTSO) {
+            /* Raise an IOError exception in the blocked thread. (See bug
+             * #4934 for what happens without this.) Note that raiseAsync
+             * removes the aiop from the table via syncIOCancel.
+             */
+            StgTSO *tso = aiop->notify.tso;
+            debugTrace(DEBUG_iomanager,
+                       "Raising exception in thread %" FMT_StgThreadID
+                       " blocked on an invalid fd", tso->id);
+            raiseAsync(cap, tso, (StgClosure *)blockedOnBadFD_closure,
+                       false, NULL);
+            return;
+        }
+        aiop->outcome = IOOpOutcomeFailed;
+        aiop->error   = EBADF;
+    } else {
+        aiop->outcome = IOOpOutcomeSuccess;
+        aiop->result  = 0;
+    }
+    removeOp(cap, iomgr, ix);
+    notifyIOCompletion(cap, aiop);
+}
+
+
+/* Reap everything in the CQ, without any system calls. Returns the number of
+ * completions processed.
+ */
+static int processCompletions(Capability *cap, CapIOManager *iomgr)
+{
+    struct IOURing *ring = iomgr->uring;
+    unsigned head = *ring->cq_head;
+    unsigned tail = ACQUIRE_LOAD_ALWAYS(ring->cq_tail);
+    int n = 0;
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+        uint64_t user_data = cqe->user_data;
+        int      res       = cqe->res;
+        head++;
+        /* Release the CQ slot before processing, since processing may queue
+         * further SQEs and so end up entering the kernel.
+         */
+        RELEASE_STORE_ALWAYS(ring->cq_head, head);
+        processCompletion(cap, iomgr, user_data, res);
+        n++;
+    }
+    debugTrace(DEBUG_iomanager, "processCompletions() = %d", n);
+    return n;
+}
+
+
+static bool pendingSubmissions(struct IOURing *ring)
+{
+    return ring->sq_tail_local != *ring->sq_tail
+        || (RELAXED_LOAD_ALWAYS(ring->sq_flags) & IORING_SQ_CQ_OVERFLOW);
+}
+
+
+void pollCompletedTimeoutsOrIOIOUring(Capability *cap)
+{
+    CapIOManager *iomgr  = cap->iomgr;
+    struct IOURing *ring = iomgr->uring;
+
+    if (anyPendingTimeouts(iomgr)) {
+        Time now = getProcessElapsedTime();
+        processTimeoutCompletions(cap, now);
+    }
+
+    /* Only enter the kernel if we have queued operations to submit (or the
+     * kernel is holding overflowed completions for us). Otherwise we can
+     * just look in the CQ.
+     */
+    if (pendingSubmissions(ring)) {
+        struct __kernel_timespec ts = { .tv_sec = 0, .tv_nsec = 0 };
+        int res = enterRing(ring, 0, &ts);
+        if (res < 0 && errno != EINTR && errno != ETIME) {
+            reportIOUringError("io_uring_enter", res);
+        }
+    }
+    processCompletions(cap, iomgr);
+}
+
+
+void awaitCompletedTimeoutsOrIOIOUring(Capability *cap)
+{
+    CapIOManager *iomgr  = cap->iomgr;
+    struct IOURing *ring = iomgr->uring;
+
+    /* Loop until we've woken up some threads. See the comments in
+     * awaitCompletedTimeoutsOrIOPoll for why this is necessary.
+     */
+    do {
+        /* There is either pending I/O or pending timers. */
+        ASSERT(anyPendingTimeouts(iomgr) ||
+               !isEmptyClosureTable(&iomgr->aiop_table));
+
+        Time now = getProcessElapsedTime();
+        processTimeoutCompletions(cap, now);
+
+        /* Pick up anything already completed before deciding to wait. */
+        processCompletions(cap, iomgr);
+
+        bool wait = emptyRunQueue(cap);
+        struct timespec tv, *timeout;
+        timeout = timeoutInNanoseconds(iomgr, wait, now, &tv);
+
+        struct __kernel_timespec kts;
+        if (timeout != NULL) {
+            kts = (struct __kernel_timespec) { .tv_sec  = timeout->tv_sec,
+                                               .tv_nsec = timeout->tv_nsec };
+        }
+
+        /* Submit the batch of queued operations and wait in a single call */
+        int res = enterRing(ring, wait ? 1 : 0,
+                            timeout == NULL ? NULL : &kts);
+
+        if (res >= 0 || errno == ETIME) {
+            /* Submitted (and possibly woken by a completion), or the timeout
+             * expired. Either way the do-while loop condition handles it.
+             */
+            processCompletions(cap, iomgr);
+
+        } else if (errno == EINTR) {
+            /* We got interrupted by a signal. In the non-threaded RTS, if the
+             * signal is one of ours we need to return to the scheduler to let
+             * it handle it. See awaitCompletedTimeoutsOrIOPoll.
+             */
+            processCompletions(cap, iomgr);
+#if defined(RTS_USER_SIGNALS)
+            if (startPendingSignalHandlers(cap)) break;
+#endif
+
+        } else {
+            reportIOUringError("io_uring_enter", res);
+        }
+
+    } while (emptyRunQueue(cap)
+         && (getSchedState() == SCHED_RUNNING));
+}
+
+
+static void reportIOUringError(const char *what, int res)
+{
+    sysErrorBelch("io_uring iomgr: %s res = %d", what, res);
+    stg_exit(EXIT_FAILURE);
+}
+
+
+/* Helper function to double the size of the aiop_table and the ring's
+ * auxiliary ops table.
+ */
+static bool enlargeTables(Capability *cap, CapIOManager *iomgr)
+{
+    int oldcapacity = capacityClosureTable(&iomgr->aiop_table);
+    int newcapacity = (oldcapacity == 0) ? 1 : (oldcapacity * 2);
+
+    bool ok = enlargeClosureTable(cap, &iomgr->aiop_table, newcapacity);
+    if (RTS_UNLIKELY(!ok)) return false;
+
+    struct IOURing *ring = iomgr->uring;
+    ring->ops = stgReallocBytes(ring->ops,
+                                sizeof(struct IOURingOp) * newcapacity,
+                                "IOUring.c: enlargeTables");
+    for (int i = oldcapacity; i < newcapacity; i++) {
+        ring->ops[i] = (struct IOURingOp) {
+                         .fd     = -1,
+                         .events = 0,
+                         .state  = IOURingOpFree,
+                         .gen    = 0
+                       };
+    }
+    return true;
+}
+
+#endif /* IOMGR_ENABLED_IOURING */
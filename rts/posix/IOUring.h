@@ -0,0 +1,45 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2020-2025
+ *
+ * An I/O manager based on the Linux io_uring API.
+ *
+ * Prototypes for functions in IOUring.c
+ *
+ * -------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "IOManager.h"
+
+#include "BeginPrivate.h"
+
+#if defined(IOMGR_ENABLED_IOURING)
+
+/* Check if the kernel will let us set up a ring with the features we need.
+ * Used by selectIOManager to fall back to another I/O manager if not.
+ */
+bool probeIOManagerIOUring(void);
+
+void initCapabilityIOManagerIOUring(CapIOManager *iomgr);
+void initIOManagerAfterForkIOUring(CapIOManager *iomgr);
+void exitCapabilityIOManagerIOUring(CapIOManager *iomgr);
+
+/* Synchronous I/O and timer operations */
+bool syncIOWaitReadyIOUring(Capability *cap, StgTSO *tso,
+                            IOReadOrWrite rw, HsInt fd);
+void syncIOCancelIOUring(Capability *cap, StgTSO *tso);
+
+/* Asynchronous operations */
+bool asyncIOWaitReadyIOUring(Capability *cap, StgAsyncIOOp *aiop,
+                             IOReadOrWrite rw, int fd);
+void asyncIOCancelIOUring(Capability *cap, StgAsyncIOOp *aiop);
+
+/* Scheduler operations */
+bool anyPendingTimeoutsOrIOIOUring(CapIOManager *iomgr);
+void pollCompletedTimeoutsOrIOIOUring(Capability *cap);
+void awaitCompletedTimeoutsOrIOIOUring(Capability *cap);
+
+#endif /* IOMGR_ENABLED_IOURING */
+
+#include "EndPrivate.h"
@@ -166,6 +166,12 @@ post_mmap_madvise(int operation, W_ size, void *ret)
         madvise(ret, size, MADV_WILLNEED);
 # if defined(MADV_DODUMP)
         madvise(ret, size, MADV_DODUMP);
+# endif
+# if defined(MADV_HUGEPAGE)
+        // See Note [Huge pages] in MBlock.c.
+        if (RtsFlags.GcFlags.hugePages) {
+            madvise(ret, size, MADV_HUGEPAGE);
+        }
 # endif
     } else {
         madvise(ret, size, MADV_DONTNEED);
@@ -734,6 +740,77 @@ void osReleaseHeapMemory(void)
 
 #endif
 
+/* Returns the size of a transparent huge page, or 0 if the OS cannot back
+ * our memory with huge pages. See Note [Huge pages] in MBlock.c.
+ */
+W_ osHugePageSize(void)
+{
+#if defined(linux_HOST_OS) && defined(MADV_HUGEPAGE)
+    static W_ huge_page_size = (W_)-1;
+
+    if (huge_page_size == (W_)-1) {
+        huge_page_size = 0;
+
+        // If THP is disabled system-wide then MADV_HUGEPAGE is accepted but
+        // has no effect.
+        char enabled[64] = "";
+        FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+        if (f != NULL) {
+            if (fgets(enabled, sizeof(enabled), f) == NULL) {
+                enabled[0] = '\0';
+            }
+            fclose(f);
+        }
+        if (enabled[0] == '\0' || strstr(enabled, "[never]") != NULL) {
+            return huge_page_size;
+        }
+
+        unsigned long size = 0;
+        f = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+        if (f != NULL) {
+            if (fscanf(f, "%lu", &size) != 1) {
+                size = 0;
+            }
+            fclose(f);
+        }
+        // We commit and decommit memory in units of huge pages, so they
+        // must be a power of two.
+        if (size != 0 && (size & (size - 1)) == 0) {
+            huge_page_size = size;
+        }
+    }
+    return huge_page_size;
+#else
+    return 0;
+#endif
+}
+
+/* Returns the number of bytes of our memory that are currently backed by
+ * transparent huge pages, or 0 if the OS does not tell us.
+ */
+StgWord64 osHugePageBytes(void)
+{
+#if defined(linux_HOST_OS)
+    StgWord64 bytes = 0;
+    char line[128];
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    if (f == NULL) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned long long kb;
+        if (sscanf(line, "AnonHugePages: %llu kB", &kb) == 1) {
+            bytes = (StgWord64)kb * 1024;
+            break;
+        }
+    }
+    fclose(f);
+    return bytes;
+#else
+    return 0;
+#endif
+}
+
 bool osBuiltWithNumaSupport(void)
 {
 #if HAVE_LIBNUMA
@@ -761,6 +838,19 @@ uint32_t osNumaNodes(void)
 #endif
 }
 
+// The distance between two OS NUMA nodes, in the units of the ACPI SLIT
+// table: 10 for the same node, larger for nodes further away.
+uint32_t osNumaDistance(uint32_t from, uint32_t to)
+{
+#if HAVE_LIBNUMA
+    int d = numa_distance(from, to);
+    if (d > 0) {
+        return d;
+    }
+#endif
+    return from == to ? 10 : 20;
+}
+
 uint64_t osNumaMask(void)
 {
 #if HAVE_LIBNUMA
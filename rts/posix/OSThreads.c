@@ -451,6 +451,95 @@ setThreadAffinity (uint32_t n STG_UNUSED,
 }
 #endif
 
+#if defined(linux_HOST_OS)
+static bool
+readCpuTopologyId (uint32_t n, const char *file, uint32_t *id)
+{
+    char path[128];
+    unsigned int val;
+    FILE *f;
+    bool ok;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/%s", n, file);
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    ok = fscanf(f, "%u", &val) == 1;
+    fclose(f);
+    if (ok) {
+        *id = val;
+    }
+    return ok;
+}
+
+// Find where CPU n sits in the machine: its package (socket), the last level
+// cache it shares with its neighbours, and its physical core within the
+// package.  Returns false if we can't tell.
+bool
+getCpuTopology (uint32_t n, uint32_t *package, uint32_t *cache, uint32_t *core)
+{
+    if (!readCpuTopologyId(n, "topology/physical_package_id", package) ||
+        !readCpuTopologyId(n, "topology/core_id", core)) {
+        return false;
+    }
+    // Not every machine has an L3 cache; then the package is the best we
+    // can say about which CPUs share a cache.
+    if (!readCpuTopologyId(n, "cache/index3/id", cache)) {
+        *cache = *package;
+    }
+    return true;
+}
+
+// As getCpuTopology, but for the CPUs that setThreadAffinity(n, m) lets a
+// thread run on: n, n+m, n+2m etc.  Returns false unless they are all in
+// the same package.  If they don't all share a cache, or a core, then the
+// cache, or the core, is UINT32_MAX.
+bool
+getAffinityTopology (uint32_t n, uint32_t m,
+                     uint32_t *package, uint32_t *cache, uint32_t *core)
+{
+    uint32_t nproc = getNumberOfProcessors();
+    uint32_t p, c, k;
+
+    if (m == 0 || n >= nproc || !getCpuTopology(n, package, cache, core)) {
+        return false;
+    }
+    for (uint32_t i = n + m; i < nproc; i += m) {
+        if (!getCpuTopology(i, &p, &c, &k) || p != *package) {
+            return false;
+        }
+        if (c != *cache) {
+            *cache = UINT32_MAX;
+        }
+        if (k != *core) {
+            *core = UINT32_MAX;
+        }
+    }
+    return true;
+}
+
+#else
+bool
+getCpuTopology (uint32_t n STG_UNUSED,
+                uint32_t *package STG_UNUSED,
+                uint32_t *cache STG_UNUSED,
+                uint32_t *core STG_UNUSED)
+{
+    return false;
+}
+
+bool
+getAffinityTopology (uint32_t n STG_UNUSED,
+                     uint32_t m STG_UNUSED,
+                     uint32_t *package STG_UNUSED,
+                     uint32_t *cache STG_UNUSED,
+                     uint32_t *core STG_UNUSED)
+{
+    return false;
+}
+#endif
+
 #if HAVE_LIBNUMA
 void setThreadNode (uint32_t node)
 {
@@ -101,14 +101,16 @@ makes for slightly cheaper calls to poll() (which cost O(nfds)) and cheaper
 iteration over all active operations. We use a simple doubling strategy to
 enlarge the tables, and never shrink.
 
-We also use a StgTimeoutQueue to track timeouts, and use the delay to the next
-timeout (if any) as the poll() timeout parameter.
+We also use a StgTimeoutQueue (or a TimerWheel, depending on the RTS flags) to
+track timeouts, and use the delay to the next timeout (if any) as the poll()
+timeout parameter.
 
 The CapIOManager structure for this I/O manager contains:
 
     ClosureTable     aiop_table;
     struct pollfd   *aiop_poll_table;
     StgTimeoutQueue *timeout_queue;
+    TimerWheel      *timer_wheel;
 
 We also support the Linux-specific ppoll API which supports higher resolution
 time delays -- nanoseconds rather than milliseconds as in classic poll(). It
@@ -130,7 +132,7 @@ void initCapabilityIOManagerPoll(CapIOManager *iomgr)
 {
     initClosureTable(&iomgr->aiop_table, ClosureTableCompact);
     iomgr->aiop_poll_table = NULL;
-    iomgr->timeout_queue = emptyTimeoutQueue();
+    initCapabilityTimeouts(iomgr);
 }
 
 
@@ -232,7 +234,7 @@ static void ioCancel(Capability *cap, StgAsyncIOOp *aiop)
 
 bool anyPendingTimeoutsOrIOPoll(CapIOManager *iomgr)
 {
-    return !isEmptyTimeoutQueue(iomgr->timeout_queue)
+    return anyPendingTimeouts(iomgr)
         || !isEmptyClosureTable(&iomgr->aiop_table);
 }
 
@@ -347,7 +349,7 @@ void pollCompletedTimeoutsOrIOPoll(Capability *cap)
 {
     CapIOManager *iomgr = cap->iomgr;
 
-    if (!isEmptyTimeoutQueue(iomgr->timeout_queue)) {
+    if (anyPendingTimeouts(iomgr)) {
         Time now = getProcessElapsedTime();
         processTimeoutCompletions(cap, now);
     }
@@ -405,7 +407,7 @@ void awaitCompletedTimeoutsOrIOPoll(Capability *cap)
      */
     do {
         /* There is either pending I/O or pending timers. */
-        ASSERT(!isEmptyTimeoutQueue(iomgr->timeout_queue) ||
+        ASSERT(anyPendingTimeouts(iomgr) ||
                !isEmptyClosureTable(&iomgr->aiop_table));
 
         Time now = getProcessElapsedTime();
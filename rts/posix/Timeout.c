@@ -17,14 +17,80 @@
 #include "Timeout.h"
 #include "IOManagerInternals.h"
 #include "TimeoutQueue.h"
+#include "TimerWheel.h"
+#include "RtsFlags.h"
 
 #include <limits.h>
 
 
-/* Currently only used by the poll I/O manager, but in future may be used by
-   several in-RTS I/O managers.
+/* Currently used by the poll, epoll and io_uring I/O managers, but in future
+   may be used by several in-RTS I/O managers.
  */
-#if defined(IOMGR_ENABLED_POLL)
+#if defined(IOMGR_ENABLED_POLL) || defined(IOMGR_ENABLED_EPOLL) \
+ || defined(IOMGR_ENABLED_IOURING)
+
+/* The timeouts live either in the leftist heap timeout_queue, or in the
+ * timer_wheel. We always initialise the timeout_queue (to empty) so that
+ * marking it is always valid, and use the timer_wheel iff it is non-NULL.
+ */
+void initCapabilityTimeouts(CapIOManager *iomgr)
+{
+    iomgr->timeout_queue = emptyTimeoutQueue();
+    switch (RtsFlags.MiscFlags.ioManagerTimers) {
+        case IO_MNGR_TIMERS_HEAP:
+            iomgr->timer_wheel = NULL;
+            break;
+        case IO_MNGR_TIMERS_WHEEL:
+            iomgr->timer_wheel = newTimerWheel();
+            break;
+        default:
+            barf("initCapabilityTimeouts: %d",
+                 RtsFlags.MiscFlags.ioManagerTimers);
+    }
+}
+
+
+void exitCapabilityTimeouts(CapIOManager *iomgr)
+{
+    if (iomgr->timer_wheel != NULL) {
+        freeTimerWheel(iomgr->timer_wheel);
+        iomgr->timer_wheel = NULL;
+    }
+}
+
+
+bool anyPendingTimeouts(CapIOManager *iomgr)
+{
+    if (iomgr->timer_wheel != NULL) {
+        return !isEmptyTimerWheel(iomgr->timer_wheel);
+    } else {
+        return !isEmptyTimeoutQueue(iomgr->timeout_queue);
+    }
+}
+
+
+void markCapabilityTimeouts(evac_fn evac, void *user, CapIOManager *iomgr)
+{
+    evac(user, (StgClosure **)(void *)&iomgr->timeout_queue);
+    if (iomgr->timer_wheel != NULL) {
+        markTimerWheel(evac, user, iomgr->timer_wheel);
+    }
+}
+
+
+/* The time of the next timeout, or for the timer wheel possibly an earlier
+ * time at which it needs to be advanced. There must be pending timeouts, and
+ * any expired ones must already have been processed.
+ */
+static Time nextTimeoutWaketime(CapIOManager *iomgr)
+{
+    if (iomgr->timer_wheel != NULL) {
+        return nextWaketimeTimerWheel(iomgr->timer_wheel);
+    } else {
+        return findMinWaketimeTimeoutQueue(iomgr->timeout_queue);
+    }
+}
+
 
 bool syncDelayTimeout(Capability *cap, StgTSO *tso, HsInt us_delay)
 {
@@ -51,7 +117,12 @@ bool syncDelayTimeout(Capability *cap, StgTSO *tso, HsInt us_delay)
     tso->why_blocked = BlockedOnDelay;
     tso->block_info.timeout = timeout;
 
-    insertTimeoutQueue(&cap->iomgr->timeout_queue, timeout, target);
+    CapIOManager *iomgr = cap->iomgr;
+    if (iomgr->timer_wheel != NULL) {
+        insertTimerWheel(iomgr->timer_wheel, timeout, target);
+    } else {
+        insertTimeoutQueue(&iomgr->timeout_queue, timeout, target);
+    }
 
     debugTrace(DEBUG_iomanager,
                "timer for delay of %lld usec installed at time %lld ns",
@@ -65,7 +136,12 @@ void syncDelayCancelTimeout(Capability *cap, StgTSO *tso)
     ASSERT(tso->why_blocked == BlockedOnDelay);
     StgTimeoutQueue *timeout = tso->block_info.timeout;
 
-    deleteTimeoutQueue(&cap->iomgr->timeout_queue, timeout);
+    CapIOManager *iomgr = cap->iomgr;
+    if (iomgr->timer_wheel != NULL) {
+        deleteTimerWheel(iomgr->timer_wheel, timeout);
+    } else {
+        deleteTimeoutQueue(&iomgr->timeout_queue, timeout);
+    }
 
     tso->block_info.closure = (StgClosure *)END_TSO_QUEUE;
 
@@ -94,6 +170,25 @@ void processTimeoutCompletions(Capability *cap, Time now)
 {
     CapIOManager *iomgr = cap->iomgr;
 
+    /* With the timer wheel, all the expired entries are collected together,
+     * and we unblock them in no particular order.
+     */
+    if (iomgr->timer_wheel != NULL) {
+        advanceTimerWheel(iomgr->timer_wheel, now);
+        StgTimeout *timeout;
+        while ((timeout = popExpiredTimerWheel(iomgr->timer_wheel)) != NULL) {
+            debugTrace(DEBUG_iomanager,"timer expired at %lld ns",
+                       timeout->waketime);
+            notifyTimeoutCompletion(cap, timeout);
+
+            /* the timeout is no longer accessible from anywhere (except here) */
+            IF_NONMOVING_WRITE_BARRIER_ENABLED {
+                updateRemembSetPushClosure(cap, (StgClosure *)timeout);
+            }
+        }
+        return;
+    }
+
     /* Pop entries from the front of the sleeping queue that are past their
      * wake time, and unblock the corresponding MVars.
      */
@@ -137,18 +232,19 @@ static void notifyTimeoutCompletion(Capability *cap, StgTimeout *timeout)
 }
 
 
-/* poll() expect a timeout in milliseconds, with special
+/* poll() and epoll_wait() expect a timeout in milliseconds, with special
  * values of -1 for indefinite wait, and 0 for no waiting.
  */
-#if !(defined(HAVE_DECL_PPOLL) && HAVE_DECL_PPOLL == 1)
+#if !(defined(HAVE_DECL_PPOLL) && HAVE_DECL_PPOLL == 1) \
+ || defined(IOMGR_ENABLED_EPOLL)
 int timeoutInMilliseconds(CapIOManager *iomgr, bool wait, Time now)
 {
     if (!wait) {
         /* Don't wait, just poll. */
         return 0;
 
-    } else if (!isEmptyTimeoutQueue(iomgr->timeout_queue)) {
-        Time waketime = findMinWaketimeTimeoutQueue(iomgr->timeout_queue);
+    } else if (anyPendingTimeouts(iomgr)) {
+        Time waketime = nextTimeoutWaketime(iomgr);
         Time waittime = waketime - now;
 
         /* Any expired timeouts should have been cleared, so we must be waiting
@@ -179,11 +275,12 @@ int timeoutInMilliseconds(CapIOManager *iomgr, bool wait, Time now)
 #endif
 
 
-/* ppoll() expect a timeout in nanoseconds, using
+/* ppoll() and io_uring_enter() expect a timeout in nanoseconds, using
  * struct timespec * with special values of NULL for indefinite wait,
  * and 0 for no waiting.
  */
-#if (defined(HAVE_DECL_PPOLL) && HAVE_DECL_PPOLL == 1)
+#if (defined(HAVE_DECL_PPOLL) && HAVE_DECL_PPOLL == 1) \
+ || defined(IOMGR_ENABLED_IOURING)
 struct timespec *timeoutInNanoseconds(CapIOManager *iomgr, bool wait,
                                       Time now, struct timespec *tv)
 {
@@ -192,8 +289,8 @@ struct timespec *timeoutInNanoseconds(CapIOManager *iomgr, bool wait,
         *tv = (struct timespec) { .tv_sec = 0, .tv_nsec = 0 };
         return tv;
 
-    } else if (!isEmptyTimeoutQueue(iomgr->timeout_queue)) {
-        Time waketime = findMinWaketimeTimeoutQueue(iomgr->timeout_queue);
+    } else if (anyPendingTimeouts(iomgr)) {
+        Time waketime = nextTimeoutWaketime(iomgr);
         Time waittime = waketime - now;
 
         /* Any expired timeouts should have been cleared, so we must be waiting
@@ -225,5 +322,5 @@ struct timespec *timeoutInNanoseconds(CapIOManager *iomgr, bool wait,
 }
 #endif
 
-#endif // defined(IOMGR_ENABLED_POLL)
+#endif // IOMGR_ENABLED_POLL || IOMGR_ENABLED_EPOLL || IOMGR_ENABLED_IOURING
 
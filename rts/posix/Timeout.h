@@ -10,8 +10,23 @@
 
 #pragma once
 
+#include "IOManager.h" // defines IOMGR_ENABLED_EPOLL, IOMGR_ENABLED_IOURING
+
 #include "BeginPrivate.h"
 
+/* Initialise and free the per-capability collection of timeouts. Depending on
+ * the --io-manager-timers RTS flag, this is either the leftist heap from
+ * TimeoutQueue.c or the timer wheel from TimerWheel.c.
+ */
+void initCapabilityTimeouts(CapIOManager *iomgr);
+void exitCapabilityTimeouts(CapIOManager *iomgr);
+
+/* Are there any timeouts pending? */
+bool anyPendingTimeouts(CapIOManager *iomgr);
+
+/* Mark the timeouts as GC roots. */
+void markCapabilityTimeouts(evac_fn evac, void *user, CapIOManager *iomgr);
+
 bool syncDelayTimeout(Capability *cap, StgTSO *tso, HsInt us_delay);
 
 void syncDelayCancelTimeout(Capability *cap, StgTSO *tso);
@@ -29,19 +44,21 @@ void processTimeoutCompletions(Capability *cap, Time now);
 /* Utility to compute the timeout wait time (in milliseconds) between now and
  * the next timer expiry (if any), or no waiting (if !wait).
  *
- * This is intended to be used with poll() which expect a
+ * This is intended to be used with poll() or epoll_wait() which expect a
  * timeout in milliseconds, with special values of -1 for indefinite wait,
  * and 0 for no waiting.
  */
-#if !(defined(HAVE_DECL_PPOLL) && HAVE_DECL_PPOLL == 1)
+#if !(defined(HAVE_DECL_PPOLL) && HAVE_DECL_PPOLL == 1) \
+ || defined(IOMGR_ENABLED_EPOLL)
 int timeoutInMilliseconds(CapIOManager *iomgr, bool wait, Time now);
 #endif
 
 /* As above, but a timeout in nanoseconds. This is intended to be used with
- * ppoll() which expect struct timespec *, with special
+ * ppoll() or io_uring_enter() which expect struct timespec *, with special
  * values of NULL for indefinite wait, and 0 for no waiting.
  */
-#if (defined(HAVE_DECL_PPOLL) && HAVE_DECL_PPOLL == 1)
+#if (defined(HAVE_DECL_PPOLL) && HAVE_DECL_PPOLL == 1) \
+ || defined(IOMGR_ENABLED_IOURING)
 struct timespec *timeoutInNanoseconds(CapIOManager *iomgr, bool wait,
                                       Time now, struct timespec *tv);
 #endif
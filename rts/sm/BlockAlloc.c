@@ -816,6 +816,112 @@ allocBlockOnNode_lock(uint32_t node)
     return bd;
 }
 
+/* -----------------------------------------------------------------------------
+   Per-capability block caches
+   -------------------------------------------------------------------------- */
+
+/*
+  Note [Per-capability block caches]
+  ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  Outside of GC, the mutator allocates block groups for large objects, for
+  extending the nursery, and for the mutable lists. Each such allocation used
+  to take sm_mutex, and with many capabilities allocating large objects the
+  lock became a bottleneck.
+
+  So each capability keeps a small cache of free groups of 1 to
+  BLOCK_CACHE_MAX_GROUP blocks, one list per group size. A request for a
+  small group is served from the cache without taking any lock, since only
+  the task holding the capability touches its cache. When the list for the
+  requested size is empty, we refill it with BLOCK_CACHE_REFILL_BLOCKS worth
+  of groups from the capability's NUMA node, taking sm_mutex only once.
+
+  The cached groups are allocated as far as the rest of the block allocator
+  is concerned: they are counted in n_alloc_blocks, and memInventory() counts
+  them separately. At the start of each GC we flush all the caches back to
+  the free lists, so that the blocks can be coalesced and, if they turn out
+  to be unused, returned to the OS.
+
+  The caches only exist in the threaded RTS. In the non-threaded RTS taking
+  sm_mutex is free, so allocGroupOnCap() just calls allocGroupOnNode().
+*/
+
+void
+initBlockCache (BlockCache *cache)
+{
+    for (uint32_t i = 0; i < BLOCK_CACHE_MAX_GROUP; i++) {
+        cache->groups[i] = NULL;
+    }
+    cache->n_blocks = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+}
+
+// Return all the cached groups to the free lists. Must hold sm_mutex, and
+// own the cache's capability (or have stopped the world).
+void
+flushBlockCache (BlockCache *cache)
+{
+    for (uint32_t i = 0; i < BLOCK_CACHE_MAX_GROUP; i++) {
+        bdescr *bd = cache->groups[i];
+        while (bd != NULL) {
+            bdescr *next = bd->link;
+            freeGroup(bd);
+            bd = next;
+        }
+        cache->groups[i] = NULL;
+    }
+    cache->n_blocks = 0;
+}
+
+#if defined(THREADED_RTS)
+static void
+refillBlockCache (BlockCache *cache, uint32_t node, W_ n)
+{
+    W_ count = BLOCK_CACHE_REFILL_BLOCKS / n;
+    bdescr *list = cache->groups[n-1];
+
+    ACQUIRE_SM_LOCK;
+    for (W_ i = 0; i < count; i++) {
+        bdescr *bd = allocGroupOnNode(node, n);
+        bd->link = list;
+        list = bd;
+    }
+    RELEASE_SM_LOCK;
+
+    cache->groups[n-1] = list;
+    cache->n_blocks += count * n;
+}
+#endif
+
+bdescr *
+allocGroupOnCap (Capability *cap, W_ n)
+{
+#if defined(THREADED_RTS)
+    if (n > 0 && n <= BLOCK_CACHE_MAX_GROUP) {
+        BlockCache *cache = &cap->block_cache;
+        bdescr *bd = cache->groups[n-1];
+        if (bd != NULL) {
+            cache->hits++;
+        } else {
+            cache->misses++;
+            refillBlockCache(cache, cap->node, n);
+            bd = cache->groups[n-1];
+        }
+        cache->groups[n-1] = bd->link;
+        cache->n_blocks -= n;
+        bd->link = NULL;
+        return bd;
+    }
+#endif
+    return allocGroupOnNode_lock(cap->node, n);
+}
+
+bdescr *
+allocBlockOnCap (Capability *cap)
+{
+    return allocGroupOnCap(cap, 1);
+}
+
 /* -----------------------------------------------------------------------------
    De-Allocation
    -------------------------------------------------------------------------- */
@@ -1406,6 +1512,25 @@ markBlocks (bdescr *bd)
     }
 }
 
+void
+markBlockCache (BlockCache *cache)
+{
+    for (uint32_t i = 0; i < BLOCK_CACHE_MAX_GROUP; i++) {
+        markBlocks(cache->groups[i]);
+    }
+}
+
+W_
+countBlockCache (BlockCache *cache)
+{
+    W_ n = 0;
+    for (uint32_t i = 0; i < BLOCK_CACHE_MAX_GROUP; i++) {
+        n += countBlocks(cache->groups[i]);
+    }
+    ASSERT(n == cache->n_blocks);
+    return n;
+}
+
 void
 reportUnmarkedBlocks (void)
 {
@@ -16,6 +16,35 @@ bdescr *allocLargeChunkOnNode (uint32_t node, W_ min, W_ max);
 void deferMBlockFreeing(void);
 void commitMBlockFreeing(void);
 
+/* Per-capability block caches ------------------------------------------- */
+
+// See Note [Per-capability block caches] in BlockAlloc.c.
+
+// Groups of up to this many blocks are cached.
+#define BLOCK_CACHE_MAX_GROUP 4
+
+// The number of blocks we take from the free list when refilling the cache
+// for one group size.
+#define BLOCK_CACHE_REFILL_BLOCKS 16
+
+typedef struct BlockCache_ {
+    // Free groups of (i+1) blocks, linked through bd->link.
+    bdescr *groups[BLOCK_CACHE_MAX_GROUP];
+    // The total number of blocks in the cache.
+    W_ n_blocks;
+    // Requests satisfied from the cache, and requests that needed a refill.
+    uint64_t hits;
+    uint64_t misses;
+} BlockCache;
+
+void initBlockCache  (BlockCache *cache);
+void flushBlockCache (BlockCache *cache);
+
+// Like allocGroupOnNode_lock(cap->node, n), but served from the
+// capability's block cache when n is small.
+bdescr *allocGroupOnCap (Capability *cap, W_ n);
+bdescr *allocBlockOnCap (Capability *cap);
+
 /* Debugging  -------------------------------------------------------------- */
 
 extern W_ countBlocks       (bdescr *bd);
@@ -26,6 +55,8 @@ extern uint32_t returnMemoryToOS(uint32_t n);
 void checkFreeListSanity(void);
 W_   countFreeList(void);
 void markBlocks (bdescr *bd);
+void markBlockCache (BlockCache *cache);
+W_   countBlockCache (BlockCache *cache);
 void reportUnmarkedBlocks (void);
 #endif
 
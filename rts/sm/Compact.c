@@ -71,6 +71,12 @@
 static /* STATIC_INLINE */ P_
 thread_obj (const StgInfoTable *info, P_ p);
 
+#if defined(THREADED_RTS)
+// Are GC threads threading pointers concurrently?
+// See Note [Parallel compaction]
+static bool par_threading = false;
+#endif
+
 
 STATIC_INLINE W_
 UNTAG_PTR(W_ p)
@@ -143,9 +149,24 @@ thread (StgClosure **p)
 
         if (bd->flags & BF_MARKED)
         {
+            W_ link = (W_)p + 1 + (q0_tagged ? 1 : 0);
+#if defined(THREADED_RTS)
+            if (par_threading) {
+                // Other GC threads may be adding fields to the same chain
+                W_ iptr = ACQUIRE_LOAD(q);
+                W_ r;
+                for (;;) {
+                    *p = (StgClosure *)iptr;
+                    r = cas((StgVolatilePtr)q, iptr, link);
+                    if (r == iptr) break;
+                    iptr = r;
+                }
+                return;
+            }
+#endif
             W_ iptr = *q;
             *p = (StgClosure *)iptr;
-            *q = (W_)p + 1 + (q0_tagged ? 1 : 0);
+            *q = link;
         }
     }
 }
@@ -199,7 +220,9 @@ loop:
 STATIC_INLINE StgInfoTable*
 get_threaded_info( P_ p )
 {
-    W_ q = (W_)GET_INFO(UNTAG_CLOSURE((StgClosure *)p));
+    // Other GC threads may be threading fields onto the chain,
+    // see Note [Parallel compaction]
+    W_ q = (W_)ACQUIRE_LOAD(&UNTAG_CLOSURE((StgClosure *)p)->header.info);
 
 loop:
     switch (GET_PTR_TAG(q))
@@ -555,9 +578,9 @@ update_fwd_cnf( bdescr *bd )
 }
 
 static void
-update_fwd_large( bdescr *bd )
+update_fwd_large( bdescr *bd, bdescr *end )
 {
-  for (; bd != NULL; bd = bd->link) {
+  for (; bd != end; bd = bd->link) {
 
     // nothing to do in a pinned block; it might not even have an object
     // at the beginning.
@@ -835,12 +858,12 @@ thread_obj (const StgInfoTable *info, P_ p)
 }
 
 static void
-update_fwd( bdescr *blocks )
+update_fwd( bdescr *blocks, bdescr *end )
 {
     bdescr *bd = blocks;
 
     // cycle through all the blocks in the step
-    for (; bd != NULL; bd = bd->link) {
+    for (; bd != end; bd = bd->link) {
         P_ p = bd->start;
 
         // linearly scan the objects in this block
@@ -987,6 +1010,402 @@ update_bkwd_compact( generation *gen )
     return free_blocks;
 }
 
+static void
+compact_seq(void)
+{
+    // 2. update forward ptrs
+    for (W_ g = 0; g < RtsFlags.GcFlags.generations; g++) {
+        generation *gen = &generations[g];
+        debugTrace(DEBUG_gc, "update_fwd:  %d", g);
+
+        update_fwd(gen->blocks, NULL);
+        for (W_ n = 0; n < getNumCapabilities(); n++) {
+            update_fwd(gc_threads[n]->gens[g].todo_bd, NULL);
+            update_fwd(gc_threads[n]->gens[g].part_list, NULL);
+        }
+        update_fwd_large(gen->scavenged_large_objects, NULL);
+        update_fwd_cnf(gen->live_compact_objects);
+        if (g == RtsFlags.GcFlags.generations-1 && gen->old_blocks != NULL) {
+            debugTrace(DEBUG_gc, "update_fwd:  %d (compact)", g);
+            update_fwd_compact(gen->old_blocks);
+        }
+    }
+
+    // 3. update backward ptrs
+    generation *gen = oldest_gen;
+    if (gen->old_blocks != NULL) {
+        W_ blocks = update_bkwd_compact(gen);
+        debugTrace(DEBUG_gc,
+                   "update_bkwd: %d (compact, old: %d blocks, now %d blocks)",
+                   gen->no, gen->n_old_blocks, blocks);
+        gen->n_old_blocks = blocks;
+    }
+}
+
+#if defined(THREADED_RTS)
+/* -----------------------------------------------------------------------------
+   Note [Parallel compaction]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+   The sequential algorithm above relies on visiting the compacted
+   generation in address order: when update_fwd_compact reaches an object
+   it knows that every field pointing at it from an earlier object has
+   been threaded, so it can compute the object's destination and unthread
+   those fields straight away; update_bkwd_compact then unthreads the rest
+   and moves the objects.  That order is inherently sequential, so in a
+   parallel GC (parGcThreads() > 1) with a large enough compacted
+   generation we use a different division of labour, carried out by all
+   of the GC threads with runParGcJob():
+
+   - We split the compacted generation's blocks (old_blocks) into
+     contiguous pieces of at least PAR_COMPACT_MIN_BLOCKS blocks, and
+     compact each piece into itself: objects only ever slide towards the
+     start of their own piece.  Destinations can then be computed for each
+     piece independently, at the cost of at most one partly filled block
+     per piece compared with the sequential algorithm.  The other block
+     lists that need threading (the blocks copied into each generation
+     during this GC, and the large objects) are split into pieces too.
+
+   - Thread (compact_thread_job): thread every field of every live
+     object, in the compacted generation and elsewhere.  This is
+     update_fwd_compact without the unthreading: for each piece of the
+     compacted generation we still compute the destinations and set the
+     "too large" bit (see Note [Mark bits in mark-compact collector] in
+     Compact.h).  Several threads may now add fields to the same chain at
+     once, so while par_threading is set thread() adds a field with a CAS
+     on the head of the chain.  Nothing is unthreaded during this phase,
+     so chains only grow at the head, and get_threaded_info can safely
+     walk a chain that is being extended.
+
+   - Unthread (compact_unthread_job): every field pointing at an object
+     is now on its chain, so we can walk each piece again, unthread each
+     object with its destination, and restore its info pointer.  Each
+     field is on exactly one chain, and only the owner of the object at
+     the end of the chain writes to it, so this needs no synchronisation.
+     Objects are not moved yet, because the fields we are writing may be
+     in objects belonging to other pieces.
+
+   - Move (compact_move_job): slide the objects of each piece into place,
+     as update_bkwd_compact does.  Afterwards the leader frees the blocks
+     that each piece no longer needs and links the pieces back together.
+
+   The roots and the CNF hash tables are still threaded by the leader
+   alone, before the parallel phases.  When the GC is not parallel, or the
+   compacted generation is small, we use the sequential algorithm.
+   -------------------------------------------------------------------------- */
+
+// The smallest piece of a block list that we give to a GC thread.  Since
+// each piece of the compacted generation leaves at most one partly filled
+// block, this also bounds the space we lose compared with compact_seq().
+#define PAR_COMPACT_MIN_BLOCKS 256
+
+// The number of pieces of the compacted generation to aim for per GC
+// thread, so that the GC threads can balance the work between them.
+#define PAR_COMPACT_PIECES_PER_THREAD 4
+
+typedef enum {
+    PIECE_COMPACT,      // a piece of the compacted generation
+    PIECE_BLOCKS,       // a piece of a block list that is not compacted
+    PIECE_LARGE,        // a piece of a large object list
+} PieceType;
+
+typedef struct {
+    PieceType type;
+    bdescr *start;      // the first block of the piece
+    bdescr *end;        // the first block after the piece, or NULL
+
+    // Filled in by move_piece()
+    bdescr *last;       // the last block we compacted into
+    bdescr *unused;     // the blocks we no longer need
+    W_ n_blocks;        // the number of blocks from start to last
+} CompactPiece;
+
+// The pieces of the compacted generation come first
+static CompactPiece *pieces = NULL;
+static uint32_t n_pieces;
+static uint32_t n_compact_pieces;
+static uint32_t max_pieces;
+
+// The next piece to be taken in the current phase
+static StgWord next_piece;
+
+static void
+add_pieces (PieceType type, bdescr *bd, W_ piece_blocks)
+{
+    while (bd != NULL) {
+        if (n_pieces == max_pieces) {
+            max_pieces = max_pieces == 0 ? 64 : max_pieces * 2;
+            pieces = stgReallocBytes(pieces, max_pieces * sizeof(CompactPiece),
+                                     "add_pieces");
+        }
+        CompactPiece *pc = &pieces[n_pieces++];
+        pc->type = type;
+        pc->start = bd;
+        for (W_ n = 0; bd != NULL && n < piece_blocks; bd = bd->link) {
+            n += bd->blocks;
+        }
+        pc->end = bd;
+        pc->last = NULL;
+        pc->unused = NULL;
+        pc->n_blocks = 0;
+    }
+}
+
+static CompactPiece *
+take_piece (uint32_t limit)
+{
+    StgWord i = atomic_inc(&next_piece, 1) - 1;
+    return i < limit ? &pieces[i] : NULL;
+}
+
+// As update_fwd_compact, but without unthreading
+static void
+thread_piece (CompactPiece *pc)
+{
+    bdescr *free_bd = pc->start;
+    P_ free = free_bd->start;
+
+    for (bdescr *bd = pc->start; bd != pc->end; bd = bd->link) {
+        P_ p = bd->start;
+
+        while (p < bd->free) {
+
+            while (p < bd->free && !is_marked(p,bd)) {
+                p++;
+            }
+            if (p >= bd->free) {
+                break;
+            }
+
+            StgInfoTable *iptr = get_threaded_info(p);
+            P_ q = p;
+
+            p = thread_obj(INFO_PTR_TO_STRUCT(iptr), p);
+
+            W_ size = p - q;
+            if (free + size > free_bd->start + BLOCK_SIZE_W) {
+                mark(q+1,bd);
+                free_bd = free_bd->link;
+                free = free_bd->start;
+            } else {
+                ASSERT(!is_marked(q+1,bd));
+            }
+            free += size;
+        }
+    }
+}
+
+// The unthreading half of update_bkwd_compact
+static void
+unthread_piece (CompactPiece *pc)
+{
+    bdescr *free_bd = pc->start;
+    P_ free = free_bd->start;
+
+    for (bdescr *bd = pc->start; bd != pc->end; bd = bd->link) {
+        P_ p = bd->start;
+
+        while (p < bd->free) {
+
+            while (p < bd->free && !is_marked(p,bd)) {
+                p++;
+            }
+            if (p >= bd->free) {
+                break;
+            }
+
+            if (is_marked(p+1,bd)) {
+                free_bd = free_bd->link;
+                free = free_bd->start;
+            }
+
+            StgInfoTable *iptr = get_threaded_info(p);
+            unthread(p, (W_)free, get_iptr_tag(iptr));
+            ASSERT(LOOKS_LIKE_INFO_PTR((W_)((StgClosure *)p)->header.info));
+            W_ size = closure_sizeW_((StgClosure *)p, INFO_PTR_TO_STRUCT(iptr));
+
+            free += size;
+            p += size;
+        }
+    }
+}
+
+// The moving half of update_bkwd_compact
+static void
+move_piece (CompactPiece *pc)
+{
+    bdescr *free_bd = pc->start;
+    P_ free = free_bd->start;
+    W_ free_blocks = 1;
+
+    for (bdescr *bd = pc->start; bd != pc->end; bd = bd->link) {
+        P_ p = bd->start;
+
+        while (p < bd->free) {
+
+            while (p < bd->free && !is_marked(p,bd)) {
+                p++;
+            }
+            if (p >= bd->free) {
+                break;
+            }
+
+            if (is_marked(p+1,bd)) {
+                free_bd->free = free;
+                IF_DEBUG(zero_on_gc, {
+                    memset(free_bd->free, 0xaa,
+                           BLOCK_SIZE - ((W_)(free_bd->free - free_bd->start) * sizeof(W_)));
+                });
+                free_bd = free_bd->link;
+                free = free_bd->start;
+                free_blocks++;
+            }
+
+            const StgInfoTable *info = get_itbl((StgClosure *)p);
+            W_ size = closure_sizeW_((StgClosure *)p,info);
+
+            if (free != p) {
+                move(free,p,size);
+            }
+
+            // relocate TSOs
+            if (info->type == STACK) {
+                move_STACK((StgStack *)p, (StgStack *)free);
+            }
+
+            free += size;
+            p += size;
+        }
+    }
+
+    free_bd->free = free;
+    IF_DEBUG(zero_on_gc, {
+        W_ block_size_bytes = free_bd->blocks * BLOCK_SIZE;
+        W_ block_in_use_bytes = (free_bd->free - free_bd->start) * sizeof(W_);
+        W_ block_free_bytes = block_size_bytes - block_in_use_bytes;
+        memset(free_bd->free, 0xaa, block_free_bytes);
+    });
+
+    // Cut off the blocks we didn't need; the leader frees them.
+    pc->last = free_bd;
+    pc->n_blocks = free_blocks;
+    if (free_bd->link != pc->end) {
+        bdescr *bd = free_bd->link;
+        pc->unused = bd;
+        while (bd->link != pc->end) {
+            bd = bd->link;
+        }
+        bd->link = NULL;
+    }
+    free_bd->link = NULL;
+}
+
+static void
+compact_thread_job (void)
+{
+    CompactPiece *pc;
+    while ((pc = take_piece(n_pieces)) != NULL) {
+        switch (pc->type) {
+        case PIECE_COMPACT:
+            thread_piece(pc);
+            break;
+        case PIECE_BLOCKS:
+            update_fwd(pc->start, pc->end);
+            break;
+        case PIECE_LARGE:
+            update_fwd_large(pc->start, pc->end);
+            break;
+        }
+    }
+}
+
+static void
+compact_unthread_job (void)
+{
+    CompactPiece *pc;
+    while ((pc = take_piece(n_compact_pieces)) != NULL) {
+        unthread_piece(pc);
+    }
+}
+
+static void
+compact_move_job (void)
+{
+    CompactPiece *pc;
+    while ((pc = take_piece(n_compact_pieces)) != NULL) {
+        move_piece(pc);
+    }
+}
+
+static void
+compact_par(void)
+{
+    generation *gen = oldest_gen;
+    uint32_t n_threads = parGcThreads();
+
+    W_ piece_blocks = gen->n_old_blocks /
+        (n_threads * PAR_COMPACT_PIECES_PER_THREAD);
+    if (piece_blocks < PAR_COMPACT_MIN_BLOCKS) {
+        piece_blocks = PAR_COMPACT_MIN_BLOCKS;
+    }
+
+    n_pieces = 0;
+    add_pieces(PIECE_COMPACT, gen->old_blocks, piece_blocks);
+    n_compact_pieces = n_pieces;
+    for (W_ g = 0; g < RtsFlags.GcFlags.generations; g++) {
+        add_pieces(PIECE_BLOCKS, generations[g].blocks, piece_blocks);
+        for (W_ n = 0; n < getNumCapabilities(); n++) {
+            add_pieces(PIECE_BLOCKS, gc_threads[n]->gens[g].todo_bd,
+                       piece_blocks);
+            add_pieces(PIECE_BLOCKS, gc_threads[n]->gens[g].part_list,
+                       piece_blocks);
+        }
+        add_pieces(PIECE_LARGE, generations[g].scavenged_large_objects,
+                   piece_blocks);
+
+        // The CNFs are few, and update_fwd_cnf isn't thread-safe
+        update_fwd_cnf(generations[g].live_compact_objects);
+    }
+
+    debugTrace(DEBUG_gc,
+               "compact_par: %d threads, %d pieces (%d compacted) of %d blocks",
+               n_threads, n_pieces, n_compact_pieces, piece_blocks);
+
+    // 2. thread everything
+    par_threading = true;
+    next_piece = 0;
+    runParGcJob(compact_thread_job);
+    par_threading = false;
+
+    // 3. unthread, then move the compacted objects
+    next_piece = 0;
+    runParGcJob(compact_unthread_job);
+    next_piece = 0;
+    runParGcJob(compact_move_job);
+
+    // Link the pieces back together, freeing what they no longer need
+    W_ blocks = 0;
+    for (uint32_t i = 0; i < n_compact_pieces; i++) {
+        CompactPiece *pc = &pieces[i];
+        if (pc->unused != NULL) {
+            freeChain(pc->unused);
+        }
+        if (i + 1 < n_compact_pieces) {
+            pc->last->link = pieces[i+1].start;
+        }
+        blocks += pc->n_blocks;
+    }
+    debugTrace(DEBUG_gc,
+               "compact_par: old: %d blocks, now %d blocks",
+               gen->n_old_blocks, blocks);
+    gen->n_old_blocks = blocks;
+
+    stgFree(pieces);
+    pieces = NULL;
+    max_pieces = 0;
+}
+#endif /* THREADED_RTS */
+
 void
 compact(StgClosure *static_objects,
         StgWeak **dead_weak_ptr_list,
@@ -1048,32 +1467,16 @@ compact(StgClosure *static_objects,
     // the CAF list (used by GHCi)
     markCAFs((evac_fn)thread_root, NULL);
 
-    // 2. update forward ptrs
-    for (W_ g = 0; g < RtsFlags.GcFlags.generations; g++) {
-        generation *gen = &generations[g];
-        debugTrace(DEBUG_gc, "update_fwd:  %d", g);
-
-        update_fwd(gen->blocks);
-        for (W_ n = 0; n < getNumCapabilities(); n++) {
-            update_fwd(gc_threads[n]->gens[g].todo_bd);
-            update_fwd(gc_threads[n]->gens[g].part_list);
-        }
-        update_fwd_large(gen->scavenged_large_objects);
-        update_fwd_cnf(gen->live_compact_objects);
-        if (g == RtsFlags.GcFlags.generations-1 && gen->old_blocks != NULL) {
-            debugTrace(DEBUG_gc, "update_fwd:  %d (compact)", g);
-            update_fwd_compact(gen->old_blocks);
-        }
-    }
-
-    // 3. update backward ptrs
-    generation *gen = oldest_gen;
-    if (gen->old_blocks != NULL) {
-        W_ blocks = update_bkwd_compact(gen);
-        debugTrace(DEBUG_gc,
-                   "update_bkwd: %d (compact, old: %d blocks, now %d blocks)",
-                   gen->no, gen->n_old_blocks, blocks);
-        gen->n_old_blocks = blocks;
+#if defined(THREADED_RTS)
+    if (parGcThreads() > 1 &&
+        oldest_gen->n_old_blocks >= 2 * PAR_COMPACT_MIN_BLOCKS) {
+        // 2. and 3. in parallel, see Note [Parallel compaction]
+        compact_par();
+    } else
+#endif
+    {
+        // 2. update forward ptrs, and 3. update backward ptrs
+        compact_seq();
     }
 
     // 4. Re-hash hash tables of threaded CNFs.
@@ -152,6 +152,57 @@ static StgInt n_gc_exited = 0;
 static Condition gc_exit_arrived_cv;
 static Condition gc_exit_leave_now_cv;
 
+// A job for the GC threads waiting to be released, see runParGcJob().
+// Protected by gc_exit_mutex.
+static GcJob gc_job = NULL;
+static uint32_t gc_job_pass = 0;
+static StgInt gc_job_running = 0;
+static Condition gc_job_done_cv;
+
+// The latencies of the GC barriers in the current GC, see
+// Note [Adaptive GC synchronisation]
+static StgWord gc_sync_hist[GC_SYNC_HIST_BUCKETS];
+
+// The longest we ever spin at a GC barrier before parking
+#define GC_SYNC_MAX_SPIN USToTime(50)
+
+/* Note [Adaptive GC synchronisation]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * A parallel GC has two barriers at each end:
+ *
+ *  - at the start, the leader waits in waitForGcThreads for the other
+ *    GC threads to stop mutating, and the GC threads then wait in
+ *    gcWorkerThread for the leader to tell them to start
+ *    (wakeup_gc_threads);
+ *
+ *  - at the end, the leader waits in shutdown_gc_threads for the GC threads
+ *    to finish, and the GC threads then wait in gcWorkerThread to be
+ *    released (releaseGCThreads).
+ *
+ * Parking on a condition variable and being woken up costs a couple of
+ * system calls and a trip through the OS scheduler on each side, which is
+ * a large part of a short minor GC with many capabilities.  So each thread
+ * first spins on the counter it is waiting for, and only parks on the
+ * condition variable if the wait lasts longer than its spin budget.  The
+ * waiter that is signalled still checks the counter under the mutex as
+ * before, so spinning doesn't change the protocol.
+ *
+ * The budget is tuned from recent waits: each gc_thread keeps, for its
+ * entry and exit waits separately, a moving average of how long they took
+ * (gc_sync_policy).  When waits are short we spin for up to twice the
+ * average, so that most of them end while spinning; when they are longer
+ * than GC_SYNC_MAX_SPIN spinning would only burn CPU time, so we park
+ * straight away.  We never spin when there are more capabilities than
+ * processors, since then the thread we are waiting for may need our
+ * processor.
+ *
+ * The waits that hold up the GC (all but the GC threads' wait to be
+ * released, which ends after the GC) are counted in a histogram,
+ * gc_sync_hist, which the leader reports after each parallel GC in the
+ * GC_SYNC_HISTOGRAM event and accumulates in the machine-readable
+ * statistics (see stat_gcSyncHistogram).
+ */
+
 #else // THREADED_RTS
 // Must match the alignment of gen_workspace.
 StgWord8 the_gc_thread[sizeof(gc_thread) + 64 * sizeof(gen_workspace)]
@@ -222,6 +273,14 @@ static void resize_nursery          (void);
 static void scavenge_until_all_done (void);
 static StgWord inc_running          (void);
 static StgWord dec_running          (void);
+#if defined(THREADED_RTS)
+static bool gc_sync_spin            (gc_sync_policy *policy, StgInt *p,
+                                     StgInt v, Time t0);
+static void gc_sync_record          (gc_sync_policy *policy, Time wait,
+                                     bool count);
+#endif
+static void assign_idle_caps        (uint32_t me, bool idle_cap[]);
+static void mark_idle_caps          (bool idle_cap[]);
 static void wakeup_gc_threads       (uint32_t me, bool idle_cap[]);
 static void shutdown_gc_threads     (uint32_t me, bool idle_cap[]);
 static void collect_gct_blocks      (void);
@@ -314,6 +373,15 @@ GarbageCollect (struct GcConfig config,
 
   ACQUIRE_SM_LOCK;
 
+#if defined(THREADED_RTS)
+  // Return the capabilities' cached blocks to the free lists; every
+  // capability is stopped, so nobody is allocating from its cache.
+  // See Note [Per-capability block caches] in BlockAlloc.c.
+  for (n = 0; n < getNumCapabilities(); n++) {
+      flushBlockCache(&getCapability(n)->block_cache);
+  }
+#endif
+
 #if defined(RTS_USER_SIGNALS)
   if (RtsFlags.MiscFlags.install_signal_handlers) {
     // block signals
@@ -375,7 +443,8 @@ GarbageCollect (struct GcConfig config,
           static_flag == STATIC_FLAG_A ? STATIC_FLAG_B : STATIC_FLAG_A;
   }
 
-  /* N.B. We currently don't unload code with the non-moving collector. */
+  /* N.B. The non-moving collector marks code itself. See Note [Object
+   * unloading under the non-moving collector] in CheckUnload.c. */
   if (major_gc && !RtsFlags.GcFlags.useNonmoving) {
       unload_mark_needed = prepareUnloadCheck();
   } else {
@@ -496,6 +565,7 @@ GarbageCollect (struct GcConfig config,
   // NB. do this after the mutable lists have been saved above, otherwise
   // the other GC threads will be writing into the old mutable lists.
   inc_running();
+  assign_idle_caps(gct->thread_index, idle_cap);
   wakeup_gc_threads(gct->thread_index, idle_cap);
 
   traceEventGcWork(gct->cap);
@@ -514,13 +584,7 @@ GarbageCollect (struct GcConfig config,
       }
   } else {
       scavenge_capability_mut_lists(gct->cap);
-      for (n = 0; n < getNumCapabilities(); n++) {
-          if (idle_cap[n]) {
-              markCapability(mark_root, gct, getCapability(n),
-                             true/*don't mark sparks*/);
-              scavenge_capability_mut_lists(getCapability(n));
-          }
-      }
+      mark_idle_caps(idle_cap);
   }
 
   // follow roots from the CAF list (used by GHCi)
@@ -545,9 +609,6 @@ GarbageCollect (struct GcConfig config,
   // Mark the stable pointer table.
   markStablePtrTable(mark_root, gct);
 
-  // Remember old stable name addresses.
-  rememberOldStableNameAddresses ();
-
   /* -------------------------------------------------------------------------
    * Repeatedly scavenge all the areas we know about until there's no
    * more scavenging to be done.
@@ -556,6 +617,15 @@ GarbageCollect (struct GcConfig config,
   scavenge_until_all_done();
   shutdown_gc_threads(gct->thread_index, idle_cap);
 
+#if defined(THREADED_RTS)
+  // Report the latencies of the GC barriers of this GC,
+  // see Note [Adaptive GC synchronisation]
+  if (is_par_gc()) {
+      stat_gcSyncHistogram(gct->cap, gc_sync_hist);
+  }
+  memset(gc_sync_hist, 0, sizeof(gc_sync_hist));
+#endif
+
   StgWeak *dead_weak_ptr_list = NULL;
   StgTSO *resurrected_threads = END_TSO_QUEUE;
   // must be last...  invariant is that everything is fully
@@ -940,8 +1010,8 @@ GarbageCollect (struct GcConfig config,
   }
 #endif
 
-  // Update the stable name hash table
-  updateStableNameTable(major_gc);
+  // Update the stable name hash tables
+  updateStableNameTable(major_gc && oldest_gen->mark && oldest_gen->compact);
 
   // unlock the StablePtr table.  Must be before scheduleFinalizers(),
   // because a finalizer may call hs_free_fun_ptr() or
@@ -951,9 +1021,8 @@ GarbageCollect (struct GcConfig config,
   // Unload dynamically-loaded object code after a major GC.
   // See Note [Object unloading] in CheckUnload.c for details.
   //
-  // TODO: Similar to `nonmovingGcCafs` non-moving GC should have its own
-  // collector for these objects, but that's currently not implemented, so we
-  // simply don't unload object code when non-moving GC is enabled.
+  // The non-moving collector unloads object code at the end of its own mark
+  // instead, see Note [Object unloading under the non-moving collector].
   if (major_gc && !RtsFlags.GcFlags.useNonmoving) {
       checkUnload();
   }
@@ -1180,9 +1249,14 @@ new_gc_thread (uint32_t n, gc_thread *t)
     t->id = 0;
     SEQ_CST_STORE(&t->wakeup, GC_THREAD_INACTIVE);  // starts true, so we can wait for the
                           // thread to start up, see wakeup_gc_threads
+    t->entry_sync = (gc_sync_policy) { .spin = 0, .avg_wait = 0 };
+    t->exit_sync  = (gc_sync_policy) { .spin = 0, .avg_wait = 0 };
 #endif
 
     t->thread_index = n;
+#if defined(THREADED_RTS)
+    t->idle_owner = n;
+#endif
     t->free_blocks = NULL;
     t->gc_count = 0;
 
@@ -1246,6 +1320,7 @@ initGcThreads (uint32_t from USED_IF_THREADS, uint32_t to USED_IF_THREADS)
         initMutex(&gc_exit_mutex);
         initCondition(&gc_exit_arrived_cv);
         initCondition(&gc_exit_leave_now_cv);
+        initCondition(&gc_job_done_cv);
         initMutex(&gc_running_mutex);
         initCondition(&gc_running_cv);
     }
@@ -1283,6 +1358,7 @@ freeGcThreads (void)
         }
         closeCondition(&gc_running_cv);
         closeMutex(&gc_running_mutex);
+        closeCondition(&gc_job_done_cv);
         closeCondition(&gc_exit_leave_now_cv);
         closeCondition(&gc_exit_arrived_cv);
         closeMutex(&gc_exit_mutex);
@@ -1444,13 +1520,20 @@ gcWorkerThread (Capability *cap)
     SEQ_CST_STORE(&gct->wakeup, GC_THREAD_STANDING_BY);
     debugTrace(DEBUG_gc, "GC thread %d standing by...", gct->thread_index);
 
+    Time t0 = getProcessElapsedTime();
     ACQUIRE_LOCK(&gc_entry_mutex);
     SEQ_CST_ADD(&n_gc_entered, 1);
     signalCondition(&gc_entry_arrived_cv);
-    while(SEQ_CST_LOAD(&n_gc_entered) != 0) {
-        waitCondition(&gc_entry_start_now_cv, &gc_entry_mutex);
-    }
     RELEASE_LOCK(&gc_entry_mutex);
+    // See Note [Adaptive GC synchronisation]
+    if (!gc_sync_spin(&gct->entry_sync, &n_gc_entered, 0, t0)) {
+        ACQUIRE_LOCK(&gc_entry_mutex);
+        while(SEQ_CST_LOAD(&n_gc_entered) != 0) {
+            waitCondition(&gc_entry_start_now_cv, &gc_entry_mutex);
+        }
+        RELEASE_LOCK(&gc_entry_mutex);
+    }
+    gc_sync_record(&gct->entry_sync, getProcessElapsedTime() - t0, true);
 
     init_gc_thread(gct);
 
@@ -1460,6 +1543,7 @@ gcWorkerThread (Capability *cap)
     gct->evac_gen_no = 0;
     markCapability(mark_root, gct, cap, true/*prune sparks*/);
     scavenge_capability_mut_lists(cap);
+    mark_idle_caps(NULL);
 
     scavenge_until_all_done();
 
@@ -1478,20 +1562,89 @@ gcWorkerThread (Capability *cap)
     // This must come *after* stat_endGCWorker since it serves to
     // synchronize us with the GC leader, which will later aggregate the
     // GC statistics  (#17964,#18717)
+    t0 = getProcessElapsedTime();
     ACQUIRE_LOCK(&gc_exit_mutex);
+    uint32_t job_pass = gc_job_pass;
     SEQ_CST_STORE(&gct->wakeup, GC_THREAD_WAITING_TO_CONTINUE);
     SEQ_CST_ADD(&n_gc_exited, 1);
     signalCondition(&gc_exit_arrived_cv);
-    while(SEQ_CST_LOAD(&n_gc_exited) != 0) {
-        waitCondition(&gc_exit_leave_now_cv, &gc_exit_mutex);
-    }
     RELEASE_LOCK(&gc_exit_mutex);
+    if (!gc_sync_spin(&gct->exit_sync, &n_gc_exited, 0, t0)) {
+        ACQUIRE_LOCK(&gc_exit_mutex);
+        while(SEQ_CST_LOAD(&n_gc_exited) != 0) {
+            // The leader may give us more work before releasing us,
+            // see runParGcJob()
+            if (gc_job_pass != job_pass) {
+                GcJob job = gc_job;
+                job_pass = gc_job_pass;
+                RELEASE_LOCK(&gc_exit_mutex);
+                job();
+                ACQUIRE_LOCK(&gc_exit_mutex);
+                if (--gc_job_running == 0) {
+                    signalCondition(&gc_job_done_cv);
+                }
+                t0 = getProcessElapsedTime();
+                continue;
+            }
+            waitCondition(&gc_exit_leave_now_cv, &gc_exit_mutex);
+        }
+        RELEASE_LOCK(&gc_exit_mutex);
+    }
+    // This wait ends after the GC, so it is not in the histogram
+    gc_sync_record(&gct->exit_sync, getProcessElapsedTime() - t0, false);
 
     debugTrace(DEBUG_gc, "GC thread %d on my way...", gct->thread_index);
 
     SET_GCT(saved_gct);
 }
 
+/* Spin until *p == v, for as long as the policy allows since t0.  Returns
+ * false if we gave up, in which case the caller parks.
+ * See Note [Adaptive GC synchronisation]
+ */
+static bool
+gc_sync_spin (gc_sync_policy *policy, StgInt *p, StgInt v, Time t0)
+{
+    uint32_t i = 0;
+
+    if (policy->spin == 0) {
+        return SEQ_CST_LOAD(p) == v;
+    }
+    while (SEQ_CST_LOAD(p) != v) {
+        // reading the clock is cheap, but not as cheap as spinning
+        if (++i % 64 == 0 && getProcessElapsedTime() - t0 >= policy->spin) {
+            return false;
+        }
+        busy_wait_nop();
+    }
+    return true;
+}
+
+/* Record a wait at a GC barrier, and adjust the spin budget for the next
+ * one.  If count is true, the wait is also counted in the histogram of the
+ * current GC.
+ */
+static void
+gc_sync_record (gc_sync_policy *policy, Time wait, bool count)
+{
+    policy->avg_wait = (7 * policy->avg_wait + wait) / 8;
+    if (2 * policy->avg_wait <= GC_SYNC_MAX_SPIN
+        && getNumCapabilities() <= getNumberOfProcessors()) {
+        policy->spin = 2 * policy->avg_wait;
+    } else {
+        policy->spin = 0;
+    }
+
+    if (count) {
+        uint32_t b = 0;
+        for (Time us = TimeToUS(wait); us > 0 && b < GC_SYNC_HIST_BUCKETS-1;
+             us >>= 1) {
+            b++;
+        }
+        atomic_inc(&gc_sync_hist[b], 1);
+    }
+}
+
 #endif
 
 #if defined(THREADED_RTS)
@@ -1516,6 +1669,21 @@ waitForGcThreads (Capability *cap, bool idle_cap[])
     ASSERT(n_threads < getNumCapabilities()); // must be less because we don't count ourself
     if(n_threads == 0) { return; }
 
+    // Make sure that the capabilities without a running task have one to
+    // stop for the GC, then spin while they arrive before we park.
+    // See Note [Adaptive GC synchronisation]
+    for(i = 0; i < getNumCapabilities(); ++i) {
+        if (i == me || idle_cap[i]) { continue; }
+        if (SEQ_CST_LOAD(&gc_threads[i]->wakeup) != GC_THREAD_STANDING_BY) {
+            prodCapability(getCapability(i), cap->running_task);
+        }
+    }
+    gc_sync_policy *policy = &gc_threads[me]->entry_sync;
+    if (gc_sync_spin(policy, &n_gc_entered, n_threads, t0)) {
+        gc_sync_record(policy, getProcessElapsedTime() - t0, true);
+        return;
+    }
+
     ACQUIRE_LOCK(&gc_entry_mutex);
     while((cur_n_gc_entered = SEQ_CST_LOAD(&n_gc_entered)) != n_threads) {
         ASSERT(cur_n_gc_entered < n_threads);
@@ -1544,6 +1712,9 @@ waitForGcThreads (Capability *cap, bool idle_cap[])
     }
     RELEASE_LOCK(&gc_entry_mutex);
 
+    t2 = getProcessElapsedTime();
+    gc_sync_record(policy, t2 - t0, true);
+
     if (RtsFlags.GcFlags.longGCSync != 0 &&
         t2 - t0 > RtsFlags.GcFlags.longGCSync) {
         rtsConfig.longGCSyncEnd(t2 - t0);
@@ -1552,6 +1723,77 @@ waitForGcThreads (Capability *cap, bool idle_cap[])
 
 #endif // THREADED_RTS
 
+/* Note [Locality-aware parallel GC]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * In a parallel GC each GC thread starts with the roots of its own
+ * capability: its run queue, its remembered set and so on (see
+ * gcWorkerThread), so the objects a capability allocated are mostly copied
+ * by the GC thread running on the same CPU, into blocks allocated on that
+ * CPU's NUMA node (see allocGroup_sync).  Two things spoil this:
+ *
+ *  - the roots of idle capabilities, which don't take part in the GC, are
+ *    all marked by the GC leader, wherever those capabilities ran;
+ *
+ *  - when a GC thread runs out of work it steals from the other GC threads
+ *    in order of capability number (see steal_todo_block).
+ *
+ * With +RTS -ql, each idle capability is instead adopted by the nearest
+ * capability taking part in the GC, according to its victim order (see
+ * Note [Capability victim order] in Capability.c), whose GC thread marks
+ * its roots after its own; and a GC thread that runs out of local work
+ * steals from the other GC threads nearest first.  Without -ql the leader
+ * adopts every idle capability, as before.
+ *
+ * The adopter is recorded in gc_thread.idle_owner by the leader before it
+ * wakes up the GC threads.
+ */
+static void
+assign_idle_caps (uint32_t me USED_IF_THREADS,
+                  bool idle_cap[] USED_IF_THREADS)
+{
+#if defined(THREADED_RTS)
+    uint32_t i, j, n = getNumCapabilities();
+
+    if (!is_par_gc()) return;
+
+    for (i = 0; i < n; i++) {
+        gc_threads[i]->idle_owner = i;
+        if (!idle_cap[i]) continue;
+        gc_threads[i]->idle_owner = me;
+        if (RtsFlags.ParFlags.parGcLocality && getCapability(i)->victims) {
+            for (j = 0; j < n - 1; j++) {
+                uint32_t v = getCapability(i)->victims[j];
+                if (!idle_cap[v]) {
+                    gc_threads[i]->idle_owner = v;
+                    break;
+                }
+            }
+        }
+    }
+#endif
+}
+
+/* Mark the roots of the idle capabilities adopted by this GC thread, see
+ * Note [Locality-aware parallel GC].  idle_cap is NULL in the GC threads
+ * other than the leader, which don't know which capabilities are idle.
+ */
+static void
+mark_idle_caps (bool idle_cap[] USED_IF_THREADS)
+{
+#if defined(THREADED_RTS)
+    uint32_t n;
+
+    for (n = 0; n < getNumCapabilities(); n++) {
+        if (n == gct->thread_index) continue;
+        if (idle_cap != NULL && !idle_cap[n]) continue;
+        if (gc_threads[n]->idle_owner != gct->thread_index) continue;
+        markCapability(mark_root, gct, getCapability(n),
+                       true/*don't mark sparks*/);
+        scavenge_capability_mut_lists(getCapability(n));
+    }
+#endif
+}
+
 static void
 wakeup_gc_threads (uint32_t me USED_IF_THREADS,
                    bool idle_cap[] USED_IF_THREADS)
@@ -1600,6 +1842,9 @@ shutdown_gc_threads (uint32_t me USED_IF_THREADS USED_IF_DEBUG,
     // we need to wait for `n_threads` threads. -1 because that's ourself
     StgInt n_threads = (StgInt)n_gc_threads - 1 - (StgInt)n_gc_idle_threads;
     StgInt cur_n_gc_exited;
+    Time t0 = getProcessElapsedTime();
+    // See Note [Adaptive GC synchronisation]
+    gc_sync_spin(&gct->exit_sync, &n_gc_exited, n_threads, t0);
     ACQUIRE_LOCK(&gc_exit_mutex);
     while((cur_n_gc_exited = SEQ_CST_LOAD(&n_gc_exited)) != n_threads) {
         ASSERT(cur_n_gc_exited >= 0);
@@ -1614,10 +1859,48 @@ shutdown_gc_threads (uint32_t me USED_IF_THREADS USED_IF_DEBUG,
     }
 #endif // DEBUG
     RELEASE_LOCK(&gc_exit_mutex);
+    gc_sync_record(&gct->exit_sync, getProcessElapsedTime() - t0, true);
 #endif // THREADED_RTS
 }
 
 #if defined(THREADED_RTS)
+/* The number of threads taking part in this GC, including the leader. */
+uint32_t
+parGcThreads (void)
+{
+    if (!is_par_gc()) return 1;
+    return n_gc_threads - n_gc_idle_threads;
+}
+
+/* Run job on the leader and on each of the other GC threads, and return
+ * when they have all finished.  This is for work after scavenging, once
+ * shutdown_gc_threads has returned: the GC threads are then waiting in
+ * gcWorkerThread to be released, and they run the job before they go back
+ * to waiting.  A GC thread that is still spinning at the exit barrier only
+ * notices the job when it gives up and parks, so a job should be a sizeable
+ * piece of work, such as a phase of the compacting collector.
+ */
+void
+runParGcJob (GcJob job)
+{
+    ASSERT(is_par_gc());
+    ACQUIRE_LOCK(&gc_exit_mutex);
+    gc_job = job;
+    gc_job_pass++;
+    gc_job_running = (StgInt)n_gc_threads - 1 - (StgInt)n_gc_idle_threads;
+    broadcastCondition(&gc_exit_leave_now_cv);
+    RELEASE_LOCK(&gc_exit_mutex);
+
+    job();
+
+    ACQUIRE_LOCK(&gc_exit_mutex);
+    while (gc_job_running > 0) {
+        waitCondition(&gc_job_done_cv, &gc_exit_mutex);
+    }
+    gc_job = NULL;
+    RELEASE_LOCK(&gc_exit_mutex);
+}
+
 void
 releaseGCThreads (Capability *cap USED_IF_THREADS, bool idle_cap[])
 {
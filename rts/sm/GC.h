@@ -56,6 +56,12 @@ extern StgPtr mark_sp;
 
 extern bool work_stealing;
 
+// The number of buckets of the histograms of GC synchronisation latencies,
+// see Note [Adaptive GC synchronisation] in GC.c.  Bucket 0 counts waits of
+// less than 1us, bucket i (for 0 < i < GC_SYNC_HIST_BUCKETS-1) waits of
+// [2^(i-1), 2^i) us, and the last bucket all longer waits.
+#define GC_SYNC_HIST_BUCKETS 12
+
 #if defined(PROF_SPIN) && defined(THREADED_RTS)
 extern volatile StgWord64 whitehole_gc_spin;
 extern volatile StgWord64 waitForGcThreads_spin;
@@ -92,6 +98,10 @@ void resizeGenerations (void);
 void notifyTodoBlock (void);
 void waitForGcThreads (Capability *cap, bool idle_cap[]);
 void releaseGCThreads (Capability *cap, bool idle_cap[]);
+
+typedef void (*GcJob)(void);
+uint32_t parGcThreads (void);
+void runParGcJob (GcJob job);
 #endif
 
 #define WORK_UNIT_WORDS 128
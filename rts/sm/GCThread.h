@@ -126,14 +126,28 @@ typedef struct ATTRIBUTE_ALIGNED(GEN_WORKSPACE_ALIGNMENT) gen_workspace_ {
 #define GC_THREAD_RUNNING              2
 #define GC_THREAD_WAITING_TO_CONTINUE  3
 
+// How long a GC thread spins at one of the GC barriers before parking, see
+// Note [Adaptive GC synchronisation] in GC.c
+typedef struct {
+    Time spin;                     // how long to spin before parking
+    Time avg_wait;                 // moving average of recent waits
+} gc_sync_policy;
+
 typedef struct gc_thread_ {
     Capability *cap;
 
 #if defined(THREADED_RTS)
     OSThreadId id;                 // The OS thread that this struct belongs to
     volatile StgWord wakeup;       // NB not StgWord8; only StgWord is guaranteed atomic
+    gc_sync_policy entry_sync;     // waiting for the GC to start
+    gc_sync_policy exit_sync;      // waiting for the GC to finish
 #endif
     uint32_t thread_index;         // a zero based index identifying the thread
+#if defined(THREADED_RTS)
+    uint32_t idle_owner;           // if this thread's capability is idle in a
+                                   // parallel GC, the GC thread that marks its
+                                   // roots.  See Note [Locality-aware parallel GC]
+#endif
 
     bdescr * free_blocks;          // a buffer of free blocks for this thread
                                    //  during GC without accessing the block
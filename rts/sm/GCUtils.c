@@ -125,6 +125,20 @@ steal_todo_block (uint32_t g)
 {
     uint32_t n;
     bdescr *bd;
+    const uint32_t *victims = gct->cap->victims;
+
+    // With -ql, look for work to steal nearest first, see
+    // Note [Locality-aware parallel GC] in GC.c
+    if (RtsFlags.ParFlags.parGcLocality && victims != NULL) {
+        for (n = 0; n < getNumCapabilities() - 1; n++) {
+            if (victims[n] >= n_gc_threads) continue;
+            bd = stealWSDeque(gc_threads[victims[n]]->gens[g].todo_q);
+            if (bd) {
+                return bd;
+            }
+        }
+        return NULL;
+    }
 
     // look for work to steal
     for (n = 0; n < n_gc_threads; n++) {
@@ -96,6 +96,50 @@ typedef struct free_list {
 
 static free_list *free_list_head;
 static W_ mblock_high_watermark;
+
+/*
+  Note [Huge pages]
+  ~~~~~~~~~~~~~~~~~
+  With +RTS --huge-pages we ask the OS to back the heap with transparent huge
+  pages (madvise(MADV_HUGEPAGE) on Linux), typically 2MB each. A big heap then
+  needs far fewer TLB entries, which matters for the GC as it chases pointers
+  all over the heap.
+
+  The OS can only use a huge page for an aligned huge-page-sized range that
+  is committed as a whole, and decommitting part of a huge page splits it
+  into small pages again. Megablocks are only 1MB, so in this mode we commit
+  and decommit the address space in units of commit_granule (the huge page
+  size) rather than in megablocks:
+
+   * Everything between mblock_address_space.begin and the high watermark
+     is committed, except for the granules lying wholly within a range on
+     the free list, which are decommitted.
+
+   * Above the high watermark, the rest of the granule containing the
+     watermark is committed, and everything beyond it is decommitted.
+
+  So freeing megablocks decommits only the granules that become wholly free
+  once the freed range has been coalesced with its neighbours on the free
+  list, and allocating megablocks commits only the granules that were wholly
+  free before. The partially used granules at either end of a range stay
+  committed. At most one granule at each end of each free range is committed
+  but unused.
+
+  Without --huge-pages, commit_granule is MBLOCK_SIZE and all this reduces
+  to committing and decommitting exactly the megablocks we allocate and free.
+*/
+
+static W_ commit_granule = MBLOCK_SIZE;
+
+#define GRANULE_ROUND_DOWN(p) ((W_)(p) & ~(commit_granule - 1))
+#define GRANULE_ROUND_UP(p)   GRANULE_ROUND_DOWN((W_)(p) + commit_granule - 1)
+
+static void commitRange(W_ lo, W_ hi)
+{
+    if (lo < hi) {
+        osCommitMemory((void*)lo, hi - lo);
+    }
+}
 /*
  * it is quite important that these are in the same cache line as they
  * are both needed by HEAP_ALLOCED. Moreover, we need to ensure that they
@@ -164,6 +208,7 @@ static void *getReusableMBlocks(uint32_t n)
             continue;
 
         addr = (void*)iter->address;
+        W_ free_end = iter->address + iter->size;
         iter->address += size;
         iter->size -= size;
         if (iter->size == 0) {
@@ -183,7 +228,10 @@ static void *getReusableMBlocks(uint32_t n)
             stgFree(iter);
         }
 
-        osCommitMemory(addr, size);
+        // Commit the granules that were wholly free. See Note [Huge pages].
+        commitRange(GRANULE_ROUND_UP(addr),
+                    stg_min(GRANULE_ROUND_DOWN(free_end),
+                            GRANULE_ROUND_UP((W_)addr + size)));
         return addr;
     }
 
@@ -202,7 +250,11 @@ static void *getFreshMBlocks(uint32_t n)
         stg_exit(EXIT_HEAPOVERFLOW);
     }
 
-    osCommitMemory(addr, size);
+    // The granule containing the watermark is already committed.
+    // See Note [Huge pages].
+    commitRange(GRANULE_ROUND_UP(addr),
+                stg_min(GRANULE_ROUND_UP((W_)addr + size),
+                        mblock_address_space.end));
     mblock_high_watermark += size;
     return addr;
 }
@@ -220,13 +272,51 @@ static void *getCommittedMBlocks(uint32_t n)
     return p;
 }
 
+// Decommit the granules that become wholly free when the given range is
+// freed. This must be called before the range is added to the free list.
+// See Note [Huge pages].
+static void decommitFreedRange(W_ address, W_ size)
+{
+    W_ lo = address;
+    W_ hi = address + size;
+
+    if (commit_granule != MBLOCK_SIZE) {
+        // Find the extent of the free range after coalescing
+        W_ free_lo = address;
+        W_ free_hi = address + size;
+        for (struct free_list *iter = free_list_head; iter != NULL;
+             iter = iter->next) {
+            if (iter->address + iter->size == address) {
+                free_lo = iter->address;
+            }
+            if (iter->address == address + size) {
+                free_hi = iter->address + iter->size;
+            }
+        }
+
+        lo = stg_max(GRANULE_ROUND_UP(free_lo), GRANULE_ROUND_DOWN(address));
+        if (free_hi == mblock_high_watermark) {
+            // The watermark will drop, so the granule containing it is
+            // no longer needed.
+            hi = stg_min(GRANULE_ROUND_UP(free_hi), mblock_address_space.end);
+        } else {
+            hi = stg_min(GRANULE_ROUND_DOWN(free_hi),
+                         GRANULE_ROUND_UP(address + size));
+        }
+    }
+
+    if (lo < hi) {
+        osDecommitMemory((void*)lo, hi - lo);
+    }
+}
+
 static void decommitMBlocks(char *addr, uint32_t n)
 {
     struct free_list *iter, *prev;
     W_ size = MBLOCK_SIZE * (W_)n;
     W_ address = (W_)addr;
 
-    osDecommitMemory(addr, size);
+    decommitFreedRange(address, size);
 
     prev = NULL;
     for (iter = free_list_head; iter != NULL; iter = iter->next)
@@ -668,6 +758,15 @@ initMBlocks(void)
         mblock_address_space.begin = (W_)addr;
         mblock_address_space.end = (W_)addr + RtsFlags.GcFlags.addressSpaceSize;
         mblock_high_watermark = (W_)addr;
+
+        if (RtsFlags.GcFlags.hugePages) {
+            commit_granule = stg_max(osHugePageSize(), MBLOCK_SIZE);
+            // The granule containing the watermark is committed.
+            // See Note [Huge pages].
+            commitRange(mblock_high_watermark,
+                        stg_min(GRANULE_ROUND_UP(mblock_high_watermark),
+                                mblock_address_space.end));
+        }
     }
 #elif SIZEOF_VOID_P == 8
     memset(mblock_cache,0xff,sizeof(mblock_cache));
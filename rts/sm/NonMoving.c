@@ -27,6 +27,7 @@
 #include "StablePtr.h" // markStablePtrTable
 #include "Sanity.h"
 #include "Weak.h" // scheduleFinalizers
+#include "CheckUnload.h" // nonmovingPrepareUnloadCheck, nonmovingCheckUnload
 
 //#define NONCONCURRENT_SWEEP
 
@@ -758,6 +759,7 @@ void nonmovingExit(void)
 {
     if (! RtsFlags.GcFlags.useNonmoving) return;
     nonmovingExitConcurrentWorker();
+    nonmovingMarkExit();
 }
 
 /* Prepare the heap bitmaps and snapshot metadata for a mark */
@@ -861,6 +863,10 @@ void nonmovingCollect(StgWeak **dead_weaks, StgTSO **resurrected_threads, bool c
 
     nonmovingPrepareMark();
 
+    // See Note [Object unloading under the non-moving collector] in
+    // CheckUnload.c
+    nonmovingPrepareUnloadCheck();
+
     // N.B. These should have been cleared at the end of the last sweep.
     ASSERT(nonmoving_marked_large_objects == NULL);
     ASSERT(n_nonmoving_marked_large_blocks == 0);
@@ -1203,6 +1209,7 @@ concurrent_marking:
             // nonmoving_old_weak_ptr_list back to nonmoving_weak_ptr_list
             // such that their C finalizers can be run by hs_exit_.
             appendWeakList(&nonmoving_weak_ptr_list, nonmoving_old_weak_ptr_list);
+            nonmovingCheckUnload(false);
             goto finish;
         }
 
@@ -1267,6 +1274,12 @@ concurrent_marking:
     nonmovingGcCafs();
 #endif
 
+    // Unload object code that is no longer reachable. This must happen before
+    // the mutators resume, lest they load objects concurrently with the sweep.
+    // See Note [Object unloading under the non-moving collector] in
+    // CheckUnload.c.
+    nonmovingCheckUnload(true);
+
     ASSERT(mark_queue->top->head == 0);
     ASSERT(mark_queue->blocks->link == NULL);
 
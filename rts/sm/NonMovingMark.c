@@ -19,6 +19,7 @@
 #include "Trace.h"
 #include "HeapUtils.h"
 #include "Printer.h"
+#include "RtsUtils.h"
 #include "Schedule.h"
 #include "Weak.h"
 #include "Stats.h"
@@ -26,6 +27,8 @@
 #include "MarkWeak.h"
 #include "sm/Storage.h"
 #include "CNF.h"
+#include "WSDeque.h"
+#include "CheckUnload.h" // nonmoving_unload_mark_needed, nonmovingMarkObjectCode
 
 #if defined(THREADED_RTS)
 static void nonmovingResetUpdRemSetQueue (MarkQueue *rset);
@@ -100,11 +103,12 @@ memcount n_nonmoving_marked_compact_blocks = 0;
  * large object blocks when this is held. This ensures that the write barrier
  * (e.g. finish_upd_rem_set_mark) and the collector (mark_closure) don't try to
  * move the same large object to nonmoving_marked_large_objects more than once.
+ *
+ * We never mark a compact object eagerly in a write barrier, but with
+ * parallel marking several mark workers may race to mark the same compact
+ * object, so we take the lock for compact objects too.
  */
 static Mutex nonmoving_large_objects_mutex;
-// Note that we don't need a similar lock for compact objects because we never
-// mark a compact object eagerly in a write barrier; all compact objects are
-// marked by the mark thread, so there can't be any races here.
 #endif
 
 /*
@@ -259,12 +263,24 @@ StgWord nonmoving_write_barrier_enabled = false;
  */
 MarkQueue *current_mark_queue = NULL;
 
-/* Initialise update remembered set data structures */
+#if defined(THREADED_RTS)
+static void initMarkWorkers(void);
+static void exitMarkWorkers(void);
+#endif
+
+/* Initialise update remembered set data structures and the mark workers */
 void nonmovingMarkInit(void) {
 #if defined(THREADED_RTS)
     initMutex(&upd_rem_set_lock);
     initCondition(&upd_rem_set_flushed_cond);
     initMutex(&nonmoving_large_objects_mutex);
+    initMarkWorkers();
+#endif
+}
+
+void nonmovingMarkExit(void) {
+#if defined(THREADED_RTS)
+    exitMarkWorkers();
 #endif
 }
 
@@ -466,11 +482,23 @@ push (MarkQueue *q, const MarkQueueEnt *ent)
             // allocate a fresh block.
             ACQUIRE_SM_LOCK;
             bdescr *bd = allocGroup(MARK_QUEUE_BLOCKS);
-            bd->link = q->blocks;
+            RELEASE_SM_LOCK;
+            bdescr *full = q->blocks;
+#if defined(THREADED_RTS)
+            // Offer the full block to the other mark workers.
+            // See Note [Parallel nonmoving mark].
+            bdescr *older = full->link;
+            full->link = NULL;
+            if (q->shared != NULL && pushWSDeque(q->shared, full)) {
+                full = older;
+            } else {
+                full->link = older;
+            }
+#endif
+            bd->link = full;
             q->blocks = bd;
             q->top = (MarkQueueBlock *) bd->start;
             q->top->head = 0;
-            RELEASE_SM_LOCK;
         }
     }
 
@@ -959,6 +987,8 @@ void initMarkQueue (MarkQueue *queue)
 {
     init_mark_queue_(queue);
     queue->is_upd_rem_set = false;
+    queue->shared = NULL;
+    queue->live_words = 0;
 }
 
 /* Must hold sm_mutex. */
@@ -966,6 +996,8 @@ void nonmovingInitUpdRemSet (UpdRemSet *rset)
 {
     init_mark_queue_(&rset->queue);
     rset->queue.is_upd_rem_set = true;
+    rset->queue.shared = NULL;
+    rset->queue.live_words = 0;
 }
 
 #if defined(THREADED_RTS)
@@ -1291,6 +1323,12 @@ mark_closure (MarkQueue *queue, const StgClosure *p0, StgClosure **origin)
                                 (StgClosure **) &(obj)->field)
 
     if (!HEAP_ALLOCED_GC(p)) {
+        // See Note [Object unloading under the non-moving collector] in
+        // CheckUnload.c
+        if (RTS_UNLIKELY(nonmoving_unload_mark_needed)) {
+            nonmovingMarkObjectCode(p);
+        }
+
         const StgInfoTable *info = get_itbl(p);
         StgHalfWord type = info->type;
 
@@ -1391,12 +1429,16 @@ mark_closure (MarkQueue *queue, const StgClosure *p0, StgClosure **origin)
             }
 
             if (! (flags & BF_MARKED)) {
-                dbl_link_remove(bd, &nonmoving_compact_objects);
-                dbl_link_onto(bd, &nonmoving_marked_compact_objects);
-                StgWord blocks = str->totalW / BLOCK_SIZE_W;
-                n_nonmoving_compact_blocks -= blocks;
-                n_nonmoving_marked_compact_blocks += blocks;
-                block_set_flag(bd, BF_MARKED);
+                ACQUIRE_LOCK(&nonmoving_large_objects_mutex);
+                if (! (block_get_flags(bd) & BF_MARKED)) {
+                    dbl_link_remove(bd, &nonmoving_compact_objects);
+                    dbl_link_onto(bd, &nonmoving_marked_compact_objects);
+                    StgWord blocks = str->totalW / BLOCK_SIZE_W;
+                    n_nonmoving_compact_blocks -= blocks;
+                    n_nonmoving_marked_compact_blocks += blocks;
+                    block_set_flag(bd, BF_MARKED);
+                }
+                RELEASE_LOCK(&nonmoving_large_objects_mutex);
             }
 
             // N.B. the object being marked is in a compact region so by
@@ -1744,10 +1786,12 @@ mark_closure (MarkQueue *queue, const StgClosure *p0, StgClosure **origin)
         /* Marking a large object isn't idempotent since we move it to
          * nonmoving_marked_large_objects; to ensure that we don't repeatedly
          * mark a large object, we only set BF_MARKED on large objects in the
-         * nonmoving heap while holding nonmoving_large_objects_mutex
+         * nonmoving heap while holding nonmoving_large_objects_mutex. Another
+         * mark worker may have marked it since we read bd_flags, so check
+         * again under the lock (see Note [Parallel nonmoving mark]).
          */
         ACQUIRE_LOCK(&nonmoving_large_objects_mutex);
-        if (! (bd_flags & BF_MARKED)) {
+        if (! (block_get_flags(bd) & BF_MARKED)) {
             // Remove the object from nonmoving_large_objects and link it to
             // nonmoving_marked_large_objects
             dbl_link_remove(bd, &nonmoving_large_objects);
@@ -1762,7 +1806,13 @@ mark_closure (MarkQueue *queue, const StgClosure *p0, StgClosure **origin)
         struct NonmovingSegment *seg = nonmovingGetSegment((StgPtr) p);
         nonmoving_block_idx block_idx = nonmovingGetBlockIdx((StgPtr) p);
         nonmovingSetMark(seg, block_idx);
-        nonmoving_segment_live_words += nonmovingSegmentBlockSize(seg) / sizeof(W_);
+        memcount words = nonmovingSegmentBlockSize(seg) / sizeof(W_);
+        if (queue->shared != NULL) {
+            // A parallel mark worker; see Note [Parallel nonmoving mark].
+            queue->live_words += words;
+        } else {
+            nonmoving_segment_live_words += words;
+        }
     }
 
     // If we found a indirection to shortcut keep going.
@@ -1781,6 +1831,439 @@ done:
     }
 }
 
+/* Mark a single entry popped from the mark queue. */
+STATIC_INLINE void
+mark_entry (MarkQueue *queue, MarkQueueEnt *ent)
+{
+    switch (nonmovingMarkQueueEntryType(ent)) {
+    case MARK_CLOSURE:
+        mark_closure(queue, ent->mark_closure.p, ent->mark_closure.origin);
+        break;
+    case MARK_ARRAY: {
+        const StgMutArrPtrs *arr = (const StgMutArrPtrs *)
+            UNTAG_CLOSURE((StgClosure *) ent->mark_array.array);
+        StgWord start = ent->mark_array.start_index;
+        StgWord end = start + MARK_ARRAY_CHUNK_LENGTH;
+        if (end < arr->ptrs) {
+            // There is more to be marked after this chunk.
+            markQueuePushArray(queue, arr, end);
+        } else {
+            end = arr->ptrs;
+        }
+        for (StgWord i = start; i < end; i++) {
+            StgClosure *c = ACQUIRE_LOAD(&arr->payload[i]);
+            markQueuePushClosure_(queue, c);
+        }
+        break;
+    }
+    case NULL_ENTRY:
+        barf("mark_entry: NULL_ENTRY");
+    }
+}
+
+/* Replace the (empty) blocks of a mark queue with the given chain of blocks.
+ */
+static void
+markQueueTakeBlocks (MarkQueue *queue, bdescr *blocks)
+{
+    bdescr *old = queue->blocks;
+    ASSERT(old->link == NULL);
+    ASSERT(queue->top->head == 0);
+    queue->blocks = blocks;
+    queue->top = (MarkQueueBlock *) blocks->start;
+    freeGroup_lock(old);
+}
+
+/* Move the global update remembered set to the given mark queue, which must
+ * be empty. Returns false if there was nothing to take.
+ */
+static bool
+takeUpdRemSet (MarkQueue *queue)
+{
+    // N.B. This must be atomic since we have not yet taken
+    // upd_rem_set_lock.
+    if (RELAXED_LOAD(&upd_rem_set_block_list) == NULL) {
+        return false;
+    }
+
+    ACQUIRE_LOCK(&upd_rem_set_lock);
+    bdescr *blocks = upd_rem_set_block_list;
+    upd_rem_set_block_list = NULL;
+    RELEASE_LOCK(&upd_rem_set_lock);
+
+    // Another mark worker may have beaten us to it.
+    if (blocks == NULL) {
+        return false;
+    }
+
+#if defined(THREADED_RTS)
+    // Offer all but the first block to the other mark workers.
+    if (queue->shared != NULL) {
+        bdescr *rest = blocks->link;
+        blocks->link = NULL;
+        while (rest != NULL) {
+            bdescr *next = rest->link;
+            rest->link = NULL;
+            if (!pushWSDeque(queue->shared, rest)) {
+                rest->link = blocks->link;
+                blocks->link = rest;
+            }
+            rest = next;
+        }
+    }
+#endif
+
+    markQueueTakeBlocks(queue, blocks);
+    return true;
+}
+
+/* Note [Parallel nonmoving mark]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * With +RTS --nonmoving-mark-threads=N (N > 1) the concurrent mark is
+ * performed by N mark workers: the thread running the collection (worker 0)
+ * and N-1 helper threads which we start in nonmovingMarkInit and which sleep
+ * between mark passes.
+ *
+ * Each worker marks from its own MarkQueue. Work is shared at the granularity
+ * of mark queue blocks (MARK_QUEUE_BLOCKS blocks of entries): when a worker's
+ * queue fills a block, push() pushes the full block onto the worker's WSDeque
+ * (MarkQueue.shared) rather than chaining it onto the queue. A worker that
+ * runs out of work first takes back blocks from its own deque, then steals
+ * the oldest block from another worker's deque, and finally takes the global
+ * update remembered set (sharing all but one of its blocks in the same way).
+ *
+ * Termination follows the parallel copying GC: mark_workers_running counts
+ * the workers which may still produce work. A worker only decrements it once
+ * its queue and its deque are both empty, so when it reaches zero there is no
+ * work left in any deque and the pass is done. Update remembered set blocks
+ * flushed by the mutators after this point are picked up by the next pass, as
+ * in the sequential case.
+ *
+ * Marking itself was already safe against concurrent marking by the mutators'
+ * write barrier; the new races are between mark workers:
+ *
+ *  - Two workers may both find an object unmarked and trace it. This is
+ *    harmless: tracing is idempotent, apart from the live word count. To
+ *    avoid contention on nonmoving_segment_live_words each worker accumulates
+ *    live words in its queue (MarkQueue.live_words) and we add them up at the
+ *    end of the pass, so a race may over-count an object; this only affects
+ *    the live data estimate.
+ *
+ *  - Large and compact objects are moved between lists when marked, so this
+ *    must happen only once. Two workers tracing the same large object may
+ *    both have seen it unmarked, so the move is done under
+ *    nonmoving_large_objects_mutex, and only if BF_MARKED is still clear once
+ *    the lock is held.
+ *
+ *  - STACKs are claimed with a CAS on StgStack.marking, and static objects
+ *    under the storage manager lock (bump_static_flag).
+ *
+ * Marking with a limited budget (during the post-mark synchronisation, see
+ * Note [Sync phase marking budget] in NonMoving.c) is always done by worker 0
+ * alone, as are passes which start with an empty mark queue, since for these
+ * waking the helpers would cost more than it saves.
+ *
+ * The workers are also used for other jobs, such as the sweep (see
+ * nonmovingSweep), through nonmovingRunWorkers.
+ */
+
+#if defined(THREADED_RTS)
+
+// Maximum number of blocks in each worker's deque. If it fills, full blocks
+// are chained onto the worker's own queue as in the sequential mark.
+#define MARK_WORKER_DEQUE_SIZE 1024
+
+typedef struct MarkWorker_ {
+    uint32_t no;
+
+    // The worker's mark queue. For worker 0 this is the queue passed to
+    // nonmovingMark; for the helpers it is own_queue, which only holds
+    // blocks during a pass.
+    MarkQueue *queue;
+    MarkQueue own_queue;
+
+    // Full mark queue blocks which other workers may steal.
+    WSDeque *shared;
+
+    // Results of the last pass.
+    StgWord32 marked;
+    memcount live_words;
+
+    OSThreadId thread;
+} MarkWorker;
+
+static uint32_t n_mark_workers = 1;
+static MarkWorker *mark_workers = NULL;
+static StgWord32 *mark_worker_counts = NULL;
+
+// Protects mark_workers_job, mark_workers_pass, mark_workers_active and
+// mark_workers_stop.
+static Mutex mark_workers_lock;
+static Condition mark_workers_start_cond;
+static Condition mark_workers_done_cond;
+
+// The job of the current pass, and a counter incremented to start a pass.
+static NonmovingWorkerJob mark_workers_job = NULL;
+static StgWord mark_workers_pass = 0;
+// Number of helpers which have not yet finished the current pass.
+static uint32_t mark_workers_active = 0;
+static bool mark_workers_stop = false;
+
+// Number of workers which may still produce work in the current pass.
+// Accessed atomically.
+static StgWord mark_workers_running = 0;
+
+static bool
+anyMarkWork (void)
+{
+    for (uint32_t i = 0; i < n_mark_workers; i++) {
+        if (!looksEmptyWSDeque(mark_workers[i].shared)) {
+            return true;
+        }
+    }
+    return RELAXED_LOAD(&upd_rem_set_block_list) != NULL;
+}
+
+/* Refill the (empty) queue of the given worker. Returns false if there is no
+ * work to be found.
+ */
+static bool
+findMarkWork (MarkWorker *w)
+{
+    bdescr *bd = popWSDeque(w->shared);
+    for (uint32_t i = 1; bd == NULL && i < n_mark_workers; i++) {
+        bd = stealWSDeque(mark_workers[(w->no + i) % n_mark_workers].shared);
+    }
+    if (bd != NULL) {
+        markQueueTakeBlocks(w->queue, bd);
+        return true;
+    }
+    return takeUpdRemSet(w->queue);
+}
+
+/* Called by a worker which has run out of work. Returns true if the worker
+ * found more work, or false if the pass is finished.
+ */
+static bool
+markWorkerIdle (MarkWorker *w)
+{
+    atomic_dec(&mark_workers_running, 1);
+    uint32_t spins = 0;
+    while (true) {
+        if (anyMarkWork()) {
+            atomic_inc(&mark_workers_running, 1);
+            if (findMarkWork(w)) {
+                return true;
+            }
+            atomic_dec(&mark_workers_running, 1);
+        }
+        if (SEQ_CST_LOAD(&mark_workers_running) == 0) {
+            return false;
+        }
+        if (++spins < 1000) {
+            busy_wait_nop();
+        } else {
+            yieldThread();
+        }
+    }
+}
+
+static void
+markWorkerLoop (MarkWorker *w)
+{
+    MarkQueue *queue = w->queue;
+    StgWord32 count = 0;
+    while (true) {
+        MarkQueueEnt ent = markQueuePop(queue);
+        if (nonmovingMarkQueueEntryType(&ent) == NULL_ENTRY) {
+            if (findMarkWork(w) || markWorkerIdle(w)) {
+                continue;
+            }
+            break;
+        }
+        count++;
+        mark_entry(queue, &ent);
+    }
+    ASSERT(looksEmptyWSDeque(w->shared));
+    w->marked = count;
+    w->live_words = queue->live_words;
+    queue->live_words = 0;
+}
+
+static void
+markWorkerJob (uint32_t worker_no)
+{
+    MarkWorker *w = &mark_workers[worker_no];
+    // Worker 0 marks from the queue passed to nonmovingMark, which
+    // nonmovingMarkParallel has set up; the helpers use a fresh queue.
+    if (worker_no != 0) {
+        ACQUIRE_SM_LOCK;
+        initMarkQueue(w->queue);
+        RELEASE_SM_LOCK;
+        w->queue->shared = w->shared;
+    }
+    markWorkerLoop(w);
+    if (worker_no != 0) {
+        freeMarkQueue(w->queue);
+        w->queue->blocks = NULL;
+    }
+}
+
+static void *
+nonmovingWorkerThread (void *data)
+{
+    MarkWorker *w = (MarkWorker *) data;
+    StgWord pass = 0;
+
+    ACQUIRE_LOCK(&mark_workers_lock);
+    while (true) {
+        while (mark_workers_pass == pass && !mark_workers_stop) {
+            waitCondition(&mark_workers_start_cond, &mark_workers_lock);
+        }
+        if (mark_workers_stop) {
+            break;
+        }
+        pass = mark_workers_pass;
+        NonmovingWorkerJob job = mark_workers_job;
+        RELEASE_LOCK(&mark_workers_lock);
+
+        // The collector thread's CPU time is accounted by
+        // stat_{start,end}NonmovingGc, but we must account for the helpers.
+        Time start_cpu = getCurrentThreadCPUTime();
+        job(w->no);
+        stat_nonmovingWorkerCpu(getCurrentThreadCPUTime() - start_cpu);
+
+        ACQUIRE_LOCK(&mark_workers_lock);
+        if (--mark_workers_active == 0) {
+            signalCondition(&mark_workers_done_cond);
+        }
+    }
+    RELEASE_LOCK(&mark_workers_lock);
+    return NULL;
+}
+
+static void
+initMarkWorkers (void)
+{
+    n_mark_workers = RtsFlags.GcFlags.nonmovingMarkThreads;
+    if (n_mark_workers <= 1) {
+        n_mark_workers = 1;
+        return;
+    }
+
+    debugTrace(DEBUG_nonmoving_gc, "Starting %d mark workers", n_mark_workers);
+    initMutex(&mark_workers_lock);
+    initCondition(&mark_workers_start_cond);
+    initCondition(&mark_workers_done_cond);
+    mark_workers_pass = 0;
+    mark_workers_stop = false;
+    mark_workers = stgMallocBytes(n_mark_workers * sizeof(MarkWorker),
+                                  "initMarkWorkers");
+    mark_worker_counts = stgMallocBytes(n_mark_workers * sizeof(StgWord32),
+                                        "initMarkWorkers");
+    for (uint32_t i = 0; i < n_mark_workers; i++) {
+        MarkWorker *w = &mark_workers[i];
+        w->no = i;
+        w->queue = &w->own_queue;
+        w->own_queue.blocks = NULL;
+        w->shared = newWSDeque(MARK_WORKER_DEQUE_SIZE);
+        w->marked = 0;
+        w->live_words = 0;
+    }
+
+    for (uint32_t i = 1; i < n_mark_workers; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "nonmoving-mark-%" FMT_Word32, i);
+        if (createOSThread(&mark_workers[i].thread, name,
+                           nonmovingWorkerThread, &mark_workers[i]) != 0) {
+            barf("initMarkWorkers: failed to spawn mark worker: %s", strerror(errno));
+        }
+    }
+}
+
+static void
+exitMarkWorkers (void)
+{
+    if (n_mark_workers <= 1) {
+        return;
+    }
+
+    ACQUIRE_LOCK(&mark_workers_lock);
+    mark_workers_stop = true;
+    broadcastCondition(&mark_workers_start_cond);
+    RELEASE_LOCK(&mark_workers_lock);
+    for (uint32_t i = 1; i < n_mark_workers; i++) {
+        joinOSThread(mark_workers[i].thread);
+    }
+
+    for (uint32_t i = 0; i < n_mark_workers; i++) {
+        freeWSDeque(mark_workers[i].shared);
+    }
+    stgFree(mark_workers);
+    stgFree(mark_worker_counts);
+    mark_workers = NULL;
+    mark_worker_counts = NULL;
+    n_mark_workers = 1;
+    closeMutex(&mark_workers_lock);
+    closeCondition(&mark_workers_start_cond);
+    closeCondition(&mark_workers_done_cond);
+}
+
+uint32_t
+nonmovingWorkerCount (void)
+{
+    return n_mark_workers;
+}
+
+void
+nonmovingRunWorkers (NonmovingWorkerJob job)
+{
+    ASSERT(n_mark_workers > 1);
+    ACQUIRE_LOCK(&mark_workers_lock);
+    mark_workers_job = job;
+    mark_workers_active = n_mark_workers - 1;
+    mark_workers_pass++;
+    broadcastCondition(&mark_workers_start_cond);
+    RELEASE_LOCK(&mark_workers_lock);
+
+    job(0);
+
+    ACQUIRE_LOCK(&mark_workers_lock);
+    while (mark_workers_active > 0) {
+        waitCondition(&mark_workers_done_cond, &mark_workers_lock);
+    }
+    mark_workers_job = NULL;
+    RELEASE_LOCK(&mark_workers_lock);
+}
+
+/* Mark the given queue to completion using all of the mark workers. */
+static void
+nonmovingMarkParallel (MarkQueue *queue)
+{
+    traceConcMarkBegin();
+    debugTrace(DEBUG_nonmoving_gc, "Starting parallel mark pass");
+
+    MarkWorker *w0 = &mark_workers[0];
+    w0->queue = queue;
+    queue->shared = w0->shared;
+    queue->live_words = 0;
+
+    SEQ_CST_STORE(&mark_workers_running, n_mark_workers);
+    nonmovingRunWorkers(markWorkerJob);
+    queue->shared = NULL;
+
+    StgWord32 count = 0;
+    for (uint32_t i = 0; i < n_mark_workers; i++) {
+        count += mark_workers[i].marked;
+        mark_worker_counts[i] = mark_workers[i].marked;
+        nonmoving_segment_live_words += mark_workers[i].live_words;
+    }
+    debugTrace(DEBUG_nonmoving_gc, "Finished parallel mark pass: %d", count);
+    traceConcMarkEnd(count, n_mark_workers, mark_worker_counts);
+}
+
+#endif /* THREADED_RTS */
+
 /* This is the main mark loop.
  * Invariants:
  *
@@ -1794,6 +2277,16 @@ done:
 GNUC_ATTR_HOT void
 nonmovingMark (MarkBudget* budget, MarkQueue *queue)
 {
+#if defined(THREADED_RTS)
+    // See Note [Parallel nonmoving mark].
+    if (n_mark_workers > 1
+        && *budget == UNLIMITED_MARK_BUDGET
+        && !markQueueIsEmpty(queue)) {
+        nonmovingMarkParallel(queue);
+        return;
+    }
+#endif
+
     traceConcMarkBegin();
     debugTrace(DEBUG_nonmoving_gc, "Starting mark pass");
     uint64_t count = 0;
@@ -1807,48 +2300,14 @@ nonmovingMark (MarkBudget* budget, MarkQueue *queue)
 
         MarkQueueEnt ent = markQueuePop(queue);
 
-        switch (nonmovingMarkQueueEntryType(&ent)) {
-        case MARK_CLOSURE:
-            mark_closure(queue, ent.mark_closure.p, ent.mark_closure.origin);
-            break;
-        case MARK_ARRAY: {
-            const StgMutArrPtrs *arr = (const StgMutArrPtrs *)
-                UNTAG_CLOSURE((StgClosure *) ent.mark_array.array);
-            StgWord start = ent.mark_array.start_index;
-            StgWord end = start + MARK_ARRAY_CHUNK_LENGTH;
-            if (end < arr->ptrs) {
-                // There is more to be marked after this chunk.
-                markQueuePushArray(queue, arr, end);
-            } else {
-                end = arr->ptrs;
-            }
-            for (StgWord i = start; i < end; i++) {
-                StgClosure *c = ACQUIRE_LOAD(&arr->payload[i]);
-                markQueuePushClosure_(queue, c);
-            }
-            break;
-        }
-        case NULL_ENTRY:
-            // Perhaps the update remembered set has more to mark...
-            // N.B. This must be atomic since we have not yet taken
-            // upd_rem_set_lock.
-            if (RELAXED_LOAD(&upd_rem_set_block_list) != NULL) {
-                ACQUIRE_LOCK(&upd_rem_set_lock);
-                bdescr *old = queue->blocks;
-                queue->blocks = upd_rem_set_block_list;
-                queue->top = (MarkQueueBlock *) queue->blocks->start;
-                upd_rem_set_block_list = NULL;
-                RELEASE_LOCK(&upd_rem_set_lock);
-
-                ACQUIRE_SM_LOCK;
-                freeGroup(old);
-                RELEASE_SM_LOCK;
-            } else {
-                // Nothing more to do
-                debugTrace(DEBUG_nonmoving_gc, "Finished mark pass: %d", count);
-                traceConcMarkEnd(count);
-                return;
-            }
+        if (nonmovingMarkQueueEntryType(&ent) != NULL_ENTRY) {
+            mark_entry(queue, &ent);
+        } else if (!takeUpdRemSet(queue)) {
+            // The update remembered set had nothing more to mark either, so
+            // there is nothing more to do
+            debugTrace(DEBUG_nonmoving_gc, "Finished mark pass: %d", count);
+            traceConcMarkEnd(count, 0, NULL);
+            return;
         }
     }
 }
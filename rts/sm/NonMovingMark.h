@@ -94,6 +94,13 @@ typedef struct MarkQueue_ {
     // Is this a mark queue or a capability-local update remembered set?
     bool is_upd_rem_set;
 
+    // When this queue belongs to a parallel mark worker: the deque to which
+    // full blocks are pushed so that other workers can steal them, and the
+    // live words marked by this worker. NULL otherwise.
+    // See Note [Parallel nonmoving mark] in NonMovingMark.c.
+    struct WSDeque_ *shared;
+    memcount live_words;
+
 #if MARK_PREFETCH_QUEUE_DEPTH > 0
     // A ring-buffer of entries which we will mark next
     MarkQueueEnt prefetch_queue[MARK_PREFETCH_QUEUE_DEPTH];
@@ -146,6 +153,20 @@ extern bdescr *upd_rem_set_block_list;
 
 
 void nonmovingMarkInit(void);
+void nonmovingMarkExit(void);
+
+#if defined(THREADED_RTS)
+/* The nonmoving collector's pool of worker threads, sized by
+ * --nonmoving-mark-threads. See Note [Parallel nonmoving mark].
+ *
+ * nonmovingRunWorkers runs the job on every worker, with the calling thread
+ * as worker 0, and returns once they have all finished. It must only be used
+ * when nonmovingWorkerCount() > 1.
+ */
+typedef void (*NonmovingWorkerJob)(uint32_t worker_no);
+uint32_t nonmovingWorkerCount(void);
+void nonmovingRunWorkers(NonmovingWorkerJob job);
+#endif
 
 void nonmovingInitUpdRemSet(UpdRemSet *rset);
 void updateRemembSetPushClosure(Capability *cap, StgClosure *p);
@@ -17,6 +17,8 @@
 #include "Trace.h"
 #include "StableName.h"
 #include "CNF.h" // compactFree
+#include "Stats.h"
+#include "RtsUtils.h"
 
 // On which list should a particular segment be placed?
 enum SweepResult {
@@ -129,32 +131,178 @@ nonmovingClearSegmentFreeBlocks(struct NonmovingSegment* seg)
     }
 }
 
-GNUC_ATTR_HOT void nonmovingSweep(void)
+/* Put a swept segment on the list it belongs to */
+static void
+nonmovingPushSweptSegment(struct NonmovingSegment *seg, enum SweepResult ret)
 {
-    while (nonmovingHeap.sweep_list) {
-        struct NonmovingSegment *seg = nonmovingHeap.sweep_list;
+    switch (ret) {
+    case SEGMENT_FREE:
+        IF_DEBUG(sanity, nonmovingClearSegment(seg));
+        nonmovingPushFreeSegment(seg);
+        break;
+    case SEGMENT_PARTIAL:
+        IF_DEBUG(sanity, nonmovingClearSegmentFreeBlocks(seg));
+        nonmovingPushActiveSegment(seg);
+        break;
+    case SEGMENT_FILLED:
+        nonmovingPushFilledSegment(seg);
+        break;
+    default:
+        barf("nonmovingSweep: weird sweep return: %d\n", ret);
+    }
+}
 
-        // Pushing the segment to one of the free/active/filled segments
-        // updates the link field, so update sweep_list here
-        nonmovingHeap.sweep_list = seg->link;
+#if defined(THREADED_RTS)
+
+/* Parallel sweep
+ * ~~~~~~~~~~~~~~
+ * With more than one nonmoving collector worker (see Note [Parallel nonmoving
+ * mark] in NonMovingMark.c) the workers sweep the segments of the sweep list
+ * in parallel. Each worker pops segments off the sweep list with a CAS (no
+ * segment is pushed back onto the sweep list while we are sweeping, so there
+ * is no ABA problem) and classifies them into worker-local free, active and
+ * filled lists, per allocator. Every SWEEP_FLUSH_SEGMENTS segments, and at
+ * the end, the worker splices its local lists onto the global lists, each
+ * with a single CAS. These are the same lock-free lists that the mutators
+ * allocate from concurrently, so freed segments become available for
+ * allocation while the sweep is still going.
+ */
+
+#define SWEEP_FLUSH_SEGMENTS 256
+
+// A worker-local list of swept segments
+struct SweptList {
+    struct NonmovingSegment *head;
+    struct NonmovingSegment *tail;
+};
+
+struct SweptLists {
+    struct SweptList free;
+    struct SweptList *active;   // indexed by allocator
+    struct SweptList *filled;   // indexed by allocator
+    uint32_t count;
+};
+
+static struct NonmovingSegment *
+takeSweepSegment(void)
+{
+    while (true) {
+        struct NonmovingSegment *seg = ACQUIRE_LOAD(&nonmovingHeap.sweep_list);
+        if (seg == NULL) {
+            return NULL;
+        }
+        struct NonmovingSegment *next = RELAXED_LOAD(&seg->link);
+        if (cas((StgVolatilePtr) &nonmovingHeap.sweep_list,
+                (StgWord) seg, (StgWord) next) == (StgWord) seg) {
+            return seg;
+        }
+    }
+}
+
+static void
+consSweptList(struct SweptList *list, struct NonmovingSegment *seg)
+{
+    seg->link = list->head;
+    list->head = seg;
+    if (list->tail == NULL) {
+        list->tail = seg;
+    }
+}
+
+/* Splice a worker-local list onto the front of a global segment list */
+static void
+spliceSweptList(struct NonmovingSegment **global, struct SweptList *list)
+{
+    if (list->head == NULL) {
+        return;
+    }
+    while (true) {
+        struct NonmovingSegment *old = RELAXED_LOAD(global);
+        RELAXED_STORE(&list->tail->link, old);
+        if (cas((StgVolatilePtr) global, (StgWord) old, (StgWord) list->head)
+              == (StgWord) old) {
+            break;
+        }
+    }
+    list->head = NULL;
+    list->tail = NULL;
+}
 
-        enum SweepResult ret = nonmovingSweepSegment(seg);
+static void
+flushSweptLists(struct SweptLists *lists)
+{
+    spliceSweptList(&nonmovingHeap.free, &lists->free);
+    for (unsigned int i = 0; i < nonmoving_alloca_cnt; i++) {
+        struct NonmovingAllocator *alloc = &nonmovingHeap.allocators[i];
+        spliceSweptList(&alloc->active, &lists->active[i]);
+        spliceSweptList(&alloc->filled, &lists->filled[i]);
+    }
+    lists->count = 0;
+}
 
-        switch (ret) {
+static void
+nonmovingSweepWorker(uint32_t worker_no)
+{
+    Time start = getProcessElapsedTime();
+    struct SweptLists lists;
+    lists.free.head = NULL;
+    lists.free.tail = NULL;
+    lists.active = stgCallocBytes(nonmoving_alloca_cnt, sizeof(struct SweptList),
+                                  "nonmovingSweepWorker");
+    lists.filled = stgCallocBytes(nonmoving_alloca_cnt, sizeof(struct SweptList),
+                                  "nonmovingSweepWorker");
+    lists.count = 0;
+
+    struct NonmovingSegment *seg;
+    while ((seg = takeSweepSegment()) != NULL) {
+        uint8_t alloca_idx =
+          nonmovingAllocatorForSize(nonmovingSegmentBlockSize(seg));
+        switch (nonmovingSweepSegment(seg)) {
         case SEGMENT_FREE:
             IF_DEBUG(sanity, nonmovingClearSegment(seg));
-            nonmovingPushFreeSegment(seg);
+            SET_SEGMENT_STATE(seg, FREE);
+            consSweptList(&lists.free, seg);
             break;
         case SEGMENT_PARTIAL:
             IF_DEBUG(sanity, nonmovingClearSegmentFreeBlocks(seg));
-            nonmovingPushActiveSegment(seg);
+            SET_SEGMENT_STATE(seg, ACTIVE);
+            consSweptList(&lists.active[alloca_idx], seg);
             break;
         case SEGMENT_FILLED:
-            nonmovingPushFilledSegment(seg);
+            SET_SEGMENT_STATE(seg, FILLED);
+            consSweptList(&lists.filled[alloca_idx], seg);
             break;
-        default:
-            barf("nonmovingSweep: weird sweep return: %d\n", ret);
         }
+        if (++lists.count == SWEEP_FLUSH_SEGMENTS) {
+            flushSweptLists(&lists);
+        }
+    }
+    flushSweptLists(&lists);
+
+    stgFree(lists.active);
+    stgFree(lists.filled);
+    stat_nonmovingSweepWorker(worker_no, getProcessElapsedTime() - start);
+}
+
+#endif
+
+GNUC_ATTR_HOT void nonmovingSweep(void)
+{
+#if defined(THREADED_RTS)
+    if (nonmovingWorkerCount() > 1) {
+        nonmovingRunWorkers(nonmovingSweepWorker);
+        return;
+    }
+#endif
+
+    while (nonmovingHeap.sweep_list) {
+        struct NonmovingSegment *seg = nonmovingHeap.sweep_list;
+
+        // Pushing the segment to one of the free/active/filled segments
+        // updates the link field, so update sweep_list here
+        nonmovingHeap.sweep_list = seg->link;
+
+        nonmovingPushSweptSegment(seg, nonmovingSweepSegment(seg));
     }
 }
 
@@ -392,14 +540,14 @@ void nonmovingSweepStableNameTable(void)
 
     stableNameLock();
     FOR_EACH_STABLE_NAME(
-        p, {
+        sn, p, {
             if (p->sn_obj != NULL) {
                 if (!is_alive((StgClosure*)p->sn_obj)) {
                     p->sn_obj = NULL; // Just to make an assertion happy
-                    freeSnEntry(p);
+                    freeSnEntry(sn);
                 } else if (p->addr != NULL) {
                     if (!is_alive((StgClosure*)p->addr)) {
-                        p->addr = NULL;
+                        clearSnEntryAddr(sn);
                     }
                 }
             }
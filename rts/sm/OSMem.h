@@ -21,7 +21,10 @@ bool osBuiltWithNumaSupport(void); // See #14956
 bool osNumaAvailable(void);
 uint32_t osNumaNodes(void);
 uint64_t osNumaMask(void);
+uint32_t osNumaDistance(uint32_t from, uint32_t to);
 void osBindMBlocksToNode(void *addr, StgWord size, uint32_t node);
+W_ osHugePageSize(void);
+StgWord64 osHugePageBytes(void);
 
 INLINE_HEADER size_t
 roundDownToPage (size_t x)
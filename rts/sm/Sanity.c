@@ -1107,6 +1107,9 @@ findMemoryLeak (void)
         markBlocks(getCapability(i)->pinned_object_block);
         markBlocks(getCapability(i)->pinned_object_blocks);
         markBlocks(getCapability(i)->upd_rem_set.queue.blocks);
+#if defined(THREADED_RTS)
+        markBlockCache(&getCapability(i)->block_cache);
+#endif
     }
 
     if (RtsFlags.GcFlags.useNonmoving) {
@@ -1254,7 +1257,7 @@ memInventory (bool show)
   W_ gen_blocks[RtsFlags.GcFlags.generations];
   W_ nursery_blocks = 0, free_pinned_blocks = 0, retainer_blocks = 0,
       arena_blocks = 0, exec_blocks = 0, gc_free_blocks = 0,
-      upd_rem_set_blocks = 0;
+      upd_rem_set_blocks = 0, block_cache_blocks = 0;
   W_ live_blocks = 0, free_blocks = 0;
   bool leak;
 
@@ -1314,13 +1317,20 @@ memInventory (bool show)
   }
   upd_rem_set_blocks += countBlocks(upd_rem_set_block_list);
 
+#if defined(THREADED_RTS)
+  // count the blocks in the per-capability block caches
+  for (i = 0; i < getNumCapabilities(); ++i) {
+      block_cache_blocks += countBlockCache(&getCapability(i)->block_cache);
+  }
+#endif
+
   live_blocks = 0;
   for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
       live_blocks += gen_blocks[g];
   }
   live_blocks += nursery_blocks +
                + retainer_blocks + arena_blocks + exec_blocks + gc_free_blocks
-               + upd_rem_set_blocks + free_pinned_blocks;
+               + upd_rem_set_blocks + free_pinned_blocks + block_cache_blocks;
 
 #define MB(n) (((double)(n) * BLOCK_SIZE_W) / ((1024*1024)/sizeof(W_)))
 
@@ -1353,6 +1363,8 @@ memInventory (bool show)
                  free_blocks, MB(free_blocks));
       debugBelch("  UpdRemSet    : %5" FMT_Word " blocks (%6.1lf MB)\n",
                  upd_rem_set_blocks, MB(upd_rem_set_blocks));
+      debugBelch("  block cache  : %5" FMT_Word " blocks (%6.1lf MB)\n",
+                 block_cache_blocks, MB(block_cache_blocks));
       debugBelch("  total        : %5" FMT_Word " blocks (%6.1lf MB)\n",
                  live_blocks + free_blocks, MB(live_blocks+free_blocks));
       if (leak) {
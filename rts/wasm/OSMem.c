@@ -82,3 +82,18 @@ uint64_t osNumaMask(void)
 {
     return 1;
 }
+
+uint32_t osNumaDistance(uint32_t from, uint32_t to)
+{
+    return from == to ? 10 : 20;
+}
+
+W_ osHugePageSize(void)
+{
+    return 0;
+}
+
+StgWord64 osHugePageBytes(void)
+{
+    return 0;
+}
@@ -481,6 +481,18 @@ void osReleaseHeapMemory (void)
 
 #endif
 
+W_ osHugePageSize(void)
+{
+    // Large pages on Windows need the SeLockMemoryPrivilege and cannot be
+    // decommitted, so we don't use them for the heap.
+    return 0;
+}
+
+StgWord64 osHugePageBytes(void)
+{
+    return 0;
+}
+
 bool osBuiltWithNumaSupport(void)
 {
     return true;
@@ -524,6 +536,13 @@ uint64_t osNumaMask(void)
     return (1 << osNumaNodes()) - 1;
 }
 
+uint32_t osNumaDistance(uint32_t from, uint32_t to)
+{
+    // Windows does not expose the ACPI node distances, so we can only tell
+    // local from remote.
+    return from == to ? 10 : 20;
+}
+
 void osBindMBlocksToNode(
     void *addr,
     StgWord size,
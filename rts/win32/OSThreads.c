@@ -315,6 +315,25 @@ getNumberOfProcessors (void)
     return nproc;
 }
 
+bool
+getCpuTopology (uint32_t n STG_UNUSED,
+                uint32_t *package STG_UNUSED,
+                uint32_t *cache STG_UNUSED,
+                uint32_t *core STG_UNUSED)
+{
+    return false;
+}
+
+bool
+getAffinityTopology (uint32_t n STG_UNUSED,
+                     uint32_t m STG_UNUSED,
+                     uint32_t *package STG_UNUSED,
+                     uint32_t *cache STG_UNUSED,
+                     uint32_t *core STG_UNUSED)
+{
+    return false;
+}
+
 void
 setThreadAffinity (uint32_t n, uint32_t m) // cap N of M
 {
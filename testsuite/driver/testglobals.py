@@ -177,6 +177,9 @@ class TestConfig:
         # Is readelf available?
         self.have_readelf = False
 
+        # Does the non-threaded RTS use io_uring when asked to?
+        self.have_io_uring = False
+
         # Do we use a fast backend for bignum (e.g. GMP)
         self.have_fast_bignum = True
 
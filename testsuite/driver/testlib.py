@@ -1078,6 +1078,13 @@ def have_gdb( ) -> bool:
 def have_readelf( ) -> bool:
     return config.have_readelf
 
+def have_io_uring( ) -> bool:
+    '''
+    Does the non-threaded RTS have the io_uring I/O manager, and can it be
+    used here? Otherwise the RTS falls back to the poll I/O manager.
+    '''
+    return config.have_io_uring
+
 def have_fast_bignum( ) -> bool:
     return config.have_fast_bignum
 
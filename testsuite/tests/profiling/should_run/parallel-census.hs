@@ -0,0 +1,26 @@
+{-# LANGUAGE BangPatterns #-}
+-- Heap censuses taken by all of the parallel GC threads, sampling half of
+-- the heap blocks.  See Note [Parallel heap census] and
+-- Note [Sampled heap census] in rts/ProfHeap.c.
+--
+-- The Makefile compares the profile with a sequential census of every block.
+module Main where
+
+import GHC.Profiling
+import Control.Exception
+import Control.Monad
+
+main :: IO ()
+main = do
+  let !t = [0..1000000 :: Int]
+  _ <- evaluate (length t)
+  forM_ [1 .. 4 :: Int] $ \i -> do
+    requestHeapCensus
+    -- The census is taken by the next GC, so allocate until there is one
+    _ <- evaluate (garbage i)
+    return ()
+  _ <- evaluate (length t)
+  return ()
+
+garbage :: Int -> Int
+garbage i = length (show [i .. i + 200000])
@@ -0,0 +1,82 @@
+#define THREADED_RTS
+
+#include "Rts.h"
+#include <stdio.h>
+
+/* Check getAffinityTopology(), which gives the victim orders (see Note
+ * [Capability victim order] in rts/Capability.c) the location of each
+ * capability under -qa: the CPUs that setThreadAffinity(n, m) lets
+ * capability n of m run on are n, n+m, n+2m etc., and the location must
+ * describe all of them, not just CPU n.
+ *
+ * Where we can't read the CPU topology, getAffinityTopology() must always
+ * fail, and there is nothing else to check.
+ */
+
+static uint32_t nproc;
+static int failures = 0;
+
+static void
+check (uint32_t n, uint32_t m)
+{
+    uint32_t package, cache, core;
+    uint32_t p, c, k;
+    bool known = getAffinityTopology(n, m, &package, &cache, &core);
+    bool one_package = true, one_cache = true, one_core = true;
+    bool all_known = true;
+    uint32_t p0 = 0, c0 = 0, k0 = 0;
+
+    for (uint32_t i = n; i < nproc; i += m) {
+        if (!getCpuTopology(i, &p, &c, &k)) {
+            all_known = false;
+            break;
+        }
+        if (i == n) {
+            p0 = p; c0 = c; k0 = k;
+        }
+        one_package = one_package && p == p0;
+        one_cache = one_cache && c == c0;
+        one_core = one_core && k == k0;
+    }
+
+    if (known != (all_known && one_package)) {
+        printf("FAIL: capability %u of %u: known = %d\n", n, m, known);
+        failures++;
+        return;
+    }
+    if (!known) {
+        return;
+    }
+    if (package != p0
+        || cache != (one_cache ? c0 : UINT32_MAX)
+        || core != (one_core ? k0 : UINT32_MAX)) {
+        printf("FAIL: capability %u of %u: package %u, cache %u, core %u\n",
+               n, m, package, cache, core);
+        failures++;
+    }
+}
+
+int main (void)
+{
+    nproc = getNumberOfProcessors();
+
+    for (uint32_t m = 1; m <= nproc; m++) {
+        for (uint32_t n = 0; n < m; n++) {
+            check(n, m);
+        }
+    }
+    // Only one CPU each: the same as that CPU
+    for (uint32_t n = 0; n < nproc; n++) {
+        uint32_t package, cache, core, p, c, k;
+        bool known = getAffinityTopology(n, nproc, &package, &cache, &core);
+        if (known != getCpuTopology(n, &p, &c, &k)
+            || (known && (package != p || cache != c || core != k))) {
+            printf("FAIL: capability %u of %u differs from CPU %u\n",
+                   n, nproc, n);
+            failures++;
+        }
+    }
+
+    printf("%s\n", failures == 0 ? "OK" : "FAILED");
+    return 0;
+}
@@ -0,0 +1,33 @@
+{-# LANGUAGE ForeignFunctionInterface #-}
+
+import Control.Concurrent
+import Control.Monad (forM, forM_)
+import Debug.Trace (traceEventIO)
+import Foreign.C.Types
+
+-- Test the asynchronous eventlog writer (--eventlog-async): every capability
+-- posts user events while the EventLogWriter is stalled, so that some of them
+-- are dropped. The eventlog must still parse, and every event posted must
+-- either have been written or been reported as dropped.
+main :: IO ()
+main = do
+  c_start
+  n <- getNumCapabilities
+  dones <- forM [0 .. n - 1] $ \i -> do
+    done <- newEmptyMVar
+    _ <- forkOn i $ do
+      forM_ [1 .. eventsPerCap] $ \_ -> traceEventIO "EventlogAsync"
+      putMVar done ()
+    return done
+  mapM_ takeMVar dones
+  c_stop (fromIntegral (n * eventsPerCap))
+
+-- Enough to fill several eventlog buffers on each capability.
+eventsPerCap :: Int
+eventsPerCap = 200000
+
+foreign import ccall safe "c_start"
+  c_start :: IO ()
+
+foreign import ccall safe "c_stop"
+  c_stop :: CULong -> IO ()
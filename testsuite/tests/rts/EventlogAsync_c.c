@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Rts.h>
+#include <rts/EventLogFormat.h>
+
+// An EventLogWriter which keeps the whole eventlog in memory. Once stalled,
+// the writer blocks until it is released, so that the capabilities fill up
+// the spare buffers of the asynchronous writer and have to drop events.
+
+static Mutex writeMutex;
+static Condition stallCond;
+static bool stalled = false;
+
+static uint8_t *log_buf = NULL;
+static size_t log_size = 0;
+static size_t log_cap = 0;
+
+static void test_init(void) {
+  log_size = 0;
+}
+
+static bool test_write(void *eventlog, size_t eventlog_size) {
+  ACQUIRE_LOCK(&writeMutex);
+  while (stalled) {
+    waitCondition(&stallCond, &writeMutex);
+  }
+  if (log_size + eventlog_size > log_cap) {
+    while (log_size + eventlog_size > log_cap) {
+      log_cap = log_cap ? 2 * log_cap : 4 * 1024 * 1024;
+    }
+    log_buf = realloc(log_buf, log_cap);
+    if (log_buf == NULL) {
+      printf("out of memory\n");
+      exit(1);
+    }
+  }
+  memcpy(log_buf + log_size, eventlog, eventlog_size);
+  log_size += eventlog_size;
+  RELEASE_LOCK(&writeMutex);
+  return true;
+}
+
+static void test_flush(void) {
+}
+
+static void test_stop(void) {
+}
+
+static const EventLogWriter writer = {
+  .initEventLogWriter = test_init,
+  .writeEventLog = test_write,
+  .flushEventLog = test_flush,
+  .stopEventLogWriter = test_stop
+};
+
+// The RTS reports the dropped events when the writer thread stops.
+static RtsMsgFunction *origErrorMsgFn;
+static unsigned long dropped_events = 0;
+
+static void captureErrorMsg(const char *s, va_list ap) {
+  char msg[512];
+  va_list ap2;
+  va_copy(ap2, ap);
+  vsnprintf(msg, sizeof(msg), s, ap2);
+  va_end(ap2);
+  if (sscanf(msg, "warning: dropped %lu events", &dropped_events) != 1) {
+    origErrorMsgFn(s, ap);
+  }
+}
+
+static uint16_t get16(const uint8_t *p) {
+  return (uint16_t) ((p[0] << 8) | p[1]);
+}
+
+static uint32_t get32(const uint8_t *p) {
+  return ((uint32_t) get16(p) << 16) | get16(p + 2);
+}
+
+#define NEED(n) if (end - p < (ptrdiff_t) (n)) return false
+
+// Parse the eventlog in log_buf, counting the user messages.
+static bool parse_eventlog(unsigned long *user_msgs) {
+  const uint8_t *p = log_buf;
+  const uint8_t *end = log_buf + log_size;
+  static int32_t sizes[EVENT_DATA_END];
+  static bool known[EVENT_DATA_END];
+  memset(known, 0, sizeof(known));
+
+  NEED(8);
+  if (get32(p) != EVENT_HEADER_BEGIN || get32(p + 4) != EVENT_HET_BEGIN) {
+    return false;
+  }
+  p += 8;
+  for (;;) {
+    NEED(4);
+    uint32_t marker = get32(p);
+    p += 4;
+    if (marker == EVENT_HET_END) {
+      break;
+    }
+    if (marker != EVENT_ET_BEGIN) {
+      return false;
+    }
+    NEED(8);
+    uint16_t num = get16(p);
+    int16_t size = (int16_t) get16(p + 2);
+    uint32_t desclen = get32(p + 4);
+    p += 8;
+    NEED(desclen + 4);
+    p += desclen;
+    uint32_t extlen = get32(p);
+    p += 4;
+    NEED(extlen + 4);
+    p += extlen;
+    if (get32(p) != EVENT_ET_END || num == EVENT_DATA_END) {
+      return false;
+    }
+    p += 4;
+    known[num] = true;
+    sizes[num] = size;
+  }
+  NEED(8);
+  if (get32(p) != EVENT_HEADER_END || get32(p + 4) != EVENT_DATA_BEGIN) {
+    return false;
+  }
+  p += 8;
+
+  *user_msgs = 0;
+  for (;;) {
+    NEED(2);
+    uint16_t type = get16(p);
+    p += 2;
+    if (type == EVENT_DATA_END) {
+      break;
+    }
+    if (!known[type]) {
+      return false;
+    }
+    NEED(8);
+    p += 8;
+    uint32_t size;
+    if (sizes[type] < 0) {
+      NEED(2);
+      size = get16(p);
+      p += 2;
+    } else {
+      size = sizes[type];
+    }
+    NEED(size);
+    p += size;
+    if (type == EVENT_USER_MSG) {
+      (*user_msgs)++;
+    }
+  }
+  // Nothing may follow the end of data marker.
+  return p == end;
+}
+
+void c_start(void) {
+  initMutex(&writeMutex);
+  initCondition(&stallCond);
+
+  // Replace the eventlog file started by -l.
+  endEventLogging();
+  if (!startEventLogging(&writer)) {
+    printf("failed to start eventlog\n");
+    exit(1);
+  }
+
+  ACQUIRE_LOCK(&writeMutex);
+  stalled = true;
+  RELEASE_LOCK(&writeMutex);
+}
+
+void c_stop(unsigned long posted) {
+  ACQUIRE_LOCK(&writeMutex);
+  stalled = false;
+  broadcastCondition(&stallCond);
+  RELEASE_LOCK(&writeMutex);
+
+  origErrorMsgFn = errorMsgFn;
+  errorMsgFn = captureErrorMsg;
+  endEventLogging();
+  errorMsgFn = origErrorMsgFn;
+
+  unsigned long user_msgs;
+  if (!parse_eventlog(&user_msgs)) {
+    printf("failed to parse the eventlog\n");
+    return;
+  }
+  printf("eventlog parsed\n");
+
+  if (user_msgs > posted || user_msgs + dropped_events < posted) {
+    printf("posted %lu user events, but wrote %lu and dropped %lu\n",
+           posted, user_msgs, dropped_events);
+  } else if (dropped_events == 0) {
+    printf("no events were dropped\n");
+  } else {
+    printf("user events accounted for\n");
+  }
+}
@@ -0,0 +1,58 @@
+{-# LANGUAGE ForeignFunctionInterface #-}
+
+import Control.Concurrent
+import Control.Monad (forM_, unless)
+import Debug.Trace (traceEventIO)
+import Foreign.C.Types
+
+-- Test the eventlog socket writer (+RTS --eventlog-socket): connect to it
+-- twice, checking that each consumer gets a header and the initialisation
+-- events, followed by the events posted while it is connected. With
+-- --eventlog-socket-policy=drop the consumer doesn't read anything until all
+-- of the events have been posted, so some of them must be dropped.
+main :: IO ()
+main = do
+  forM_ [1, 2] $ \conn -> do
+    c_connect conn
+    finished <- newEmptyMVar
+    -- All on one capability, so that the messages are written in order.
+    _ <- forkOn 0 $ flood conn >> putMVar finished ()
+    c_consume (fromIntegral floodEvents)
+    takeMVar finished
+  c_finish
+
+-- Enough to fill several eventlog buffers.
+floodEvents :: Int
+floodEvents = 500000
+
+flood :: CInt -> IO ()
+flood conn = do
+  forM_ [0 .. floodEvents - 1] $ \i ->
+    traceEventIO (show conn ++ ":" ++ show i)
+  c_flood_done
+  -- Keep flushing until the consumer has seen the end, as with the drop
+  -- policy it may miss it.
+  let loop = do
+        traceEventIO (show conn ++ ":done")
+        c_flush
+        seen <- c_done_seen conn
+        unless (seen /= 0) $ threadDelay 10000 >> loop
+  loop
+
+foreign import ccall safe "c_connect"
+  c_connect :: CInt -> IO ()
+
+foreign import ccall safe "c_consume"
+  c_consume :: CULong -> IO ()
+
+foreign import ccall unsafe "c_flood_done"
+  c_flood_done :: IO ()
+
+foreign import ccall safe "c_flush"
+  c_flush :: IO ()
+
+foreign import ccall unsafe "c_done_seen"
+  c_done_seen :: CInt -> IO CInt
+
+foreign import ccall safe "c_finish"
+  c_finish :: IO ()
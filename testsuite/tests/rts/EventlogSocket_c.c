@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <Rts.h>
+#include <rts/EventLogFormat.h>
+
+// A consumer of the eventlog socket (+RTS --eventlog-socket), which runs in
+// the program itself. Each connection must start with a header and the
+// initialisation events, after which we parse the user messages posted by
+// EventlogSocket.hs, of the form "<conn>:<n>" and "<conn>:done".
+
+#define NEED_MORE 0
+#define PARSED    1
+#define BAD       (-1)
+
+static int fd = -1;
+static int conn = 0;
+
+static uint8_t *buf = NULL;
+static size_t buf_size = 0;     // bytes received
+static size_t buf_cap = 0;
+static size_t pos = 0;          // bytes parsed
+
+static bool header_done;
+static int32_t sizes[EVENT_DATA_END];
+static bool known[EVENT_DATA_END];
+static bool pid_seen, clock_seen;
+static long next_msg;           // the first number we may see next
+static unsigned long msgs, gaps;
+
+static int flood_done = 0;
+static int done_conn = 0;       // the last connection that saw "<conn>:done"
+
+static void fail(const char *what) {
+  printf("consumer %d: %s\n", conn, what);
+  exit(1);
+}
+
+static uint16_t get16(const uint8_t *p) {
+  return (uint16_t) ((p[0] << 8) | p[1]);
+}
+
+static uint32_t get32(const uint8_t *p) {
+  return ((uint32_t) get16(p) << 16) | get16(p + 2);
+}
+
+static void read_more(void) {
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+  int r;
+  do {
+    r = poll(&pfd, 1, 60000);
+  } while (r < 0 && errno == EINTR);
+  if (r <= 0) {
+    fail("timed out");
+  }
+
+  if (buf_cap - buf_size < 65536) {
+    buf_cap = buf_cap ? 2 * buf_cap : 1024 * 1024;
+    buf = realloc(buf, buf_cap);
+    if (buf == NULL) {
+      fail("out of memory");
+    }
+  }
+  ssize_t n = read(fd, buf + buf_size, buf_cap - buf_size);
+  if (n < 0 && errno == EINTR) {
+    return;
+  }
+  if (n <= 0) {
+    fail("connection closed");
+  }
+  buf_size += n;
+}
+
+#define NEED(n) if (end - p < (ptrdiff_t) (n)) return NEED_MORE
+
+static int parse_header(void) {
+  const uint8_t *p = buf;
+  const uint8_t *end = buf + buf_size;
+
+  memset(known, 0, sizeof(known));
+  NEED(8);
+  if (get32(p) != EVENT_HEADER_BEGIN || get32(p + 4) != EVENT_HET_BEGIN) {
+    return BAD;
+  }
+  p += 8;
+  for (;;) {
+    NEED(4);
+    uint32_t marker = get32(p);
+    p += 4;
+    if (marker == EVENT_HET_END) {
+      break;
+    }
+    if (marker != EVENT_ET_BEGIN) {
+      return BAD;
+    }
+    NEED(8);
+    uint16_t num = get16(p);
+    int16_t size = (int16_t) get16(p + 2);
+    uint32_t desclen = get32(p + 4);
+    p += 8;
+    NEED(desclen + 4);
+    p += desclen;
+    uint32_t extlen = get32(p);
+    p += 4;
+    NEED(extlen + 4);
+    p += extlen;
+    if (get32(p) != EVENT_ET_END || num == EVENT_DATA_END) {
+      return BAD;
+    }
+    p += 4;
+    known[num] = true;
+    sizes[num] = size;
+  }
+  NEED(8);
+  if (get32(p) != EVENT_HEADER_END || get32(p + 4) != EVENT_DATA_BEGIN) {
+    return BAD;
+  }
+  pos = p + 8 - buf;
+  return PARSED;
+}
+
+static int user_msg(const uint8_t *msg, uint32_t len) {
+  char s[64];
+  int c;
+  long n;
+  char rest;
+
+  if (len >= sizeof(s)) {
+    return PARSED;
+  }
+  memcpy(s, msg, len);
+  s[len] = '\0';
+  if (sscanf(s, "%d:%ld%c", &c, &n, &rest) == 2) {
+    if (c != conn) {
+      return PARSED;  // left over from an earlier connection
+    }
+    if (n < next_msg) {
+      return BAD;
+    }
+    if (n > next_msg) {
+      gaps++;
+    }
+    next_msg = n + 1;
+    msgs++;
+  } else if (sscanf(s, "%d:done%c", &c, &rest) == 1 && c == conn) {
+    RELEASE_STORE(&done_conn, conn);
+  }
+  return PARSED;
+}
+
+// Parse a single event.
+static int parse_event(void) {
+  const uint8_t *p = buf + pos;
+  const uint8_t *end = buf + buf_size;
+
+  NEED(10);
+  uint16_t type = get16(p);
+  p += 10;
+  if (type == EVENT_DATA_END || !known[type]) {
+    return BAD;
+  }
+  uint32_t size;
+  if (sizes[type] < 0) {
+    NEED(2);
+    size = get16(p);
+    p += 2;
+  } else {
+    size = sizes[type];
+  }
+  NEED(size);
+
+  if (type == EVENT_OSPROCESS_PID) {
+    pid_seen = true;
+  } else if (type == EVENT_WALL_CLOCK_TIME) {
+    clock_seen = true;
+  } else if (type == EVENT_USER_MSG && user_msg(p, size) != PARSED) {
+    return BAD;
+  }
+  pos = p + size - buf;
+  return PARSED;
+}
+
+static void parse_until(bool (*done)(void)) {
+  while (!done()) {
+    int r = header_done ? parse_event() : parse_header();
+    if (r == BAD) {
+      fail("failed to parse the eventlog");
+    } else if (r == NEED_MORE) {
+      read_more();
+    } else {
+      header_done = true;
+    }
+  }
+}
+
+static bool init_events_seen(void) {
+  return header_done && pid_seen && clock_seen;
+}
+
+static bool done_seen(void) {
+  return ACQUIRE_LOAD(&done_conn) == conn;
+}
+
+// Connect to the eventlog socket, and wait for the header and the
+// initialisation events.
+void c_connect(int c) {
+  struct sockaddr_un addr;
+
+  conn = c;
+  buf_size = 0;
+  pos = 0;
+  header_done = pid_seen = clock_seen = false;
+  next_msg = 0;
+  msgs = gaps = 0;
+  RELEASE_STORE(&flood_done, 0);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, RtsFlags.TraceFlags.eventlogSocket,
+          sizeof(addr.sun_path) - 1);
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    fail("socket failed");
+  }
+  if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+    fail("connect failed");
+  }
+
+  parse_until(init_events_seen);
+  printf("consumer %d: header and init events\n", conn);
+  fflush(stdout);
+}
+
+// Read the user messages, until we see "<conn>:done". With the drop policy
+// we don't read anything until all of the numbered messages have been
+// posted, so that the writer has to drop some of them.
+void c_consume(unsigned long posted) {
+  if (RtsFlags.TraceFlags.eventlogSocketPolicy == EVENTLOG_SOCKET_DROP) {
+    while (!ACQUIRE_LOAD(&flood_done)) {
+      usleep(1000);
+    }
+  }
+  parse_until(done_seen);
+  close(fd);
+  fd = -1;
+
+  if (RtsFlags.TraceFlags.eventlogSocketPolicy == EVENTLOG_SOCKET_DROP) {
+    if (gaps > 0 && msgs < posted) {
+      printf("consumer %d: some events dropped\n", conn);
+    } else {
+      printf("consumer %d: received %lu of %lu events\n", conn, msgs, posted);
+    }
+  } else {
+    if (gaps == 0 && msgs == posted) {
+      printf("consumer %d: all events received\n", conn);
+    } else {
+      printf("consumer %d: received %lu of %lu events\n", conn, msgs, posted);
+    }
+  }
+  fflush(stdout);
+}
+
+void c_flood_done(void) {
+  RELEASE_STORE(&flood_done, 1);
+}
+
+int c_done_seen(int c) {
+  return ACQUIRE_LOAD(&done_conn) >= c;
+}
+
+void c_flush(void) {
+  flushEventLog(NULL);
+}
+
+// The RTS reports the dropped blocks when the socket writer stops.
+static RtsMsgFunction *origErrorMsgFn;
+static unsigned long dropped_blocks = 0;
+
+static void captureErrorMsg(const char *s, va_list ap) {
+  char msg[512];
+  va_list ap2;
+  va_copy(ap2, ap);
+  vsnprintf(msg, sizeof(msg), s, ap2);
+  va_end(ap2);
+  if (sscanf(msg, "warning: dropped %lu eventlog blocks", &dropped_blocks) != 1) {
+    origErrorMsgFn(s, ap);
+  }
+}
+
+void c_finish(void) {
+  origErrorMsgFn = errorMsgFn;
+  errorMsgFn = captureErrorMsg;
+  endEventLogging();
+  errorMsgFn = origErrorMsgFn;
+
+  if (RtsFlags.TraceFlags.eventlogSocketPolicy == EVENTLOG_SOCKET_DROP) {
+    printf(dropped_blocks > 0 ? "dropped blocks reported\n"
+                              : "no dropped blocks reported\n");
+  } else if (dropped_blocks > 0) {
+    printf("dropped %lu blocks\n", dropped_blocks);
+  }
+}
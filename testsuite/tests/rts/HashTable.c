@@ -0,0 +1,419 @@
+#include "rts/PosixSource.h"
+#include "Rts.h"
+
+#include "Hash.h"
+#include "RtsUtils.h"
+#include "GetTime.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h> // for the PRI* macros for printf for types like int64_t
+
+/* Tests for the RTS HashTable, and a benchmark comparing it with the chained
+ * linear hash table it replaced, on a workload like the linker's symbol
+ * table.
+ *
+ * Run with cli arg "--show-timing" to enable timing. Otherwise it doesn't show
+ * times, so the output is deterministic and can be used as a regression test.
+ *
+ * Compile with -DDEBUG and link with the -debug RTS to enable assertions.
+ */
+
+/* See TimeoutQueue.c for why we use our own prng */
+static unsigned long int next = 1;
+static int prng(void) // RAND_MAX assumed to be 32767
+{
+    next = next * 1103515245 + 12345;
+    return (unsigned int)(next/65536) % 32768;
+}
+
+static void fail(const char *msg, StgWord key)
+{
+    printf("FAIL: %s (key %" FMT_Word ")\n", msg, key);
+    exit(1);
+}
+
+/******************************************************************************
+ * A model of a HashTable: for each key, a stack of the data inserted, the
+ * most recent on top.
+ */
+
+#define KEYS 4096
+#define DEPTH 4
+
+typedef struct {
+    int depth[KEYS];
+    StgWord data[KEYS][DEPTH];
+} Model;
+
+static StgWord model_lookup(Model *m, StgWord k)
+{
+    return m->depth[k] == 0 ? 0 : m->data[k][m->depth[k] - 1];
+}
+
+/* Keys are spread out, like pointers into the heap */
+static StgWord key_of(StgWord k)
+{
+    return (k * 4099 + 1) * sizeof(StgWord);
+}
+
+static void check_model(HashTable *t, Model *m)
+{
+    int count = 0;
+    for (StgWord k = 0; k < KEYS; k++) {
+        StgWord d = (StgWord) lookupHashTable(t, key_of(k));
+        if (d != model_lookup(m, k)) {
+            fail("lookup doesn't match the model", k);
+        }
+        count += m->depth[k];
+    }
+    if (keyCountHashTable(t) != count) {
+        fail("wrong key count", count);
+    }
+}
+
+static void sum_data(void *sum, StgWord key STG_UNUSED, const void *value)
+{
+    *(StgWord *) sum += (StgWord) value;
+}
+
+int main_test (void)
+{
+    Model *m = calloc(1, sizeof(Model));
+    HashTable *t = allocHashTable();
+    int inserts = 0, removes = 0, shadowed = 0, misses = 0;
+
+    /* Random inserts and removes, including inserting a key that is there
+     * already, and removing a particular entry for a key.
+     */
+    printf("===== Test random inserts and removes =====\n");
+    for (int i = 0; i < 200000; i++) {
+        StgWord k = ((StgWord) prng() << 15 | prng()) % KEYS;
+        /* Mostly inserts to begin with, then mostly removes */
+        bool insert = prng() % 100 < (i < 100000 ? 70 : 30);
+        if (insert && m->depth[k] < DEPTH) {
+            StgWord d = (StgWord) i + 1;
+            if (m->depth[k] > 0) shadowed++;
+            insertHashTable(t, key_of(k), (void *) d);
+            m->data[k][m->depth[k]++] = d;
+            inserts++;
+        } else if (m->depth[k] == 0) {
+            if (removeHashTable(t, key_of(k), NULL) != NULL) {
+                fail("removed a key that isn't there", k);
+            }
+            misses++;
+        } else if (prng() % 4 == 0) {
+            /* Remove an older entry by its data */
+            int j = prng() % m->depth[k];
+            StgWord d = m->data[k][j];
+            if ((StgWord) removeHashTable(t, key_of(k), (void *) d) != d) {
+                fail("remove by data returned the wrong data", k);
+            }
+            for (; j < m->depth[k] - 1; j++) {
+                m->data[k][j] = m->data[k][j+1];
+            }
+            m->depth[k]--;
+            removes++;
+        } else {
+            StgWord d = model_lookup(m, k);
+            if ((StgWord) removeHashTable(t, key_of(k), NULL) != d) {
+                fail("remove returned the wrong data", k);
+            }
+            m->depth[k]--;
+            removes++;
+        }
+        if (i % 10000 == 0) {
+            check_model(t, m);
+        }
+    }
+    check_model(t, m);
+    printf("%i inserts (%i shadowing), %i removes, %i misses, %i keys left\n",
+           inserts, shadowed, removes, misses, keyCountHashTable(t));
+
+    /* Every entry is visited once, and only once */
+    StgWord sum = 0, expected = 0;
+    for (StgWord k = 0; k < KEYS; k++) {
+        for (int j = 0; j < m->depth[k]; j++) expected += m->data[k][j];
+    }
+    mapHashTable(t, &sum, sum_data);
+    if (sum != expected) {
+        fail("mapHashTable didn't visit every entry", sum);
+    }
+    StgWord *keys = calloc(KEYS * DEPTH, sizeof(StgWord));
+    if (keysHashTable(t, keys, KEYS * DEPTH) != keyCountHashTable(t)) {
+        fail("keysHashTable didn't return every key", 0);
+    }
+    free(keys);
+    freeHashTable(t, NULL);
+
+    /* Strings, in buffers of their own, so that equal keys are different
+     * pointers.
+     */
+    printf("===== Test string keys =====\n");
+    StrHashTable *st = allocStrHashTable();
+    char buf[32];
+    for (int i = 0; i < 10000; i++) {
+        snprintf(buf, sizeof(buf), "sym_%d", i);
+        insertStrHashTable(st, strdup(buf), (void *) (StgWord) (i + 1));
+    }
+    int found = 0;
+    for (int i = 0; i < 20000; i++) {
+        snprintf(buf, sizeof(buf), "sym_%d", i);
+        StgWord d = (StgWord) lookupStrHashTable(st, buf);
+        if (d != (i < 10000 ? (StgWord) i + 1 : 0)) {
+            fail("string lookup returned the wrong data", i);
+        }
+        if (d != 0) found++;
+    }
+    printf("found %i of 20000 strings\n", found);
+    freeStrHashTable(st, NULL);
+
+    free(m);
+    return 0;
+}
+
+/******************************************************************************
+ * The chained linear hash table which the RTS used before, for comparison:
+ * Per-\AAke Larson, ``Dynamic Hash Tables,'' CACM 31(4), April 1988.
+ * Only what we need for string keys.
+ */
+
+#define HSEGSIZE    1024
+#define HDIRSIZE    1024
+#define HLOAD       5
+#define HCHUNK      (1024 * sizeof(W_) / sizeof(ChainList))
+
+typedef struct chainlist {
+    StgWord key;
+    const void *data;
+    struct chainlist *next;
+} ChainList;
+
+typedef struct chainchunk {
+    struct chainchunk *next;
+} ChainChunk;
+
+typedef struct {
+    int split, max, mask1, mask2, kcount, bcount;
+    ChainList **dir[HDIRSIZE];
+    ChainList *freeList;
+    ChainChunk *chunks;
+} ChainTable;
+
+static int chainHash(const ChainTable *table, const char *key)
+{
+    StgWord h = hashStr(NULL, (StgWord) key);
+    int bucket = h & table->mask1;
+    if (bucket < table->split) {
+        bucket = h & table->mask2;
+    }
+    return bucket;
+}
+
+static ChainTable *allocChainTable(void)
+{
+    ChainTable *table = calloc(1, sizeof(ChainTable));
+    table->dir[0] = calloc(HSEGSIZE, sizeof(ChainList *));
+    table->max = HSEGSIZE;
+    table->mask1 = HSEGSIZE - 1;
+    table->mask2 = 2 * HSEGSIZE - 1;
+    table->bcount = HSEGSIZE;
+    return table;
+}
+
+static void expandChainTable(ChainTable *table)
+{
+    if (table->split + table->max >= HDIRSIZE * HSEGSIZE) return;
+    int oldsegment = table->split / HSEGSIZE;
+    int oldindex = table->split % HSEGSIZE;
+    int newbucket = table->max + table->split;
+    int newsegment = newbucket / HSEGSIZE;
+    int newindex = newbucket % HSEGSIZE;
+    if (newindex == 0) {
+        table->dir[newsegment] = malloc(HSEGSIZE * sizeof(ChainList *));
+    }
+    if (++table->split == table->max) {
+        table->split = 0;
+        table->max *= 2;
+        table->mask1 = table->mask2;
+        table->mask2 = table->mask2 << 1 | 1;
+    }
+    table->bcount++;
+
+    ChainList *old = NULL, *new = NULL, *next;
+    for (ChainList *hl = table->dir[oldsegment][oldindex]; hl; hl = next) {
+        next = hl->next;
+        if (chainHash(table, (const char *) hl->key) == newbucket) {
+            hl->next = new;
+            new = hl;
+        } else {
+            hl->next = old;
+            old = hl;
+        }
+    }
+    table->dir[oldsegment][oldindex] = old;
+    table->dir[newsegment][newindex] = new;
+}
+
+static void *lookupChainTable(const ChainTable *table, const char *key)
+{
+    int bucket = chainHash(table, key);
+    for (ChainList *hl = table->dir[bucket / HSEGSIZE][bucket % HSEGSIZE];
+         hl != NULL; hl = hl->next) {
+        if (strcmp((const char *) hl->key, key) == 0) {
+            return (void *) hl->data;
+        }
+    }
+    return NULL;
+}
+
+static void insertChainTable(ChainTable *table, const char *key,
+                             const void *data)
+{
+    if (++table->kcount >= HLOAD * table->bcount) {
+        expandChainTable(table);
+    }
+    if (table->freeList == NULL) {
+        ChainChunk *cl = malloc(sizeof(ChainChunk) + HCHUNK * sizeof(ChainList));
+        ChainList *hl = (ChainList *) &cl[1];
+        cl->next = table->chunks;
+        table->chunks = cl;
+        for (ChainList *p = hl; p < hl + HCHUNK - 1; p++) {
+            p->next = p + 1;
+        }
+        hl[HCHUNK - 1].next = NULL;
+        table->freeList = hl;
+    }
+    ChainList *hl = table->freeList;
+    table->freeList = hl->next;
+
+    int bucket = chainHash(table, key);
+    hl->key = (StgWord) key;
+    hl->data = data;
+    hl->next = table->dir[bucket / HSEGSIZE][bucket % HSEGSIZE];
+    table->dir[bucket / HSEGSIZE][bucket % HSEGSIZE] = hl;
+}
+
+static void freeChainTable(ChainTable *table)
+{
+    for (int s = 0; s <= (table->max + table->split - 1) / HSEGSIZE; s++) {
+        free(table->dir[s]);
+    }
+    ChainChunk *next;
+    for (ChainChunk *cl = table->chunks; cl != NULL; cl = next) {
+        next = cl->next;
+        free(cl);
+    }
+    free(table);
+}
+
+/******************************************************************************
+ * The benchmark
+ */
+
+/* Loading MODULES modules, each defining SYMBOLS symbols (named like GHC's
+ * z-encoded closures and info tables), and each resolving REFS references to
+ * symbols in any module, of which one in ten is not in the table (e.g. from
+ * libc, which the linker then looks up elsewhere).
+ */
+#define MODULES 2000
+#define SYMBOLS 100
+#define REFS    500
+
+static char **make_names(int n, const char *suffix)
+{
+    char **names = malloc(n * sizeof(char *));
+    char buf[128];
+    for (int i = 0; i < n; i++) {
+        snprintf(buf, sizeof(buf),
+                 "mypkgzm0zi1zi0zmABCDEF_DataziModule%dziInternal_f%d_%s",
+                 i / SYMBOLS, i % SYMBOLS, suffix);
+        names[i] = strdup(buf);
+    }
+    return names;
+}
+
+int main_bench (bool showtiming)
+{
+    const int N = MODULES * SYMBOLS;
+    char **names = make_names(N, "closure");
+    char **others = make_names(N, "info");    /* never defined */
+    int *refs = malloc(MODULES * REFS * sizeof(int));
+    for (int i = 0; i < MODULES * REFS; i++) {
+        refs[i] = ((prng() << 15) | prng()) % N;
+        if (prng() % 10 == 0) refs[i] = -1 - refs[i];
+    }
+    Time before, after;
+    initializeTimer();
+
+    printf("===== Benchmark %i modules, %i symbols =====\n", MODULES, N);
+
+    /* The HashTable. As in ghciInsertSymbolTable, we look each symbol up
+     * before inserting it. */
+    int resolved = 0;
+    before = getProcessElapsedTime();
+    StrHashTable *st = allocStrHashTable();
+    for (int mod = 0; mod < MODULES; mod++) {
+        for (int i = mod * SYMBOLS; i < (mod + 1) * SYMBOLS; i++) {
+            if (lookupStrHashTable(st, names[i]) == NULL) {
+                insertStrHashTable(st, names[i], names[i]);
+            }
+        }
+        for (int i = mod * REFS; i < (mod + 1) * REFS; i++) {
+            const char *name = refs[i] >= 0 ? names[refs[i]] : others[-1 - refs[i]];
+            if (lookupStrHashTable(st, name) != NULL) resolved++;
+        }
+    }
+    freeStrHashTable(st, NULL);
+    after = getProcessElapsedTime();
+    printf("hash table:         %i references resolved\n", resolved);
+    if (showtiming) {
+      Time ns = after - before;
+      printf("completed in %" PRIi64 " nsec, %.1f ns per operation\n",
+             ns, (double)ns/(2*N + MODULES * REFS));
+    }
+
+    /* The chained hash table, doing the same */
+    resolved = 0;
+    before = getProcessElapsedTime();
+    ChainTable *ct = allocChainTable();
+    for (int mod = 0; mod < MODULES; mod++) {
+        for (int i = mod * SYMBOLS; i < (mod + 1) * SYMBOLS; i++) {
+            if (lookupChainTable(ct, names[i]) == NULL) {
+                insertChainTable(ct, names[i], names[i]);
+            }
+        }
+        for (int i = mod * REFS; i < (mod + 1) * REFS; i++) {
+            const char *name = refs[i] >= 0 ? names[refs[i]] : others[-1 - refs[i]];
+            if (lookupChainTable(ct, name) != NULL) resolved++;
+        }
+    }
+    freeChainTable(ct);
+    after = getProcessElapsedTime();
+    printf("chained hash table: %i references resolved\n", resolved);
+    if (showtiming) {
+      Time ns = after - before;
+      printf("completed in %" PRIi64 " nsec, %.1f ns per operation\n",
+             ns, (double)ns/(2*N + MODULES * REFS));
+    }
+
+    for (int i = 0; i < N; i++) {
+        free(names[i]);
+        free(others[i]);
+    }
+    free(names);
+    free(others);
+    free(refs);
+    return 0;
+}
+
+int main (int argc, char *argv[])
+{
+    bool showtiming = argc > 1 ? strcmp(argv[1], "--show-timing") == 0 : false;
+
+    main_test();
+    main_bench(showtiming);
+    return 0;
+}
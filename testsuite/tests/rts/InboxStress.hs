@@ -0,0 +1,86 @@
+-- Stress the inter-capability message inbox: every capability sends
+-- messages (MVar wakeups, throwTo and blocking on blackholes) to every other
+-- capability.  See Note [Lock-free capability inbox] in rts/Messages.c.
+--
+-- Run with "--show-timing" to print how long each phase takes.
+
+module Main (main) where
+
+import Control.Concurrent
+import Control.Exception
+import Control.Monad
+import Data.IORef
+import Data.List (foldl')
+
+import RtsStress
+
+data Ping = Ping deriving Show
+instance Exception Ping
+
+rounds :: Int
+rounds = 20000
+
+main :: IO ()
+main = stressMain $ \n ->
+  [ phase "wakeup" (wakeups n)
+  , phase "throwTo" (throws n)
+  , phase "blackhole" (blackholes n)
+  ]
+
+-- Each round, the thread on capability i puts to the MVar of another
+-- capability, waking up the thread blocked there, and then takes from its
+-- own.  The destination moves round all the other capabilities in turn.
+wakeups :: Int -> IO Bool
+wakeups n = do
+  mvs <- replicateM n newEmptyMVar
+  done <- newEmptyMVar
+  forM_ [0 .. n-1] $ \i -> forkOn i $ do
+    let step acc r = do
+          let j = (i + 1 + r `mod` max 1 (n-1)) `mod` n
+          putMVar (mvs !! j) r
+          x <- takeMVar (mvs !! i)
+          return $! acc + x
+    s <- foldM step 0 [0 .. rounds-1]
+    putMVar done s
+  total <- sum <$> replicateM n (takeMVar done)
+  return (total == n * sum [0 .. rounds-1])
+
+-- The thread on capability i throws to the victims on all the capabilities
+-- in turn.  Each throwTo is a MSG_THROWTO to the victim's capability, and
+-- the thrower is woken up by a message when it has been delivered.
+throws :: Int -> IO Bool
+throws n = do
+  counts <- replicateM n (newIORef (0 :: Int))
+  victims <- forM (zip [0 ..] counts) $ \(i, c) ->
+    forkOn i $ mask $ \restore ->
+      let loop = restore (forever yield) `catch` \Ping -> do
+                   modifyIORef' c (+1)
+                   loop
+      in loop
+  done <- newEmptyMVar
+  forM_ [0 .. n-1] $ \i -> forkOn i $ do
+    forM_ [1 .. nthrows] $ \r ->
+      throwTo (victims !! ((i + r) `mod` n)) Ping
+    putMVar done ()
+  replicateM_ n (takeMVar done)
+  mapM_ killThread victims
+  total <- sum <$> mapM readIORef counts
+  return (total == n * nthrows)
+  where
+    nthrows = rounds `div` 10
+
+-- Every capability demands the same expensive thunks at the same time, so
+-- that threads block on blackholes owned by other capabilities, and are
+-- woken up by messages when the owner updates them.
+blackholes :: Int -> IO Bool
+blackholes n = do
+  let thunks = [ expensive k | k <- [1 .. 200] ]
+  done <- newEmptyMVar
+  forM_ [0 .. n-1] $ \i -> forkOn i $ do
+    s <- foldM (\acc t -> evaluate (acc + t)) 0 thunks
+    putMVar done s
+  rs <- replicateM n (takeMVar done)
+  return (and (zipWith (==) rs (drop 1 rs)))
+
+expensive :: Int -> Int
+expensive k = foldl' (+) k [1 .. 20000] `mod` 1000
@@ -0,0 +1,33 @@
+-- Exercise the parallel mark of the nonmoving collector: build a large live
+-- heap, mutate it while major collections are running, and check that
+-- nothing reachable was lost.
+
+import Control.Monad
+import Data.IORef
+import System.Mem
+
+data Tree = Leaf | Node Tree !Int Tree
+
+build :: Int -> Int -> Tree
+build lo hi
+  | lo > hi   = Leaf
+  | otherwise = let m = (lo + hi) `div` 2
+                in Node (build lo (m - 1)) m (build (m + 1) hi)
+
+sumTree :: Tree -> Int
+sumTree Leaf = 0
+sumTree (Node l x r) = sumTree l + x + sumTree r
+
+main :: IO ()
+main = do
+  let n = 200000
+  refs <- forM [0 .. 99] $ \i -> newIORef (build (i * n) (i * n + n - 1))
+  forM_ [1 .. 20 :: Int] $ \r -> do
+    performMajorGC
+    -- Replace some of the trees, so the write barrier sees old values
+    -- while the collector may still be marking them.
+    forM_ (zip [0 ..] refs) $ \(i, ref) ->
+      when ((i + r) `mod` 7 == 0) $
+        writeIORef ref $! build (i * n) (i * n + n - 1)
+  total <- sum <$> mapM (fmap sumTree . readIORef) refs
+  print total
@@ -0,0 +1,43 @@
+-- Exercise the marking of large objects by the parallel mark of the
+-- nonmoving collector: many large arrays, each reachable from several roots,
+-- so that mark workers often trace the same large object at the same time.
+-- Each must be moved to the marked large objects exactly once (see Note
+-- [Parallel nonmoving mark]).
+
+import Control.Monad
+import Data.Array
+import Data.IORef
+import System.Mem
+
+-- Large enough to be allocated as a large object.
+arraySize :: Int
+arraySize = 1024
+
+nArrays :: Int
+nArrays = 2000
+
+mkArray :: Int -> Array Int Int
+mkArray k = listArray (0, arraySize - 1) [k * arraySize .. (k + 1) * arraySize - 1]
+
+rotate :: Int -> [a] -> [a]
+rotate n xs = drop n xs ++ take n xs
+
+main :: IO ()
+main = do
+  let arrays = map mkArray [0 .. nArrays - 1]
+  mapM_ (\a -> a ! 0 `seq` return ()) arrays
+  -- Every root sees all of the arrays, starting at a different one.
+  refs <- forM [0 .. 7] $ \i -> newIORef (rotate (i * nArrays `div` 8) arrays)
+  forM_ [1 .. 20 :: Int] $ \r -> do
+    performMajorGC
+    -- Replace some of the arrays under one root with new copies, so that
+    -- new large objects keep arriving while the collector marks.
+    let ref = refs !! (r `mod` 8)
+    xs <- readIORef ref
+    let xs' = [ if j `mod` 5 == r `mod` 5 then mkArray (a ! 0 `div` arraySize) else a
+              | (j, a) <- zip [0 :: Int ..] xs ]
+    mapM_ (\a -> a ! 0 `seq` return ()) xs'
+    writeIORef ref xs'
+  totals <- mapM (fmap (sum . map sum) . readIORef) refs
+  print (head totals)
+  print (all (== head totals) totals)
@@ -0,0 +1,36 @@
+-- A few megabytes of long-lived data, with pointers in all directions
+-- between objects of different kinds, compacted by many parallel major GCs
+-- while some of it is replaced.  See Note [Parallel compaction] in
+-- rts/sm/Compact.c.
+
+module Main (main) where
+
+import Control.Concurrent
+import Control.Monad
+import Data.IORef
+import qualified Data.Map.Strict as M
+import System.Mem
+
+size, rounds :: Int
+size = 100000
+rounds = 20
+
+main :: IO ()
+main = do
+  -- the map is built in order, so its nodes point both ways in the heap
+  m <- newIORef (M.fromList [ (k, [k, k+1]) | k <- [1 .. size] ])
+  refs <- forM [1 .. 1000] $ \k -> newIORef (k, show k)
+  mvars <- forM [1 .. 1000] newMVar
+  forM_ [1 .. rounds] $ \r -> do
+    -- replace some of the map, leaving garbage in the old generation
+    modifyIORef' m $ \mp ->
+      foldr (\k -> M.insert k [k, k+1]) mp [ r, r + rounds .. size ]
+    forM_ (zip refs [1 ..]) $ \(ref, k) ->
+      when (k `mod` r == 0) $ writeIORef ref (k, show k)
+    performMajorGC
+  mp <- readIORef m
+  print (M.size mp, sum (map sum (M.elems mp)))
+  xs <- mapM readIORef refs
+  print (all (\(k, s) -> show k == s) xs)
+  ys <- mapM readMVar mvars
+  print (ys == [1 .. 1000 :: Int])
@@ -0,0 +1,35 @@
+-- Each capability builds and keeps its own data across many parallel GCs,
+-- with some capabilities idle for part of the time, using the
+-- locality-aware parallel GC.  See Note [Locality-aware parallel GC] in
+-- rts/sm/GC.c.
+
+module Main (main) where
+
+import Control.Concurrent
+import Control.Monad
+import Data.IORef
+import Data.List (foldl')
+
+rounds, size :: Int
+rounds = 200
+size = 5000
+
+main :: IO ()
+main = do
+  n <- getNumCapabilities
+  done <- newEmptyMVar
+  -- only half of the capabilities work at first, so the others are idle
+  -- in some of the GCs
+  forM_ [0 .. n-1] $ \i -> forkOn i $ do
+    when (odd i) $ threadDelay 20000
+    ref <- newIORef []
+    forM_ [1 .. rounds] $ \r -> do
+      let xs = [ i * r + k | k <- [1 .. size] ]
+      modifyIORef' ref (take 10 . (foldl' (+) 0 xs :))
+    ys <- readIORef ref
+    putMVar done (ys == [ expected i r | r <- [rounds, rounds-1 .. rounds-9] ])
+  oks <- replicateM n (takeMVar done)
+  print (and oks)
+
+expected :: Int -> Int -> Int
+expected i r = i * r * size + size * (size + 1) `div` 2
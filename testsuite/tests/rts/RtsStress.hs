@@ -0,0 +1,44 @@
+-- Shared by the stress tests of the RTS's concurrent data structures
+-- (InboxStress, StablePtrStress and StableNameStress).
+--
+-- A stress test is a series of phases, run on all of the capabilities at
+-- once, each of which checks its own results. We print whether each phase
+-- passed. Run with "--show-timing" to also print how long each phase takes,
+-- and the throughput of the phases that count their operations; this output
+-- is not deterministic, so the testsuite doesn't ask for it.
+
+module RtsStress (Phase, phase, phaseOps, stressMain) where
+
+import Control.Concurrent (getNumCapabilities)
+import Control.Monad (forM_, when)
+import GHC.Clock (getMonotonicTime)
+import System.Environment (getArgs)
+import Text.Printf (printf)
+
+data Phase = Phase String (Maybe (Int, String)) (IO Bool)
+
+-- | A phase with the given name.
+phase :: String -> IO Bool -> Phase
+phase what = Phase what Nothing
+
+-- | A phase doing the given number of operations on some kind of object
+-- (e.g. "stable pointers"), for which we report the throughput.
+phaseOps :: String -> Int -> String -> IO Bool -> Phase
+phaseOps what ops things = Phase what (Just (ops, things))
+
+-- | Run the phases, given the number of capabilities.
+stressMain :: (Int -> [Phase]) -> IO ()
+stressMain phases = do
+  args <- getArgs
+  let showTiming = args == ["--show-timing"]
+  n <- getNumCapabilities
+  forM_ (phases n) $ \(Phase what ops act) -> do
+    t0 <- getMonotonicTime
+    r <- act
+    t1 <- getMonotonicTime
+    putStrLn (what ++ ": " ++ show r)
+    when showTiming $ case ops of
+      Nothing -> printf "  %.3fs\n" (t1 - t0)
+      Just (k, things) ->
+        printf "  %.3fs, %.1f M %s/s\n"
+          (t1 - t0) (fromIntegral k / (t1 - t0) / 1e6 :: Double) things
@@ -0,0 +1,69 @@
+-- Check that transactions see consistent snapshots when they commit against
+-- the STM version clock: writers move money between accounts while readers
+-- check, in read-only transactions, that the total never changes.  See
+-- Note [STM version clock] in rts/STM.c.
+
+module Main (main) where
+
+import Control.Concurrent
+import Control.Monad
+import GHC.Conc.Sync
+
+accounts :: Int
+accounts = 64
+
+transfers :: Int
+transfers = 20000
+
+checks :: Int
+checks = 2000
+
+main :: IO ()
+main = do
+  n <- getNumCapabilities
+  tvs <- replicateM accounts (newTVarIO (100 :: Int))
+  done <- newTVarIO (0 :: Int)
+  ok <- newTVarIO True
+  let total = foldM (\s tv -> (s +) <$> readTVar tv) 0 tvs
+      expected = 100 * accounts
+
+      -- a simple LCG, so that each writer moves money between its own
+      -- sequence of accounts
+      writer seed = go seed transfers
+        where
+          go _ 0 = atomically $ modifyTVar' done (+1)
+          go s k = do
+            let s' = (s * 1103515245 + 12345) `mod` 2147483648
+                from = tvs !! (s' `mod` accounts)
+                to   = tvs !! ((s' `div` accounts) `mod` accounts)
+            atomically $ do
+              a <- readTVar from
+              when (a > 0) $ do
+                writeTVar from (a - 1)
+                b <- readTVar to
+                writeTVar to (b + 1)
+            go s' (k - 1 :: Int)
+
+      reader = do
+        replicateM_ checks $ do
+          t <- atomically total
+          when (t /= expected) $ atomically $ writeTVar ok False
+        atomically $ modifyTVar' done (+1)
+
+  forM_ [1 .. n] $ \i -> forkIO (writer i)
+  forM_ [1 .. n] $ \_ -> forkIO reader
+
+  -- wait for everyone with retry, which takes the stmWait path
+  atomically $ do
+    d <- readTVar done
+    when (d < 2 * n) retry
+
+  t <- atomically total
+  putStrLn ("total: " ++ show t)
+  c <- readTVarIO ok
+  putStrLn ("consistent: " ++ show c)
+
+modifyTVar' :: TVar a -> (a -> a) -> STM ()
+modifyTVar' tv f = do
+  x <- readTVar tv
+  writeTVar tv $! f x
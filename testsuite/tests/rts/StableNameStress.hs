@@ -0,0 +1,64 @@
+-- Throughput of makeStableName on every capability at once, for objects
+-- private to each capability and for objects shared by all of them, with
+-- garbage collections moving the objects in between.  Every capability must
+-- get the same stable name for the same object, before and after a GC.
+-- See Note [Concurrent stable names] in rts/StableName.c.
+--
+-- Run with "--show-timing" to print the throughput of each phase.
+
+module Main (main) where
+
+import Control.Concurrent
+import Control.Monad
+import System.Mem (performMajorGC, performMinorGC)
+import System.Mem.StableName
+
+import RtsStress
+
+rounds, batch :: Int
+rounds = 50
+batch = 2000
+
+main :: IO ()
+main = stressMain $ \n ->
+  [ phaseOps "private" (n * rounds * batch * 2) "stable names" (private n)
+  , phaseOps "shared" (n * rounds * batch * 2) "stable names" (shared n)
+  ]
+
+-- Make stable names for a batch of objects, let the GC move them, and check
+-- that we get the same stable names again
+names :: Int -> [Maybe Int] -> IO Bool
+names r xs = do
+  sns <- mapM makeStableName xs
+  if even r then performMinorGC else when (r `mod` 10 == 1) performMajorGC
+  sns' <- mapM makeStableName xs
+  return (sns == sns')
+
+-- Each capability names its own objects
+private :: Int -> IO Bool
+private n = do
+  done <- newEmptyMVar
+  forM_ [0 .. n-1] $ \i -> forkOn i $ do
+    oks <- forM [0 .. rounds-1] $ \r ->
+      names r [ Just ((i * rounds + r) * batch + k) | k <- [0 .. batch-1] ]
+    putMVar done (and oks)
+  and <$> replicateM n (takeMVar done)
+
+-- All capabilities name the same objects, and must agree on their names
+shared :: Int -> IO Bool
+shared n = do
+  done <- newEmptyMVar
+  forM_ [0 .. n-1] $ \i -> forkOn i $ do
+    oks <- forM [0 .. rounds-1] $ \r -> do
+      let xs = objects !! r
+      ok <- names r xs
+      sns <- mapM makeStableName xs
+      return (ok, map hashStableName sns)
+    putMVar done (and (map fst oks), map snd oks)
+  rs <- replicateM n (takeMVar done)
+  return (all fst rs && all ((== snd (head rs)) . snd) rs)
+
+objects :: [[Maybe Int]]
+objects = [ [ Just (r * batch + k) | k <- [0 .. batch-1] ]
+          | r <- [0 .. rounds-1] ]
+{-# NOINLINE objects #-}
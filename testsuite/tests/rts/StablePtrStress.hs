@@ -0,0 +1,62 @@
+-- Throughput of creating and freeing stable pointers on every capability at
+-- once, with each capability freeing its own stable pointers, and with the
+-- stable pointers freed by a different capability than the one that made
+-- them.  See Note [Stable pointer caches] in rts/StablePtr.c.
+--
+-- Run with "--show-timing" to print the throughput of each phase.
+
+module Main (main) where
+
+import Control.Concurrent
+import Control.Monad
+import Foreign.StablePtr
+
+import RtsStress
+
+rounds, batch :: Int
+rounds = 200
+batch = 1000
+
+main :: IO ()
+main = stressMain $ \n ->
+  [ phaseOps "local" (n * rounds * batch) "stable pointers" (local n)
+  , phaseOps "cross" (n * rounds * batch) "stable pointers" (cross n)
+  ]
+
+-- Make a batch of stable pointers to distinct values
+makeBatch :: Int -> Int -> IO [StablePtr Int]
+makeBatch i r = forM [0 .. batch-1] $ \k -> newStablePtr (tag i r k)
+
+tag :: Int -> Int -> Int -> Int
+tag i r k = (i * rounds + r) * batch + k
+
+-- Check that a batch still points to its values, and free it
+checkAndFree :: Int -> Int -> [StablePtr Int] -> IO Bool
+checkAndFree i r sps = do
+  vs <- mapM deRefStablePtr sps
+  mapM_ freeStablePtr sps
+  return (vs == [ tag i r k | k <- [0 .. batch-1] ])
+
+-- Each capability makes and frees its own stable pointers
+local :: Int -> IO Bool
+local n = do
+  done <- newEmptyMVar
+  forM_ [0 .. n-1] $ \i -> forkOn i $ do
+    oks <- forM [0 .. rounds-1] $ \r -> makeBatch i r >>= checkAndFree i r
+    putMVar done (and oks)
+  and <$> replicateM n (takeMVar done)
+
+-- Each capability makes stable pointers and hands them to the next one,
+-- which frees them
+cross :: Int -> IO Bool
+cross n = do
+  chans <- replicateM n newChan
+  done <- newEmptyMVar
+  forM_ [0 .. n-1] $ \i -> forkOn i $ do
+    let next = chans !! ((i + 1) `mod` n)
+        prev = (i + n - 1) `mod` n
+    oks <- forM [0 .. rounds-1] $ \r -> do
+      makeBatch i r >>= writeChan next
+      readChan (chans !! i) >>= checkAndFree prev r
+    putMVar done (and oks)
+  and <$> replicateM n (takeMVar done)
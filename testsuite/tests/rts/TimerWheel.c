@@ -0,0 +1,300 @@
+#include "rts/PosixSource.h"
+#include "Rts.h"
+
+#include "TimerWheel.h"
+#include "rts/Time.h"
+#include "GetTime.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h> // for the PRI* macros for printf for types like int64_t
+
+/* Tests and benchmarks for the TimerWheel, and a comparison with the
+ * TimeoutQueue leftist heap.
+ *
+ * Run with cli arg "--show-timing" to enable timing. Otherwise it doesn't show
+ * times, so the output is deterministic and can be used as a regression test.
+ *
+ * Compile with -DDEBUG and link with the -debug RTS to enable assertions.
+ * Compile with -DDEBUG to report algorithmic counters, ie algorithm steps.
+ */
+
+#define EMPTY ((StgTimeoutQueue *) &stg_TIMEOUT_QUEUE_EMPTY_closure)
+
+/* See TimeoutQueue.c for why we use our own prng */
+static unsigned long int next = 1;
+static int prng(void) // RAND_MAX assumed to be 32767
+{
+    next = next * 1103515245 + 12345;
+    return (unsigned int)(next/65536) % 32768;
+}
+
+/* A random time in [0..2^40) ns, i.e. up to about 18 minutes, which spans
+ * several levels of the wheel. */
+static Time prng_time(void)
+{
+    return ((Time) prng() << 25) | ((Time) prng() << 10) | (prng() & 1023);
+}
+
+#if defined(DEBUG)
+extern int timer_wheel_cascade_count;
+extern int timer_wheel_scan_count;
+#endif
+
+static void reset_counters(void)
+{
+#if defined(DEBUG)
+    timer_wheel_cascade_count = 0;
+    timer_wheel_scan_count    = 0;
+#endif
+}
+
+static void init_elems(StgTimeout *elems, int N)
+{
+    for (int i = 0; i < N; i++) {
+        /* we'll never actually notify, so we can fill it in as empty */
+        union NotifyCompletion notify = { .mvar = (StgMVar *) EMPTY };
+        initElemTimeoutQueue(&elems[i], notify, NotifyMVar, NULL /*CCS*/);
+    }
+}
+
+static void random_perm(int *rperm, int N)
+{
+    for (int i = 0; i < N; i++) {
+        rperm[i] = i;
+    }
+    for (int i = N-1; i > 0; i--) {
+        int j = prng() % (i+1);
+        int temp = rperm[i];
+        rperm[i] = rperm[j];
+        rperm[j] = temp;
+    }
+}
+
+/* Advance the wheel to now, and check that exactly the live elements with
+ * wake times up to now expire. Returns the number that expired.
+ */
+static int check_advance(TimerWheel *w, StgTimeout *elems, bool *live, int N,
+                         Time now)
+{
+    int expected = 0;
+    for (int i = 0; i < N; i++) {
+        if (live[i] && elems[i].waketime <= now) expected++;
+    }
+    advanceTimerWheel(w, now);
+    int expired = 0;
+    StgTimeout *t;
+    while ((t = popExpiredTimerWheel(w)) != NULL) {
+        int i = t - elems;
+        if (!live[i] || t->waketime > now) {
+            printf("FAIL: element %i expired wrongly at %" PRIi64 "\n", i, now);
+            exit(1);
+        }
+        live[i] = false;
+        expired++;
+    }
+    if (expired != expected) {
+        printf("FAIL: expected %i expired, got %i\n", expected, expired);
+        exit(1);
+    }
+
+    /* The next wake time must be in the future, and no later than the
+     * earliest live element. */
+    if (!isEmptyTimerWheel(w)) {
+        Time min = TIME_MAX;
+        for (int i = 0; i < N; i++) {
+            if (live[i] && elems[i].waketime < min) min = elems[i].waketime;
+        }
+        Time nextwake = nextWaketimeTimerWheel(w);
+        if (nextwake <= now || nextwake > min) {
+            printf("FAIL: next wake time %" PRIi64 " not in (%" PRIi64
+                   ", %" PRIi64 "]\n", nextwake, now, min);
+            exit(1);
+        }
+    }
+    return expired;
+}
+
+int main_test (void)
+{
+    const int N = 1000;
+    TimerWheel *w = newTimerWheel();
+
+    StgTimeout *elems = calloc(N, sizeof(StgTimeout));
+    bool       *live  = calloc(N, sizeof(bool));
+    int        *rperm = calloc(N, sizeof(int));
+    init_elems(elems, N);
+    random_perm(rperm, N);
+
+    /* Insert everything, then advance in random sized steps, following the
+     * next wake time as the I/O managers do.
+     */
+    printf("===== Test insert then expire =====\n");
+    for (int i = 0; i < N; i++) {
+        insertTimerWheel(w, &elems[i], prng_time());
+        live[i] = true;
+    }
+    Time now = 0;
+    int steps = 0, total = 0;
+    while (!isEmptyTimerWheel(w)) {
+        Time nextwake = nextWaketimeTimerWheel(w);
+        /* Either jump to the next wake time or a bit beyond it */
+        now = nextwake + (prng() % 2 == 0 ? 0 : prng() << 10);
+        total += check_advance(w, elems, live, N, now);
+        steps++;
+    }
+    printf("expired %i elements in %i steps\n", total, steps);
+
+    /* Insert in bulk, delete half in random order, interleaved with time
+     * advancing, and inserting new timeouts relative to the current time.
+     */
+    printf("===== Test insert, delete and expire =====\n");
+    for (int i = 0; i < N; i++) {
+        insertTimerWheel(w, &elems[i], now + prng_time());
+        live[i] = true;
+    }
+    int deleted = 0, expired = 0, reinserted = 0;
+    for (int i = 0; i < N; i++) {
+        int j = rperm[i];
+        if (i % 2 == 0) {
+            if (live[j]) {
+                deleteTimerWheel(w, &elems[j]);
+                live[j] = false;
+                deleted++;
+            }
+        } else {
+            now += prng() << 12;
+            expired += check_advance(w, elems, live, N, now);
+        }
+        /* occasionally re-use a dead element, possibly already expired */
+        if (i % 7 == 0 && !live[j]) {
+            insertTimerWheel(w, &elems[j], now + (prng() % 3 - 1) * 1000);
+            live[j] = true;
+            reinserted++;
+        }
+    }
+    while (!isEmptyTimerWheel(w)) {
+        now = nextWaketimeTimerWheel(w);
+        expired += check_advance(w, elems, live, N, now);
+    }
+    printf("deleted %i, reinserted %i, expired %i\n",
+           deleted, reinserted, expired);
+
+    freeTimerWheel(w);
+    free(elems);
+    free(live);
+    free(rperm);
+    return 0;
+}
+
+/* Churn through timers the way a server with a timeout per request does: a
+ * steady stream of new timers, most of which are cancelled before they
+ * expire. We keep a window of live timers, and each step we start one new
+ * timer and cancel or expire the oldest.
+ */
+int main_bench (bool showtiming)
+{
+    const int N      = 1000000;   /* total number of timers */
+    const int LIVE   = 100000;    /* window of live timers */
+    const Time STEP  = 10000;     /* 10us of time between new timers */
+    Time before, after;
+    initializeTimer();
+
+    StgTimeout *elems = calloc(N, sizeof(StgTimeout));
+    Time       *delay = calloc(N, sizeof(Time));
+    bool       *keep  = calloc(N, sizeof(bool));
+    init_elems(elems, N);
+    for (int i = 0; i < N; i++) {
+        /* timeouts of 1 to 33 seconds, of which 1 in 10 fires */
+        delay[i] = SecondsToTime(1) + (Time) prng() * 1000000;
+        keep[i]  = prng() % 10 == 0;
+    }
+
+    printf("===== Benchmark churn %i timers (%i live) =====\n", N, LIVE);
+
+    /* The timer wheel */
+    TimerWheel *w = newTimerWheel();
+    int fired = 0;
+    reset_counters();
+    before = getProcessElapsedTime();
+    for (int i = 0; i < N + LIVE; i++) {
+        Time now = (Time) i * STEP;
+        if (i < N) {
+            insertTimerWheel(w, &elems[i], now + delay[i]);
+        }
+        if (i >= LIVE && !keep[i - LIVE]) {
+            deleteTimerWheel(w, &elems[i - LIVE]);
+        }
+        advanceTimerWheel(w, now);
+        while (popExpiredTimerWheel(w) != NULL) fired++;
+    }
+    Time now = (Time) (N + LIVE) * STEP;
+    while (!isEmptyTimerWheel(w)) {
+        now = nextWaketimeTimerWheel(w);
+        advanceTimerWheel(w, now);
+        while (popExpiredTimerWheel(w) != NULL) fired++;
+    }
+    after = getProcessElapsedTime();
+    printf("timer wheel:    %i timers fired\n", fired);
+    if (showtiming) {
+      Time ns = after - before;
+      printf("completed in %" PRIi64 " nsec, %.1f ns per timer\n",
+             ns, (double)ns/N);
+    }
+#if defined(DEBUG)
+    printf("cascade count:  %8i, per-timer: %.2f\n",
+           timer_wheel_cascade_count, (double)timer_wheel_cascade_count/N);
+    printf("scan count:     %8i, per-timer: %.2f\n",
+           timer_wheel_scan_count, (double)timer_wheel_scan_count/N);
+#endif
+    freeTimerWheel(w);
+
+    /* The leftist heap, doing the same */
+    init_elems(elems, N);
+    StgTimeoutQueue *root = EMPTY;
+    fired = 0;
+    before = getProcessElapsedTime();
+    for (int i = 0; i < N + LIVE; i++) {
+        Time now = (Time) i * STEP;
+        if (i < N) {
+            insertTimeoutQueue(&root, &elems[i], now + delay[i]);
+        }
+        if (i >= LIVE && !keep[i - LIVE]) {
+            deleteTimeoutQueue(&root, &elems[i - LIVE]);
+        }
+        while (!isEmptyTimeoutQueue(root)
+            && findMinWaketimeTimeoutQueue(root) <= now) {
+            StgTimeout *unused_min;
+            deleteMinTimeoutQueue(&root, &unused_min);
+            fired++;
+        }
+    }
+    while (!isEmptyTimeoutQueue(root)) {
+        StgTimeout *unused_min;
+        deleteMinTimeoutQueue(&root, &unused_min);
+        fired++;
+    }
+    after = getProcessElapsedTime();
+    printf("timeout queue:  %i timers fired\n", fired);
+    if (showtiming) {
+      Time ns = after - before;
+      printf("completed in %" PRIi64 " nsec, %.1f ns per timer\n",
+             ns, (double)ns/N);
+    }
+
+    free(elems);
+    free(delay);
+    free(keep);
+    return 0;
+}
+
+int main (int argc, char *argv[])
+{
+    bool showtiming = argc > 1 ? strcmp(argv[1], "--show-timing") == 0 : false;
+
+    main_test();
+    main_bench(showtiming);
+    return 0;
+}
@@ -0,0 +1,183 @@
+#define THREADED_RTS
+
+#include "Rts.h"
+#include "WSDeque.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Spark throughput with single-element and bulk stealing.
+ *
+ * Each thread plays a capability with its own deque, used the way the spark
+ * pools are (see findSpark()): the owner takes its own work from the top
+ * with stealWSDeque_(), and when its deque is empty it steals from the
+ * others, either one element at a time, or half of the victim's elements at
+ * once with stealHalfWSDeque_(), keeping the rest with pushWSDequeN().
+ * Thread 0 creates all the work, one element at a time like newSpark(), and
+ * each element is a tiny amount of work, as with fine-grained strategies.
+ *
+ * Run with cli arg "--show-timing" to enable timing. Otherwise it doesn't
+ * show times, so the output is deterministic and can be used as a
+ * regression test.
+ */
+
+#define ITEMS      (1024*1024)
+#define DEQUE_SIZE 4096
+#define BATCH      64
+#define MAX_THREADS 64
+
+typedef struct {
+    uint32_t no;
+    uint32_t n_threads;
+    bool bulk;
+    WSDeque *q;
+    OSThreadId id;
+    StgWord steals;     /* successful steal operations */
+    StgWord stolen;     /* elements taken from other deques */
+} Worker;
+
+static Worker workers[MAX_THREADS];
+static StgWord scratch[ITEMS];
+static StgWord done;     /* number of elements worked on */
+static StgWord created;  /* number of elements pushed by thread 0 */
+
+static void work(StgWord *p, uint32_t n)
+{
+    if (*p != 0) {
+        fflush(stdout);
+        barf("FAIL: element %ld worked on twice (by %" FMT_Word32 ")",
+             (long)(p - scratch), n);
+    }
+    *p = n + 1;
+}
+
+/* Take an element from our own deque, or steal some from another. */
+static StgWord *
+findWork (Worker *w)
+{
+    void *elems[BATCH];
+    StgWord *p;
+    uint32_t i, n, pushed;
+
+    p = stealWSDeque_(w->q);
+    if (p != NULL) return p;
+
+    for (i = 1; i < w->n_threads; i++) {
+        Worker *v = &workers[(w->no + i) % w->n_threads];
+        if (looksEmptyWSDeque(v->q)) continue;
+        if (w->bulk) {
+            n = stealHalfWSDeque_(v->q, elems, BATCH);
+            if (n == 0) continue;
+            w->steals++;
+            w->stolen += n;
+            pushed = pushWSDequeN(w->q, elems + 1, n - 1);
+            if (pushed != n - 1) {
+                barf("FAIL: no room for %" FMT_Word32 " stolen elements", n - 1);
+            }
+            return elems[0];
+        } else {
+            p = stealWSDeque_(v->q);
+            if (p == NULL) continue;
+            w->steals++;
+            w->stolen++;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static void* OSThreadProcAttr
+worker (void *info)
+{
+    Worker *w = info;
+    StgWord *p;
+    StgWord count = 0;
+
+    while (RELAXED_LOAD(&done) < ITEMS) {
+        /* Thread 0 creates the work, and does some itself */
+        if (w->no == 0 && created < ITEMS) {
+            uint32_t i;
+            for (i = 0; i < BATCH && created < ITEMS; i++) {
+                if (!pushWSDeque(w->q, &scratch[created])) break;
+                created++;
+            }
+        }
+        p = findWork(w);
+        if (p != NULL) {
+            work(p, w->no);
+            if (++count == BATCH) {
+                atomic_inc(&done, count);
+                count = 0;
+            }
+        } else {
+            if (count > 0) {
+                atomic_inc(&done, count);
+                count = 0;
+            }
+            yieldThread();
+        }
+    }
+    return NULL;
+}
+
+static void
+run (uint32_t n_threads, bool bulk, bool showtiming)
+{
+    uint32_t i;
+    StgWord steals = 0, stolen = 0;
+    StgWord64 before, after;
+
+    memset(scratch, 0, sizeof(scratch));
+    done = 0;
+    created = 0;
+    for (i = 0; i < n_threads; i++) {
+        workers[i].no = i;
+        workers[i].n_threads = n_threads;
+        workers[i].bulk = bulk;
+        workers[i].q = newWSDeque(DEQUE_SIZE);
+        workers[i].steals = 0;
+        workers[i].stolen = 0;
+    }
+
+    before = getMonotonicNSec();
+    for (i = 0; i < n_threads; i++) {
+        if (createOSThread(&workers[i].id, "worker", worker, &workers[i]) != 0) {
+            barf("createOSThread failed");
+        }
+    }
+    for (i = 0; i < n_threads; i++) {
+        joinOSThread(workers[i].id);
+    }
+    after = getMonotonicNSec();
+
+    for (i = 0; i < ITEMS; i++) {
+        if (scratch[i] == 0) {
+            barf("FAIL: element %" FMT_Word32 " was never worked on", i);
+        }
+    }
+    for (i = 0; i < n_threads; i++) {
+        steals += workers[i].steals;
+        stolen += workers[i].stolen;
+        freeWSDeque(workers[i].q);
+    }
+
+    printf("%-6s %2" FMT_Word32 " threads: %d elements done\n",
+           bulk ? "bulk" : "single", n_threads, ITEMS);
+    if (showtiming) {
+        printf("    %.1f ns per element, %" FMT_Word " steals, "
+               "%.1f elements per steal\n",
+               (double)(after - before) / ITEMS, steals,
+               steals ? (double)stolen / steals : 0.0);
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    bool showtiming = argc > 1 ? strcmp(argv[1], "--show-timing") == 0 : false;
+    uint32_t n;
+
+    for (n = 2; n <= MAX_THREADS; n *= 2) {
+        run(n, false, showtiming);
+        run(n, true, showtiming);
+    }
+    return 0;
+}
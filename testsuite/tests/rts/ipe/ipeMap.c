@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -10,6 +11,7 @@ HaskellObj shouldFindOneIfItHasBeenRegistered(Capability *cap);
 void shouldFindTwoIfTwoHaveBeenRegistered(Capability *cap, HaskellObj fortyTwo);
 void shouldFindTwoFromTheSameList(Capability *cap);
 void shouldDealWithAnEmptyList(Capability *cap, HaskellObj);
+void shouldFindAllInInterleavedLists(Capability *cap);
 
 // This is a unit test for IPE.c, the IPE map.
 // Due to the nature of IPE having static state, the test cases are not
@@ -23,6 +25,7 @@ int main(int argc, char *argv[]) {
     shouldFindTwoIfTwoHaveBeenRegistered(cap, fortyTwo);
     shouldFindTwoFromTheSameList(cap);
     shouldDealWithAnEmptyList(cap, fortyTwo);
+    shouldFindAllInInterleavedLists(cap);
 
     rts_unlock(cap);
     hs_exit();
@@ -177,6 +180,60 @@ void shouldDealWithAnEmptyList(Capability *cap, HaskellObj fortyTwo) {
     assertStringsEqual(resultFortyTwo.prov.table_name, "table_name_042");
 }
 
+// Lookups never dereference the info tables, so use addresses in an array.
+#define INTERLEAVED_TABLES 200
+static StgWord fakeTables[INTERLEAVED_TABLES + 1];
+
+static IpeBufferListNode *makeInterleavedList(Capability *cap, int first,
+                                              bool reversed) {
+    const int n = INTERLEAVED_TABLES / 2;
+    IpeBufferListNode *node = malloc(sizeof(IpeBufferListNode));
+    node->tables = malloc(sizeof(StgInfoTable *) * n);
+    node->entries_block = malloc(sizeof(StgWord64) + sizeof(IpeBufferEntry) * n);
+    node->entries_block->magic = IPE_MAGIC_WORD;
+
+    StringTable st;
+    init_string_table(&st);
+
+    node->unit_id = add_string(&st, "unit-id");
+    node->module_name = add_string(&st, "TheModule");
+
+    for (int i = 0; i < n; i++) {
+        int table = first + 2 * (reversed ? n - 1 - i : i);
+        node->tables[i] = (const StgInfoTable *) &fakeTables[table];
+        node->entries_block->entries[i] = makeAnyProvEntry(cap, &st, table);
+    }
+    node->next = NULL;
+    node->compressed = 0;
+    node->count = n;
+    node->entries_size = sizeof(IpeBufferEntry) * n;
+    IpeStringTableBlock *string_table_block = malloc(sizeof(StgWord64) + st.size);
+    string_table_block->magic = IPE_MAGIC_WORD;
+    memcpy(string_table_block->string_table, st.buffer, st.size);
+    node->string_table_block = string_table_block;
+    node->string_table_size = st.size;
+    return node;
+}
+
+// Two lists whose address ranges overlap, one of them not in address order.
+void shouldFindAllInInterleavedLists(Capability *cap) {
+    registerInfoProvList(makeInterleavedList(cap, 0, false));
+    registerInfoProvList(makeInterleavedList(cap, 1, true));
+
+    char table_name[32];
+    for (int i = 0; i < INTERLEAVED_TABLES; i++) {
+        InfoProvEnt result = lookupIPE_("shouldFindAllInInterleavedLists",
+                                        (const StgInfoTable *) &fakeTables[i]);
+        snprintf(table_name, sizeof(table_name), "table_name_%03i", i);
+        assertStringsEqual(result.prov.table_name, table_name);
+    }
+
+    InfoProvEnt ent;
+    if (lookupIPE((const StgInfoTable *) &fakeTables[INTERLEAVED_TABLES], &ent)) {
+        barf("Found entry for an unregistered info table!");
+    }
+}
+
 void assertStringsEqual(const char *s1, const char *s2) {
     if (strcmp(s1, s2) != 0) {
         errorBelch("%s != %s", s1, s2);
@@ -0,0 +1,98 @@
+#include "ghcconfig.h"
+#include "Rts.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Load and unload an object repeatedly with the nonmoving collector, and check
+ * that every unloaded object is freed by the next collection or so, rather
+ * than accumulating. See Note [Object unloading under the non-moving
+ * collector] in rts/CheckUnload.c.
+ *
+ * Built with -threaded, the collections mark concurrently with the mutator,
+ * and the object is unloaded in the final sync of the mark. */
+
+#define ITERATIONS 200
+
+#if defined(mingw32_HOST_OS)
+#define OBJPATH L"Test.o"
+#else
+#define OBJPATH "Test.o"
+#endif
+
+typedef int testfun(int);
+
+extern void loadPackages(void);
+
+/* With the threaded RTS, performMajorGC returns as soon as the concurrent mark
+ * has started. Wait for the mark to finish, collecting the nursery meanwhile
+ * so that the mutator is active during the mark. Without it, the mark has
+ * finished already. */
+static void waitForConcurrentMark(void)
+{
+    while (RELAXED_LOAD(&nonmoving_write_barrier_enabled)) {
+        performGC();
+        yieldThread();
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    testfun *f;
+    int i, r, gcs;
+
+    RtsConfig conf = defaultRtsConfig;
+    conf.rts_opts_enabled = RtsOptsAll;
+    hs_init_ghc(&argc, &argv, conf);
+
+    if (!RtsFlags.GcFlags.useNonmoving) {
+        errorBelch("must be run with +RTS --nonmoving-gc");
+        exit(1);
+    }
+
+    initLinker_(0);
+
+    loadPackages();
+
+    for (i=0; i < ITERATIONS; i++) {
+        r = loadObj(OBJPATH);
+        if (!r) {
+            errorBelch("loadObj(%" PATH_FMT ") failed", OBJPATH);
+            exit(1);
+        }
+        r = resolveObjs();
+        if (!r) {
+            errorBelch("resolveObjs failed");
+            exit(1);
+        }
+#if LEADING_UNDERSCORE
+        f = lookupSymbol("_f");
+#else
+        f = lookupSymbol("f");
+#endif
+        if (!f) {
+            errorBelch("lookupSymbol failed");
+            exit(1);
+        }
+        r = f(3);
+        if (r != 4) {
+            errorBelch("call failed; %d", r);
+            exit(1);
+        }
+        unloadObj(OBJPATH);
+        // The object may be reachable from the snapshot of the first
+        // collection, but must be gone after the next one.
+        for (gcs = 0; gcs < 2; gcs++) {
+            performMajorGC();
+            waitForConcurrentMark();
+            if (getObjectLoadStatus(OBJPATH) == OBJECT_NOT_LOADED) break;
+        }
+        if (getObjectLoadStatus(OBJPATH) != OBJECT_NOT_LOADED) {
+            errorBelch("object not unloaded in iteration %d", i);
+            exit(1);
+        }
+    }
+    printf("loaded and unloaded %d times\n", ITERATIONS);
+
+    hs_exit();
+    exit(0);
+}
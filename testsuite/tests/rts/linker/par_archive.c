@@ -0,0 +1,50 @@
+#include "ghcconfig.h"
+#include "Rts.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Load an archive of many members, which the linker prepares in parallel
+ * (see Note [Parallel archive loading] in rts/linker/LoadArchive.c), and
+ * check that all of them were loaded and resolved. */
+
+#define MEMBERS 64
+
+int main (int argc, char *argv[])
+{
+    char sym[64];
+    int (*f)(void);
+
+    hs_init(&argc, &argv);
+    initLinker_(0);
+
+    if (argc != 2) {
+        errorBelch("usage: par_archive <archive>");
+        exit(1);
+    }
+
+    if (!loadArchive(argv[1])) {
+        errorBelch("loadArchive(%s) failed", argv[1]);
+        exit(1);
+    }
+    if (!resolveObjs()) {
+        errorBelch("resolveObjs failed");
+        exit(1);
+    }
+
+    for (int i = 0; i < MEMBERS; i++) {
+        snprintf(sym, sizeof(sym), "par_archive_member_%d", i);
+        f = (int (*)(void)) lookupSymbol(sym);
+        if (f == NULL) {
+            errorBelch("symbol %s not found", sym);
+            exit(1);
+        }
+        if (f() != i * (i + 1) / 2) {
+            errorBelch("%s returned %d", sym, f());
+            exit(1);
+        }
+    }
+    printf("loaded %d members\n", MEMBERS);
+
+    hs_exit();
+    return 0;
+}
@@ -0,0 +1,21 @@
+/* Compiled once for each member of the archive loaded by the ParArchive test,
+ * with N set to the index of the member and PREV to the index of the one
+ * before it. Each member calls the one before it, so resolving a member needs
+ * the symbols of the others. */
+
+#define CAT_(a,b) a ## b
+#define CAT(a,b) CAT_(a,b)
+#define MEMBER(n) CAT(par_archive_member_, n)
+
+#if N > 0
+int MEMBER(PREV) (void);
+#endif
+
+int MEMBER(N) (void)
+{
+#if N > 0
+    return N + MEMBER(PREV)();
+#else
+    return 0;
+#endif
+}